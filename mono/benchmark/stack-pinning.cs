@@ -0,0 +1,79 @@
+//
+// Allocates from several threads with deep stacks full of references to
+// nursery objects.  Compare the output, and the "Bytes in pinned objects"
+// and "Minor pinning" counters, of
+//
+//   MONO_GC_PARAMS=stack-mark=conservative mono-sgen --stats stack-pinning.exe
+//   MONO_GC_PARAMS=stack-mark=precise mono-sgen --stats stack-pinning.exe
+//
+// Objects which are only referenced from dead stack slots are pinned and
+// promoted by conservative stack marking, so the heap grows more before the
+// full collection at the end, and there are more nursery collections.
+//
+using System;
+using System.Threading;
+
+class Node {
+	public Node next;
+	public int [] data;
+}
+
+class T {
+	const int threads = 4;
+	const int depth = 200;
+	const int iterations = 20000;
+
+	static Node Recurse (int level, Node list)
+	{
+		Node local = new Node ();
+		local.next = list;
+		local.data = new int [level % 16 + 1];
+
+		if (level == 0) {
+			Node result = null;
+			for (int i = 0; i < iterations; ++i) {
+				Node n = new Node ();
+				n.next = result;
+				n.data = new int [8];
+				if (i % 64 == 0)
+					result = null;
+				else
+					result = n;
+			}
+			return local;
+		}
+
+		Node child = Recurse (level - 1, local);
+		return child.next == local ? local : child;
+	}
+
+	static void Work ()
+	{
+		for (int i = 0; i < 10; ++i)
+			Recurse (depth, null);
+	}
+
+	static int Main ()
+	{
+		int start = Environment.TickCount;
+		Thread [] ts = new Thread [threads];
+
+		for (int i = 0; i < threads; ++i) {
+			ts [i] = new Thread (Work);
+			ts [i].Start ();
+		}
+		for (int i = 0; i < threads; ++i)
+			ts [i].Join ();
+
+		int elapsed = Environment.TickCount - start;
+		long heap_before = GC.GetTotalMemory (false);
+		long heap_after = GC.GetTotalMemory (true);
+
+		Console.WriteLine ("time: {0} ms", elapsed);
+		Console.WriteLine ("nursery collections: {0}", GC.CollectionCount (0));
+		Console.WriteLine ("major collections: {0}", GC.CollectionCount (1));
+		Console.WriteLine ("heap before full collection: {0} KB", heap_before / 1024);
+		Console.WriteLine ("heap after full collection: {0} KB", heap_after / 1024);
+		return 0;
+	}
+}
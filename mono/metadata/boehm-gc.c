@@ -69,6 +69,11 @@ mono_gc_warning (char *msg, GC_word arg)
 	mono_trace (G_LOG_LEVEL_WARNING, MONO_TRACE_GC, msg, (unsigned long)arg);
 }
 
+void
+mono_gc_base_cleanup (void)
+{
+}
+
 void
 mono_gc_base_init (void)
 {
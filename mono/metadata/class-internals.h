@@ -19,6 +19,7 @@
 #define MONO_DEFAULT_SUPERTABLE_SIZE 6
 
 extern gboolean mono_print_vtable;
+extern gboolean mono_class_track_overrides;
 
 typedef struct _MonoMethodWrapper MonoMethodWrapper;
 typedef struct _MonoMethodInflated MonoMethodInflated;
@@ -59,6 +60,18 @@ typedef enum {
 } MonoRemotingTarget;
 
 #define MONO_METHOD_PROP_GENERIC_CONTAINER 0
+#define MONO_METHOD_PROP_OVERRIDE_INFO 1
+
+/*
+ * Loaded overrides of a virtual method, maintained if mono_class_track_overrides
+ * is set. Used by the JIT to devirtualize calls to methods with no overrides.
+ */
+typedef struct {
+	/* Set once a loaded class overrides the method, checked by JITted code */
+	volatile gint32 overridden;
+	/* The override if all the loaded overrides are the same method, NULL otherwise */
+	MonoMethod *override;
+} MonoMethodOverrideInfo;
 
 struct _MonoMethod {
 	guint16 flags;  /* method flags */
@@ -933,6 +946,9 @@ mono_class_get_inflated_method (MonoClass *klass, MonoMethod *method) MONO_INTER
 MonoMethod*
 mono_class_get_vtable_entry (MonoClass *klass, int offset) MONO_INTERNAL;
 
+MonoMethodOverrideInfo*
+mono_method_get_override_info (MonoMethod *method) MONO_INTERNAL;
+
 GPtrArray*
 mono_class_get_implemented_interfaces (MonoClass *klass, MonoError *error) MONO_INTERNAL;
 
@@ -48,6 +48,9 @@ MonoStats mono_stats;
 
 gboolean mono_print_vtable = FALSE;
 
+/* Whenever to record which virtual methods are overridden by loaded classes */
+gboolean mono_class_track_overrides = FALSE;
+
 /* Statistics */
 guint32 inflated_classes, inflated_classes_size, inflated_methods_size;
 guint32 classes_size, class_ext_size;
@@ -3688,6 +3691,72 @@ mono_class_check_vtable_constraints (MonoClass *class, GList *in_setup)
 	return TRUE;
 }
  
+/*
+ * mono_method_get_override_info:
+ *
+ *   Return the information about the loaded overrides of the virtual method METHOD,
+ * creating it if needed. It is only kept up to date if mono_class_track_overrides
+ * is set.
+ *
+ * LOCKING: Acquires the loader lock.
+ */
+MonoMethodOverrideInfo*
+mono_method_get_override_info (MonoMethod *method)
+{
+	MonoImage *image = method->klass->image;
+	MonoMethodOverrideInfo *info;
+
+	mono_loader_lock ();
+	info = mono_image_property_lookup (image, method, MONO_METHOD_PROP_OVERRIDE_INFO);
+	if (!info) {
+		info = mono_image_alloc0 (image, sizeof (MonoMethodOverrideInfo));
+		mono_image_property_insert (image, method, MONO_METHOD_PROP_OVERRIDE_INFO, info);
+	}
+	mono_loader_unlock ();
+
+	return info;
+}
+
+/*
+ * record_overrides:
+ *
+ *   Mark the methods of the parents of CLASS which are overridden in the vtable
+ * of CLASS. Inflated methods are not tracked.
+ */
+static void
+record_overrides (MonoClass *class)
+{
+	MonoMethodOverrideInfo *info;
+	MonoMethod *cm, *m;
+	MonoClass *k;
+	int i;
+
+	if (!mono_class_track_overrides || !class->parent || class->vtable == class->parent->vtable)
+		return;
+
+	mono_loader_lock ();
+	for (i = 0; i < class->parent->vtable_size; ++i) {
+		cm = class->vtable [i];
+		if (!cm)
+			continue;
+		for (k = class->parent; k && k->vtable && i < k->vtable_size; k = k->parent) {
+			m = k->vtable [i];
+			if (!m || m == cm || m->is_inflated)
+				continue;
+			info = mono_method_get_override_info (m);
+			if (!info->overridden) {
+				info->override = cm;
+				/* Code compiled assuming M has no overrides checks this flag */
+				mono_memory_barrier ();
+				info->overridden = TRUE;
+			} else if (info->override != cm) {
+				info->override = NULL;
+			}
+		}
+	}
+	mono_loader_unlock ();
+}
+
 /*
  * mono_class_setup_vtable:
  *
@@ -4322,6 +4391,7 @@ mono_class_setup_vtable_general (MonoClass *class, MonoMethod **overrides, int o
 					class->methods [i]->slot = gklass->methods [i]->slot;
 		}
 
+		record_overrides (class);
 		return;
 	}
 
@@ -4697,6 +4767,8 @@ mono_class_setup_vtable_general (MonoClass *class, MonoMethod **overrides, int o
 		class->vtable = tmp;
 	}
 
+	record_overrides (class);
+
 	DEBUG_INTERFACE_VTABLE (print_vtable_full (class, class->vtable, class->vtable_size, first_non_interface_slot, "FINALLY", FALSE));
 	if (mono_print_vtable) {
 		int icount = 0;
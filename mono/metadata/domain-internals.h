@@ -227,6 +227,8 @@ struct _MonoJitInfo {
 	gboolean    dbg_step_through:1;
 	gboolean    dbg_non_user_code_inited:1;
 	gboolean    dbg_non_user_code:1;
+	/* Whenever this is quickly compiled code which is replaced once the method is hot */
+	gboolean    tier0:1;
 
 	/* FIXME: Embed this after the structure later*/
 	gpointer    gc_info; /* Currently only used by SGen */
@@ -911,6 +911,8 @@ mono_init_version (const char *domain_name, const char *version)
 void
 mono_cleanup (void)
 {
+	mono_gc_base_cleanup ();
+
 	mono_close_exe_image ();
 
 	mono_defaults.corlib = NULL;
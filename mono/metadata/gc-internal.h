@@ -93,6 +93,7 @@ MonoBoolean ves_icall_Mono_Runtime_SetGCAllowSynchronousMajor (MonoBoolean flag)
 extern void mono_gc_init (void) MONO_INTERNAL;
 extern void mono_gc_base_init (void) MONO_INTERNAL;
 extern void mono_gc_cleanup (void) MONO_INTERNAL;
+extern void mono_gc_base_cleanup (void) MONO_INTERNAL;
 
 /*
  * Return whenever the current thread is registered with the GC (i.e. started
@@ -166,6 +167,7 @@ void  mono_gc_free_fixed             (void* addr) MONO_INTERNAL;
 /* make sure the gchandle was allocated for an object in domain */
 gboolean mono_gchandle_is_in_domain (guint32 gchandle, MonoDomain *domain) MONO_INTERNAL;
 void     mono_gchandle_free_domain  (MonoDomain *domain) MONO_INTERNAL;
+void     mono_gchandle_free_thread_cache (void) MONO_INTERNAL;
 
 typedef void (*FinalizerThreadCallback) (gpointer user_data);
 
@@ -35,6 +35,7 @@
 #include <mono/utils/mono-semaphore.h>
 #include <mono/utils/mono-memory-model.h>
 #include <mono/utils/mono-counters.h>
+#include <mono/utils/mono-time.h>
 #include <mono/utils/dtrace.h>
 #include <mono/utils/mono-threads.h>
 #include <mono/utils/atomic.h>
@@ -69,11 +70,25 @@ static MonoMList *threads_to_finalize = NULL;
 
 static MonoInternalThread *gc_thread;
 
+/*
+ * Besides the finalizer thread there can be additional finalizer
+ * threads, set with MONO_FINALIZER_THREADS.  They only run finalizers,
+ * which the finalizer thread hands to them through `finalizer_queue`.
+ */
+#define MAX_FINALIZER_HELPERS	64
+static int num_finalizer_helpers = 0;
+static MonoInternalThread *finalizer_helpers [MAX_FINALIZER_HELPERS];
+/* Finalizers queued or being run by the helpers. */
+static volatile gint32 finalizer_queue_depth = 0;
+
 static void object_register_finalizer (MonoObject *obj, void (*callback)(void *, void*));
 
 static void mono_gchandle_set_target (guint32 gchandle, MonoObject *obj);
 
 static void reference_queue_proccess_all (void);
+#ifndef HAVE_NULL_GC
+static gboolean finalizer_queue_push (void *obj, void *data);
+#endif
 static void mono_reference_queue_cleanup (void);
 static void reference_queue_clear_for_domain (MonoDomain *domain);
 #ifndef HAVE_NULL_GC
@@ -94,12 +109,26 @@ add_thread_to_finalize (MonoInternalThread *thread)
 }
 
 static gboolean suspend_finalizers = FALSE;
+static void run_finalizer (void *obj, void *data);
+
 /* 
  * actually, we might want to queue the finalize requests in a separate thread,
  * but we need to be careful about the execution domain of the thread...
  */
 void
 mono_gc_run_finalize (void *obj, void *data)
+{
+#ifndef HAVE_NULL_GC
+	/* With helper threads the finalizer thread just hands out the work. */
+	if (num_finalizer_helpers && mono_thread_internal_current () == gc_thread && finalizer_queue_push (obj, data))
+		return;
+#endif
+
+	run_finalizer (obj, data);
+}
+
+static void
+run_finalizer (void *obj, void *data)
 {
 	MonoObject *exc = NULL;
 	MonoObject *o;
@@ -338,7 +367,7 @@ mono_domain_finalize (MonoDomain *domain, guint32 timeout)
 	return FALSE;
 #endif
 
-	if (mono_thread_internal_current () == gc_thread)
+	if (mono_gc_is_finalizer_internal_thread (mono_thread_internal_current ()))
 		/* We are called from inside a finalizer, not much we can do here */
 		return FALSE;
 
@@ -465,10 +494,10 @@ void
 ves_icall_System_GC_WaitForPendingFinalizers (void)
 {
 #ifndef HAVE_NULL_GC
-	if (!mono_gc_pending_finalizers ())
+	if (!mono_gc_pending_finalizers () && !finalizer_queue_depth)
 		return;
 
-	if (mono_thread_internal_current () == gc_thread)
+	if (mono_gc_is_finalizer_internal_thread (mono_thread_internal_current ()))
 		/* Avoid deadlocks */
 		return;
 
@@ -585,38 +614,162 @@ ves_icall_Mono_Runtime_SetGCAllowSynchronousMajor (MonoBoolean flag)
 	return mono_gc_set_allow_synchronous_major (flag);
 }
 
+/*
+ * GC handles live in a table of buckets per handle type.  Bucket N holds
+ * HANDLE_MIN_BUCKET_SIZE << N slots, so the table grows by doubling
+ * without ever moving an entry: weak links stay registered at the same
+ * address and lookups don't need a lock.  A slot is owned by whoever
+ * manages to set its bit in the bucket's bitmap with a CAS.  Growing
+ * installs the next bucket with a single CAS, and allocators that still
+ * find free slots in the installed buckets are never held up by it.
+ *
+ * Each thread also remembers the slots it freed last and tries to claim
+ * those first, so that threads which allocate and free handles all the
+ * time mostly touch their own bitmap words.  The cached slots are only
+ * hints: they stay free in the bitmap and anybody may claim them.
+ */
+#define HANDLE_MIN_BUCKET_BITS 10
+#define HANDLE_MIN_BUCKET_SIZE (1 << HANDLE_MIN_BUCKET_BITS)
+/* Handles keep 29 bits for the slot, see alloc_handle (). */
+#define HANDLE_MAX_SLOT_BITS 29
+#define HANDLE_BUCKETS (HANDLE_MAX_SLOT_BITS - HANDLE_MIN_BUCKET_BITS)
+#define HANDLE_BUCKET_SIZE(b) (HANDLE_MIN_BUCKET_SIZE << (b))
+/* Index of the first slot in bucket B */
+#define HANDLE_BUCKET_START(b) (HANDLE_BUCKET_SIZE (b) - HANDLE_MIN_BUCKET_SIZE)
+
+#define HANDLE_CACHE_SIZE 8
+
 typedef struct {
 	guint32  *bitmap;
 	gpointer *entries;
-	guint32   size;
-	guint8    type;
-	guint     slot_hint : 24; /* starting slot for search */
 	/* 2^16 appdomains should be enough for everyone (though I know I'll regret this in 20 years) */
 	/* we alloc this only for weak refs, since we can get the domain directly in the other cases */
 	guint16  *domain_ids;
+} HandleBucket;
+
+typedef struct {
+	HandleBucket * volatile buckets [HANDLE_BUCKETS];
+	volatile gint32 num_buckets;
+	/* bitmap word at which threads without a hint of their own start searching */
+	volatile guint32 word_hint;
+	guint8    type;
 } HandleData;
 
 /* weak and weak-track arrays will be allocated in malloc memory 
  */
 static HandleData gc_handles [] = {
-	{NULL, NULL, 0, HANDLE_WEAK, 0},
-	{NULL, NULL, 0, HANDLE_WEAK_TRACK, 0},
-	{NULL, NULL, 0, HANDLE_NORMAL, 0},
-	{NULL, NULL, 0, HANDLE_PINNED, 0}
+	{{NULL}, 0, 0, HANDLE_WEAK},
+	{{NULL}, 0, 0, HANDLE_WEAK_TRACK},
+	{{NULL}, 0, 0, HANDLE_NORMAL},
+	{{NULL}, 0, 0, HANDLE_PINNED}
 };
 
+#define HANDLE_TYPES G_N_ELEMENTS (gc_handles)
+
+typedef struct {
+	guint32 slots [HANDLE_TYPES][HANDLE_CACHE_SIZE];
+	int num_slots [HANDLE_TYPES];
+	guint32 word_hint [HANDLE_TYPES];
+} HandleCache;
+
+static MonoNativeTlsKey handle_cache_key;
+
+/* Only used to serialize mono_gchandle_free_domain () */
 #define lock_handles(handles) mono_mutex_lock (&handle_section)
 #define unlock_handles(handles) mono_mutex_unlock (&handle_section)
 
-static int
-find_first_unset (guint32 bitmap)
+static inline int
+index_bucket (guint32 slot, guint32 *offset)
 {
+	guint32 biased = slot + HANDLE_MIN_BUCKET_SIZE;
+	int bucket;
+
+#ifdef __GNUC__
+	bucket = 31 - __builtin_clz (biased) - HANDLE_MIN_BUCKET_BITS;
+#else
+	for (bucket = 0; biased >> (bucket + HANDLE_MIN_BUCKET_BITS + 1); ++bucket)
+		;
+#endif
+	*offset = slot - HANDLE_BUCKET_START (bucket);
+	return bucket;
+}
+
+/*
+ * Returns the bucket containing SLOT and sets *OFFSET to its index
+ * in it, or returns NULL if SLOT is beyond the end of the table.
+ */
+static inline HandleBucket*
+slot_bucket (HandleData *handles, guint32 slot, guint32 *offset)
+{
+	int bucket = index_bucket (slot, offset);
+
+	if (bucket >= HANDLE_BUCKETS)
+		return NULL;
+	return handles->buckets [bucket];
+}
+
+static inline gboolean
+bucket_slot_is_set (HandleBucket *bucket, guint32 offset)
+{
+	return (bucket->bitmap [offset / 32] & (1 << (offset % 32))) != 0;
+}
+
+static gboolean
+try_claim_slot (HandleBucket *bucket, guint32 offset)
+{
+	volatile guint32 *word = (volatile guint32*)&bucket->bitmap [offset / 32];
+	guint32 bit = 1 << (offset % 32);
+	guint32 old;
+
+	do {
+		old = *word;
+		if (old & bit)
+			return FALSE;
+	} while (InterlockedCompareExchange ((volatile gint32*)word, old | bit, old) != old);
+	return TRUE;
+}
+
+static void
+release_slot (HandleBucket *bucket, guint32 offset)
+{
+	volatile guint32 *word = (volatile guint32*)&bucket->bitmap [offset / 32];
+	guint32 bit = 1 << (offset % 32);
+	guint32 old;
+
+	do {
+		old = *word;
+	} while (InterlockedCompareExchange ((volatile gint32*)word, old & ~bit, old) != old);
+}
+
+/* Claims the first free slot in bitmap word WORD, or returns -1 if it is full. */
+static gint32
+try_claim_in_word (HandleBucket *bucket, guint32 word)
+{
+	volatile guint32 *bits = (volatile guint32*)&bucket->bitmap [word];
+	guint32 old;
 	int i;
-	for (i = 0; i < 32; ++i) {
-		if (!(bitmap & (1 << i)))
-			return i;
+
+	for (;;) {
+		old = *bits;
+		if (old == 0xffffffff)
+			return -1;
+		for (i = 0; old & (1 << i); ++i)
+			;
+		if (InterlockedCompareExchange ((volatile gint32*)bits, old | (1 << i), old) == old)
+			return word * 32 + i;
 	}
-	return -1;
+}
+
+static HandleCache*
+get_handle_cache (void)
+{
+	HandleCache *cache = mono_native_tls_get_value (handle_cache_key);
+
+	if (!cache) {
+		cache = g_new0 (HandleCache, 1);
+		mono_native_tls_set_value (handle_cache_key, cache);
+	}
+	return cache;
 }
 
 static void*
@@ -629,102 +782,133 @@ make_root_descr_all_refs (int numbits, gboolean pinned)
 	return mono_gc_make_root_descr_all_refs (numbits);
 }
 
-static guint32
-alloc_handle (HandleData *handles, MonoObject *obj, gboolean track)
+static HandleBucket*
+alloc_bucket (HandleData *handles, int index)
 {
-	gint slot, i;
-	guint32 res;
-	lock_handles (handles);
-	if (!handles->size) {
-		handles->size = 32;
-		if (handles->type > HANDLE_WEAK_TRACK) {
-			handles->entries = mono_gc_alloc_fixed (sizeof (gpointer) * handles->size, make_root_descr_all_refs (handles->size, handles->type == HANDLE_PINNED));
-		} else {
-			handles->entries = g_malloc0 (sizeof (gpointer) * handles->size);
-			handles->domain_ids = g_malloc0 (sizeof (guint16) * handles->size);
-		}
-		handles->bitmap = g_malloc0 (handles->size / 8);
+	HandleBucket *bucket = g_new0 (HandleBucket, 1);
+	guint32 size = HANDLE_BUCKET_SIZE (index);
+
+	if (handles->type > HANDLE_WEAK_TRACK) {
+		bucket->entries = mono_gc_alloc_fixed (sizeof (gpointer) * size, make_root_descr_all_refs (size, handles->type == HANDLE_PINNED));
+		MONO_GC_REGISTER_ROOT_FIXED (bucket->entries);
+	} else {
+		bucket->entries = g_malloc0 (sizeof (gpointer) * size);
+		bucket->domain_ids = g_malloc0 (sizeof (guint16) * size);
 	}
-	i = -1;
-	for (slot = handles->slot_hint; slot < handles->size / 32; ++slot) {
-		if (handles->bitmap [slot] != 0xffffffff) {
-			i = find_first_unset (handles->bitmap [slot]);
-			handles->slot_hint = slot;
-			break;
-		}
+	bucket->bitmap = g_malloc0 (size / 8);
+	return bucket;
+}
+
+static void
+free_bucket (HandleData *handles, HandleBucket *bucket)
+{
+	if (handles->type > HANDLE_WEAK_TRACK) {
+		if (!mono_gc_is_moving ())
+			MONO_GC_UNREGISTER_ROOT (bucket->entries);
+		mono_gc_free_fixed (bucket->entries);
+	} else {
+		g_free (bucket->entries);
+		g_free (bucket->domain_ids);
 	}
-	if (i == -1 && handles->slot_hint != 0) {
-		for (slot = 0; slot < handles->slot_hint; ++slot) {
-			if (handles->bitmap [slot] != 0xffffffff) {
-				i = find_first_unset (handles->bitmap [slot]);
-				handles->slot_hint = slot;
-				break;
-			}
-		}
+	g_free (bucket->bitmap);
+	g_free (bucket);
+}
+
+/*
+ * Makes sure bucket INDEX is installed.  If several threads race to grow
+ * the table only one of their buckets is kept.
+ */
+static void
+grow_handles (HandleData *handles, int index)
+{
+	if (index >= HANDLE_BUCKETS)
+		g_error ("Too many GC handles of type %d", handles->type);
+
+	if (!handles->buckets [index]) {
+		HandleBucket *bucket = alloc_bucket (handles, index);
+		if (InterlockedCompareExchangePointer ((volatile gpointer*)&handles->buckets [index], bucket, NULL) != NULL)
+			free_bucket (handles, bucket);
 	}
-	if (i == -1) {
-		guint32 *new_bitmap;
-		guint32 new_size = handles->size * 2; /* always double: we memset to 0 based on this below */
+	InterlockedCompareExchange (&handles->num_buckets, index + 1, index);
+}
 
-		/* resize and copy the bitmap */
-		new_bitmap = g_malloc0 (new_size / 8);
-		memcpy (new_bitmap, handles->bitmap, handles->size / 8);
-		g_free (handles->bitmap);
-		handles->bitmap = new_bitmap;
+/*
+ * Scans the bitmap words of the installed buckets, starting at word
+ * START_WORD, and claims the first free slot.  Returns -1 if all of them
+ * are taken.
+ */
+static gint32
+claim_free_slot (HandleData *handles, guint32 start_word, int num_buckets)
+{
+	guint32 total_words = HANDLE_BUCKET_START (num_buckets) / 32;
+	guint32 i, word;
+
+	if (start_word >= total_words)
+		start_word = 0;
+
+	for (i = 0, word = start_word; i < total_words; ++i, ++word) {
+		HandleBucket *bucket;
+		guint32 offset;
+		gint32 claimed;
+
+		if (word == total_words)
+			word = 0;
+		bucket = slot_bucket (handles, word * 32, &offset);
+		claimed = try_claim_in_word (bucket, offset / 32);
+		if (claimed >= 0)
+			return word * 32 + (claimed - offset);
+	}
+	return -1;
+}
 
-		/* resize and copy the entries */
-		if (handles->type > HANDLE_WEAK_TRACK) {
-			gpointer *entries;
+static guint32
+alloc_handle (HandleData *handles, MonoObject *obj, gboolean track)
+{
+	HandleCache *cache = get_handle_cache ();
+	HandleBucket *bucket;
+	guint32 offset;
+	gint32 slot = -1;
+	guint32 res;
 
-			entries = mono_gc_alloc_fixed (sizeof (gpointer) * new_size, make_root_descr_all_refs (new_size, handles->type == HANDLE_PINNED));
-			mono_gc_memmove_aligned (entries, handles->entries, sizeof (gpointer) * handles->size);
+	/* Try the slots this thread freed last */
+	while (slot < 0 && cache->num_slots [handles->type] > 0) {
+		guint32 cached = cache->slots [handles->type][--cache->num_slots [handles->type]];
+		bucket = slot_bucket (handles, cached, &offset);
+		if (try_claim_slot (bucket, offset))
+			slot = cached;
+	}
 
-			mono_gc_free_fixed (handles->entries);
-			handles->entries = entries;
-		} else {
-			gpointer *entries;
-			guint16 *domain_ids;
-			domain_ids = g_malloc0 (sizeof (guint16) * new_size);
-			entries = g_malloc0 (sizeof (gpointer) * new_size);
-			memcpy (domain_ids, handles->domain_ids, sizeof (guint16) * handles->size);
-			for (i = 0; i < handles->size; ++i) {
-				MonoObject *obj = mono_gc_weak_link_get (&(handles->entries [i]));
-				if (obj) {
-					mono_gc_weak_link_add (&(entries [i]), obj, track);
-					mono_gc_weak_link_remove (&(handles->entries [i]), track);
-				} else {
-					g_assert (!handles->entries [i]);
-				}
-			}
-			g_free (handles->entries);
-			g_free (handles->domain_ids);
-			handles->entries = entries;
-			handles->domain_ids = domain_ids;
-		}
+	while (slot < 0) {
+		int num_buckets = handles->num_buckets;
+		guint32 hint = cache->word_hint [handles->type];
 
-		/* set i and slot to the next free position */
-		i = 0;
-		slot = (handles->size + 1) / 32;
-		handles->slot_hint = handles->size + 1;
-		handles->size = new_size;
+		if (!hint)
+			hint = handles->word_hint;
+		if (num_buckets)
+			slot = claim_free_slot (handles, hint, num_buckets);
+		if (slot < 0)
+			grow_handles (handles, num_buckets);
 	}
-	handles->bitmap [slot] |= 1 << i;
-	slot = slot * 32 + i;
-	handles->entries [slot] = NULL;
+
+	/* Start the next search from here, leaving the rest of the table to other threads */
+	cache->word_hint [handles->type] = slot / 32;
+	handles->word_hint = slot / 32;
+
+	bucket = slot_bucket (handles, slot, &offset);
+	bucket->entries [offset] = NULL;
 	if (handles->type <= HANDLE_WEAK_TRACK) {
 		/*FIXME, what to use when obj == null?*/
-		handles->domain_ids [slot] = (obj ? mono_object_get_domain (obj) : mono_domain_get ())->domain_id;
+		bucket->domain_ids [offset] = (obj ? mono_object_get_domain (obj) : mono_domain_get ())->domain_id;
 		if (obj)
-			mono_gc_weak_link_add (&(handles->entries [slot]), obj, track);
+			mono_gc_weak_link_add (&(bucket->entries [offset]), obj, track);
 	} else {
-		handles->entries [slot] = obj;
+		bucket->entries [offset] = obj;
 	}
 
 #ifndef DISABLE_PERFCOUNTERS
-	mono_perfcounters->gc_num_handles++;
+	InterlockedIncrement ((volatile gint32*)&mono_perfcounters->gc_num_handles);
 #endif
-	unlock_handles (handles);
-	/*g_print ("allocated entry %d of type %d to object %p (in slot: %p)\n", slot, handles->type, obj, handles->entries [slot]);*/
+	/*g_print ("allocated entry %d of type %d to object %p (in slot: %p)\n", slot, handles->type, obj, bucket->entries [offset]);*/
 	res = (slot << 3) | (handles->type + 1);
 	mono_profiler_gc_handle (MONO_PROFILER_GC_HANDLE_CREATED, handles->type, res, obj);
 	return res;
@@ -804,20 +988,21 @@ mono_gchandle_get_target (guint32 gchandle)
 	guint slot = gchandle >> 3;
 	guint type = (gchandle & 7) - 1;
 	HandleData *handles = &gc_handles [type];
+	HandleBucket *bucket;
+	guint32 offset;
 	MonoObject *obj = NULL;
 	if (type > 3)
 		return NULL;
-	lock_handles (handles);
-	if (slot < handles->size && (handles->bitmap [slot / 32] & (1 << (slot % 32)))) {
+	bucket = slot_bucket (handles, slot, &offset);
+	if (bucket && bucket_slot_is_set (bucket, offset)) {
 		if (handles->type <= HANDLE_WEAK_TRACK) {
-			obj = mono_gc_weak_link_get (&handles->entries [slot]);
+			obj = mono_gc_weak_link_get (&bucket->entries [offset]);
 		} else {
-			obj = handles->entries [slot];
+			obj = bucket->entries [offset];
 		}
 	} else {
 		/* print a warning? */
 	}
-	unlock_handles (handles);
 	/*g_print ("get target of entry %d of type %d: %p\n", slot, handles->type, obj);*/
 	return obj;
 }
@@ -828,28 +1013,27 @@ mono_gchandle_set_target (guint32 gchandle, MonoObject *obj)
 	guint slot = gchandle >> 3;
 	guint type = (gchandle & 7) - 1;
 	HandleData *handles = &gc_handles [type];
-	MonoObject *old_obj = NULL;
+	HandleBucket *bucket;
+	guint32 offset;
 
 	if (type > 3)
 		return;
-	lock_handles (handles);
-	if (slot < handles->size && (handles->bitmap [slot / 32] & (1 << (slot % 32)))) {
+	bucket = slot_bucket (handles, slot, &offset);
+	if (bucket && bucket_slot_is_set (bucket, offset)) {
 		if (handles->type <= HANDLE_WEAK_TRACK) {
-			old_obj = handles->entries [slot];
-			if (handles->entries [slot])
-				mono_gc_weak_link_remove (&handles->entries [slot], handles->type == HANDLE_WEAK_TRACK);
+			if (bucket->entries [offset])
+				mono_gc_weak_link_remove (&bucket->entries [offset], handles->type == HANDLE_WEAK_TRACK);
 			if (obj)
-				mono_gc_weak_link_add (&handles->entries [slot], obj, handles->type == HANDLE_WEAK_TRACK);
+				mono_gc_weak_link_add (&bucket->entries [offset], obj, handles->type == HANDLE_WEAK_TRACK);
 			/*FIXME, what to use when obj == null?*/
-			handles->domain_ids [slot] = (obj ? mono_object_get_domain (obj) : mono_domain_get ())->domain_id;
+			bucket->domain_ids [offset] = (obj ? mono_object_get_domain (obj) : mono_domain_get ())->domain_id;
 		} else {
-			handles->entries [slot] = obj;
+			bucket->entries [offset] = obj;
 		}
 	} else {
 		/* print a warning? */
 	}
-	/*g_print ("changed entry %d of type %d to object %p (in slot: %p)\n", slot, handles->type, obj, handles->entries [slot]);*/
-	unlock_handles (handles);
+	/*g_print ("changed entry %d of type %d to object %p (in slot: %p)\n", slot, handles->type, obj, bucket ? bucket->entries [offset] : NULL);*/
 }
 
 /**
@@ -865,16 +1049,18 @@ mono_gchandle_is_in_domain (guint32 gchandle, MonoDomain *domain)
 	guint slot = gchandle >> 3;
 	guint type = (gchandle & 7) - 1;
 	HandleData *handles = &gc_handles [type];
+	HandleBucket *bucket;
+	guint32 offset;
 	gboolean result = FALSE;
 	if (type > 3)
 		return FALSE;
-	lock_handles (handles);
-	if (slot < handles->size && (handles->bitmap [slot / 32] & (1 << (slot % 32)))) {
+	bucket = slot_bucket (handles, slot, &offset);
+	if (bucket && bucket_slot_is_set (bucket, offset)) {
 		if (handles->type <= HANDLE_WEAK_TRACK) {
-			result = domain->domain_id == handles->domain_ids [slot];
+			result = domain->domain_id == bucket->domain_ids [offset];
 		} else {
 			MonoObject *obj;
-			obj = handles->entries [slot];
+			obj = bucket->entries [offset];
 			if (obj == NULL)
 				result = TRUE;
 			else
@@ -883,7 +1069,6 @@ mono_gchandle_is_in_domain (guint32 gchandle, MonoDomain *domain)
 	} else {
 		/* print a warning? */
 	}
-	unlock_handles (handles);
 	return result;
 }
 
@@ -901,26 +1086,34 @@ mono_gchandle_free (guint32 gchandle)
 	guint slot = gchandle >> 3;
 	guint type = (gchandle & 7) - 1;
 	HandleData *handles = &gc_handles [type];
+	HandleBucket *bucket;
+	guint32 offset;
 	if (type > 3)
 		return;
 
-	lock_handles (handles);
-	if (slot < handles->size && (handles->bitmap [slot / 32] & (1 << (slot % 32)))) {
+	bucket = slot_bucket (handles, slot, &offset);
+	if (bucket && bucket_slot_is_set (bucket, offset)) {
+		HandleCache *cache = get_handle_cache ();
+
 		if (handles->type <= HANDLE_WEAK_TRACK) {
-			if (handles->entries [slot])
-				mono_gc_weak_link_remove (&handles->entries [slot], handles->type == HANDLE_WEAK_TRACK);
+			if (bucket->entries [offset])
+				mono_gc_weak_link_remove (&bucket->entries [offset], handles->type == HANDLE_WEAK_TRACK);
+			/* The root domain is never unloaded, so mono_gchandle_free_domain () won't touch the slot */
+			bucket->domain_ids [offset] = 0;
 		} else {
-			handles->entries [slot] = NULL;
+			bucket->entries [offset] = NULL;
 		}
-		handles->bitmap [slot / 32] &= ~(1 << (slot % 32));
+		release_slot (bucket, offset);
+
+		if (cache->num_slots [type] < HANDLE_CACHE_SIZE)
+			cache->slots [type][cache->num_slots [type]++] = slot;
 	} else {
 		/* print a warning? */
 	}
 #ifndef DISABLE_PERFCOUNTERS
-	mono_perfcounters->gc_num_handles--;
+	InterlockedDecrement ((volatile gint32*)&mono_perfcounters->gc_num_handles);
 #endif
 	/*g_print ("freed entry %d of type %d\n", slot, handles->type);*/
-	unlock_handles (handles);
 	mono_profiler_gc_handle (MONO_PROFILER_GC_HANDLE_DESTROYED, handles->type, gchandle, NULL);
 }
 
@@ -937,22 +1130,29 @@ mono_gchandle_free_domain (MonoDomain *domain)
 	guint type;
 
 	for (type = 0; type < 3; ++type) {
-		guint slot;
 		HandleData *handles = &gc_handles [type];
+		int b;
+
 		lock_handles (handles);
-		for (slot = 0; slot < handles->size; ++slot) {
-			if (!(handles->bitmap [slot / 32] & (1 << (slot % 32))))
-				continue;
-			if (type <= HANDLE_WEAK_TRACK) {
-				if (domain->domain_id == handles->domain_ids [slot]) {
-					handles->bitmap [slot / 32] &= ~(1 << (slot % 32));
-					if (handles->entries [slot])
-						mono_gc_weak_link_remove (&handles->entries [slot], handles->type == HANDLE_WEAK_TRACK);
-				}
-			} else {
-				if (handles->entries [slot] && mono_object_domain (handles->entries [slot]) == domain) {
-					handles->bitmap [slot / 32] &= ~(1 << (slot % 32));
-					handles->entries [slot] = NULL;
+		for (b = 0; b < handles->num_buckets; ++b) {
+			HandleBucket *bucket = handles->buckets [b];
+			guint32 offset;
+
+			for (offset = 0; offset < HANDLE_BUCKET_SIZE (b); ++offset) {
+				if (!bucket_slot_is_set (bucket, offset))
+					continue;
+				if (type <= HANDLE_WEAK_TRACK) {
+					if (domain->domain_id == bucket->domain_ids [offset]) {
+						if (bucket->entries [offset])
+							mono_gc_weak_link_remove (&bucket->entries [offset], handles->type == HANDLE_WEAK_TRACK);
+						bucket->domain_ids [offset] = 0;
+						release_slot (bucket, offset);
+					}
+				} else {
+					if (bucket->entries [offset] && mono_object_domain (bucket->entries [offset]) == domain) {
+						bucket->entries [offset] = NULL;
+						release_slot (bucket, offset);
+					}
 				}
 			}
 		}
@@ -961,6 +1161,22 @@ mono_gchandle_free_domain (MonoDomain *domain)
 
 }
 
+/*
+ * mono_gchandle_free_thread_cache:
+ *
+ *   Free the calling thread's cache of recently freed GC handle slots.
+ */
+void
+mono_gchandle_free_thread_cache (void)
+{
+	HandleCache *cache = mono_native_tls_get_value (handle_cache_key);
+
+	if (cache) {
+		mono_native_tls_set_value (handle_cache_key, NULL);
+		g_free (cache);
+	}
+}
+
 MonoBoolean
 GCHandle_CheckCurrentDomain (guint32 gchandle)
 {
@@ -1000,6 +1216,154 @@ collect_objects (gpointer key, gpointer value, gpointer user_data)
 
 #endif
 
+/*
+ * The finalizer queue is a bounded lock-free queue of objects whose
+ * finalizers are waiting to be run by the finalizer helper threads.
+ * Each slot's sequence number says whether it's ready to be written
+ * (it's equal to the tail position) or to be read (it's one more than
+ * the head position).  The slots are allocated as a GC root, so the
+ * objects stay alive while they're queued.
+ *
+ * Critical finalizers must run after the normal ones that became ready
+ * in the same collection, so they're never queued: the finalizer
+ * thread first waits for the queue to drain and then runs them itself.
+ */
+#define FINALIZER_QUEUE_SIZE	1024
+
+typedef struct {
+	volatile gint32 sequence;
+	void *object;
+	void *data;
+	gint64 queued_time;
+} FinalizerQueueSlot;
+
+static FinalizerQueueSlot *finalizer_queue;
+static volatile gint32 finalizer_queue_head = 0;
+static volatile gint32 finalizer_queue_tail = 0;
+static HANDLE finalizer_queue_sem;
+static HANDLE finalizer_queue_idle_event;
+
+static gint32 finalizer_queue_max_depth = 0;
+static guint64 finalizers_queued = 0;
+/* Time from queueing to running, summed over all queued finalizers. */
+static volatile gint64 finalizer_queue_latency = 0;
+
+static gboolean
+has_critical_finalizer (MonoObject *o)
+{
+	return mono_defaults.critical_finalizer_object && mono_class_has_parent_fast (o->vtable->klass, mono_defaults.critical_finalizer_object);
+}
+
+static gboolean
+finalizer_queue_pop (void **obj, void **data)
+{
+	FinalizerQueueSlot *slot;
+	gint32 pos;
+
+	for (;;) {
+		pos = finalizer_queue_head;
+		slot = &finalizer_queue [pos & (FINALIZER_QUEUE_SIZE - 1)];
+		if (slot->sequence == pos + 1) {
+			if (InterlockedCompareExchange (&finalizer_queue_head, pos + 1, pos) == pos)
+				break;
+		} else if ((gint32)(slot->sequence - (pos + 1)) < 0) {
+			return FALSE;
+		}
+	}
+
+	mono_memory_read_barrier ();
+	*obj = slot->object;
+	*data = slot->data;
+	InterlockedAdd64 (&finalizer_queue_latency, mono_100ns_ticks () - slot->queued_time);
+	slot->object = NULL;
+	mono_memory_write_barrier ();
+	slot->sequence = pos + FINALIZER_QUEUE_SIZE;
+	return TRUE;
+}
+
+/* Runs one queued finalizer.  Returns FALSE if the queue was empty. */
+static gboolean
+run_queued_finalizer (void)
+{
+	void *obj, *data;
+
+	if (!finalizer_queue_pop (&obj, &data))
+		return FALSE;
+
+	/* The object is on the stack now, so it's pinned. */
+	run_finalizer (obj, data);
+
+	if (InterlockedDecrement (&finalizer_queue_depth) == 0)
+		SetEvent (finalizer_queue_idle_event);
+	return TRUE;
+}
+
+/*
+ * Waits until all queued finalizers have run, helping to run them.
+ * Only called by the finalizer thread.
+ */
+static void
+finalizer_queue_drain (void)
+{
+	if (!num_finalizer_helpers)
+		return;
+
+	while (run_queued_finalizer ())
+		;
+	while (finalizer_queue_depth > 0)
+		WaitForSingleObjectEx (finalizer_queue_idle_event, INFINITE, TRUE);
+}
+
+/*
+ * Hands a finalizer to the helper threads.  Returns FALSE if the
+ * finalizer thread must run it itself, because it's critical or the
+ * queue is full.  Only called by the finalizer thread, which is the only
+ * writer.
+ */
+static gboolean
+finalizer_queue_push (void *obj, void *data)
+{
+	FinalizerQueueSlot *slot;
+	gint32 pos, depth;
+
+	if (has_critical_finalizer ((MonoObject*)((char*)obj + GPOINTER_TO_UINT (data)))) {
+		finalizer_queue_drain ();
+		return FALSE;
+	}
+
+	pos = finalizer_queue_tail;
+	slot = &finalizer_queue [pos & (FINALIZER_QUEUE_SIZE - 1)];
+	if (slot->sequence != pos)
+		return FALSE;
+
+	slot->object = obj;
+	slot->data = data;
+	slot->queued_time = mono_100ns_ticks ();
+
+	depth = InterlockedIncrement (&finalizer_queue_depth);
+	if (depth > finalizer_queue_max_depth)
+		finalizer_queue_max_depth = depth;
+	++finalizers_queued;
+
+	mono_memory_write_barrier ();
+	slot->sequence = pos + 1;
+	finalizer_queue_tail = pos + 1;
+
+	ReleaseSemaphore (finalizer_queue_sem, 1, NULL);
+	return TRUE;
+}
+
+static guint32
+finalizer_helper_thread (gpointer unused)
+{
+	while (!finished) {
+		WaitForSingleObjectEx (finalizer_queue_sem, INFINITE, TRUE);
+		while (run_queued_finalizer ())
+			;
+	}
+	return 0;
+}
+
 /*
  * finalize_domain_objects:
  *
@@ -1049,6 +1413,8 @@ finalize_domain_objects (DomainFinalizationReq *req)
 	}
 #endif
 
+	finalizer_queue_drain ();
+
 	/* cleanup the reference queue */
 	reference_queue_clear_for_domain (domain);
 	
@@ -1107,6 +1473,9 @@ finalizer_thread (gpointer unused)
 		 */
 		mono_gc_invoke_finalizers ();
 
+		/* WaitForPendingFinalizers () must wait for the helpers, too. */
+		finalizer_queue_drain ();
+
 		mono_threads_join_threads ();
 
 		reference_queue_proccess_all ();
@@ -1123,6 +1492,16 @@ finalizer_thread (gpointer unused)
 #endif
 	}
 
+	if (num_finalizer_helpers) {
+		int i;
+
+		ReleaseSemaphore (finalizer_queue_sem, num_finalizer_helpers, NULL);
+		for (i = 0; i < num_finalizer_helpers; ++i) {
+			while (WaitForSingleObjectEx (finalizer_helpers [i]->handle, INFINITE, TRUE) == WAIT_IO_COMPLETION)
+				;
+		}
+	}
+
 	SetEvent (shutdown_event);
 	return 0;
 }
@@ -1133,21 +1512,29 @@ static
 void
 mono_gc_init_finalizer_thread (void)
 {
+	int i;
+
 	gc_thread = mono_thread_create_internal (mono_domain_get (), finalizer_thread, NULL, FALSE, 0);
 	ves_icall_System_Threading_Thread_SetName_internal (gc_thread, mono_string_new (mono_domain_get (), "Finalizer"));
+
+	for (i = 0; i < num_finalizer_helpers; ++i) {
+		finalizer_helpers [i] = mono_thread_create_internal (mono_domain_get (), finalizer_helper_thread, NULL, FALSE, 0);
+		ves_icall_System_Threading_Thread_SetName_internal (finalizer_helpers [i], mono_string_new (mono_domain_get (), "Finalizer"));
+	}
 }
 
 void
 mono_gc_init (void)
 {
+	const char *env;
+
 	mono_mutex_init_recursive (&handle_section);
+	mono_native_tls_alloc (&handle_cache_key, g_free);
 	mono_mutex_init_recursive (&allocator_section);
 
 	mono_mutex_init_recursive (&finalizer_mutex);
 	mono_mutex_init_recursive (&reference_queue_mutex);
 
-	MONO_GC_REGISTER_ROOT_FIXED (gc_handles [HANDLE_NORMAL].entries);
-	MONO_GC_REGISTER_ROOT_FIXED (gc_handles [HANDLE_PINNED].entries);
 
 	mono_counters_register ("Minor GC collections", MONO_COUNTER_GC | MONO_COUNTER_UINT, &gc_stats.minor_gc_count);
 	mono_counters_register ("Major GC collections", MONO_COUNTER_GC | MONO_COUNTER_UINT, &gc_stats.major_gc_count);
@@ -1172,6 +1559,26 @@ mono_gc_init (void)
 	MONO_SEM_INIT (&finalizer_sem, 0);
 #endif
 
+	env = g_getenv ("MONO_FINALIZER_THREADS");
+	if (env)
+		num_finalizer_helpers = CLAMP (atoi (env), 1, MAX_FINALIZER_HELPERS + 1) - 1;
+	if (num_finalizer_helpers) {
+		int i;
+
+		finalizer_queue = mono_gc_alloc_fixed (sizeof (FinalizerQueueSlot) * FINALIZER_QUEUE_SIZE, NULL);
+		for (i = 0; i < FINALIZER_QUEUE_SIZE; ++i)
+			finalizer_queue [i].sequence = i;
+		finalizer_queue_sem = CreateSemaphore (NULL, 0, G_MAXINT32, NULL);
+		finalizer_queue_idle_event = CreateEvent (NULL, FALSE, FALSE, NULL);
+		if (finalizer_queue_sem == NULL || finalizer_queue_idle_event == NULL)
+			g_assert_not_reached ();
+	}
+
+	mono_counters_register ("Finalizer queue depth", MONO_COUNTER_GC | MONO_COUNTER_INT, (void*)&finalizer_queue_depth);
+	mono_counters_register ("Finalizer queue max depth", MONO_COUNTER_GC | MONO_COUNTER_INT, &finalizer_queue_max_depth);
+	mono_counters_register ("Finalizers queued", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &finalizers_queued);
+	mono_counters_register ("Finalizer queue latency", MONO_COUNTER_GC | MONO_COUNTER_LONG | MONO_COUNTER_TIME, (void*)&finalizer_queue_latency);
+
 #ifndef LAZY_GC_THREAD_CREATION
 	mono_gc_init_finalizer_thread ();
 #endif
@@ -1187,7 +1594,7 @@ mono_gc_cleanup (void)
 	if (!gc_disabled) {
 		ResetEvent (shutdown_event);
 		finished = TRUE;
-		if (mono_thread_internal_current () != gc_thread) {
+		if (!mono_gc_is_finalizer_internal_thread (mono_thread_internal_current ())) {
 			gboolean timed_out = FALSE;
 
 			mono_gc_finalize_notify ();
@@ -1251,6 +1658,7 @@ mono_gc_finalize_notify (void)
 void mono_gc_init (void)
 {
 	mono_mutex_init_recursive (&handle_section);
+	mono_native_tls_alloc (&handle_cache_key, g_free);
 }
 
 void mono_gc_cleanup (void)
@@ -1262,7 +1670,15 @@ void mono_gc_cleanup (void)
 gboolean
 mono_gc_is_finalizer_internal_thread (MonoInternalThread *thread)
 {
-	return thread == gc_thread;
+	int i;
+
+	if (thread == gc_thread)
+		return TRUE;
+	for (i = 0; i < num_finalizer_helpers; ++i) {
+		if (thread == finalizer_helpers [i])
+			return TRUE;
+	}
+	return FALSE;
 }
 
 /**
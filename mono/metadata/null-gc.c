@@ -17,6 +17,11 @@
 
 #ifdef HAVE_NULL_GC
 
+void
+mono_gc_base_cleanup (void)
+{
+}
+
 void
 mono_gc_base_init (void)
 {
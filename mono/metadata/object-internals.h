@@ -1464,6 +1464,9 @@ mono_get_constant_value_from_blob (MonoDomain* domain, MonoTypeEnum type, const
 void
 mono_release_type_locks (MonoInternalThread *thread) MONO_INTERNAL;
 
+gboolean
+mono_type_initialization_involves_thread (guint32 tid) MONO_INTERNAL;
+
 char *
 mono_string_to_utf8_mp	(MonoMemPool *mp, MonoString *s, MonoError *error) MONO_INTERNAL;
 
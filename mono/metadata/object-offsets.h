@@ -226,6 +226,11 @@ DECL_OFFSET(MonoLMFTramp, lmf_addr)
 DECL_OFFSET(MonoDelegateTrampInfo, invoke_impl)
 DECL_OFFSET(MonoDelegateTrampInfo, method_ptr)
 
+DECL_OFFSET(MonoInlineCache, entries)
+DECL_OFFSET(MonoInlineCache, megamorphic)
+DECL_OFFSET(MonoInlineCacheEntry, vtable)
+DECL_OFFSET(MonoInlineCacheEntry, addr)
+
 #endif
 
 #endif
@@ -481,6 +481,33 @@ mono_release_type_locks (MonoInternalThread *thread)
 	mono_type_initialization_unlock ();
 }
 
+static gboolean
+is_initializing_thread (gpointer key, gpointer value, gpointer user)
+{
+	TypeInitializationLock *lock = (TypeInitializationLock*) value;
+
+	return lock->initializing_tid == GPOINTER_TO_UINT (user) && !lock->done;
+}
+
+/*
+ * mono_type_initialization_involves_thread:
+ *
+ *   Return whenever the thread TID is running a class constructor or waiting
+ * for another thread to finish running one.
+ */
+gboolean
+mono_type_initialization_involves_thread (guint32 tid)
+{
+	gboolean res;
+
+	mono_type_initialization_lock ();
+	res = g_hash_table_lookup (blocked_thread_hash, GUINT_TO_POINTER (tid)) ||
+		g_hash_table_find (type_initialization_hash, is_initializing_thread, GUINT_TO_POINTER (tid));
+	mono_type_initialization_unlock ();
+
+	return res;
+}
+
 static gpointer
 default_trampoline (MonoMethod *method)
 {
@@ -1929,8 +1956,10 @@ mono_class_create_runtime_vtable (MonoDomain *domain, MonoClass *class, gboolean
 	/* 
 	 * For some classes, mono_class_init () already computed class->vtable_size, and 
 	 * that is all that is needed because of the vtable trampolines.
+	 * The overrides of a class are only recorded when its vtable is set up, so do it
+	 * before an instance can be created if they are tracked.
 	 */
-	if (!class->vtable_size)
+	if (!class->vtable_size || (mono_class_track_overrides && !class->rank))
 		mono_class_setup_vtable (class);
 
 	if (class->generic_class && !class->vtable)
@@ -73,6 +73,11 @@ static guint64 stat_bytes_alloced_los = 0;
 
 #endif
 
+static guint64 stat_tlab_refills = 0;
+static guint64 stat_tlab_bytes_wasted = 0;
+/* Small pinned allocations that had to take the GC lock */
+static guint64 stat_pinned_alloc_lock_hits = 0;
+
 /*
  * Allocation is done from a Thread Local Allocation Buffer (TLAB). TLABs are allocated
  * from nursery fragments.
@@ -108,6 +113,17 @@ static __thread char **tlab_next_addr;
 #define TLAB_REAL_END	(__thread_info__->tlab_real_end)
 #endif
 
+#ifdef HAVE_KW_THREAD
+#define TLAB_INFO	sgen_thread_info
+#else
+#define TLAB_INFO	__thread_info__
+#endif
+
+/* The size of this thread's next TLAB */
+#define TLAB_SIZE	(TLAB_INFO->tlab_size)
+/* We don't retire a TLAB with more than this much space left in it */
+#define TLAB_WASTE_LIMIT	(TLAB_SIZE / SGEN_TLAB_WASTE_FRACTION)
+
 static void*
 alloc_degraded (MonoVTable *vtable, size_t size, gboolean for_mature)
 {
@@ -288,7 +304,7 @@ mono_gc_alloc_obj_nolock (MonoVTable *vtable, size_t size)
 				return alloc_degraded (vtable, size, FALSE);
 
 			available_in_tlab = (int)(TLAB_REAL_END - TLAB_NEXT);//We'll never have tlabs > 2Gb
-			if (size > tlab_size || available_in_tlab > SGEN_MAX_NURSERY_WASTE) {
+			if (size > TLAB_SIZE || available_in_tlab > TLAB_WASTE_LIMIT) {
 				/* Allocate directly from the nursery */
 				p = sgen_nursery_alloc (size);
 				if (!p) {
@@ -322,17 +338,21 @@ mono_gc_alloc_obj_nolock (MonoVTable *vtable, size_t size)
 				if (TLAB_START)
 					SGEN_LOG (3, "Retire TLAB: %p-%p [%ld]", TLAB_START, TLAB_REAL_END, (long)(TLAB_REAL_END - TLAB_NEXT - size));
 				sgen_nursery_retire_region (p, available_in_tlab);
+				TLAB_INFO->tlab_bytes_wasted += available_in_tlab;
 
-				p = sgen_nursery_alloc_range (tlab_size, size, &alloc_size);
+				p = sgen_nursery_alloc_range (TLAB_SIZE, size, &alloc_size);
 				if (!p) {
 					/* See comment above in similar case. */
-					sgen_ensure_free_space (tlab_size);
+					sgen_ensure_free_space (TLAB_SIZE);
 					if (!degraded_mode)
-						p = sgen_nursery_alloc_range (tlab_size, size, &alloc_size);
+						p = sgen_nursery_alloc_range (TLAB_SIZE, size, &alloc_size);
 				}
 				if (!p)
 					return alloc_degraded (vtable, size, FALSE);
 
+				TLAB_INFO->tlab_bytes_allocated += alloc_size;
+				++TLAB_INFO->tlab_refills;
+
 				/* Allocate a new TLAB from the current nursery fragment */
 				TLAB_START = (char*)p;
 				TLAB_NEXT = TLAB_START;
@@ -387,10 +407,19 @@ mono_gc_try_alloc_obj_nolock (MonoVTable *vtable, size_t size)
 	SGEN_ASSERT (9, real_size >= sizeof (MonoObject), "Object too small");
 
 	g_assert (vtable->gc_descr);
-	if (real_size > SGEN_MAX_SMALL_OBJ_SIZE)
-		return NULL;
+	if (real_size > SGEN_MAX_SMALL_OBJ_SIZE) {
+		p = sgen_los_try_alloc_large (vtable, ALIGN_UP (real_size));
+		if (p) {
+			HEAVY_STAT (++stat_objects_alloced);
+			HEAVY_STAT (stat_bytes_alloced_los += size);
+			if (G_UNLIKELY (MONO_GC_MAJOR_OBJ_ALLOC_LARGE_ENABLED ()))
+				MONO_GC_MAJOR_OBJ_ALLOC_LARGE ((mword)p, size, vtable->klass->name_space, vtable->klass->name);
+			mono_atomic_store_seq (p, vtable);
+		}
+		return p;
+	}
 
-	if (G_UNLIKELY (size > tlab_size)) {
+	if (G_UNLIKELY (size > TLAB_SIZE)) {
 		/* Allocate directly from the nursery */
 		p = sgen_nursery_alloc (size);
 		if (!p)
@@ -421,7 +450,7 @@ mono_gc_try_alloc_obj_nolock (MonoVTable *vtable, size_t size)
 				TLAB_TEMP_END = MIN (TLAB_REAL_END, TLAB_NEXT + SGEN_SCAN_START_SIZE);
 				SGEN_LOG (5, "Expanding local alloc: %p-%p", TLAB_NEXT, TLAB_TEMP_END);
 			}
-		} else if (available_in_tlab > SGEN_MAX_NURSERY_WASTE) {
+		} else if (available_in_tlab > TLAB_WASTE_LIMIT) {
 			/* Allocate directly from the nursery */
 			p = sgen_nursery_alloc (size);
 			if (!p)
@@ -432,11 +461,15 @@ mono_gc_try_alloc_obj_nolock (MonoVTable *vtable, size_t size)
 			size_t alloc_size = 0;
 
 			sgen_nursery_retire_region (p, available_in_tlab);
-			new_next = sgen_nursery_alloc_range (tlab_size, size, &alloc_size);
+			TLAB_INFO->tlab_bytes_wasted += available_in_tlab;
+			new_next = sgen_nursery_alloc_range (TLAB_SIZE, size, &alloc_size);
 			p = (void**)new_next;
 			if (!p)
 				return NULL;
 
+			TLAB_INFO->tlab_bytes_allocated += alloc_size;
+			++TLAB_INFO->tlab_refills;
+
 			TLAB_START = (char*)new_next;
 			TLAB_NEXT = new_next + size;
 			TLAB_REAL_END = new_next + alloc_size;
@@ -631,13 +664,32 @@ void*
 mono_gc_alloc_pinned_obj (MonoVTable *vtable, size_t size)
 {
 	void **p;
+	TLAB_ACCESS_INIT;
 
 	if (!SGEN_CAN_ALIGN_UP (size))
 		return NULL;
 	size = ALIGN_UP (size);
 
+#ifndef DISABLE_CRITICAL_REGION
+	if (size <= SGEN_MAX_SMALL_OBJ_SIZE && TLAB_INFO) {
+		SGEN_ASSERT (9, vtable->klass->inited, "class %s:%s is not initialized", vtable->klass->name_space, vtable->klass->name);
+		ENTER_CRITICAL_REGION;
+		p = major_collector.try_alloc_small_pinned_obj (TLAB_INFO, vtable, size, SGEN_VTABLE_HAS_REFERENCES (vtable));
+		EXIT_CRITICAL_REGION;
+		if (p) {
+			SGEN_LOG (6, "Allocated pinned object %p, vtable: %p (%s), size: %zd", p, vtable, vtable->klass->name, size);
+			MONO_GC_MAJOR_OBJ_ALLOC_PINNED ((mword)p, size, vtable->klass->name_space, vtable->klass->name);
+			binary_protocol_alloc_pinned (p, vtable, size);
+			return p;
+		}
+	}
+#endif
+
 	LOCK_GC;
 
+	if (size <= SGEN_MAX_SMALL_OBJ_SIZE)
+		++stat_pinned_alloc_lock_hits;
+
 	if (size > SGEN_MAX_SMALL_OBJ_SIZE) {
 		/* large objects are always pinned anyway */
 		p = sgen_los_alloc_large_inner (vtable, size);
@@ -709,13 +761,37 @@ sgen_init_tlab_info (SgenThreadInfo* info)
 	info->tlab_temp_end_addr = &TLAB_TEMP_END;
 	info->tlab_real_end_addr = &TLAB_REAL_END;
 
+	info->tlab_size = min_tlab_size;
+	info->tlab_bytes_allocated = 0;
+	info->tlab_bytes_wasted = 0;
+	info->tlab_refills = 0;
+
 #ifdef HAVE_KW_THREAD
 	tlab_next_addr = &tlab_next;
 #endif
 }
 
 /*
- * Clear the thread local TLAB variables for all threads.
+ * Picks the size of the TLABs a thread should allocate until the next
+ * collection, based on how much it allocated in TLABs since the last
+ * one.  Threads that allocate a lot get bigger TLABs so they have to
+ * refill less often, while idle threads get small ones so they don't
+ * hold on to nursery space they don't use.
+ */
+static void
+update_tlab_size (SgenThreadInfo *info)
+{
+	size_t desired = info->tlab_bytes_allocated / SGEN_TLAB_TARGET_REFILLS;
+
+	/* Don't jump around too much between collections. */
+	desired = SGEN_ALIGN_UP ((info->tlab_size + desired) / 2);
+
+	info->tlab_size = MAX (MIN (desired, max_tlab_size), min_tlab_size);
+}
+
+/*
+ * Clear the thread local TLAB variables for all threads, and adapt
+ * their TLAB sizes.
  */
 void
 sgen_clear_tlabs (void)
@@ -728,6 +804,15 @@ sgen_clear_tlabs (void)
 		*info->tlab_next_addr = NULL;
 		*info->tlab_temp_end_addr = NULL;
 		*info->tlab_real_end_addr = NULL;
+
+		stat_tlab_refills += info->tlab_refills;
+		stat_tlab_bytes_wasted += info->tlab_bytes_wasted;
+
+		update_tlab_size (info);
+
+		info->tlab_bytes_allocated = 0;
+		info->tlab_bytes_wasted = 0;
+		info->tlab_refills = 0;
 	} END_FOREACH_THREAD
 }
 
@@ -1093,7 +1178,7 @@ mono_gc_get_managed_allocator (MonoClass *klass, gboolean for_box)
 		return NULL;
 	if (!mono_runtime_has_tls_get ())
 		return NULL;
-	if (klass->instance_size > tlab_size)
+	if (klass->instance_size > max_tlab_size)
 		return NULL;
 
 	if (klass->has_finalize || mono_class_is_marshalbyref (klass) || (mono_profiler_get_events () & MONO_PROFILE_ALLOCATIONS))
@@ -1209,6 +1294,14 @@ sgen_has_managed_allocator (void)
 	return FALSE;
 }	
 
+void
+sgen_init_allocator (void)
+{
+	mono_counters_register ("# TLAB refills", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_tlab_refills);
+	mono_counters_register ("TLAB bytes wasted", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_tlab_bytes_wasted);
+	mono_counters_register ("# pinned alloc lock hits", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_pinned_alloc_lock_hits);
+}
+
 #ifdef HEAVY_STATISTICS
 void
 sgen_alloc_init_heavy_stats (void)
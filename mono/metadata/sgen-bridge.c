@@ -50,6 +50,7 @@
 #include "utils/mono-logger-internal.h"
 #include "utils/mono-time.h"
 #include "utils/mono-compiler.h"
+#include "utils/mono-counters.h"
 
 MonoGCBridgeCallbacks bridge_callbacks;
 static SgenBridgeProcessor bridge_processor;
@@ -57,6 +58,15 @@ static SgenBridgeProcessor compare_to_bridge_processor;
 
 gboolean bridge_processing_in_progress = FALSE;
 
+static guint64 time_bridge_stw_step = 0;
+static guint64 time_bridge_build_callback_data = 0;
+static guint64 time_bridge_callback = 0;
+static guint64 time_bridge_null_weak_links = 0;
+static guint64 time_bridge_after_callback = 0;
+static guint64 stat_bridge_processings = 0;
+static guint64 stat_bridge_sccs = 0;
+static guint64 stat_bridge_xrefs = 0;
+
 void
 mono_gc_wait_for_bridge_processing (void)
 {
@@ -139,13 +149,20 @@ sgen_bridge_reset_data (void)
 void
 sgen_bridge_processing_stw_step (void)
 {
+	SGEN_TV_DECLARE (atv);
+	SGEN_TV_DECLARE (btv);
+
 	/*
 	 * bridge_processing_in_progress must be set with the world
 	 * stopped.  If not there would be race conditions.
 	 */
 	bridge_processing_in_progress = TRUE;
 
+	SGEN_TV_GETTIME (atv);
 	bridge_processor.processing_stw_step ();
+	SGEN_TV_GETTIME (btv);
+	time_bridge_stw_step += SGEN_TV_ELAPSED (atv, btv);
+
 	if (compare_bridge_processors ())
 		compare_to_bridge_processor.processing_stw_step ();
 }
@@ -215,26 +232,36 @@ free_callback_data (SgenBridgeProcessor *processor)
 void
 sgen_bridge_processing_finish (int generation)
 {
-	unsigned long step_8;
 	SGEN_TV_DECLARE (atv);
 	SGEN_TV_DECLARE (btv);
 
+	SGEN_TV_GETTIME (atv);
 	bridge_processor.processing_build_callback_data (generation);
+	SGEN_TV_GETTIME (btv);
+	time_bridge_build_callback_data += SGEN_TV_ELAPSED (atv, btv);
+
 	if (compare_bridge_processors ())
 		compare_to_bridge_processor.processing_build_callback_data (generation);
 
+	++stat_bridge_processings;
+	stat_bridge_sccs += bridge_processor.num_sccs;
+	stat_bridge_xrefs += bridge_processor.num_xrefs;
+
 	if (bridge_processor.num_sccs == 0) {
 		g_assert (bridge_processor.num_xrefs == 0);
 		goto after_callback;
 	}
 
+	SGEN_TV_GETTIME (atv);
 	bridge_callbacks.cross_references (bridge_processor.num_sccs, bridge_processor.api_sccs,
 			bridge_processor.num_xrefs, bridge_processor.api_xrefs);
+	SGEN_TV_GETTIME (btv);
+	time_bridge_callback += SGEN_TV_ELAPSED (atv, btv);
 
 	if (compare_bridge_processors ())
 		sgen_compare_bridge_processor_results (&bridge_processor, &compare_to_bridge_processor);
 
-	SGEN_TV_GETTIME (btv);
+	SGEN_TV_GETTIME (atv);
 
 	null_weak_links_to_dead_objects (&bridge_processor, generation);
 
@@ -242,11 +269,15 @@ sgen_bridge_processing_finish (int generation)
 	if (compare_bridge_processors ())
 		free_callback_data (&compare_to_bridge_processor);
 
-	SGEN_TV_GETTIME (atv);
-	step_8 = SGEN_TV_ELAPSED (btv, atv);
+	SGEN_TV_GETTIME (btv);
+	time_bridge_null_weak_links += SGEN_TV_ELAPSED (atv, btv);
 
  after_callback:
+	SGEN_TV_GETTIME (atv);
 	bridge_processor.processing_after_callback (generation);
+	SGEN_TV_GETTIME (btv);
+	time_bridge_after_callback += SGEN_TV_ELAPSED (atv, btv);
+
 	if (compare_bridge_processors ())
 		compare_to_bridge_processor.processing_after_callback (generation);
 
@@ -449,4 +480,17 @@ sgen_bridge_print_gc_debug_usage (void)
 	fprintf (stderr, "  bridge-compare-to=<implementation>\n");
 }
 
+void
+sgen_init_bridge (void)
+{
+	mono_counters_register ("Bridge processings", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_bridge_processings);
+	mono_counters_register ("Bridge SCCs", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_bridge_sccs);
+	mono_counters_register ("Bridge xrefs", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_bridge_xrefs);
+	mono_counters_register ("Bridge STW step", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_bridge_stw_step);
+	mono_counters_register ("Bridge build callback data", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_bridge_build_callback_data);
+	mono_counters_register ("Bridge callback", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_bridge_callback);
+	mono_counters_register ("Bridge null weak links", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_bridge_null_weak_links);
+	mono_counters_register ("Bridge after callback", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_bridge_after_callback);
+}
+
 #endif
@@ -35,6 +35,17 @@
 #include "utils/mono-time.h"
 #include "utils/mono-memory-model.h"
 
+/*
+ * Scanning for dirty cards with SSE2/AVX2 needs per-function target
+ * attributes, which older GCCs can't combine with the intrinsics headers.
+ */
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && \
+	(defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define SGEN_HAVE_SIMD_CARD_SCAN 1
+#include <immintrin.h>
+#include "utils/mono-hwcap-x86.h"
+#endif
+
 //#define CARDTABLE_STATS
 
 #ifdef HAVE_UNISTD_H
@@ -261,12 +272,7 @@ sgen_card_table_is_range_marked (guint8 *cards, mword address, mword size)
 	guint8 *end = cards + cards_in_range (address, size);
 
 	/*This is safe since this function is only called by code that only passes continuous card blocks*/
-	while (cards != end) {
-		if (*cards++)
-			return TRUE;
-	}
-	return FALSE;
-
+	return sgen_card_table_find_next_card (cards, end) != end;
 }
 
 static void
@@ -425,11 +431,8 @@ sgen_card_table_finish_minor_collection (void)
 }
 
 static void
-sgen_card_table_finish_scan_remsets (void *start_nursery, void *end_nursery, SgenGrayQueue *queue)
+sgen_card_table_begin_scan_remsets (void)
 {
-	SGEN_TV_DECLARE (atv);
-	SGEN_TV_DECLARE (btv);
-
 	sgen_card_tables_collect_stats (TRUE);
 
 #ifdef SGEN_HAVE_OVERLAPPING_CARDS
@@ -441,15 +444,28 @@ sgen_card_table_finish_scan_remsets (void *start_nursery, void *end_nursery, Sge
 	/*Then we clear*/
 	sgen_card_table_prepare_for_major_collection ();
 #endif
+}
+
+/*
+ * Scans the cards of one share of the major heap and the LOS.  For
+ * parallel nursery collections this is called from several worker
+ * threads, each with a different JOB_INDEX.
+ */
+static void
+sgen_card_table_finish_scan_remsets (void *start_nursery, void *end_nursery, int job_index, int job_split_count, SgenGrayQueue *queue)
+{
+	SGEN_TV_DECLARE (atv);
+	SGEN_TV_DECLARE (btv);
+
 	SGEN_TV_GETTIME (atv);
-	sgen_major_collector_scan_card_table (queue);
+	sgen_major_collector_scan_card_table (job_index, job_split_count, queue);
 	SGEN_TV_GETTIME (btv);
 	last_major_scan_time = SGEN_TV_ELAPSED (atv, btv); 
-	major_card_scan_time += last_major_scan_time;
-	sgen_los_scan_card_table (FALSE, queue);
+	InterlockedAdd64 ((volatile gint64*)&major_card_scan_time, last_major_scan_time);
+	sgen_los_scan_card_table (FALSE, job_index, job_split_count, queue);
 	SGEN_TV_GETTIME (atv);
 	last_los_scan_time = SGEN_TV_ELAPSED (btv, atv);
-	los_card_scan_time += last_los_scan_time;
+	InterlockedAdd64 ((volatile gint64*)&los_card_scan_time, last_los_scan_time);
 }
 
 guint8*
@@ -522,7 +538,7 @@ find_card_offset (mword card)
 }
 
 static guint8*
-find_next_card (guint8 *card_data, guint8 *end)
+find_next_card_word (guint8 *card_data, guint8 *end)
 {
 	mword *cards, *cards_end;
 	mword card;
@@ -555,6 +571,125 @@ find_next_card (guint8 *card_data, guint8 *end)
 	return end;
 }
 
+#ifdef SGEN_HAVE_SIMD_CARD_SCAN
+/*
+ * Compare whole vectors of cards against zero and use the byte mask to
+ * find the first dirty one.  Clean runs are skipped 64 cards at a time by
+ * OR-ing several vectors together first.  The loads are aligned, so we
+ * step bytewise up to the first boundary and finish the tail the same way.
+ */
+static __attribute__ ((target ("sse2"))) guint8*
+find_next_card_sse2 (guint8 *card_data, guint8 *end)
+{
+	__m128i zero = _mm_setzero_si128 ();
+
+	while ((((mword)card_data) & 15) && card_data < end) {
+		if (*card_data)
+			return card_data;
+		++card_data;
+	}
+
+	while (card_data + 64 <= end) {
+		__m128i *v = (__m128i*)card_data;
+		__m128i any = _mm_or_si128 (_mm_or_si128 (_mm_load_si128 (v), _mm_load_si128 (v + 1)),
+				_mm_or_si128 (_mm_load_si128 (v + 2), _mm_load_si128 (v + 3)));
+		if (_mm_movemask_epi8 (_mm_cmpeq_epi8 (any, zero)) != 0xffff)
+			break;
+		card_data += 64;
+	}
+
+	while (card_data + 16 <= end) {
+		__m128i cards = _mm_load_si128 ((__m128i*)card_data);
+		unsigned int dirty = _mm_movemask_epi8 (_mm_cmpeq_epi8 (cards, zero)) ^ 0xffff;
+		if (dirty)
+			return card_data + __builtin_ctz (dirty);
+		card_data += 16;
+	}
+
+	while (card_data < end) {
+		if (*card_data)
+			return card_data;
+		++card_data;
+	}
+
+	return end;
+}
+
+static __attribute__ ((target ("avx2"))) guint8*
+find_next_card_avx2 (guint8 *card_data, guint8 *end)
+{
+	__m256i zero = _mm256_setzero_si256 ();
+
+	while ((((mword)card_data) & 31) && card_data < end) {
+		if (*card_data)
+			return card_data;
+		++card_data;
+	}
+
+	while (card_data + 64 <= end) {
+		__m256i *v = (__m256i*)card_data;
+		__m256i any = _mm256_or_si256 (_mm256_load_si256 (v), _mm256_load_si256 (v + 1));
+		if (!_mm256_testz_si256 (any, any))
+			break;
+		card_data += 64;
+	}
+
+	while (card_data + 32 <= end) {
+		__m256i cards = _mm256_load_si256 ((__m256i*)card_data);
+		unsigned int dirty = ~(unsigned int)_mm256_movemask_epi8 (_mm256_cmpeq_epi8 (cards, zero));
+		if (dirty)
+			return card_data + __builtin_ctz (dirty);
+		card_data += 32;
+	}
+
+	while (card_data < end) {
+		if (*card_data)
+			return card_data;
+		++card_data;
+	}
+
+	return end;
+}
+#endif
+
+static guint8* (*find_next_card) (guint8 *card_data, guint8 *end) = find_next_card_word;
+
+/*
+ * Returns the first non-zero card in [CARD_DATA, END), or END if there
+ * is none.
+ */
+guint8*
+sgen_card_table_find_next_card (guint8 *card_data, guint8 *end)
+{
+	return find_next_card (card_data, end);
+}
+
+/*
+ * Selects the routine used to look for dirty cards.  IMPL is one of
+ * "word", "sse2" or "avx2".  Returns FALSE, leaving the current one in
+ * place, if IMPL is unknown or not supported by this build or CPU.
+ */
+gboolean
+sgen_card_table_set_find_next_card_impl (const char *impl)
+{
+	if (!strcmp (impl, "word")) {
+		find_next_card = find_next_card_word;
+		return TRUE;
+	}
+#ifdef SGEN_HAVE_SIMD_CARD_SCAN
+	mono_hwcap_init ();
+	if (!strcmp (impl, "sse2") && mono_hwcap_x86_has_sse2) {
+		find_next_card = find_next_card_sse2;
+		return TRUE;
+	}
+	if (!strcmp (impl, "avx2") && mono_hwcap_x86_has_avx2) {
+		find_next_card = find_next_card_avx2;
+		return TRUE;
+	}
+#endif
+	return FALSE;
+}
+
 void
 sgen_cardtable_scan_object (char *obj, mword block_obj_size, guint8 *cards, gboolean mod_union, SgenGrayQueue *queue)
 {
@@ -776,6 +911,7 @@ sgen_card_table_init (SgenRemeberedSet *remset)
 	remset->wbarrier_generic_nostore = sgen_card_table_wbarrier_generic_nostore;
 	remset->record_pointer = sgen_card_table_record_pointer;
 
+	remset->begin_scan_remsets = sgen_card_table_begin_scan_remsets;
 	remset->finish_scan_remsets = sgen_card_table_finish_scan_remsets;
 
 	remset->finish_minor_collection = sgen_card_table_finish_minor_collection;
@@ -785,6 +921,9 @@ sgen_card_table_init (SgenRemeberedSet *remset)
 	remset->find_address_with_cards = sgen_card_table_find_address_with_cards;
 
 	need_mod_union = sgen_get_major_collector ()->is_concurrent;
+
+	if (!sgen_card_table_set_find_next_card_impl ("avx2"))
+		sgen_card_table_set_find_next_card_impl ("sse2");
 }
 
 #endif /*HAVE_SGEN_GC*/
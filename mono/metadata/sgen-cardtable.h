@@ -37,6 +37,9 @@ guint8* sgen_card_table_update_mod_union (guint8 *dest, char *obj, mword obj_siz
 
 void sgen_card_table_init (SgenRemeberedSet *remset) MONO_INTERNAL;
 
+guint8* sgen_card_table_find_next_card (guint8 *card_data, guint8 *end) MONO_INTERNAL;
+gboolean sgen_card_table_set_find_next_card_impl (const char *impl) MONO_INTERNAL;
+
 /*How many bytes a single card covers*/
 #define CARD_BITS 9
 
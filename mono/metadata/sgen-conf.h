@@ -171,6 +171,38 @@ typedef guint64 mword;
 */
 #define SGEN_MAX_NURSERY_WASTE 512
 
+/*
+ * Bounds for the size of a thread's TLAB, overridable with the
+ * `min-tlab-size` and `max-tlab-size` options.  Each thread starts out
+ * with the minimum and its TLAB size is adjusted at every collection so
+ * that it would have refilled its TLAB about SGEN_TLAB_TARGET_REFILLS
+ * times in the preceding cycle.
+ */
+#define SGEN_DEFAULT_MIN_TLAB_SIZE	(1024 * 4)
+#define SGEN_DEFAULT_MAX_TLAB_SIZE	(1024 * 32)
+#define SGEN_MIN_TLAB_SIZE_LIMIT	(1024)
+#define SGEN_MAX_TLAB_SIZE_LIMIT	(1024 * 1024)
+#define SGEN_TLAB_TARGET_REFILLS	64
+
+/*
+ * A TLAB is retired when an allocation doesn't fit and the space left
+ * in it is at most this fraction of the thread's TLAB size.  For the
+ * default minimum TLAB size that's SGEN_MAX_NURSERY_WASTE.
+ */
+#define SGEN_TLAB_WASTE_FRACTION	8
+
+
+/*
+ * Dynamic nursery sizing (`max-pause`).  The active part of the nursery is
+ * resized in multiples of SGEN_NURSERY_RESIZE_GRANULE and never shrinks below
+ * 1/SGEN_NURSERY_MIN_ACTIVE_FRACTION of the reserved nursery.  If at least
+ * SGEN_NURSERY_HIGH_SURVIVAL_RATE of the active nursery survives a collection
+ * that stayed well within the pause goal we double the active size, to give
+ * objects more time to die before they're promoted.
+ */
+#define SGEN_NURSERY_RESIZE_GRANULE	(64 * 1024)
+#define SGEN_NURSERY_MIN_ACTIVE_FRACTION	16
+#define SGEN_NURSERY_HIGH_SURVIVAL_RATE	0.1
 
 /*
  * Minimum allowance for nursery allocations, as a multiple of the size of nursery.
@@ -201,6 +233,14 @@ typedef guint64 mword;
 #define SGEN_MIN_SAVE_TARGET_RATIO 0.1
 #define SGEN_MAX_SAVE_TARGET_RATIO 2.0
 
+/*
+ * Empty major heap blocks and free LOS chunks that stay unused for this
+ * many major collections are decommitted, i.e. their pages are given back
+ * to the OS while the address space stays reserved.  0 disables it.
+ */
+#define SGEN_DEFAULT_DECOMMIT_DELAY	2
+#define SGEN_MAX_DECOMMIT_DELAY	100
+
 /*
  * Configurable cementing parameters.
  *
@@ -92,6 +92,9 @@ copy_object_no_checks (void *obj, SgenGrayQueue *queue)
 	if (!has_references)
 		queue = NULL;
 
+	if (sgen_nursery_max_pause)
+		sgen_bytes_copied += objsize;
+
 	par_copy_object_no_checks (destination, vt, obj, objsize, queue);
 	/* FIXME: mark mod union cards if necessary */
 
@@ -100,3 +103,91 @@ copy_object_no_checks (void *obj, SgenGrayQueue *queue)
 
 	return destination;
 }
+
+#ifdef COLLECTOR_PARALLEL_ALLOC_FOR_PROMOTION
+/*
+ * The parallel version of copy_object_no_checks (), for when several
+ * threads might try to copy OBJ at the same time.  The object is copied
+ * first and then the forwarding pointer is installed with a CAS.  Only
+ * the thread that wins stores the vtable in the copy, which makes the
+ * copy visible to card table scanning, and enqueues it.  The losers
+ * give their slots up.
+ *
+ * This can return OBJ itself if it's pinned, either by another thread
+ * or because we're out of memory.
+ */
+static MONO_NEVER_INLINE void*
+copy_object_no_checks_par (void *obj, SgenGrayQueue *queue)
+{
+	mword vtable_word = *(mword*)obj;
+	MonoVTable *vt;
+	gboolean has_references;
+	mword objsize;
+	char *destination;
+
+	if (SGEN_POINTER_IS_TAGGED_FORWARDED (vtable_word))
+		return SGEN_POINTER_UNTAG_VTABLE (vtable_word);
+	if (SGEN_POINTER_IS_TAGGED_PINNED (vtable_word))
+		return obj;
+
+	vt = (MonoVTable*)vtable_word;
+	has_references = SGEN_VTABLE_HAS_REFERENCES (vt);
+	objsize = SGEN_ALIGN_UP (sgen_par_object_get_size (vt, (MonoObject*)obj));
+	destination = COLLECTOR_PARALLEL_ALLOC_FOR_PROMOTION (vt, obj, objsize, has_references);
+
+	if (G_UNLIKELY (!destination)) {
+		void *result = obj;
+		sgen_parallel_pin_or_update (&result, obj, vt, queue);
+		if (result == obj)
+			sgen_set_pinned_from_failed_allocation (objsize);
+		return result;
+	}
+
+	memcpy (destination + sizeof (mword), (char*)obj + sizeof (mword), objsize - sizeof (mword));
+
+	/* adjust array->bounds */
+	if (G_UNLIKELY (vt->rank && ((MonoArray*)obj)->bounds)) {
+		MonoArray *array = (MonoArray*)destination;
+		array->bounds = (MonoArrayBounds*)((char*)destination + ((char*)((MonoArray*)obj)->bounds - (char*)obj));
+	}
+
+	vtable_word = (mword)SGEN_CAS_PTR (obj, SGEN_POINTER_TAG_FORWARDED (destination), vt);
+	if (vtable_word != (mword)vt) {
+		/* Another thread forwarded or pinned the object before us. */
+		memset (destination, 0, objsize);
+		HEAVY_STAT (InterlockedIncrement64 ((volatile gint64*)&stat_slots_allocated_in_vain));
+
+		if (SGEN_POINTER_IS_TAGGED_FORWARDED (vtable_word))
+			return SGEN_POINTER_UNTAG_VTABLE (vtable_word);
+		return obj;
+	}
+
+	/* The contents must be visible before the vtable is. */
+	mono_memory_write_barrier ();
+	*(MonoVTable**)destination = vt;
+
+	if (sgen_nursery_max_pause)
+		SGEN_ATOMIC_ADD_P (sgen_bytes_copied, objsize);
+
+	SGEN_LOG (9, " (to %p, %s size: %lu)", destination, vt->klass->name, (unsigned long)objsize);
+	binary_protocol_copy (obj, destination, vt, objsize);
+
+#ifdef ENABLE_DTRACE
+	if (G_UNLIKELY (MONO_GC_OBJ_MOVED_ENABLED ())) {
+		int dest_gen = sgen_ptr_in_nursery (destination) ? GENERATION_NURSERY : GENERATION_OLD;
+		int src_gen = sgen_ptr_in_nursery (obj) ? GENERATION_NURSERY : GENERATION_OLD;
+		MONO_GC_OBJ_MOVED ((mword)destination, (mword)obj, dest_gen, src_gen, objsize, vt->klass->name_space, vt->klass->name);
+	}
+#endif
+
+	if (G_UNLIKELY (mono_profiler_events & MONO_PROFILE_GC_MOVES))
+		sgen_register_moved_object (obj, destination);
+
+	if (has_references) {
+		SGEN_LOG (9, "Enqueuing gray object %p (%s)", destination, vt->klass->name);
+		GRAY_OBJECT_ENQUEUE (queue, destination, sgen_vtable_get_descriptor (vt));
+	}
+
+	return destination;
+}
+#endif
@@ -31,8 +31,10 @@
 #include "metadata/sgen-gray.h"
 #include "metadata/sgen-protocol.h"
 #include "metadata/sgen-pointer-queue.h"
+#include "metadata/sgen-workers.h"
 #include "utils/dtrace.h"
 #include "utils/mono-counters.h"
+#include "utils/mono-time.h"
 
 #define ptr_in_nursery sgen_ptr_in_nursery
 
@@ -179,67 +181,187 @@ sgen_collect_bridge_objects (int generation, ScanCopyContext ctx)
 }
 
 
+/*
+ * Finalizable objects and weak links are processed at the end of every
+ * collection, which means walking the whole table for the generation.  If
+ * the table is big and we have workers, the walk is split into partitions
+ * of hash buckets, one job each.  The jobs only deal with entries that
+ * don't need the copy function: objects that are dead, live in place or
+ * already forwarded.  Everything else, as well as every change to another
+ * table, is collected in the job's queues and done by the GC thread once
+ * the workers are finished.
+ */
+#define MIN_FIN_WEAK_ENTRIES_PER_JOB	4096
+
+typedef struct {
+	SgenHashTable *hash_table;
+	int job_index;
+	int job_split_count;
+	gboolean before_finalization;
+	/* Entries the GC thread must process with the copy function */
+	SgenPointerQueue deferred;
+	/* Entries the GC thread must insert into the table again */
+	SgenPointerQueue moved;
+	/* Entries the GC thread must insert into the major table */
+	SgenPointerQueue promoted;
+} FinWeakJobData;
+
+static guint64 time_minor_finalize = 0;
+static guint64 time_major_finalize = 0;
+static guint64 time_minor_null_links = 0;
+static guint64 time_major_null_links = 0;
+static guint64 stat_fin_weak_jobs = 0;
+
+static int
+fin_weak_job_split_count (SgenHashTable *hash_table)
+{
+	int count;
+
+	if (!sgen_collection_is_parallel () && !sgen_collection_is_concurrent ())
+		return 1;
+
+	count = sgen_hash_table_num_entries (hash_table) / MIN_FIN_WEAK_ENTRIES_PER_JOB;
+	return MAX (1, MIN (count, sgen_workers_get_job_split_count ()));
+}
+
+static void
+run_fin_weak_jobs (SgenHashTable *hash_table, gboolean before_finalization, int num_jobs, JobFunc func, FinWeakJobData *jobs)
+{
+	void *job_ptrs [num_jobs];
+	int i;
+
+	for (i = 0; i < num_jobs; ++i) {
+		jobs [i].hash_table = hash_table;
+		jobs [i].job_index = i;
+		jobs [i].job_split_count = num_jobs;
+		jobs [i].before_finalization = before_finalization;
+		sgen_pointer_queue_init (&jobs [i].deferred, INTERNAL_MEM_TEMPORARY);
+		sgen_pointer_queue_init (&jobs [i].moved, INTERNAL_MEM_TEMPORARY);
+		sgen_pointer_queue_init (&jobs [i].promoted, INTERNAL_MEM_TEMPORARY);
+		job_ptrs [i] = &jobs [i];
+	}
+
+	stat_fin_weak_jobs += num_jobs;
+	sgen_workers_run_jobs (func, job_ptrs, num_jobs);
+}
+
+/* LOCKING: requires that the GC lock is held */
+static void
+finalize_object (SgenHashTable *hash_table, MonoObject *object, int tag, ScanCopyContext ctx, SgenPointerQueue *moved_fin_objects)
+{
+	gboolean is_fin_ready = sgen_gc_is_object_ready_for_finalization (object);
+	MonoObject *copy = object;
+
+	ctx.copy_func ((void**)&copy, ctx.queue);
+	if (is_fin_ready) {
+		num_ready_finalizers++;
+		sgen_queue_finalization_entry (copy);
+		/* Make it survive */
+		SGEN_LOG (5, "Queueing object for finalization: %p (%s) (was at %p) (%d/%d)", copy, sgen_safe_name (copy), object, num_ready_finalizers, sgen_hash_table_num_entries (hash_table));
+	} else if (hash_table == &minor_finalizable_hash && !ptr_in_nursery (copy)) {
+		/* insert it into the major hash */
+		sgen_hash_table_replace (&major_finalizable_hash, tagged_object_apply (copy, tag), NULL, NULL);
+
+		SGEN_LOG (5, "Promoting finalization of object %p (%s) (was at %p) to major table", copy, sgen_safe_name (copy), object);
+	} else {
+		/* register for reinsertion */
+		sgen_pointer_queue_add (moved_fin_objects, tagged_object_apply (copy, tag));
+
+		SGEN_LOG (5, "Updating object for finalization: %p (%s) (was at %p)", copy, sgen_safe_name (copy), object);
+	}
+}
+
+static void
+job_finalize_partition (WorkerData *worker_data, void *job_data_untyped)
+{
+	FinWeakJobData *job = job_data_untyped;
+	SgenHashTable *hash_table = job->hash_table;
+	MonoObject *object;
+	gpointer dummy;
+
+	SGEN_HASH_TABLE_FOREACH_PARTITION (hash_table, job->job_index, job->job_split_count, object, dummy) {
+		int tag = tagged_object_get_tag (object);
+		MonoObject *copy;
+		object = tagged_object_get_object (object);
+
+		if (major_collector.is_object_live ((char*)object))
+			continue;
+
+		/* A forwarded object is alive, so it's not ready for finalization */
+		copy = (MonoObject*)SGEN_OBJECT_IS_FORWARDED (object);
+		SGEN_HASH_TABLE_FOREACH_PARTITION_REMOVE (TRUE);
+		if (!copy)
+			sgen_pointer_queue_add (&job->deferred, tagged_object_apply (object, tag));
+		else if (hash_table == &minor_finalizable_hash && !ptr_in_nursery (copy))
+			sgen_pointer_queue_add (&job->promoted, tagged_object_apply (copy, tag));
+		else
+			sgen_pointer_queue_add (&job->moved, tagged_object_apply (copy, tag));
+	} SGEN_HASH_TABLE_FOREACH_PARTITION_END;
+}
+
 /* LOCKING: requires that the GC lock is held */
 void
 sgen_finalize_in_range (int generation, ScanCopyContext ctx)
 {
-	CopyOrMarkObjectFunc copy_func = ctx.copy_func;
-	GrayQueue *queue = ctx.queue;
 	SgenHashTable *hash_table = get_finalize_entry_hash_table (generation);
 	MonoObject *object;
 	gpointer dummy;
 	SgenPointerQueue moved_fin_objects;
-
-	sgen_pointer_queue_init (&moved_fin_objects, INTERNAL_MEM_TEMPORARY);
+	int num_jobs;
+	SGEN_TV_DECLARE (atv);
+	SGEN_TV_DECLARE (btv);
 
 	if (no_finalize)
 		return;
-	SGEN_HASH_TABLE_FOREACH (hash_table, object, dummy) {
-		int tag = tagged_object_get_tag (object);
-		object = tagged_object_get_object (object);
-		if (!major_collector.is_object_live ((char*)object)) {
-			gboolean is_fin_ready = sgen_gc_is_object_ready_for_finalization (object);
-			MonoObject *copy = object;
-			copy_func ((void**)&copy, queue);
-			if (is_fin_ready) {
-				/* remove and put in fin_ready_list */
-				SGEN_HASH_TABLE_FOREACH_REMOVE (TRUE);
-				num_ready_finalizers++;
-				sgen_queue_finalization_entry (copy);
-				/* Make it survive */
-				SGEN_LOG (5, "Queueing object for finalization: %p (%s) (was at %p) (%d/%d)", copy, sgen_safe_name (copy), object, num_ready_finalizers, sgen_hash_table_num_entries (hash_table));
-				continue;
-			} else {
-				if (hash_table == &minor_finalizable_hash && !ptr_in_nursery (copy)) {
-					/* remove from the list */
-					SGEN_HASH_TABLE_FOREACH_REMOVE (TRUE);
-
-					/* insert it into the major hash */
-					sgen_hash_table_replace (&major_finalizable_hash, tagged_object_apply (copy, tag), NULL, NULL);
 
-					SGEN_LOG (5, "Promoting finalization of object %p (%s) (was at %p) to major table", copy, sgen_safe_name (copy), object);
-
-					continue;
-				} else if (copy != object) {
-					/* update pointer */
-					SGEN_HASH_TABLE_FOREACH_REMOVE (TRUE);
+	SGEN_TV_GETTIME (atv);
+	sgen_pointer_queue_init (&moved_fin_objects, INTERNAL_MEM_TEMPORARY);
 
-					/* register for reinsertion */
-					sgen_pointer_queue_add (&moved_fin_objects, tagged_object_apply (copy, tag));
+	num_jobs = fin_weak_job_split_count (hash_table);
+	if (num_jobs > 1) {
+		FinWeakJobData jobs [num_jobs];
+		int i;
 
-					SGEN_LOG (5, "Updating object for finalization: %p (%s) (was at %p)", copy, sgen_safe_name (copy), object);
+		run_fin_weak_jobs (hash_table, FALSE, num_jobs, job_finalize_partition, jobs);
 
-					continue;
-				}
+		for (i = 0; i < num_jobs; ++i) {
+			while (!sgen_pointer_queue_is_empty (&jobs [i].deferred)) {
+				object = sgen_pointer_queue_pop (&jobs [i].deferred);
+				finalize_object (hash_table, tagged_object_get_object (object), tagged_object_get_tag (object), ctx, &moved_fin_objects);
 			}
+			while (!sgen_pointer_queue_is_empty (&jobs [i].moved))
+				sgen_pointer_queue_add (&moved_fin_objects, sgen_pointer_queue_pop (&jobs [i].moved));
+			while (!sgen_pointer_queue_is_empty (&jobs [i].promoted))
+				sgen_hash_table_replace (&major_finalizable_hash, sgen_pointer_queue_pop (&jobs [i].promoted), NULL, NULL);
+			sgen_pointer_queue_free (&jobs [i].deferred);
+			sgen_pointer_queue_free (&jobs [i].moved);
+			sgen_pointer_queue_free (&jobs [i].promoted);
 		}
-	} SGEN_HASH_TABLE_FOREACH_END;
+	} else {
+		SGEN_HASH_TABLE_FOREACH (hash_table, object, dummy) {
+			int tag = tagged_object_get_tag (object);
+			object = tagged_object_get_object (object);
+			if (!major_collector.is_object_live ((char*)object)) {
+				/* remove from the list, finalize_object () puts it where it belongs */
+				SGEN_HASH_TABLE_FOREACH_REMOVE (TRUE);
+				finalize_object (hash_table, object, tag, ctx, &moved_fin_objects);
+				continue;
+			}
+		} SGEN_HASH_TABLE_FOREACH_END;
+	}
 
 	while (!sgen_pointer_queue_is_empty (&moved_fin_objects)) {
 		sgen_hash_table_replace (hash_table, sgen_pointer_queue_pop (&moved_fin_objects), NULL, NULL);
 	}
 
 	sgen_pointer_queue_free (&moved_fin_objects);
+
+	SGEN_TV_GETTIME (btv);
+	if (sgen_get_current_collection_generation () == GENERATION_NURSERY)
+		time_minor_finalize += SGEN_TV_ELAPSED (atv, btv);
+	else
+		time_major_finalize += SGEN_TV_ELAPSED (atv, btv);
+	SGEN_LOG (2, "Finalizable %s table processing with %d jobs: %d usecs", sgen_generation_name (generation), num_jobs, SGEN_TV_ELAPSED (atv, btv) / 10);
 }
 
 /* LOCKING: requires that the GC lock is held */
@@ -659,6 +781,126 @@ add_or_remove_disappearing_link (MonoObject *obj, void **link, int generation)
 			obj, obj->vtable->klass->name, link, sgen_generation_name (generation));
 }
 
+typedef enum {
+	DISLINK_KEEP,
+	DISLINK_REMOVE,
+	DISLINK_PROMOTE,
+	DISLINK_DEFER
+} DislinkAction;
+
+/*
+ * Nulls or updates the weak link LINK from the table HASH if its target
+ * died or moved, and returns what to do with its table entry.  Without a
+ * COPY_FUNC, i.e. in a partition job, links whose target might have to be
+ * copied are left alone and DISLINK_DEFER is returned.
+ */
+static DislinkAction
+null_link_if_necessary (SgenHashTable *hash, void **link, gboolean before_finalization, CopyOrMarkObjectFunc copy_func, GrayQueue *queue)
+{
+	char *object, *copy;
+	gboolean track;
+
+	/*
+	We null a weak link before unregistering it, so it's possible that a thread is
+	suspended right in between setting the content to null and staging the unregister.
+
+	The rest of this code cannot handle null links as DISLINK_OBJECT (NULL) produces an invalid address.
+
+	We should simply skip the entry as the staged removal will take place during the next GC.
+	*/
+	if (!*link) {
+		SGEN_LOG (5, "Dislink %p was externally nullified", link);
+		return DISLINK_KEEP;
+	}
+
+	track = DISLINK_TRACK (link);
+	/*
+	 * Tracked references are processed after
+	 * finalization handling whereas standard weak
+	 * references are processed before.  If an
+	 * object is still not marked after finalization
+	 * handling it means that it either doesn't have
+	 * a finalizer or the finalizer has already run,
+	 * so we must null a tracking reference.
+	 */
+	if (track == before_finalization)
+		return DISLINK_KEEP;
+
+	object = DISLINK_OBJECT (link);
+	/*
+	We should guard against a null object been hidden. This can sometimes happen.
+	*/
+	if (!object) {
+		SGEN_LOG (5, "Dislink %p with a hidden null object", link);
+		return DISLINK_KEEP;
+	}
+
+	if (major_collector.is_object_live (object))
+		return DISLINK_KEEP;
+
+	if (sgen_gc_is_object_ready_for_finalization (object)) {
+		*link = NULL;
+		binary_protocol_dislink_update (link, NULL, 0, 0);
+		SGEN_LOG (5, "Dislink nullified at %p to GCed object %p", link, object);
+		return DISLINK_REMOVE;
+	}
+
+	if (copy_func) {
+		copy = object;
+		copy_func ((void**)&copy, queue);
+	} else {
+		/* Only a forwarded object can be resolved without copying */
+		copy = SGEN_OBJECT_IS_FORWARDED (object);
+		if (!copy)
+			return DISLINK_DEFER;
+	}
+
+	/* Update pointer if it's moved.  If the object
+	 * has been moved out of the nursery, we need to
+	 * remove the link from the minor hash table to
+	 * the major one.
+	 *
+	 * FIXME: what if an object is moved earlier?
+	 */
+
+	g_assert (copy);
+	*link = HIDE_POINTER (copy, track);
+	binary_protocol_dislink_update (link, copy, track, 0);
+
+	if (hash == &minor_disappearing_link_hash && !ptr_in_nursery (copy)) {
+		SGEN_LOG (5, "Upgraded dislink at %p to major because object %p moved to %p", link, object, copy);
+		return DISLINK_PROMOTE;
+	}
+
+	SGEN_LOG (5, "Updated dislink at %p to %p", link, DISLINK_OBJECT (link));
+	return DISLINK_KEEP;
+}
+
+static void
+job_null_links_partition (WorkerData *worker_data, void *job_data_untyped)
+{
+	FinWeakJobData *job = job_data_untyped;
+	void **link;
+	gpointer dummy;
+
+	SGEN_HASH_TABLE_FOREACH_PARTITION (job->hash_table, job->job_index, job->job_split_count, link, dummy) {
+		switch (null_link_if_necessary (job->hash_table, link, job->before_finalization, NULL, NULL)) {
+		case DISLINK_KEEP:
+			break;
+		case DISLINK_REMOVE:
+			SGEN_HASH_TABLE_FOREACH_PARTITION_REMOVE (TRUE);
+			continue;
+		case DISLINK_PROMOTE:
+			SGEN_HASH_TABLE_FOREACH_PARTITION_REMOVE (TRUE);
+			sgen_pointer_queue_add (&job->promoted, link);
+			continue;
+		case DISLINK_DEFER:
+			sgen_pointer_queue_add (&job->deferred, link);
+			break;
+		}
+	} SGEN_HASH_TABLE_FOREACH_PARTITION_END;
+}
+
 /* LOCKING: requires that the GC lock is held */
 void
 sgen_null_link_in_range (int generation, gboolean before_finalization, ScanCopyContext ctx)
@@ -668,83 +910,69 @@ sgen_null_link_in_range (int generation, gboolean before_finalization, ScanCopyC
 	void **link;
 	gpointer dummy;
 	SgenHashTable *hash = get_dislink_hash_table (generation);
-
-	SGEN_HASH_TABLE_FOREACH (hash, link, dummy) {
-		char *object;
-		gboolean track;
-
-		/*
-		We null a weak link before unregistering it, so it's possible that a thread is
-		suspended right in between setting the content to null and staging the unregister.
-
-		The rest of this code cannot handle null links as DISLINK_OBJECT (NULL) produces an invalid address.
-
-		We should simply skip the entry as the staged removal will take place during the next GC.
-		*/
-		if (!*link) {
-			SGEN_LOG (5, "Dislink %p was externally nullified", link);
-			continue;
+	int num_jobs;
+	SGEN_TV_DECLARE (atv);
+	SGEN_TV_DECLARE (btv);
+
+	SGEN_TV_GETTIME (atv);
+
+	num_jobs = fin_weak_job_split_count (hash);
+	if (num_jobs > 1) {
+		FinWeakJobData jobs [num_jobs];
+		int i;
+
+		run_fin_weak_jobs (hash, before_finalization, num_jobs, job_null_links_partition, jobs);
+
+		for (i = 0; i < num_jobs; ++i) {
+			while (!sgen_pointer_queue_is_empty (&jobs [i].deferred)) {
+				link = sgen_pointer_queue_pop (&jobs [i].deferred);
+				switch (null_link_if_necessary (hash, link, before_finalization, copy_func, queue)) {
+				case DISLINK_KEEP:
+					break;
+				case DISLINK_REMOVE:
+					sgen_hash_table_remove (hash, link, NULL);
+					break;
+				case DISLINK_PROMOTE:
+					sgen_hash_table_remove (hash, link, NULL);
+					add_or_remove_disappearing_link (DISLINK_OBJECT (link), link, GENERATION_OLD);
+					break;
+				default:
+					g_assert_not_reached ();
+				}
+			}
+			while (!sgen_pointer_queue_is_empty (&jobs [i].promoted)) {
+				link = sgen_pointer_queue_pop (&jobs [i].promoted);
+				add_or_remove_disappearing_link (DISLINK_OBJECT (link), link, GENERATION_OLD);
+			}
+			sgen_pointer_queue_free (&jobs [i].deferred);
+			sgen_pointer_queue_free (&jobs [i].moved);
+			sgen_pointer_queue_free (&jobs [i].promoted);
 		}
-
-		track = DISLINK_TRACK (link);
-		/*
-		 * Tracked references are processed after
-		 * finalization handling whereas standard weak
-		 * references are processed before.  If an
-		 * object is still not marked after finalization
-		 * handling it means that it either doesn't have
-		 * a finalizer or the finalizer has already run,
-		 * so we must null a tracking reference.
-		 */
-		if (track != before_finalization) {
-			object = DISLINK_OBJECT (link);
-			/*
-			We should guard against a null object been hidden. This can sometimes happen.
-			*/
-			if (!object) {
-				SGEN_LOG (5, "Dislink %p with a hidden null object", link);
+	} else {
+		SGEN_HASH_TABLE_FOREACH (hash, link, dummy) {
+			switch (null_link_if_necessary (hash, link, before_finalization, copy_func, queue)) {
+			case DISLINK_KEEP:
+				break;
+			case DISLINK_REMOVE:
+				SGEN_HASH_TABLE_FOREACH_REMOVE (TRUE);
+				continue;
+			case DISLINK_PROMOTE:
+				SGEN_HASH_TABLE_FOREACH_REMOVE (TRUE);
+				add_or_remove_disappearing_link (DISLINK_OBJECT (link), link, GENERATION_OLD);
 				continue;
+			default:
+				g_assert_not_reached ();
 			}
+		} SGEN_HASH_TABLE_FOREACH_END;
+	}
 
-			if (!major_collector.is_object_live (object)) {
-				if (sgen_gc_is_object_ready_for_finalization (object)) {
-					*link = NULL;
-					binary_protocol_dislink_update (link, NULL, 0, 0);
-					SGEN_LOG (5, "Dislink nullified at %p to GCed object %p", link, object);
-					SGEN_HASH_TABLE_FOREACH_REMOVE (TRUE);
-					continue;
-				} else {
-					char *copy = object;
-					copy_func ((void**)&copy, queue);
-
-					/* Update pointer if it's moved.  If the object
-					 * has been moved out of the nursery, we need to
-					 * remove the link from the minor hash table to
-					 * the major one.
-					 *
-					 * FIXME: what if an object is moved earlier?
-					 */
-
-					if (hash == &minor_disappearing_link_hash && !ptr_in_nursery (copy)) {
-						SGEN_HASH_TABLE_FOREACH_REMOVE (TRUE);
-
-						g_assert (copy);
-						*link = HIDE_POINTER (copy, track);
-						add_or_remove_disappearing_link ((MonoObject*)copy, link, GENERATION_OLD);
-						binary_protocol_dislink_update (link, copy, track, 0);
-
-						SGEN_LOG (5, "Upgraded dislink at %p to major because object %p moved to %p", link, object, copy);
-
-						continue;
-					} else {
-						*link = HIDE_POINTER (copy, track);
-						binary_protocol_dislink_update (link, copy, track, 0);
-						SGEN_LOG (5, "Updated dislink at %p to %p", link, DISLINK_OBJECT (link));
-					}
-				}
-			}
-		}
-	} SGEN_HASH_TABLE_FOREACH_END;
+	SGEN_TV_GETTIME (btv);
+	if (sgen_get_current_collection_generation () == GENERATION_NURSERY)
+		time_minor_null_links += SGEN_TV_ELAPSED (atv, btv);
+	else
+		time_major_null_links += SGEN_TV_ELAPSED (atv, btv);
+	SGEN_LOG (2, "Dislink %s table processing (%s finalization) with %d jobs: %d usecs", sgen_generation_name (generation),
+			before_finalization ? "before" : "after", num_jobs, SGEN_TV_ELAPSED (atv, btv) / 10);
 }
 
 /* LOCKING: requires that the GC lock is held */
@@ -912,6 +1140,12 @@ sgen_init_fin_weak_hash (void)
 	mono_counters_register ("FinWeak Index decremented", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_index_decremented);
 	mono_counters_register ("FinWeak Entry invalidated", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_entry_invalidated);
 #endif
+
+	mono_counters_register ("Minor finalizable processing", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_minor_finalize);
+	mono_counters_register ("Minor dislink processing", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_minor_null_links);
+	mono_counters_register ("Major finalizable processing", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_major_finalize);
+	mono_counters_register ("Major dislink processing", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_major_null_links);
+	mono_counters_register ("FinWeak partition jobs", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_fin_weak_jobs);
 }
 
 #endif /* HAVE_SGEN_GC */
@@ -291,6 +291,8 @@ static gboolean do_verify_nursery = FALSE;
 static gboolean do_dump_nursery_content = FALSE;
 static gboolean enable_nursery_canaries = FALSE;
 
+mword sgen_bytes_copied;
+
 #ifdef HEAVY_STATISTICS
 guint64 stat_objects_alloced_degraded = 0;
 guint64 stat_bytes_alloced_degraded = 0;
@@ -322,6 +324,7 @@ static int stat_wbarrier_object_copy = 0;
 #endif
 
 static guint64 stat_pinned_objects = 0;
+static guint64 stat_pinned_bytes = 0;
 
 static guint64 time_minor_pre_collection_fragment_clear = 0;
 static guint64 time_minor_pinning = 0;
@@ -351,6 +354,24 @@ static guint64 time_max = 0;
 static SGEN_TV_DECLARE (time_major_conc_collection_start);
 static SGEN_TV_DECLARE (time_major_conc_collection_end);
 
+/*
+ * Pause time goal for the pauses of concurrent collections, in 100ns
+ * ticks, or 0 if concurrent mark isn't paced.  See
+ * major_assist_concurrent_mark ().
+ */
+static gint64 concurrent_max_pause = 0;
+
+static guint64 time_major_conc_mark_assist = 0;
+static guint64 stat_major_conc_pauses = 0;
+static guint64 stat_major_conc_pauses_over_goal = 0;
+static guint64 stat_major_conc_cycles_over_goal = 0;
+
+/* Statistics for the concurrent collection in progress */
+static int conc_cycle_pauses;
+static int conc_cycle_pauses_over_goal;
+static gint64 conc_cycle_longest_pause;
+static gint64 conc_cycle_mark_assist;
+
 static SGEN_TV_DECLARE (last_minor_collection_start_tv);
 static SGEN_TV_DECLARE (last_minor_collection_end_tv);
 
@@ -426,6 +447,12 @@ static volatile mword lowest_heap_address = ~(mword)0;
 static volatile mword highest_heap_address = 0;
 
 LOCK_DECLARE (sgen_interruption_mutex);
+/*
+ * Protects the pin queue, the cementing table, the global remsets and
+ * the moved objects buffer while workers copy in a parallel nursery
+ * collection.
+ */
+static LOCK_DECLARE (par_collection_mutex);
 
 typedef struct _FinalizeReadyEntry FinalizeReadyEntry;
 struct _FinalizeReadyEntry {
@@ -499,13 +526,13 @@ __thread SgenThreadInfo *sgen_thread_info;
 __thread char *stack_end;
 #endif
 
-/* The size of a TLAB */
-/* The bigger the value, the less often we have to go to the slow path to allocate a new 
- * one, but the more space is wasted by threads not allocating much memory.
- * FIXME: Tune this.
- * FIXME: Make this self-tuning for each thread.
+/* The bounds for the TLAB size of each thread */
+/* The bigger the TLAB, the less often we have to go to the slow path to allocate a new
+ * one, but the more space is wasted by threads not allocating much memory.  That's why
+ * each thread's TLAB size adapts to how much it allocates, see sgen_clear_tlabs ().
  */
-guint32 tlab_size = (1024 * 4);
+guint32 min_tlab_size = SGEN_DEFAULT_MIN_TLAB_SIZE;
+guint32 max_tlab_size = SGEN_DEFAULT_MAX_TLAB_SIZE;
 
 #define MAX_SMALL_OBJ_SIZE	SGEN_MAX_SMALL_OBJ_SIZE
 
@@ -600,7 +627,7 @@ gray_queue_redirect (SgenGrayQueue *queue)
 	}
 
 	if (wake) {
-		g_assert (concurrent_collection_in_progress);
+		g_assert (concurrent_collection_in_progress || sgen_collection_is_parallel ());
 		if (sgen_workers_have_started ()) {
 			sgen_workers_ensure_awake ();
 		} else {
@@ -613,7 +640,7 @@ gray_queue_redirect (SgenGrayQueue *queue)
 static void
 gray_queue_enable_redirect (SgenGrayQueue *queue)
 {
-	if (!concurrent_collection_in_progress)
+	if (!concurrent_collection_in_progress && !sgen_collection_is_parallel ())
 		return;
 
 	sgen_gray_queue_set_alloc_prepare (queue, gray_queue_redirect, sgen_workers_get_distribute_section_gray_queue ());
@@ -830,12 +857,14 @@ mono_gc_clear_domain (MonoDomain * domain)
  *   The global remset contains locations which point into newspace after
  * a minor collection. This can happen if the objects they point to are pinned.
  *
- * LOCKING: If called from a parallel collector, the global remset
- * lock must be held.  For serial collectors that is not necessary.
+ * LOCKING: In a parallel collection this takes the parallel collection
+ * lock, because cementing is not thread-safe.
  */
 void
 sgen_add_to_global_remset (gpointer ptr, gpointer obj)
 {
+	gboolean parallel = sgen_collection_is_parallel ();
+
 	SGEN_ASSERT (5, sgen_ptr_in_nursery (obj), "Target pointer of global remset must be in the nursery");
 
 	HEAVY_STAT (++stat_wbarrier_add_to_global_remset);
@@ -847,16 +876,25 @@ sgen_add_to_global_remset (gpointer ptr, gpointer obj)
 			SGEN_ASSERT (5, sgen_concurrent_collection_in_progress (), "Global remsets outside of collection pauses can only be added by the concurrent collector");
 	}
 
-	if (!object_is_pinned (obj))
+	if (parallel)
+		mono_mutex_lock (&par_collection_mutex);
+
+	if (!object_is_pinned (obj)) {
 		SGEN_ASSERT (5, sgen_minor_collector.is_split || sgen_concurrent_collection_in_progress (), "Non-pinned objects can only remain in nursery if it is a split nursery");
-	else if (sgen_cement_lookup_or_register (obj))
+	} else if (sgen_cement_lookup_or_register (obj)) {
+		if (parallel)
+			mono_mutex_unlock (&par_collection_mutex);
 		return;
+	}
 
 	remset.record_pointer (ptr);
 
 	if (G_UNLIKELY (do_pin_stats))
 		sgen_pin_stats_register_global_remset (obj);
 
+	if (parallel)
+		mono_mutex_unlock (&par_collection_mutex);
+
 	SGEN_LOG (8, "Adding global remset for %p", ptr);
 	binary_protocol_global_remset (ptr, obj, (gpointer)SGEN_LOAD_VTABLE (obj));
 
@@ -1063,6 +1101,7 @@ pin_objects_from_nursery_pin_queue (ScanCopyContext ctx)
 			GRAY_OBJECT_ENQUEUE (queue, obj_to_pin, desc);
 			if (G_UNLIKELY (do_pin_stats))
 				sgen_pin_stats_register_object (obj_to_pin, obj_to_pin_size);
+			stat_pinned_bytes += obj_to_pin_size;
 			definitely_pinned [count] = obj_to_pin;
 			count++;
 		}
@@ -1126,7 +1165,9 @@ sgen_parallel_pin_or_update (void **ptr, void *obj, MonoVTable *vt, SgenGrayQueu
 
 		if (sgen_ptr_in_nursery (obj)) {
 			if (SGEN_CAS_PTR (obj, SGEN_POINTER_TAG_PINNED (vt), vt) == vt) {
+				mono_mutex_lock (&par_collection_mutex);
 				sgen_pin_object (obj, queue);
+				mono_mutex_unlock (&par_collection_mutex);
 				break;
 			}
 		} else {
@@ -1266,6 +1307,7 @@ pin_from_roots (void *start_nursery, void *end_nursery, GrayQueue *queue)
 		SGEN_LOG (6, "Pinned roots %p-%p", start_root, root->end_root);
 		conservatively_pin_objects_from (start_root, (void**)root->end_root, start_nursery, end_nursery, PIN_TYPE_OTHER);
 	} SGEN_HASH_TABLE_FOREACH_END;
+	sgen_pin_stage_end_run ();
 	/* now deal with the thread stacks
 	 * in the future we should be able to conservatively scan only:
 	 * *) the cpu registers
@@ -1915,14 +1957,20 @@ dump_heap (const char *type, int num, const char *reason)
 void
 sgen_register_moved_object (void *obj, void *destination)
 {
+	gboolean parallel = sgen_collection_is_parallel ();
+
 	g_assert (mono_profiler_events & MONO_PROFILE_GC_MOVES);
 
+	if (parallel)
+		mono_mutex_lock (&par_collection_mutex);
 	if (moved_objects_idx == MOVED_OBJECTS_NUM) {
 		mono_profiler_gc_moves (moved_objects, moved_objects_idx);
 		moved_objects_idx = 0;
 	}
 	moved_objects [moved_objects_idx++] = obj;
 	moved_objects [moved_objects_idx++] = destination;
+	if (parallel)
+		mono_mutex_unlock (&par_collection_mutex);
 }
 
 static void
@@ -1935,6 +1983,11 @@ init_stats (void)
 
 	mono_counters_register ("Collection max time",  MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME | MONO_COUNTER_MONOTONIC, &time_max);
 
+	mono_counters_register ("Major concurrent pauses", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_conc_pauses);
+	mono_counters_register ("Major concurrent pauses over goal", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_conc_pauses_over_goal);
+	mono_counters_register ("Major concurrent cycles over goal", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_conc_cycles_over_goal);
+	mono_counters_register ("Major concurrent mark assist", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_major_conc_mark_assist);
+
 	mono_counters_register ("Minor fragment clear", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_minor_pre_collection_fragment_clear);
 	mono_counters_register ("Minor pinning", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_minor_pinning);
 	mono_counters_register ("Minor scan remembered set", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_minor_scan_remsets);
@@ -1959,6 +2012,7 @@ init_stats (void)
 	mono_counters_register ("Major fragment creation", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_major_fragment_creation);
 
 	mono_counters_register ("Number of pinned objects", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_pinned_objects);
+	mono_counters_register ("Bytes in pinned objects", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_pinned_bytes);
 
 #ifdef HEAVY_STATISTICS
 	mono_counters_register ("WBarrier remember pointer", MONO_COUNTER_GC | MONO_COUNTER_INT, &stat_wbarrier_add_to_global_remset);
@@ -2006,7 +2060,7 @@ reset_pinned_from_failed_allocation (void)
 void
 sgen_set_pinned_from_failed_allocation (mword objsize)
 {
-	bytes_pinned_from_failed_allocation += objsize;
+	SGEN_ATOMIC_ADD_P (bytes_pinned_from_failed_allocation, objsize);
 }
 
 gboolean
@@ -2022,6 +2076,23 @@ sgen_collection_is_concurrent (void)
 	}
 }
 
+/*
+ * Whether the current collection is done by several worker threads at
+ * the same time.
+ */
+gboolean
+sgen_collection_is_parallel (void)
+{
+	switch (current_collection_generation) {
+	case GENERATION_NURSERY:
+		return sgen_minor_collector.is_parallel;
+	case GENERATION_OLD:
+		return major_collector.is_parallel;
+	default:
+		return FALSE;
+	}
+}
+
 gboolean
 sgen_concurrent_collection_in_progress (void)
 {
@@ -2032,6 +2103,8 @@ typedef struct
 {
 	char *heap_start;
 	char *heap_end;
+	int job_index;
+	int job_split_count;
 } FinishRememberedSetScanJobData;
 
 static void
@@ -2039,7 +2112,8 @@ job_finish_remembered_set_scan (WorkerData *worker_data, void *job_data_untyped)
 {
 	FinishRememberedSetScanJobData *job_data = job_data_untyped;
 
-	remset.finish_scan_remsets (job_data->heap_start, job_data->heap_end, sgen_workers_get_job_gray_queue (worker_data));
+	remset.finish_scan_remsets (job_data->heap_start, job_data->heap_end, job_data->job_index, job_data->job_split_count,
+			sgen_workers_get_job_gray_queue (worker_data));
 	sgen_free_internal_dynamic (job_data, sizeof (FinishRememberedSetScanJobData), INTERNAL_MEM_WORKER_JOB_DATA);
 }
 
@@ -2092,14 +2166,14 @@ static void
 job_scan_major_mod_union_cardtable (WorkerData *worker_data, void *job_data_untyped)
 {
 	g_assert (concurrent_collection_in_progress);
-	major_collector.scan_card_table (TRUE, sgen_workers_get_job_gray_queue (worker_data));
+	major_collector.scan_card_table (TRUE, 0, 1, sgen_workers_get_job_gray_queue (worker_data));
 }
 
 static void
 job_scan_los_mod_union_cardtable (WorkerData *worker_data, void *job_data_untyped)
 {
 	g_assert (concurrent_collection_in_progress);
-	sgen_los_scan_card_table (TRUE, sgen_workers_get_job_gray_queue (worker_data));
+	sgen_los_scan_card_table (TRUE, 0, 1, sgen_workers_get_job_gray_queue (worker_data));
 }
 
 static void
@@ -2197,7 +2271,7 @@ check_nursery_is_clean (void)
 static void
 init_gray_queue (void)
 {
-	if (sgen_collection_is_concurrent ())
+	if (sgen_collection_is_concurrent () || sgen_collection_is_parallel ())
 		sgen_workers_init_distribute_gray_queue ();
 	sgen_gray_object_queue_init (&gray_queue, NULL);
 }
@@ -2218,6 +2292,8 @@ collect_nursery (SgenGrayQueue *unpin_queue, gboolean finish_up_concurrent_mark)
 	ScanThreadDataJobData *stdjd;
 	mword fragment_total;
 	ScanCopyContext ctx;
+	gboolean parallel;
+	int i, num_remset_jobs;
 	TV_DECLARE (atv);
 	TV_DECLARE (btv);
 
@@ -2237,7 +2313,13 @@ collect_nursery (SgenGrayQueue *unpin_queue, gboolean finish_up_concurrent_mark)
 #endif
 
 	current_collection_generation = GENERATION_NURSERY;
-	current_object_ops = sgen_minor_collector.serial_ops;
+	parallel = sgen_collection_is_parallel ();
+	if (parallel)
+		current_object_ops = sgen_minor_collector.parallel_ops;
+	else
+		current_object_ops = sgen_minor_collector.serial_ops;
+
+	sgen_bytes_copied = 0;
 
 	reset_pinned_from_failed_allocation ();
 
@@ -2310,10 +2392,34 @@ collect_nursery (SgenGrayQueue *unpin_queue, gboolean finish_up_concurrent_mark)
 
 	MONO_GC_CHECKPOINT_3 (GENERATION_NURSERY);
 
-	frssjd = sgen_alloc_internal_dynamic (sizeof (FinishRememberedSetScanJobData), INTERNAL_MEM_WORKER_JOB_DATA, TRUE);
-	frssjd->heap_start = sgen_get_nursery_start ();
-	frssjd->heap_end = nursery_next;
-	sgen_workers_enqueue_job (job_finish_remembered_set_scan, frssjd);
+	/*
+	 * In a parallel collection the workers start copying once
+	 * pinning is done.  The objects pinned so far are in the GC
+	 * thread's gray queue, so we redirect it to the workers.
+	 */
+	if (parallel) {
+		sgen_workers_start_all_workers ();
+		gray_queue_enable_redirect (WORKERS_DISTRIBUTE_GRAY_QUEUE);
+	}
+
+	/*
+	 * The card table scan is split into one job per worker, each
+	 * of which scans an interleaved subset of the major blocks
+	 * and a contiguous range of the LOS objects.
+	 */
+	if (remset.begin_scan_remsets)
+		remset.begin_scan_remsets ();
+	num_remset_jobs = parallel ? sgen_workers_get_job_split_count () : 1;
+	if (num_remset_jobs > 1)
+		sgen_los_prepare_card_table_scan (num_remset_jobs);
+	for (i = 0; i < num_remset_jobs; ++i) {
+		frssjd = sgen_alloc_internal_dynamic (sizeof (FinishRememberedSetScanJobData), INTERNAL_MEM_WORKER_JOB_DATA, TRUE);
+		frssjd->heap_start = sgen_get_nursery_start ();
+		frssjd->heap_end = nursery_next;
+		frssjd->job_index = i;
+		frssjd->job_split_count = num_remset_jobs;
+		sgen_workers_enqueue_job (job_finish_remembered_set_scan, frssjd);
+	}
 
 	/* we don't have complete write barrier yet, so we scan all the old generation sections */
 	TV_GETTIME (btv);
@@ -2323,10 +2429,12 @@ collect_nursery (SgenGrayQueue *unpin_queue, gboolean finish_up_concurrent_mark)
 	MONO_GC_CHECKPOINT_4 (GENERATION_NURSERY);
 
 	/* FIXME: why is this here? */
-	ctx.scan_func = current_object_ops.scan_object;
-	ctx.copy_func = NULL;
-	ctx.queue = &gray_queue;
-	sgen_drain_gray_stack (-1, ctx);
+	if (!parallel) {
+		ctx.scan_func = current_object_ops.scan_object;
+		ctx.copy_func = NULL;
+		ctx.queue = &gray_queue;
+		sgen_drain_gray_stack (-1, ctx);
+	}
 
 	if (mono_profiler_get_events () & MONO_PROFILE_GC_ROOTS)
 		report_registered_roots ();
@@ -2379,6 +2487,19 @@ collect_nursery (SgenGrayQueue *unpin_queue, gboolean finish_up_concurrent_mark)
 
 	MONO_GC_CHECKPOINT_8 (GENERATION_NURSERY);
 
+	if (parallel) {
+		sgen_workers_join ();
+
+		/*
+		 * Finalization and weak link processing happen in
+		 * the GC thread, so we switch back to the serial
+		 * functions and stop redirecting the gray queue.
+		 */
+		current_object_ops = sgen_minor_collector.serial_ops;
+		sgen_gray_object_queue_disable_alloc_prepare (&gray_queue);
+		g_assert (sgen_section_gray_queue_is_empty (sgen_workers_get_distribute_section_gray_queue ()));
+	}
+
 	finish_gray_stack (GENERATION_NURSERY, &gray_queue);
 	TV_GETTIME (atv);
 	time_minor_finish_gray_stack += TV_ELAPSED (btv, atv);
@@ -2404,6 +2525,10 @@ collect_nursery (SgenGrayQueue *unpin_queue, gboolean finish_up_concurrent_mark)
 	 * next allocations.
 	 */
 	mono_profiler_gc_event (MONO_GC_EVENT_RECLAIM_START, 0);
+	if (sgen_nursery_max_pause) {
+		TV_GETTIME (btv);
+		sgen_nursery_adapt_size (TV_ELAPSED (last_minor_collection_start_tv, btv), sgen_bytes_copied);
+	}
 	fragment_total = sgen_build_nursery_fragments (nursery_section, unpin_queue);
 	if (!fragment_total)
 		degraded_mode = 1;
@@ -2667,7 +2792,7 @@ major_copy_or_mark_from_roots (size_t *old_next_pin_slot, gboolean start_concurr
 	 * before pinning has finished.  For the non-concurrent
 	 * collector we start the workers after pinning.
 	 */
-	if (start_concurrent_mark) {
+	if (start_concurrent_mark || sgen_collection_is_parallel ()) {
 		sgen_workers_start_all_workers ();
 		gray_queue_enable_redirect (WORKERS_DISTRIBUTE_GRAY_QUEUE);
 	}
@@ -2829,6 +2954,9 @@ major_finish_collection (const char *reason, size_t old_next_pin_slot, gboolean
 	} else {
 		SGEN_ASSERT (0, !scan_whole_nursery, "scan_whole_nursery only applies to concurrent collections");
 		current_object_ops = major_collector.major_ops;
+
+		if (sgen_collection_is_parallel ())
+			sgen_workers_join ();
 	}
 
 	/*
@@ -3074,6 +3202,82 @@ major_update_concurrent_collection (void)
 	gc_stats.major_gc_time += TV_ELAPSED (total_start, total_end);
 }
 
+/*
+ * Concurrent mark pacing.  Without pacing, marking only progresses as
+ * fast as the workers manage between pauses, and if the mutators
+ * allocate faster than that, the finishing pause has to wait for the
+ * workers to complete all the remaining marking.  With a pause goal, the
+ * GC thread assists the workers in every pause of the concurrent
+ * collection: it marks from the workers' distribute gray queue until the
+ * pause has used up the goal, and then hands what's still gray back to
+ * the workers.
+ */
+static void
+major_assist_concurrent_mark (gint64 budget)
+{
+	SgenSectionGrayQueue *distribute_queue = sgen_workers_get_distribute_section_gray_queue ();
+	SgenGrayQueue assist_queue;
+	GrayQueueSection *section;
+	ScanCopyContext ctx;
+	gint64 elapsed = 0;
+	TV_DECLARE (atv);
+	TV_DECLARE (btv);
+
+	TV_GETTIME (atv);
+
+	sgen_gray_object_queue_init (&assist_queue, NULL);
+	ctx.scan_func = major_collector.major_concurrent_ops.scan_object;
+	ctx.copy_func = NULL;
+	ctx.queue = &assist_queue;
+
+	while (elapsed < budget) {
+		if (sgen_gray_object_queue_is_empty (&assist_queue)) {
+			section = sgen_section_gray_queue_dequeue (distribute_queue);
+			if (!section)
+				break;
+			sgen_gray_object_enqueue_section (&assist_queue, section);
+		}
+		sgen_drain_gray_stack (SGEN_GRAY_QUEUE_SECTION_SIZE, ctx);
+
+		TV_GETTIME (btv);
+		elapsed = TV_ELAPSED (atv, btv);
+	}
+
+	while ((section = sgen_gray_object_dequeue_section (&assist_queue)))
+		sgen_section_gray_queue_enqueue (distribute_queue, section);
+	sgen_gray_object_queue_deinit (&assist_queue);
+
+	TV_GETTIME (btv);
+	time_major_conc_mark_assist += TV_ELAPSED (atv, btv);
+	conc_cycle_mark_assist += TV_ELAPSED (atv, btv);
+}
+
+static void
+concurrent_collection_record_pause (gint64 pause, gboolean cycle_finished)
+{
+	++conc_cycle_pauses;
+	++stat_major_conc_pauses;
+	if (concurrent_max_pause && pause > concurrent_max_pause) {
+		++conc_cycle_pauses_over_goal;
+		++stat_major_conc_pauses_over_goal;
+	}
+	conc_cycle_longest_pause = MAX (conc_cycle_longest_pause, pause);
+
+	if (!cycle_finished)
+		return;
+
+	if (conc_cycle_pauses_over_goal)
+		++stat_major_conc_cycles_over_goal;
+	SGEN_LOG (1, "Concurrent collection %d: %d pauses, %d over the goal of %d usecs, longest %d usecs, %d usecs mark assist",
+			gc_stats.major_gc_count - 1, conc_cycle_pauses, conc_cycle_pauses_over_goal, (int)(concurrent_max_pause / 10),
+			(int)(conc_cycle_longest_pause / 10), (int)(conc_cycle_mark_assist / 10));
+
+	conc_cycle_pauses = 0;
+	conc_cycle_pauses_over_goal = 0;
+	conc_cycle_longest_pause = 0;
+	conc_cycle_mark_assist = 0;
+}
+
 static void
 major_finish_concurrent_collection (void)
 {
@@ -3182,6 +3386,7 @@ sgen_perform_collection (size_t requested_size, int generation_to_collect, const
 	int overflow_generation_to_collect = -1;
 	int oldest_generation_collected = generation_to_collect;
 	const char *overflow_reason = NULL;
+	gboolean was_concurrent = concurrent_collection_in_progress;
 
 	MONO_GC_REQUESTED (generation_to_collect, requested_size, wait_to_finish ? 1 : 0);
 	if (wait_to_finish)
@@ -3214,6 +3419,11 @@ sgen_perform_collection (size_t requested_size, int generation_to_collect, const
 			if (generation_to_collect == GENERATION_NURSERY)
 				collect_nursery (NULL, FALSE);
 
+			if (concurrent_max_pause) {
+				TV_GETTIME (gc_end);
+				major_assist_concurrent_mark (concurrent_max_pause - TV_ELAPSED (gc_total_start, gc_end));
+			}
+
 			sgen_workers_signal_finish_nursery_collection ();
 		}
 
@@ -3311,6 +3521,9 @@ sgen_perform_collection (size_t requested_size, int generation_to_collect, const
 	TV_GETTIME (gc_total_end);
 	time_max = MAX (time_max, TV_ELAPSED (gc_total_start, gc_total_end));
 
+	if (was_concurrent || concurrent_collection_in_progress)
+		concurrent_collection_record_pause (TV_ELAPSED (gc_total_start, gc_total_end), was_concurrent && !concurrent_collection_in_progress);
+
 	sgen_restart_world (oldest_generation_collected, infos);
 
 	mono_profiler_gc_event (MONO_GC_EVENT_END, generation_to_collect);
@@ -3844,6 +4057,9 @@ scan_thread_data (void *start_nursery, void *end_nursery, gboolean precise, Gray
 					start_nursery, end_nursery, PIN_TYPE_STACK);
 #endif
 		}
+
+		/* Each thread's pointers are sorted separately, see sgen-pinning.c */
+		sgen_pin_stage_end_run ();
 	} END_FOREACH_THREAD
 }
 
@@ -3878,6 +4094,7 @@ sgen_thread_register (SgenThreadInfo* info, void *addr)
 	info->signal = 0;
 #endif
 	info->skip = 0;
+	info->pinned_alloc_blocks = NULL;
 	info->stack_start = NULL;
 	info->stopped_ip = NULL;
 	info->stopped_domain = NULL;
@@ -3927,6 +4144,15 @@ sgen_thread_detach (SgenThreadInfo *p)
 	 */
 	if (mono_domain_get ())
 		mono_thread_detach_internal (mono_thread_internal_current ());
+
+	/*
+	 * We can't take the GC lock in sgen_thread_unregister (), which
+	 * runs with the suspend lock held, so the thread's pinned blocks
+	 * go back to the major heap here.
+	 */
+	LOCK_GC;
+	major_collector.release_thread_pinned_blocks (p);
+	UNLOCK_GC;
 }
 
 static void
@@ -3947,6 +4173,12 @@ sgen_thread_unregister (SgenThreadInfo *p)
 	if (p->info.runtime_thread)
 		mono_threads_add_joinable_thread ((gpointer)tid);
 
+	/*
+	 * Blocks the thread took since it was detached are only missing
+	 * from the free lists until the next major collection sweeps.
+	 */
+	major_collector.free_thread_pinned_blocks (p);
+
 	if (gc_callbacks.thread_detach_func) {
 		gc_callbacks.thread_detach_func (p->runtime_data);
 		p->runtime_data = NULL;
@@ -4615,6 +4847,19 @@ parse_double_in_interval (const char *env_var, const char *opt_name, const char
 	return TRUE;
 }
 
+/*
+ * Called at runtime shutdown, once no more collections can happen.
+ */
+void
+mono_gc_base_cleanup (void)
+{
+	LOCK_GC;
+	/* The workers are busy until the concurrent collection is finished, leave them alone */
+	if (!concurrent_collection_in_progress)
+		sgen_workers_shutdown ();
+	UNLOCK_GC;
+}
+
 void
 mono_gc_base_init (void)
 {
@@ -4629,8 +4874,10 @@ mono_gc_base_init (void)
 	int dummy;
 	gboolean debug_print_allowance = FALSE;
 	double allowance_ratio = 0, save_target = 0;
+	int decommit_after = -1;
 	gboolean have_split_nursery = FALSE;
 	gboolean cement_enabled = TRUE;
+	int num_workers = MIN (mono_cpu_count (), SGEN_MAX_WORKERS);
 
 	mono_counters_init ();
 
@@ -4672,6 +4919,7 @@ mono_gc_base_init (void)
 	mono_threads_init (&cb, sizeof (SgenThreadInfo));
 
 	LOCK_INIT (sgen_interruption_mutex);
+	LOCK_INIT (par_collection_mutex);
 
 	if ((env = g_getenv (MONO_GC_PARAMS_NAME))) {
 		opts = g_strsplit (env, ",", -1);
@@ -4692,7 +4940,11 @@ mono_gc_base_init (void)
 	init_stats ();
 	sgen_init_internal_allocator ();
 	sgen_init_nursery_allocator ();
+	sgen_init_allocator ();
 	sgen_init_fin_weak_hash ();
+	sgen_init_pin_queue_counters ();
+	sgen_init_los ();
+	sgen_init_bridge ();
 	sgen_init_stw ();
 	sgen_init_hash_table ();
 	sgen_init_descriptors ();
@@ -4730,11 +4982,13 @@ mono_gc_base_init (void)
 	mono_thread_info_attach (&dummy);
 
 	if (!minor_collector_opt) {
-		sgen_simple_nursery_init (&sgen_minor_collector);
+		sgen_simple_nursery_init (&sgen_minor_collector, FALSE);
 	} else {
 		if (!strcmp (minor_collector_opt, "simple")) {
 		use_simple_nursery:
-			sgen_simple_nursery_init (&sgen_minor_collector);
+			sgen_simple_nursery_init (&sgen_minor_collector, FALSE);
+		} else if (!strcmp (minor_collector_opt, "simple-par")) {
+			sgen_simple_nursery_init (&sgen_minor_collector, TRUE);
 		} else if (!strcmp (minor_collector_opt, "split")) {
 			sgen_split_nursery_init (&sgen_minor_collector);
 			have_split_nursery = TRUE;
@@ -4749,13 +5003,27 @@ mono_gc_base_init (void)
 		sgen_marksweep_init (&major_collector);
 	} else if (!major_collector_opt || !strcmp (major_collector_opt, "marksweep-conc")) {
 		sgen_marksweep_conc_init (&major_collector);
+	} else if (!strcmp (major_collector_opt, "marksweep-par")) {
+		if (have_split_nursery) {
+			sgen_env_var_error (MONO_GC_PARAMS_NAME, "Using `marksweep` instead.", "The `marksweep-par` major collector doesn't work with the `split` minor collector.");
+			goto use_marksweep_major;
+		}
+		sgen_marksweep_par_init (&major_collector);
 	} else {
 		sgen_env_var_error (MONO_GC_PARAMS_NAME, "Using `marksweep` instead.", "Unknown major collector `%s'.", major_collector_opt);
 		goto use_marksweep_major;
 	}
 
-	///* Keep this the default for now */
-	/* Precise marking is broken on all supported targets. Disable until fixed. */
+	if (sgen_minor_collector.is_parallel && (major_collector.is_concurrent || !major_collector.par_alloc_object)) {
+		sgen_env_var_error (MONO_GC_PARAMS_NAME, "Using `simple` instead.", "The `simple-par` minor collector only works with the non-concurrent `marksweep` major collector.");
+		sgen_simple_nursery_init (&sgen_minor_collector, FALSE);
+	}
+
+	/*
+	 * Precise marking needs GC maps from the JIT, which are only
+	 * emitted on amd64, and even there it has to be asked for with
+	 * `stack-mark=precise`.
+	 */
 	conservative_stack_mark = TRUE;
 
 	sgen_nursery_size = DEFAULT_NURSERY_SIZE;
@@ -4848,6 +5116,108 @@ mono_gc_base_init (void)
 				continue;
 			}
 #endif
+			if (g_str_has_prefix (opt, "max-pause=")) {
+				double val;
+				char *endptr;
+				opt = strchr (opt, '=') + 1;
+				val = strtod (opt, &endptr);
+				if (endptr != opt && (!*endptr || !strcmp (endptr, "ms"))) {
+					if (val <= 0 || val > 10000) {
+						sgen_env_var_error (MONO_GC_PARAMS_NAME, "Ignoring.", "`max-pause` must be more than 0 and at most 10000 milliseconds.");
+						continue;
+					}
+					sgen_nursery_max_pause = (gint64)(val * 10000);
+				} else {
+					sgen_env_var_error (MONO_GC_PARAMS_NAME, "Ignoring.", "`max-pause` must be a number of milliseconds.");
+				}
+				continue;
+			}
+			if (g_str_has_prefix (opt, "concurrent-max-pause=")) {
+				double val;
+				char *endptr;
+				opt = strchr (opt, '=') + 1;
+				val = strtod (opt, &endptr);
+				if (endptr != opt && (!*endptr || !strcmp (endptr, "ms"))) {
+					if (val <= 0 || val > 10000) {
+						sgen_env_var_error (MONO_GC_PARAMS_NAME, "Ignoring.", "`concurrent-max-pause` must be more than 0 and at most 10000 milliseconds.");
+						continue;
+					}
+					if (!major_collector.is_concurrent) {
+						sgen_env_var_error (MONO_GC_PARAMS_NAME, "Ignoring.", "`concurrent-max-pause` only works with the `marksweep-conc` major collector.");
+						continue;
+					}
+					concurrent_max_pause = (gint64)(val * 10000);
+				} else {
+					sgen_env_var_error (MONO_GC_PARAMS_NAME, "Ignoring.", "`concurrent-max-pause` must be a number of milliseconds.");
+				}
+				continue;
+			}
+			if (g_str_has_prefix (opt, "min-tlab-size=")) {
+				size_t val;
+				opt = strchr (opt, '=') + 1;
+				if (*opt && mono_gc_parse_environment_string_extract_number (opt, &val)) {
+					if (val < SGEN_MIN_TLAB_SIZE_LIMIT || val > SGEN_MAX_TLAB_SIZE_LIMIT) {
+						sgen_env_var_error (MONO_GC_PARAMS_NAME, "Using default value.",
+								"`min-tlab-size` must be between %d and %d bytes.", SGEN_MIN_TLAB_SIZE_LIMIT, SGEN_MAX_TLAB_SIZE_LIMIT);
+						continue;
+					}
+					min_tlab_size = SGEN_ALIGN_UP (val);
+				} else {
+					sgen_env_var_error (MONO_GC_PARAMS_NAME, "Using default value.", "`min-tlab-size` must be an integer.");
+				}
+				continue;
+			}
+			if (g_str_has_prefix (opt, "max-tlab-size=")) {
+				size_t val;
+				opt = strchr (opt, '=') + 1;
+				if (*opt && mono_gc_parse_environment_string_extract_number (opt, &val)) {
+					if (val < SGEN_MIN_TLAB_SIZE_LIMIT || val > SGEN_MAX_TLAB_SIZE_LIMIT) {
+						sgen_env_var_error (MONO_GC_PARAMS_NAME, "Using default value.",
+								"`max-tlab-size` must be between %d and %d bytes.", SGEN_MIN_TLAB_SIZE_LIMIT, SGEN_MAX_TLAB_SIZE_LIMIT);
+						continue;
+					}
+					max_tlab_size = SGEN_ALIGN_UP (val);
+				} else {
+					sgen_env_var_error (MONO_GC_PARAMS_NAME, "Using default value.", "`max-tlab-size` must be an integer.");
+				}
+				continue;
+			}
+			if (g_str_has_prefix (opt, "workers=")) {
+				long val;
+				char *endptr;
+				if (!sgen_minor_collector.is_parallel && !major_collector.is_parallel) {
+					sgen_env_var_error (MONO_GC_PARAMS_NAME, "Ignoring.", "`workers` is only valid for the `simple-par` minor and `marksweep-par` major collectors.");
+					continue;
+				}
+				opt = strchr (opt, '=') + 1;
+				val = strtol (opt, &endptr, 10);
+				if (!*opt || *endptr) {
+					sgen_env_var_error (MONO_GC_PARAMS_NAME, "Using default value.", "`workers` must be an integer.");
+					continue;
+				}
+				if (val < 1 || val > SGEN_MAX_WORKERS) {
+					sgen_env_var_error (MONO_GC_PARAMS_NAME, "Using default value.", "`workers` must be between 1 and %d.", SGEN_MAX_WORKERS);
+					continue;
+				}
+				num_workers = val;
+				continue;
+			}
+			if (g_str_has_prefix (opt, "decommit-after=")) {
+				long val;
+				char *endptr;
+				opt = strchr (opt, '=') + 1;
+				val = strtol (opt, &endptr, 10);
+				if (!*opt || *endptr) {
+					sgen_env_var_error (MONO_GC_PARAMS_NAME, "Using default value.", "`decommit-after` must be an integer.");
+					continue;
+				}
+				if (val < 0 || val > SGEN_MAX_DECOMMIT_DELAY) {
+					sgen_env_var_error (MONO_GC_PARAMS_NAME, "Using default value.", "`decommit-after` must be between 0 and %d.", SGEN_MAX_DECOMMIT_DELAY);
+					continue;
+				}
+				decommit_after = val;
+				continue;
+			}
 			if (g_str_has_prefix (opt, "save-target-ratio=")) {
 				double val;
 				opt = strchr (opt, '=') + 1;
@@ -4908,13 +5278,20 @@ mono_gc_base_init (void)
 			fprintf (stderr, "  max-heap-size=N (where N is an integer, possibly with a k, m or a g suffix)\n");
 			fprintf (stderr, "  soft-heap-limit=n (where N is an integer, possibly with a k, m or a g suffix)\n");
 			fprintf (stderr, "  nursery-size=N (where N is an integer, possibly with a k, m or a g suffix)\n");
+			fprintf (stderr, "  max-pause=T (where T is the pause time goal for nursery collections in milliseconds, e.g. 10ms)\n");
+			fprintf (stderr, "  concurrent-max-pause=T (where T is the pause time goal for concurrent major collections in milliseconds)\n");
+			fprintf (stderr, "  min-tlab-size=N (where N is an integer, possibly with a k or m suffix)\n");
+			fprintf (stderr, "  max-tlab-size=N (where N is an integer, possibly with a k or m suffix)\n");
 			fprintf (stderr, "  major=COLLECTOR (where COLLECTOR is `marksweep', `marksweep-conc', `marksweep-par')\n");
-			fprintf (stderr, "  minor=COLLECTOR (where COLLECTOR is `simple' or `split')\n");
+			fprintf (stderr, "  minor=COLLECTOR (where COLLECTOR is `simple', `simple-par' or `split')\n");
 			fprintf (stderr, "  wbarrier=WBARRIER (where WBARRIER is `remset' or `cardtable')\n");
 			fprintf (stderr, "  stack-mark=MARK-METHOD (where MARK-METHOD is 'precise' or 'conservative')\n");
 			fprintf (stderr, "  [no-]cementing\n");
 			if (major_collector.is_concurrent)
 				fprintf (stderr, "  allow-synchronous-major=FLAG (where FLAG is `yes' or `no')\n");
+			if (sgen_minor_collector.is_parallel || major_collector.is_parallel)
+				fprintf (stderr, "  workers=N (where N is the number of parallel collection threads, between 1 and %d)\n", SGEN_MAX_WORKERS);
+			fprintf (stderr, "  decommit-after=N (where N is the number of major collections, between 0 and %d)\n", SGEN_MAX_DECOMMIT_DELAY);
 			if (major_collector.print_gc_param_usage)
 				major_collector.print_gc_param_usage ();
 			if (sgen_minor_collector.print_gc_param_usage)
@@ -4929,8 +5306,16 @@ mono_gc_base_init (void)
 		g_strfreev (opts);
 	}
 
+	if (min_tlab_size > max_tlab_size) {
+		sgen_env_var_error (MONO_GC_PARAMS_NAME, "Using default values.", "`min-tlab-size` must not be larger than `max-tlab-size`.");
+		min_tlab_size = SGEN_DEFAULT_MIN_TLAB_SIZE;
+		max_tlab_size = SGEN_DEFAULT_MAX_TLAB_SIZE;
+	}
+
 	if (major_collector.is_concurrent)
 		sgen_workers_init (1);
+	else if (sgen_minor_collector.is_parallel || major_collector.is_parallel)
+		sgen_workers_init (num_workers);
 
 	if (major_collector_opt)
 		g_free (major_collector_opt);
@@ -5092,7 +5477,7 @@ mono_gc_base_init (void)
 	if (major_collector.post_param_init)
 		major_collector.post_param_init (&major_collector);
 
-	sgen_memgov_init (max_heap, soft_limit, debug_print_allowance, allowance_ratio, save_target);
+	sgen_memgov_init (max_heap, soft_limit, debug_print_allowance, allowance_ratio, save_target, decommit_after);
 
 	memset (&remset, 0, sizeof (remset));
 
@@ -5370,9 +5755,9 @@ sgen_major_collector_iterate_live_block_ranges (sgen_cardtable_block_callback ca
 }
 
 void
-sgen_major_collector_scan_card_table (SgenGrayQueue *queue)
+sgen_major_collector_scan_card_table (int job_index, int job_split_count, SgenGrayQueue *queue)
 {
-	major_collector.scan_card_table (FALSE, queue);
+	major_collector.scan_card_table (FALSE, job_index, job_split_count, queue);
 }
 
 SgenMajorCollector*
@@ -101,6 +101,23 @@ struct _SgenThreadInfo {
 	char **tlab_real_end_addr;
 	gpointer runtime_data;
 
+	/*
+	 * The size of the TLABs this thread allocates, and what it did
+	 * with them since the last collection.  Only the thread itself
+	 * modifies these while the world is running.
+	 */
+	size_t tlab_size;
+	size_t tlab_bytes_allocated;
+	size_t tlab_bytes_wasted;
+	guint32 tlab_refills;
+
+	/*
+	 * The major collector's blocks this thread allocates small
+	 * pinned objects from without taking the GC lock.  Owned by the
+	 * major collector, which hands them back at every stop-the-world.
+	 */
+	gpointer pinned_alloc_blocks;
+
 #ifdef SGEN_POSIX_STW
 	/* This is -1 until the first suspend. */
 	int signal;
@@ -276,6 +293,14 @@ extern int sgen_nursery_bits MONO_INTERNAL;
 extern char *sgen_nursery_start MONO_INTERNAL;
 extern char *sgen_nursery_end MONO_INTERNAL;
 
+/* The pause time goal for nursery collections in 100ns ticks, 0 if there is none */
+extern gint64 sgen_nursery_max_pause MONO_INTERNAL;
+/*
+ * Bytes copied by the current collection, see sgen_nursery_adapt_size ().
+ * Only counted if there is a pause time goal.
+ */
+extern mword sgen_bytes_copied MONO_INTERNAL;
+
 static inline MONO_ALWAYS_INLINE gboolean
 sgen_ptr_in_nursery (void *p)
 {
@@ -444,6 +469,7 @@ enum {
 	INTERNAL_MEM_JOB_QUEUE_ENTRY,
 	INTERNAL_MEM_TOGGLEREF_DATA,
 	INTERNAL_MEM_CARDTABLE_MOD_UNION,
+	INTERNAL_MEM_LOS_INDEX,
 	INTERNAL_MEM_BINARY_PROTOCOL,
 	INTERNAL_MEM_TEMPORARY,
 	INTERNAL_MEM_MAX
@@ -504,6 +530,7 @@ void sgen_add_to_global_remset (gpointer ptr, gpointer obj) MONO_INTERNAL;
 
 int sgen_get_current_collection_generation (void) MONO_INTERNAL;
 gboolean sgen_collection_is_concurrent (void) MONO_INTERNAL;
+gboolean sgen_collection_is_parallel (void) MONO_INTERNAL;
 gboolean sgen_concurrent_collection_in_progress (void) MONO_INTERNAL;
 
 typedef struct {
@@ -597,10 +624,12 @@ sgen_nursery_is_object_alive (char *obj)
 
 typedef struct {
 	gboolean is_split;
+	gboolean is_parallel;
 
 	char* (*alloc_for_promotion) (MonoVTable *vtable, char *obj, size_t objsize, gboolean has_references);
 
 	SgenObjectOperations serial_ops;
+	SgenObjectOperations parallel_ops; /* Only filled in if is_parallel */
 
 	void (*prepare_to_space) (char *to_space_bitmap, size_t space_bitmap_size);
 	void (*clear_fragments) (void);
@@ -615,7 +644,7 @@ typedef struct {
 
 extern SgenMinorCollector sgen_minor_collector;
 
-void sgen_simple_nursery_init (SgenMinorCollector *collector) MONO_INTERNAL;
+void sgen_simple_nursery_init (SgenMinorCollector *collector, gboolean parallel) MONO_INTERNAL;
 void sgen_split_nursery_init (SgenMinorCollector *collector) MONO_INTERNAL;
 
 /* Updating references */
@@ -626,7 +655,7 @@ sgen_update_reference (void **p, void *o, gboolean allow_null)
 {
 	if (!allow_null)
 		SGEN_ASSERT (0, o, "Cannot update a reference with a NULL pointer");
-	SGEN_ASSERT (0, !sgen_is_worker_thread (mono_native_thread_id_get ()), "Can't update a reference in the worker thread");
+	SGEN_ASSERT (0, sgen_collection_is_parallel () || !sgen_is_worker_thread (mono_native_thread_id_get ()), "Can't update a reference in the worker thread");
 	*p = o;
 }
 
@@ -662,6 +691,7 @@ typedef struct _SgenMajorCollector SgenMajorCollector;
 struct _SgenMajorCollector {
 	size_t section_size;
 	gboolean is_concurrent;
+	gboolean is_parallel;
 	gboolean supports_cardtable;
 	gboolean sweeps_lazily;
 
@@ -680,19 +710,34 @@ struct _SgenMajorCollector {
 	void* (*alloc_heap) (mword nursery_size, mword nursery_align, int nursery_bits);
 	gboolean (*is_object_live) (char *obj);
 	void* (*alloc_small_pinned_obj) (MonoVTable *vtable, size_t size, gboolean has_references);
+	/*
+	 * Allocates from the thread's own pinned blocks without the GC
+	 * lock.  Must be called in a critical region.  Returns NULL if
+	 * the thread has no free slot of that size.
+	 */
+	void* (*try_alloc_small_pinned_obj) (SgenThreadInfo *info, MonoVTable *vtable, size_t size, gboolean has_references);
+	/* Gives the thread's pinned blocks back.  Called with the world stopped or by the thread itself, with the GC lock held. */
+	void (*release_thread_pinned_blocks) (SgenThreadInfo *info);
+	/* Frees the thread's pinned block bookkeeping once it can't allocate anymore. */
+	void (*free_thread_pinned_blocks) (SgenThreadInfo *info);
 	void* (*alloc_degraded) (MonoVTable *vtable, size_t size);
 
 	SgenObjectOperations major_ops;
 	SgenObjectOperations major_concurrent_ops;
 
 	void* (*alloc_object) (MonoVTable *vtable, size_t size, gboolean has_references);
+	/*
+	 * Like alloc_object, but can be called from several worker
+	 * threads at the same time.  The vtable is not stored.
+	 */
+	void* (*par_alloc_object) (MonoVTable *vtable, size_t size, gboolean has_references);
 	void (*free_pinned_object) (char *obj, size_t size);
 	void (*iterate_objects) (IterateObjectsFlags flags, IterateObjectCallbackFunc callback, void *data);
 	void (*free_non_pinned_object) (char *obj, size_t size);
 	void (*find_pin_queue_start_ends) (SgenGrayQueue *queue);
 	void (*pin_objects) (SgenGrayQueue *queue);
 	void (*pin_major_object) (char *obj, SgenGrayQueue *queue);
-	void (*scan_card_table) (gboolean mod_union, SgenGrayQueue *queue);
+	void (*scan_card_table) (gboolean mod_union, int job_index, int job_split_count, SgenGrayQueue *queue);
 	void (*iterate_live_block_ranges) (sgen_cardtable_block_callback callback);
 	void (*update_cardtable_mod_union) (void);
 	void (*init_to_space) (void);
@@ -717,6 +762,7 @@ struct _SgenMajorCollector {
 	void* (*alloc_worker_data) (void);
 	void (*init_worker_thread) (void *data);
 	void (*reset_worker_data) (void *data);
+	void (*free_worker_data) (void *data);
 	gboolean (*is_valid_object) (char *object);
 	MonoVTable* (*describe_pointer) (char *pointer);
 	guint8* (*get_cardtable_mod_union_for_object) (char *object);
@@ -743,7 +789,8 @@ typedef struct _SgenRemeberedSet {
 	void (*wbarrier_generic_nostore) (gpointer ptr);
 	void (*record_pointer) (gpointer ptr);
 
-	void (*finish_scan_remsets) (void *start_nursery, void *end_nursery, SgenGrayQueue *queue);
+	void (*begin_scan_remsets) (void);
+	void (*finish_scan_remsets) (void *start_nursery, void *end_nursery, int job_index, int job_split_count, SgenGrayQueue *queue);
 
 	void (*prepare_for_major_collection) (void);
 
@@ -871,6 +918,7 @@ gboolean sgen_need_bridge_processing (void) MONO_INTERNAL;
 void sgen_bridge_reset_data (void) MONO_INTERNAL;
 void sgen_bridge_processing_stw_step (void) MONO_INTERNAL;
 void sgen_bridge_processing_finish (int generation) MONO_INTERNAL;
+void sgen_init_bridge (void) MONO_INTERNAL;
 void sgen_register_test_bridge_callbacks (const char *bridge_class_name) MONO_INTERNAL;
 gboolean sgen_is_bridge_object (MonoObject *obj) MONO_INTERNAL;
 MonoGCBridgeObjectKind sgen_bridge_class_kind (MonoClass *klass) MONO_INTERNAL;
@@ -990,21 +1038,25 @@ extern mword los_memory_usage;
 
 void sgen_los_free_object (LOSObject *obj) MONO_INTERNAL;
 void* sgen_los_alloc_large_inner (MonoVTable *vtable, size_t size) MONO_INTERNAL;
+void* sgen_los_try_alloc_large (MonoVTable *vtable, size_t size) MONO_INTERNAL;
 void sgen_los_sweep (void) MONO_INTERNAL;
 gboolean sgen_ptr_is_in_los (char *ptr, char **start) MONO_INTERNAL;
 void sgen_los_iterate_objects (IterateObjectCallbackFunc cb, void *user_data) MONO_INTERNAL;
 void sgen_los_iterate_live_block_ranges (sgen_cardtable_block_callback callback) MONO_INTERNAL;
-void sgen_los_scan_card_table (gboolean mod_union, SgenGrayQueue *queue) MONO_INTERNAL;
+void sgen_los_prepare_card_table_scan (int job_split_count) MONO_INTERNAL;
+void sgen_los_scan_card_table (gboolean mod_union, int job_index, int job_split_count, SgenGrayQueue *queue) MONO_INTERNAL;
 void sgen_los_update_cardtable_mod_union (void) MONO_INTERNAL;
 void sgen_los_count_cards (long long *num_total_cards, long long *num_marked_cards) MONO_INTERNAL;
-void sgen_major_collector_scan_card_table (SgenGrayQueue *queue) MONO_INTERNAL;
+void sgen_major_collector_scan_card_table (int job_index, int job_split_count, SgenGrayQueue *queue) MONO_INTERNAL;
 gboolean sgen_los_is_valid_object (char *object) MONO_INTERNAL;
 gboolean mono_sgen_los_describe_pointer (char *ptr) MONO_INTERNAL;
 LOSObject* sgen_los_header_for_object (char *data) MONO_INTERNAL;
 mword sgen_los_object_size (LOSObject *obj) MONO_INTERNAL;
 void sgen_los_pin_object (char *obj) MONO_INTERNAL;
+gboolean sgen_los_pin_object_par (char *obj) MONO_INTERNAL;
 void sgen_los_unpin_object (char *obj) MONO_INTERNAL;
 gboolean sgen_los_object_is_pinned (char *obj) MONO_INTERNAL;
+void sgen_init_los (void) MONO_INTERNAL;
 
 
 /* nursery allocator */
@@ -1016,9 +1068,12 @@ mword sgen_build_nursery_fragments (GCMemSection *nursery_section, SgenGrayQueue
 void sgen_init_nursery_allocator (void) MONO_INTERNAL;
 void sgen_nursery_allocator_init_heavy_stats (void) MONO_INTERNAL;
 void sgen_alloc_init_heavy_stats (void) MONO_INTERNAL;
+void sgen_init_allocator (void) MONO_INTERNAL;
 char* sgen_nursery_alloc_get_upper_alloc_bound (void) MONO_INTERNAL;
 void* sgen_nursery_alloc (size_t size) MONO_INTERNAL;
 void* sgen_nursery_alloc_range (size_t size, size_t min_size, size_t *out_alloc_size) MONO_INTERNAL;
+size_t sgen_nursery_get_active_size (void) MONO_INTERNAL;
+void sgen_nursery_adapt_size (gint64 pause, mword bytes_survived) MONO_INTERNAL;
 MonoVTable* sgen_get_array_fill_vtable (void) MONO_INTERNAL;
 gboolean sgen_can_alloc_size (size_t size) MONO_INTERNAL;
 void sgen_nursery_retire_region (void *address, ptrdiff_t size) MONO_INTERNAL;
@@ -1113,7 +1168,8 @@ extern guint32 verify_before_allocs;
 extern gboolean has_per_allocation_action;
 extern size_t degraded_mode;
 extern int default_nursery_size;
-extern guint32 tlab_size;
+extern guint32 min_tlab_size;
+extern guint32 max_tlab_size;
 extern NurseryClearPolicy nursery_clear_policy;
 extern gboolean sgen_try_free_some_memory;
 
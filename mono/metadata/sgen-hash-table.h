@@ -72,6 +72,42 @@ void sgen_init_hash_table (void) MONO_INTERNAL;
 		}							\
 	} while (0)
 
+/*
+ * Iterates over the entries in the Pth of N contiguous ranges of hash
+ * buckets.  Different partitions of the same table can be processed by
+ * different threads at the same time, as long as nothing else modifies
+ * the table.  The loop must not be left early.
+ */
+#define SGEN_HASH_TABLE_FOREACH_PARTITION(h,p,n,k,v) do {		\
+		SgenHashTable *__hash_table = (h);			\
+		SgenHashTableEntry **__table = __hash_table->table;	\
+		guint __i = (guint)(((guint64)__hash_table->size * (p)) / (n));	\
+		guint __end = (guint)(((guint64)__hash_table->size * ((p) + 1)) / (n));	\
+		gint32 __removed = 0;					\
+		for (; __i < __end; ++__i) {				\
+			SgenHashTableEntry **__iter, **__next;			\
+			for (__iter = &__table [__i]; *__iter; __iter = __next) {	\
+				SgenHashTableEntry *__entry = *__iter;	\
+				__next = &__entry->next;	\
+				(k) = __entry->key;			\
+				(v) = (gpointer)__entry->data;
+
+/* The loop must be continue'd after using this! */
+#define SGEN_HASH_TABLE_FOREACH_PARTITION_REMOVE(free)	do {		\
+		*__iter = *__next;	\
+		__next = __iter;	\
+		++__removed;						\
+		if ((free))						\
+			sgen_free_internal (__entry, __hash_table->entry_mem_type); \
+	} while (0)
+
+#define SGEN_HASH_TABLE_FOREACH_PARTITION_END				\
+			}						\
+		}							\
+		if (__removed)						\
+			InterlockedAdd ((volatile gint32*)&__hash_table->num_entries, -__removed); \
+	} while (0)
+
 #endif
 
 #endif
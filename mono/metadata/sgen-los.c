@@ -37,8 +37,10 @@
 #include "metadata/sgen-protocol.h"
 #include "metadata/sgen-cardtable.h"
 #include "metadata/sgen-memory-governor.h"
+#include "metadata/sgen-pointer-queue.h"
 #include "utils/mono-mmap.h"
 #include "utils/mono-compiler.h"
+#include "utils/mono-counters.h"
 
 #define LOS_SECTION_SIZE	(1024 * 1024)
 
@@ -57,11 +59,23 @@
 #define LOS_SECTION_FOR_OBJ(obj)	((LOSSection*)((mword)(obj) & ~(mword)(LOS_SECTION_SIZE - 1)))
 #define LOS_CHUNK_INDEX(obj,section)	(((char*)(obj) - (char*)(section)) >> LOS_CHUNK_BITS)
 
-#define LOS_NUM_FAST_SIZES		32
+/*
+ * Runs of free chunks are kept in doubly linked lists, one for each run
+ * length, so the list index is the number of chunks in the run.  A bit
+ * is set in the bitmap for every list that's not empty, so we can find
+ * the smallest run that fits a request with a short bitmap scan.
+ *
+ * Free runs are always maximal, i.e. they're coalesced with their
+ * neighbors as soon as chunks are freed.
+ */
+#define LOS_NUM_FREE_LISTS		(LOS_SECTION_NUM_CHUNKS + 1)
+#define LOS_BITS_PER_WORD		(sizeof (mword) * 8)
+#define LOS_FREE_LIST_BITMAP_WORDS	((LOS_NUM_FREE_LISTS + LOS_BITS_PER_WORD - 1) / LOS_BITS_PER_WORD)
 
 typedef struct _LOSFreeChunks LOSFreeChunks;
 struct _LOSFreeChunks {
 	LOSFreeChunks *next_size;
+	LOSFreeChunks *prev_size;
 	size_t size;
 };
 
@@ -72,18 +86,78 @@ struct _LOSSection {
 	unsigned char *free_chunk_map;
 };
 
+/*
+ * The free chunk map entry of a used chunk is zero.  For a free chunk it
+ * is LOS_CHUNK_FREE plus the number of major collections the chunk has
+ * stayed free for, or LOS_CHUNK_DECOMMITTED once we've given its memory
+ * back to the OS.
+ */
+#define LOS_CHUNK_FREE		1
+#define LOS_CHUNK_DECOMMITTED	255
+
 LOSObject *los_object_list = NULL;
 mword los_memory_usage = 0;
 
 static LOSSection *los_sections = NULL;
-static LOSFreeChunks *los_fast_free_lists [LOS_NUM_FAST_SIZES]; /* 0 is for larger sizes */
+static LOSFreeChunks *los_free_lists [LOS_NUM_FREE_LISTS]; /* 0 is unused */
+static mword los_free_list_bitmap [LOS_FREE_LIST_BITMAP_WORDS];
 static mword los_num_objects = 0;
 static int los_num_sections = 0;
+static int pagesize;
+
+/*
+ * All LOS objects, sorted by address, for looking up the object a
+ * pointer points into.  It's only rebuilt on a lookup after objects have
+ * been allocated or freed.
+ */
+static SgenPointerQueue los_object_index;
+static gboolean los_object_index_dirty = TRUE;
+
+/*
+ * The LOS objects with references, and the index of the first one
+ * each card table scan job scans.  Set up by
+ * sgen_los_prepare_card_table_scan ().
+ */
+static SgenPointerQueue los_scan_objects;
+static size_t *los_scan_job_starts = NULL;
+static int los_scan_job_split_count = 0;
 
 //#define USE_MALLOC
 //#define LOS_CONSISTENCY_CHECK
 //#define LOS_DUMMY
 
+/*
+ * Large objects freed by a collection are kept, up to
+ * LOS_CHUNK_CACHE_SIZE bytes, in a cache indexed by the number of
+ * chunks they occupy, so that allocations of the same size can claim
+ * them without the GC lock.  The cache is split into stripes to spread
+ * the contention between allocating threads, which pick a stripe by
+ * their small id and steal from the other stripes when theirs is empty.
+ *
+ * Runs are only pushed onto the cache while the world is stopped, and
+ * they're popped with a CAS inside a critical region, so no run can be
+ * popped and pushed again while another thread is popping it.  That
+ * makes the CAS safe from ABA.
+ *
+ * As far as its section is concerned a cached run is in use: its free
+ * chunk map entries are zero and it's not counted in `num_free_chunks`.
+ * Runs freed during a collection first go on the pending lists.  They
+ * only become the cache in the next sgen_los_sweep (), after the runs
+ * left over in the cache from the previous collection have gone back on
+ * the free lists, so a cached run keeps its section alive for at most
+ * one more major collection.
+ */
+#define LOS_CHUNK_CACHE_MAX_CHUNKS	32
+#define LOS_CHUNK_CACHE_STRIPES		8
+#define LOS_CHUNK_CACHE_SIZE		(4 * 1024 * 1024)
+
+static LOSFreeChunks *los_chunk_cache [LOS_CHUNK_CACHE_STRIPES][LOS_CHUNK_CACHE_MAX_CHUNKS + 1];
+static LOSFreeChunks *los_chunk_cache_pending [LOS_CHUNK_CACHE_MAX_CHUNKS + 1];
+static mword los_chunk_cache_pending_size = 0;
+
+static guint64 stat_los_chunk_cache_runs = 0;
+static guint64 stat_los_chunk_cache_runs_unused = 0;
+
 #ifdef LOS_DUMMY
 #define LOS_SEGMENT_SIZE	(4096 * 1024)
 
@@ -119,21 +193,25 @@ los_consistency_check (void)
 			g_assert (!section->free_chunk_map [i]);
 	}
 
-	for (i = 0; i < LOS_NUM_FAST_SIZES; ++i) {
+	for (i = 1; i < LOS_NUM_FREE_LISTS; ++i) {
 		LOSFreeChunks *size_chunks;
-		for (size_chunks = los_fast_free_lists [i]; size_chunks; size_chunks = size_chunks->next_size) {
+		gboolean bit = (los_free_list_bitmap [i / LOS_BITS_PER_WORD] >> (i % LOS_BITS_PER_WORD)) & 1;
+
+		g_assert (bit == (los_free_lists [i] != NULL));
+
+		for (size_chunks = los_free_lists [i]; size_chunks; size_chunks = size_chunks->next_size) {
 			LOSSection *section = LOS_SECTION_FOR_OBJ (size_chunks);
 			int j, num_chunks, start_index;
 
-			if (i == 0)
-				g_assert (size_chunks->size >= LOS_NUM_FAST_SIZES * LOS_CHUNK_SIZE);
-			else
-				g_assert (size_chunks->size == i * LOS_CHUNK_SIZE);
+			g_assert (size_chunks->size == i * LOS_CHUNK_SIZE);
+			g_assert (!size_chunks->next_size || size_chunks->next_size->prev_size == size_chunks);
 
 			num_chunks = size_chunks->size >> LOS_CHUNK_BITS;
 			start_index = LOS_CHUNK_INDEX (size_chunks, section);
+			g_assert (!section->free_chunk_map [start_index - 1]);
 			for (j = start_index; j < start_index + num_chunks; ++j)
 				g_assert (section->free_chunk_map [j]);
+			g_assert (start_index + num_chunks > LOS_SECTION_NUM_CHUNKS || !section->free_chunk_map [start_index + num_chunks]);
 		}
 	}
 
@@ -146,46 +224,106 @@ add_free_chunk (LOSFreeChunks *free_chunks, size_t size)
 {
 	size_t num_chunks = size >> LOS_CHUNK_BITS;
 
+	SGEN_ASSERT (9, num_chunks > 0 && num_chunks < LOS_NUM_FREE_LISTS, "Free run of %zd chunks is too large", num_chunks);
+
 	free_chunks->size = size;
+	free_chunks->prev_size = NULL;
+	free_chunks->next_size = los_free_lists [num_chunks];
+	if (free_chunks->next_size)
+		free_chunks->next_size->prev_size = free_chunks;
+	los_free_lists [num_chunks] = free_chunks;
 
-	if (num_chunks >= LOS_NUM_FAST_SIZES)
-		num_chunks = 0;
-	free_chunks->next_size = los_fast_free_lists [num_chunks];
-	los_fast_free_lists [num_chunks] = free_chunks;
+	los_free_list_bitmap [num_chunks / LOS_BITS_PER_WORD] |= (mword)1 << (num_chunks % LOS_BITS_PER_WORD);
 }
 
-static LOSFreeChunks*
-get_from_size_list (LOSFreeChunks **list, size_t size)
+static void
+remove_free_chunk (LOSFreeChunks *free_chunks)
 {
-	LOSFreeChunks *free_chunks = NULL;
-	LOSSection *section;
-	size_t i, num_chunks, start_index;
+	size_t num_chunks = free_chunks->size >> LOS_CHUNK_BITS;
 
+	if (free_chunks->prev_size) {
+		free_chunks->prev_size->next_size = free_chunks->next_size;
+	} else {
+		SGEN_ASSERT (9, los_free_lists [num_chunks] == free_chunks, "Free run is not in its list");
+		los_free_lists [num_chunks] = free_chunks->next_size;
+		if (!free_chunks->next_size)
+			los_free_list_bitmap [num_chunks / LOS_BITS_PER_WORD] &= ~((mword)1 << (num_chunks % LOS_BITS_PER_WORD));
+	}
+	if (free_chunks->next_size)
+		free_chunks->next_size->prev_size = free_chunks->prev_size;
+}
 
-	g_assert ((size & (LOS_CHUNK_SIZE - 1)) == 0);
+/*
+ * Returns the index of the first non-empty free list for runs of at
+ * least `num_chunks` chunks, or 0 if there is none.
+ */
+static size_t
+find_free_list (size_t num_chunks)
+{
+	size_t word_index = num_chunks / LOS_BITS_PER_WORD;
+	mword word = los_free_list_bitmap [word_index] & ~(((mword)1 << (num_chunks % LOS_BITS_PER_WORD)) - 1);
 
-	while (*list) {
-		free_chunks = *list;
-		if (free_chunks->size >= size)
-			break;
-		list = &(*list)->next_size;
+	for (;;) {
+		if (word) {
+#ifdef GNUC_BUILTIN_CTZ
+			return word_index * LOS_BITS_PER_WORD + GNUC_BUILTIN_CTZ (word);
+#else
+			size_t bit = 0;
+			while (!(word & ((mword)1 << bit)))
+				++bit;
+			return word_index * LOS_BITS_PER_WORD + bit;
+#endif
+		}
+		if (++word_index == LOS_FREE_LIST_BITMAP_WORDS)
+			return 0;
+		word = los_free_list_bitmap [word_index];
 	}
+}
 
-	if (!*list)
-		return NULL;
+/* Must be called before a free chunk is written to. */
+static void
+recommit_chunk (LOSSection *section, size_t index)
+{
+	if (section->free_chunk_map [index] == LOS_CHUNK_DECOMMITTED) {
+		sgen_recommit_os_memory ((char*)section + (index << LOS_CHUNK_BITS), LOS_CHUNK_SIZE);
+		section->free_chunk_map [index] = LOS_CHUNK_FREE;
+	}
+}
 
-	*list = free_chunks->next_size;
+/*
+ * Takes `size` bytes from the smallest free run that's large enough and
+ * puts the rest of the run back on the free lists.
+ */
+static LOSFreeChunks*
+get_from_free_lists (size_t size)
+{
+	LOSFreeChunks *free_chunks;
+	LOSSection *section;
+	size_t i, num_chunks, start_index, list_index;
 
-	if (free_chunks->size > size)
-		add_free_chunk ((LOSFreeChunks*)((char*)free_chunks + size), free_chunks->size - size);
+	g_assert ((size & (LOS_CHUNK_SIZE - 1)) == 0);
 
 	num_chunks = size >> LOS_CHUNK_BITS;
 
+	list_index = find_free_list (num_chunks);
+	if (!list_index)
+		return NULL;
+
+	free_chunks = los_free_lists [list_index];
+	remove_free_chunk (free_chunks);
+
 	section = LOS_SECTION_FOR_OBJ (free_chunks);
 
 	start_index = LOS_CHUNK_INDEX (free_chunks, section);
+
+	if (free_chunks->size > size) {
+		recommit_chunk (section, start_index + num_chunks);
+		add_free_chunk ((LOSFreeChunks*)((char*)free_chunks + size), free_chunks->size - size);
+	}
+
 	for (i = start_index; i < start_index + num_chunks; ++i) {
 		g_assert (section->free_chunk_map [i]);
+		recommit_chunk (section, i);
 		section->free_chunk_map [i] = 0;
 	}
 
@@ -211,19 +349,7 @@ get_los_section_memory (size_t size)
 	g_assert (num_chunks > 0);
 
  retry:
-	if (num_chunks >= LOS_NUM_FAST_SIZES) {
-		free_chunks = get_from_size_list (&los_fast_free_lists [0], size);
-	} else {
-		size_t i;
-		for (i = num_chunks; i < LOS_NUM_FAST_SIZES; ++i) {
-			free_chunks = get_from_size_list (&los_fast_free_lists [i], size);
-			if (free_chunks)
-				break;
-		}
-		if (!free_chunks)
-			free_chunks = get_from_size_list (&los_fast_free_lists [0], size);
-	}
-
+	free_chunks = get_from_free_lists (size);
 	if (free_chunks)
 		return (LOSObject*)free_chunks;
 
@@ -235,17 +361,14 @@ get_los_section_memory (size_t size)
 	if (!section)
 		return NULL;
 
-	free_chunks = (LOSFreeChunks*)((char*)section + LOS_CHUNK_SIZE);
-	free_chunks->size = LOS_SECTION_SIZE - LOS_CHUNK_SIZE;
-	free_chunks->next_size = los_fast_free_lists [0];
-	los_fast_free_lists [0] = free_chunks;
+	add_free_chunk ((LOSFreeChunks*)((char*)section + LOS_CHUNK_SIZE), LOS_SECTION_SIZE - LOS_CHUNK_SIZE);
 
 	section->num_free_chunks = LOS_SECTION_NUM_CHUNKS;
 
 	section->free_chunk_map = (unsigned char*)section + sizeof (LOSSection);
 	g_assert (sizeof (LOSSection) + LOS_SECTION_NUM_CHUNKS + 1 <= LOS_CHUNK_SIZE);
 	section->free_chunk_map [0] = 0;
-	memset (section->free_chunk_map + 1, 1, LOS_SECTION_NUM_CHUNKS);
+	memset (section->free_chunk_map + 1, LOS_CHUNK_FREE, LOS_SECTION_NUM_CHUNKS);
 
 	section->next = los_sections;
 	los_sections = section;
@@ -259,7 +382,7 @@ static void
 free_los_section_memory (LOSObject *obj, size_t size)
 {
 	LOSSection *section = LOS_SECTION_FOR_OBJ (obj);
-	size_t num_chunks, i, start_index;
+	size_t num_chunks, i, start_index, end_index;
 
 	size += LOS_CHUNK_SIZE - 1;
 	size &= ~(LOS_CHUNK_SIZE - 1);
@@ -274,20 +397,129 @@ free_los_section_memory (LOSObject *obj, size_t size)
 
 	/*
 	 * We could free the LOS section here if it's empty, but we
-	 * can't unless we also remove its free chunks from the fast
-	 * free lists.  Instead, we do it in los_sweep().
+	 * keep it around until los_sweep() so that we don't map and
+	 * unmap sections all the time.
 	 */
 
 	start_index = LOS_CHUNK_INDEX (obj, section);
 	for (i = start_index; i < start_index + num_chunks; ++i) {
 		g_assert (!section->free_chunk_map [i]);
-		section->free_chunk_map [i] = 1;
+		section->free_chunk_map [i] = LOS_CHUNK_FREE;
+	}
+
+	/* Coalesce with the free run following us, which must start right after us. */
+	end_index = start_index + num_chunks;
+	if (end_index <= LOS_SECTION_NUM_CHUNKS && section->free_chunk_map [end_index]) {
+		LOSFreeChunks *next = (LOSFreeChunks*)((char*)section + (end_index << LOS_CHUNK_BITS));
+		remove_free_chunk (next);
+		size += next->size;
+	}
+
+	/*
+	 * Coalesce with the free run preceding us.  The first chunk holds
+	 * the section header and is never free, so this terminates.
+	 */
+	if (section->free_chunk_map [start_index - 1]) {
+		LOSFreeChunks *prev;
+		do {
+			--start_index;
+		} while (section->free_chunk_map [start_index - 1]);
+		prev = (LOSFreeChunks*)((char*)section + (start_index << LOS_CHUNK_BITS));
+		remove_free_chunk (prev);
+		size += prev->size;
+		obj = (LOSObject*)prev;
 	}
 
 	add_free_chunk ((LOSFreeChunks*)obj, size);
 }
 
-static int pagesize;
+/*
+ * Puts the run of a freed object on the pending lists, if it's small
+ * enough and there's room.
+ *
+ * LOCKING: requires the world to be stopped.
+ */
+static gboolean
+cache_freed_run (LOSObject *obj, size_t size)
+{
+	LOSFreeChunks *run = (LOSFreeChunks*)obj;
+	size_t num_chunks;
+
+	size += LOS_CHUNK_SIZE - 1;
+	size &= ~(LOS_CHUNK_SIZE - 1);
+
+	num_chunks = size >> LOS_CHUNK_BITS;
+	if (num_chunks > LOS_CHUNK_CACHE_MAX_CHUNKS || los_chunk_cache_pending_size + size > LOS_CHUNK_CACHE_SIZE)
+		return FALSE;
+
+	run->size = size;
+	run->prev_size = NULL;
+	run->next_size = los_chunk_cache_pending [num_chunks];
+	los_chunk_cache_pending [num_chunks] = run;
+	los_chunk_cache_pending_size += size;
+
+	return TRUE;
+}
+
+/*
+ * Puts the runs left over in the cache back on the free lists and makes
+ * the pending runs the new cache.
+ *
+ * LOCKING: requires the world to be stopped.
+ */
+static void
+refill_chunk_cache (void)
+{
+	size_t i, j, stripe = 0;
+
+	for (i = 0; i < LOS_CHUNK_CACHE_STRIPES; ++i) {
+		for (j = 1; j <= LOS_CHUNK_CACHE_MAX_CHUNKS; ++j) {
+			LOSFreeChunks *run = los_chunk_cache [i][j];
+			while (run) {
+				LOSFreeChunks *next = run->next_size;
+				free_los_section_memory ((LOSObject*)run, run->size);
+				++stat_los_chunk_cache_runs_unused;
+				run = next;
+			}
+			los_chunk_cache [i][j] = NULL;
+		}
+	}
+
+	/* Deal the pending runs out to the stripes. */
+	for (j = 1; j <= LOS_CHUNK_CACHE_MAX_CHUNKS; ++j) {
+		LOSFreeChunks *run = los_chunk_cache_pending [j];
+		while (run) {
+			LOSFreeChunks *next = run->next_size;
+			run->next_size = los_chunk_cache [stripe][j];
+			los_chunk_cache [stripe][j] = run;
+			stripe = (stripe + 1) % LOS_CHUNK_CACHE_STRIPES;
+			++stat_los_chunk_cache_runs;
+			run = next;
+		}
+		los_chunk_cache_pending [j] = NULL;
+	}
+	los_chunk_cache_pending_size = 0;
+}
+
+/*
+ * Links a newly allocated object into the object list.  The lock-free
+ * allocation path does this concurrently with the locked one.  Objects
+ * are only unlinked while the world is stopped.
+ */
+static void
+add_los_object (LOSObject *obj, size_t size)
+{
+	LOSObject *next;
+
+	sgen_update_heap_boundaries ((mword)obj->data, (mword)obj->data + size);
+	do {
+		next = los_object_list;
+		obj->next = next;
+	} while (SGEN_CAS_PTR ((gpointer*)&los_object_list, obj, next) != next);
+	SGEN_ATOMIC_ADD_P (los_memory_usage, size);
+	SGEN_ATOMIC_ADD_P (los_num_objects, 1);
+	los_object_index_dirty = TRUE;
+}
 
 void
 sgen_los_free_object (LOSObject *obj)
@@ -299,6 +531,7 @@ sgen_los_free_object (LOSObject *obj)
 
 	los_memory_usage -= size;
 	los_num_objects--;
+	los_object_index_dirty = TRUE;
 
 #ifdef USE_MALLOC
 	free (obj);
@@ -311,7 +544,7 @@ sgen_los_free_object (LOSObject *obj)
 		size &= ~(pagesize - 1);
 		sgen_free_os_memory (obj, size, SGEN_ALLOC_HEAP);
 		sgen_memgov_release_space (size, SPACE_LOS);
-	} else {
+	} else if (!cache_freed_run (obj, size + sizeof (LOSObject))) {
 		free_los_section_memory (obj, size + sizeof (LOSObject));
 #ifdef LOS_CONSISTENCY_CHECKS
 		los_consistency_check ();
@@ -384,11 +617,7 @@ sgen_los_alloc_large_inner (MonoVTable *vtable, size_t size)
 	obj->size = size;
 	vtslot = (void**)obj->data;
 	*vtslot = vtable;
-	sgen_update_heap_boundaries ((mword)obj->data, (mword)obj->data + size);
-	obj->next = los_object_list;
-	los_object_list = obj;
-	los_memory_usage += size;
-	los_num_objects++;
+	add_los_object (obj, size);
 	SGEN_LOG (4, "Allocated large object %p, vtable: %p (%s), size: %zd", obj->data, vtable, vtable->klass->name, size);
 	binary_protocol_alloc (obj->data, vtable, size);
 
@@ -399,6 +628,90 @@ sgen_los_alloc_large_inner (MonoVTable *vtable, size_t size)
 	return obj->data;
 }
 
+/*
+ * Allocates a large object from a cached run of exactly the right size,
+ * without the GC lock.  Must be called in a critical region.  Returns
+ * NULL if there's no such run, in which case the caller must take the
+ * slow path, which also checks whether we need a collection.
+ */
+void*
+sgen_los_try_alloc_large (MonoVTable *vtable, size_t size)
+{
+#if !defined(LOS_DUMMY) && !defined(USE_MALLOC)
+	LOSFreeChunks *run = NULL;
+	LOSObject *obj;
+	size_t num_chunks, stripe, i;
+
+	g_assert (size > SGEN_MAX_SMALL_OBJ_SIZE);
+
+	if (size > LOS_SECTION_OBJECT_LIMIT)
+		return NULL;
+
+	num_chunks = (size + sizeof (LOSObject) + LOS_CHUNK_SIZE - 1) >> LOS_CHUNK_BITS;
+	if (num_chunks > LOS_CHUNK_CACHE_MAX_CHUNKS)
+		return NULL;
+
+	stripe = mono_thread_info_get_small_id ();
+	for (i = 0; i < LOS_CHUNK_CACHE_STRIPES && !run; ++i) {
+		LOSFreeChunks **head = &los_chunk_cache [(stripe + i) % LOS_CHUNK_CACHE_STRIPES][num_chunks];
+		do {
+			run = *head;
+			if (!run)
+				break;
+		} while (SGEN_CAS_PTR ((gpointer*)head, run->next_size, run) != run);
+	}
+	if (!run)
+		return NULL;
+
+	obj = (LOSObject*)run;
+	memset (obj, 0, size + sizeof (LOSObject));
+	g_assert (!((mword)obj->data & (SGEN_ALLOC_ALIGN - 1)));
+	obj->size = size;
+	*(void**)obj->data = vtable;
+	add_los_object (obj, size);
+	SGEN_LOG (4, "Allocated large object %p from the chunk cache, vtable: %p (%s), size: %zd", obj->data, vtable, vtable->klass->name, size);
+	binary_protocol_alloc (obj->data, vtable, size);
+
+	return obj->data;
+#else
+	return NULL;
+#endif
+}
+
+/*
+ * Called at every sweep for each run of free chunks in a section.  Ages
+ * the chunks and decommits those that have been free for long enough,
+ * except for the first one, which holds the run's LOSFreeChunks.
+ */
+static void
+age_free_chunks (LOSSection *section, size_t start, size_t end)
+{
+	unsigned char *map = section->free_chunk_map;
+	int delay = sgen_memgov_get_decommit_delay ();
+	size_t i, j;
+
+	recommit_chunk (section, start);
+
+	for (i = start; i < end; ++i) {
+		if (map [i] != LOS_CHUNK_DECOMMITTED && map [i] < LOS_CHUNK_FREE + delay)
+			++map [i];
+	}
+
+	if (!delay || pagesize > LOS_CHUNK_SIZE)
+		return;
+
+	for (i = start + 1; i < end; i = j) {
+		for (j = i; j < end && map [j] == LOS_CHUNK_FREE + delay; ++j)
+			;
+		if (j == i) {
+			++j;
+			continue;
+		}
+		sgen_decommit_os_memory ((char*)section + (i << LOS_CHUNK_BITS), (j - i) << LOS_CHUNK_BITS);
+		memset (map + i, LOS_CHUNK_DECOMMITTED, j - i);
+	}
+}
+
 void
 sgen_los_sweep (void)
 {
@@ -406,8 +719,10 @@ sgen_los_sweep (void)
 	int i;
 	int num_sections = 0;
 
-	for (i = 0; i < LOS_NUM_FAST_SIZES; ++i)
-		los_fast_free_lists [i] = NULL;
+	if (!pagesize)
+		pagesize = mono_pagesize ();
+
+	refill_chunk_cache ();
 
 	prev = NULL;
 	section = los_sections;
@@ -418,6 +733,9 @@ sgen_los_sweep (void)
 				prev->next = next;
 			else
 				los_sections = next;
+			remove_free_chunk ((LOSFreeChunks*)((char*)section + LOS_CHUNK_SIZE));
+			for (i = 1; i <= LOS_SECTION_NUM_CHUNKS; ++i)
+				recommit_chunk (section, i);
 			sgen_free_os_memory (section, LOS_SECTION_SIZE, SGEN_ALLOC_HEAP);
 			sgen_memgov_release_space (LOS_SECTION_SIZE, SPACE_LOS);
 			section = next;
@@ -430,7 +748,7 @@ sgen_los_sweep (void)
 				int j;
 				for (j = i + 1; j <= LOS_SECTION_NUM_CHUNKS && section->free_chunk_map [j]; ++j)
 					;
-				add_free_chunk ((LOSFreeChunks*)((char*)section + (i << LOS_CHUNK_BITS)), (j - i) << LOS_CHUNK_BITS);
+				age_free_chunks (section, i, j);
 				i = j - 1;
 			}
 		}
@@ -447,10 +765,10 @@ sgen_los_sweep (void)
 
 	/*
 	g_print ("LOS sections: %d  objects: %d  usage: %d\n", num_sections, los_num_objects, los_memory_usage);
-	for (i = 0; i < LOS_NUM_FAST_SIZES; ++i) {
+	for (i = 1; i < LOS_NUM_FREE_LISTS; ++i) {
 		int num_chunks = 0;
 		LOSFreeChunks *free_chunks;
-		for (free_chunks = los_fast_free_lists [i]; free_chunks; free_chunks = free_chunks->next_size)
+		for (free_chunks = los_free_lists [i]; free_chunks; free_chunks = free_chunks->next_size)
 			++num_chunks;
 		g_print ("  %d: %d\n", i, num_chunks);
 	}
@@ -459,21 +777,46 @@ sgen_los_sweep (void)
 	g_assert (los_num_sections == num_sections);
 }
 
-gboolean
-sgen_ptr_is_in_los (char *ptr, char **start)
+/*
+ * Returns the LOS object `ptr` points into, or NULL.  This is a binary
+ * search in `los_object_index`, which is sorted first if necessary.
+ */
+static LOSObject*
+los_object_for_ptr (char *ptr)
 {
 	LOSObject *obj;
+	size_t index;
+
+	if (los_object_index_dirty) {
+		if (!los_object_index.size)
+			sgen_pointer_queue_init (&los_object_index, INTERNAL_MEM_LOS_INDEX);
+		/* Objects can be added concurrently, so we must clear the flag before we read the list. */
+		los_object_index_dirty = FALSE;
+		mono_memory_barrier ();
+		sgen_pointer_queue_clear (&los_object_index);
+		for (obj = los_object_list; obj; obj = obj->next)
+			sgen_pointer_queue_add (&los_object_index, obj);
+		sgen_pointer_queue_sort_uniq (&los_object_index);
+	}
 
-	*start = NULL;
-	for (obj = los_object_list; obj; obj = obj->next) {
-		char *end = obj->data + obj->size;
+	/* The object we're looking for is the last one starting before `ptr`. */
+	index = sgen_pointer_queue_search (&los_object_index, ptr);
+	if (!index)
+		return NULL;
+	obj = los_object_index.data [index - 1];
 
-		if (ptr >= obj->data && ptr < end) {
-			*start = obj->data;
-			return TRUE;
-		}
-	}
-	return FALSE;
+	if (ptr >= obj->data && ptr < obj->data + sgen_los_object_size (obj))
+		return obj;
+	return NULL;
+}
+
+gboolean
+sgen_ptr_is_in_los (char *ptr, char **start)
+{
+	LOSObject *obj = los_object_for_ptr (ptr);
+
+	*start = obj ? obj->data : NULL;
+	return obj != NULL;
 }
 
 void
@@ -488,49 +831,38 @@ sgen_los_iterate_objects (IterateObjectCallbackFunc cb, void *user_data)
 gboolean
 sgen_los_is_valid_object (char *object)
 {
-	LOSObject *obj;
+	LOSObject *obj = los_object_for_ptr (object);
 
-	for (obj = los_object_list; obj; obj = obj->next) {
-		if (obj->data == object)
-			return TRUE;
-	}
-	return FALSE;
+	return obj && obj->data == object;
 }
 
 gboolean
 mono_sgen_los_describe_pointer (char *ptr)
 {
-	LOSObject *obj;
-
-	for (obj = los_object_list; obj; obj = obj->next) {
-		MonoVTable *vtable;
-		const char *los_kind;
-		mword size;
-		gboolean pinned;
-
-		if (obj->data > ptr || obj->data + obj->size <= ptr)
-			continue;
-
-		size = sgen_los_object_size (obj);
-		pinned = sgen_los_object_is_pinned (obj->data);
+	LOSObject *obj = los_object_for_ptr (ptr);
+	const char *los_kind;
+	mword size;
+	gboolean pinned;
 
-		if (size > LOS_SECTION_OBJECT_LIMIT)
-			los_kind = "huge-los-ptr";
-		else
-			los_kind = "los-ptr";
+	if (!obj)
+		return FALSE;
 
-		vtable = (MonoVTable*)SGEN_LOAD_VTABLE (obj->data);
+	size = sgen_los_object_size (obj);
+	pinned = sgen_los_object_is_pinned (obj->data);
 
-		if (obj->data == ptr) {
-			SGEN_LOG (0, "%s (size %d pin %d)\n", los_kind, (int)size, pinned ? 1 : 0);
-		} else {
-			SGEN_LOG (0, "%s (interior-ptr offset %td size %d pin %d)",
-					  los_kind, ptr - obj->data, (int)size, pinned ? 1 : 0);
-		}
+	if (size > LOS_SECTION_OBJECT_LIMIT)
+		los_kind = "huge-los-ptr";
+	else
+		los_kind = "los-ptr";
 
-		return TRUE;
+	if (obj->data == ptr) {
+		SGEN_LOG (0, "%s (size %d pin %d)\n", los_kind, (int)size, pinned ? 1 : 0);
+	} else {
+		SGEN_LOG (0, "%s (interior-ptr offset %td size %d pin %d)",
+				  los_kind, ptr - obj->data, (int)size, pinned ? 1 : 0);
 	}
-	return FALSE;
+
+	return TRUE;
 }
 
 void
@@ -544,26 +876,84 @@ sgen_los_iterate_live_block_ranges (sgen_cardtable_block_callback callback)
 	}
 }
 
+/*
+ * Splits the LOS objects with references into JOB_SPLIT_COUNT ranges
+ * of about the same total size, one for each job scanning the card
+ * table.  Must be called by the GC thread before the jobs run.
+ */
 void
-sgen_los_scan_card_table (gboolean mod_union, SgenGrayQueue *queue)
+sgen_los_prepare_card_table_scan (int job_split_count)
 {
 	LOSObject *obj;
+	mword total_size = 0, size = 0;
+	size_t i;
+	int job;
 
+	if (!los_scan_objects.size)
+		sgen_pointer_queue_init (&los_scan_objects, INTERNAL_MEM_LOS_INDEX);
+	sgen_pointer_queue_clear (&los_scan_objects);
 	for (obj = los_object_list; obj; obj = obj->next) {
-		guint8 *cards;
-
 		if (!SGEN_OBJECT_HAS_REFERENCES (obj->data))
 			continue;
+		sgen_pointer_queue_add (&los_scan_objects, obj);
+		total_size += sgen_los_object_size (obj);
+	}
 
-		if (mod_union) {
-			cards = obj->cardtable_mod_union;
-			g_assert (cards);
-		} else {
-			cards = NULL;
-		}
+	if (job_split_count != los_scan_job_split_count) {
+		if (los_scan_job_starts)
+			sgen_free_internal_dynamic (los_scan_job_starts, sizeof (size_t) * (los_scan_job_split_count + 1), INTERNAL_MEM_LOS_INDEX);
+		los_scan_job_starts = sgen_alloc_internal_dynamic (sizeof (size_t) * (job_split_count + 1), INTERNAL_MEM_LOS_INDEX, TRUE);
+		los_scan_job_split_count = job_split_count;
+	}
+
+	job = 0;
+	los_scan_job_starts [0] = 0;
+	for (i = 0; i < los_scan_objects.next_slot; ++i) {
+		while (job < job_split_count - 1 && size >= total_size / job_split_count * (job + 1))
+			los_scan_job_starts [++job] = i;
+		size += sgen_los_object_size (los_scan_objects.data [i]);
+	}
+	while (job < job_split_count)
+		los_scan_job_starts [++job] = los_scan_objects.next_slot;
+}
+
+static void
+scan_object_cards (LOSObject *obj, gboolean mod_union, SgenGrayQueue *queue)
+{
+	guint8 *cards;
 
-		sgen_cardtable_scan_object (obj->data, obj->size, cards, mod_union, queue);
+	if (mod_union) {
+		cards = obj->cardtable_mod_union;
+		g_assert (cards);
+	} else {
+		cards = NULL;
+	}
+
+	sgen_cardtable_scan_object (obj->data, obj->size, cards, mod_union, queue);
+}
+
+/*
+ * Scans the cards of the LOS objects.  If JOB_SPLIT_COUNT is more than
+ * one, only the JOB_INDEX-th range computed by
+ * sgen_los_prepare_card_table_scan () is scanned.
+ */
+void
+sgen_los_scan_card_table (gboolean mod_union, int job_index, int job_split_count, SgenGrayQueue *queue)
+{
+	LOSObject *obj;
+	size_t i;
+
+	if (job_split_count == 1) {
+		for (obj = los_object_list; obj; obj = obj->next) {
+			if (SGEN_OBJECT_HAS_REFERENCES (obj->data))
+				scan_object_cards (obj, mod_union, queue);
+		}
+		return;
 	}
+
+	SGEN_ASSERT (0, job_split_count == los_scan_job_split_count, "LOS card table scan was not prepared");
+	for (i = los_scan_job_starts [job_index]; i < los_scan_job_starts [job_index + 1]; ++i)
+		scan_object_cards (los_scan_objects.data [i], mod_union, queue);
 }
 
 void
@@ -630,6 +1020,26 @@ sgen_los_pin_object (char *data)
 	binary_protocol_pin (data, (gpointer)SGEN_LOAD_VTABLE (data), sgen_safe_object_get_size ((MonoObject*)data));
 }
 
+/*
+ * Like sgen_los_pin_object (), but safe to call from several workers
+ * at the same time.  Returns whether it was us who pinned the object.
+ */
+gboolean
+sgen_los_pin_object_par (char *data)
+{
+	LOSObject *obj = sgen_los_header_for_object (data);
+	mword size;
+
+	do {
+		size = obj->size;
+		if (size & 1)
+			return FALSE;
+	} while (SGEN_CAS_PTR ((gpointer*)&obj->size, (gpointer)(size | 1), (gpointer)size) != (gpointer)size);
+
+	binary_protocol_pin (data, (gpointer)SGEN_LOAD_VTABLE (data), sgen_safe_object_get_size ((MonoObject*)data));
+	return TRUE;
+}
+
 void
 sgen_los_unpin_object (char *data)
 {
@@ -644,4 +1054,11 @@ sgen_los_object_is_pinned (char *data)
 	return obj->size & 1;
 }
 
+void
+sgen_init_los (void)
+{
+	mono_counters_register ("# LOS chunk cache runs", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_los_chunk_cache_runs);
+	mono_counters_register ("# LOS chunk cache runs unused", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_los_chunk_cache_runs_unused);
+}
+
 #endif /* HAVE_SGEN_GC */
@@ -26,9 +26,12 @@
  * function.
  *
  * DRAIN_GRAY_STACK_FUNCTION_NAME must be defined to be the function name of the gray stack
- * draining function.
+ * draining function, unless COPY_OR_MARK_PARALLEL is defined.
  *
  * Define COPY_OR_MARK_WITH_EVACUATION to support evacuation.
+ *
+ * Define COPY_OR_MARK_PARALLEL for functions that can be run by several workers at the
+ * same time.  They don't support evacuation.
  */
 
 /* Returns whether the object is still in the nursery. */
@@ -55,7 +58,9 @@ COPY_OR_MARK_FUNCTION_NAME (void **ptr, void *obj, SgenGrayQueue *queue)
 	SGEN_ASSERT (9, current_collection_generation == GENERATION_OLD, "old gen parallel allocator called from a %d collection", current_collection_generation);
 
 	if (sgen_ptr_in_nursery (obj)) {
+#ifndef COPY_OR_MARK_PARALLEL
 		int word, bit;
+#endif
 		char *forwarded, *old_obj;
 		mword vtable_word = *(mword*)obj;
 
@@ -81,6 +86,15 @@ COPY_OR_MARK_FUNCTION_NAME (void **ptr, void *obj, SgenGrayQueue *queue)
 		if (sgen_nursery_is_to_space (obj))
 			return TRUE;
 
+#ifdef COPY_OR_MARK_PARALLEL
+		/* The copy is marked and grayed by whichever worker wins the race for it. */
+		old_obj = obj;
+		obj = major_par_copy_nursery_object (obj, queue);
+		if (obj != old_obj)
+			SGEN_UPDATE_REFERENCE (ptr, obj);
+		return sgen_ptr_in_nursery (obj);
+#else
+
 #ifdef COPY_OR_MARK_WITH_EVACUATION
 	do_copy_object:
 #endif
@@ -97,6 +111,7 @@ COPY_OR_MARK_FUNCTION_NAME (void **ptr, void *obj, SgenGrayQueue *queue)
 				block = MS_BLOCK_FOR_OBJ (obj);
 				size_index = block->obj_size_index;
 				evacuate_block_obj_sizes [size_index] = FALSE;
+				block->evacuate = FALSE;
 				MS_MARK_OBJECT_AND_ENQUEUE (obj, sgen_obj_get_descriptor (obj), block, queue);
 				return FALSE;
 			}
@@ -128,6 +143,7 @@ COPY_OR_MARK_FUNCTION_NAME (void **ptr, void *obj, SgenGrayQueue *queue)
 		binary_protocol_mark (obj, (gpointer)LOAD_VTABLE (obj), sgen_safe_object_get_size ((MonoObject*)obj));
 
 		return FALSE;
+#endif
 	} else {
 		mword vtable_word = *(mword*)obj;
 		mword desc;
@@ -166,7 +182,7 @@ COPY_OR_MARK_FUNCTION_NAME (void **ptr, void *obj, SgenGrayQueue *queue)
 			{
 				int size_index = block->obj_size_index;
 
-				if (evacuate_block_obj_sizes [size_index] && !block->has_pinned) {
+				if ((evacuate_block_obj_sizes [size_index] || block->evacuate) && !block->has_pinned) {
 					HEAVY_STAT (++stat_optimized_copy_major_small_evacuate);
 					if (block->is_to_space)
 						return FALSE;
@@ -175,15 +191,24 @@ COPY_OR_MARK_FUNCTION_NAME (void **ptr, void *obj, SgenGrayQueue *queue)
 			}
 #endif
 
+#ifdef COPY_OR_MARK_PARALLEL
+			MS_PAR_MARK_OBJECT_AND_ENQUEUE (obj, desc, block, queue);
+#else
 			MS_MARK_OBJECT_AND_ENQUEUE (obj, desc, block, queue);
+#endif
 		} else {
 			HEAVY_STAT (++stat_optimized_copy_major_large);
 
 			if (sgen_los_object_is_pinned (obj))
 				return FALSE;
+#ifdef COPY_OR_MARK_PARALLEL
+			if (!sgen_los_pin_object_par (obj))
+				return FALSE;
+#else
 			binary_protocol_pin (obj, (gpointer)SGEN_LOAD_VTABLE (obj), sgen_safe_object_get_size ((MonoObject*)obj));
 
 			sgen_los_pin_object (obj);
+#endif
 			if (SGEN_OBJECT_HAS_REFERENCES (obj))
 				GRAY_OBJECT_ENQUEUE (queue, obj, sgen_obj_get_descriptor (obj));
 		}
@@ -227,6 +252,7 @@ SCAN_OBJECT_FUNCTION_NAME (char *obj, mword desc, SgenGrayQueue *queue)
 #include "sgen-scan-object.h"
 }
 
+#ifndef COPY_OR_MARK_PARALLEL
 static gboolean
 DRAIN_GRAY_STACK_FUNCTION_NAME (ScanCopyContext ctx)
 {
@@ -247,8 +273,10 @@ DRAIN_GRAY_STACK_FUNCTION_NAME (ScanCopyContext ctx)
 		SCAN_OBJECT_FUNCTION_NAME (obj, desc, ctx.queue);
 	}
 }
+#endif
 
 #undef COPY_OR_MARK_FUNCTION_NAME
 #undef COPY_OR_MARK_WITH_EVACUATION
+#undef COPY_OR_MARK_PARALLEL
 #undef SCAN_OBJECT_FUNCTION_NAME
 #undef DRAIN_GRAY_STACK_FUNCTION_NAME
@@ -31,6 +31,7 @@
 #include "utils/mono-counters.h"
 #include "utils/mono-semaphore.h"
 #include "utils/mono-time.h"
+#include "utils/mono-mmap.h"
 #include "metadata/object-internals.h"
 #include "metadata/profiler-private.h"
 
@@ -71,6 +72,19 @@
 
 #define MS_NUM_MARK_WORDS	((MS_BLOCK_SIZE / SGEN_ALLOC_ALIGN + sizeof (mword) * 8 - 1) / (sizeof (mword) * 8))
 
+/*
+ * After a major collection every block with live objects is in the
+ * `NEED_SWEEPING` state.  Whoever sweeps a block - the sweep thread,
+ * an allocator or the card table scan - first moves it to `SWEEPING`
+ * with a CAS.  Threads that need a block that is being swept by
+ * somebody else wait until it's `SWEPT`.
+ */
+enum {
+	BLOCK_STATE_SWEPT,
+	BLOCK_STATE_NEED_SWEEPING,
+	BLOCK_STATE_SWEEPING
+};
+
 typedef struct _MSBlockInfo MSBlockInfo;
 struct _MSBlockInfo {
 	int obj_size;
@@ -79,7 +93,8 @@ struct _MSBlockInfo {
 	unsigned int has_references : 1;
 	unsigned int has_pinned : 1;	/* means cannot evacuate */
 	unsigned int is_to_space : 1;
-	unsigned int swept : 1;
+	unsigned int evacuate : 1;	/* selected for incremental compaction */
+	volatile gint32 state;	/* BLOCK_STATE_* */
 	void **free_list;
 	MSBlockInfo *next_free;
 	size_t pin_queue_first_entry;
@@ -142,10 +157,38 @@ static float evacuation_threshold = 0.666f;
 static float concurrent_evacuation_threshold = 0.666f;
 static gboolean want_evacuation = FALSE;
 
+/*
+ * Incremental compaction.  If `compaction_budget` is set we don't
+ * evacuate whole size classes.  Instead, at every sweep, we pick the
+ * sparsest blocks, up to `compaction_budget` live bytes in total, and
+ * evacuate only those in the next major collection.
+ */
+static mword compaction_budget = 0;
+static int num_blocks_to_compact = 0;
+
+typedef struct {
+	MSBlockInfo *block;
+	int live_bytes;
+} CompactionCandidate;
+
 static gboolean lazy_sweep = TRUE;
 static gboolean have_swept;
 
+/*
+ * With concurrent sweep, the blocks that need sweeping after a major
+ * collection are handed to the sweep thread.  `sweep_in_progress` is
+ * only touched by the GC thread.
+ */
+static gboolean concurrent_sweep = FALSE;
+static gboolean sweep_in_progress = FALSE;
+static gboolean sweep_thread_started = FALSE;
+static MonoNativeThreadId sweep_thread;
+static MonoSemType sweep_start_sem;
+static MonoSemType sweep_done_sem;
+static SgenPointerQueue sweep_blocks;
+
 static gboolean concurrent_mark;
+static gboolean parallel_mark;
 
 #define BLOCK_IS_TAGGED_HAS_REFERENCES(bl)	SGEN_POINTER_IS_TAGGED_1 ((bl))
 #define BLOCK_TAG_HAS_REFERENCES(bl)		SGEN_POINTER_TAG_1 ((bl))
@@ -160,19 +203,52 @@ static SgenPointerQueue allocated_blocks;
 static void *empty_blocks = NULL;
 static size_t num_empty_blocks = 0;
 
+/*
+ * Empty blocks are linked through their first word.  The second word
+ * counts the major collections the block has stayed empty for, or is
+ * MS_EMPTY_BLOCK_DECOMMITTED once we've given all its pages except the
+ * first one, which holds those two words, back to the OS.
+ */
+#define MS_EMPTY_BLOCK_IDLE(b)		(((mword*)(b)) [1])
+#define MS_EMPTY_BLOCK_DECOMMITTED	((mword)-1)
+
+static int ms_pagesize;
+
 #define FOREACH_BLOCK(bl)	{ size_t __index; for (__index = 0; __index < allocated_blocks.next_slot; ++__index) { (bl) = BLOCK_UNTAG_HAS_REFERENCES (allocated_blocks.data [__index]);
 #define FOREACH_BLOCK_HAS_REFERENCES(bl,hr)	{ size_t __index; for (__index = 0; __index < allocated_blocks.next_slot; ++__index) { (bl) = allocated_blocks.data [__index]; (hr) = BLOCK_IS_TAGGED_HAS_REFERENCES ((bl)); (bl) = BLOCK_UNTAG_HAS_REFERENCES ((bl));
+#define FOREACH_BLOCK_RANGE_HAS_REFERENCES(bl,first,last,hr)	{ size_t __index; for (__index = (first); __index < (last); ++__index) { (bl) = allocated_blocks.data [__index]; (hr) = BLOCK_IS_TAGGED_HAS_REFERENCES ((bl)); (bl) = BLOCK_UNTAG_HAS_REFERENCES ((bl));
 #define END_FOREACH_BLOCK	} }
 #define DELETE_BLOCK_IN_FOREACH()	(allocated_blocks.data [__index] = NULL)
 
+/*
+ * Blocks allocated during a parallel nursery collection.  Card table
+ * scanning jobs iterate `allocated_blocks` while the workers are
+ * promoting objects, so new blocks are only added to it once the workers
+ * have finished.  Protected by `ms_block_list_mutex`.
+ */
+static SgenPointerQueue par_allocated_blocks;
+
+static LOCK_DECLARE (ms_block_list_mutex);
+#define LOCK_MS_BLOCK_LIST mono_mutex_lock (&ms_block_list_mutex)
+#define UNLOCK_MS_BLOCK_LIST mono_mutex_unlock (&ms_block_list_mutex)
+
 static size_t num_major_sections = 0;
 /* one free block list for each block object size */
 static MSBlockInfo **free_block_lists [MS_BLOCK_TYPE_MAX];
 
+/* The free block lists a worker thread allocates from in a parallel nursery collection. */
+static MonoNativeTlsKey workers_free_block_lists_key;
+
 static guint64 stat_major_blocks_alloced = 0;
 static guint64 stat_major_blocks_freed = 0;
 static guint64 stat_major_blocks_lazy_swept = 0;
+static guint64 stat_pinned_alloc_blocks_cached = 0;
+static guint64 stat_major_blocks_swept_concurrently = 0;
+static guint64 stat_major_blocks_sweep_waited = 0;
+static guint64 time_major_concurrent_sweep = 0;
 static guint64 stat_major_objects_evacuated = 0;
+static guint64 stat_major_blocks_compacted = 0;
+static guint64 stat_major_blocks_decommitted = 0;
 
 #if SIZEOF_VOID_P != 8
 static guint64 stat_major_blocks_freed_ideal = 0;
@@ -204,8 +280,20 @@ add_scanned_object (void *ptr)
 }
 #endif
 
-static void
+static gboolean
 sweep_block (MSBlockInfo *block, gboolean during_major_collection);
+static void
+sweep_finish (void);
+
+static inline gboolean
+block_is_swept (MSBlockInfo *block)
+{
+	if (block->state != BLOCK_STATE_SWEPT)
+		return FALSE;
+	/* Pairs with the write barrier at the end of sweep_block (). */
+	mono_memory_read_barrier ();
+	return TRUE;
+}
 
 static int
 ms_find_block_obj_size_index (size_t size)
@@ -220,6 +308,7 @@ ms_find_block_obj_size_index (size_t size)
 
 #define FREE_BLOCKS_FROM(lists,p,r)	(lists [((p) ? MS_BLOCK_FLAG_PINNED : 0) | ((r) ? MS_BLOCK_FLAG_REFS : 0)])
 #define FREE_BLOCKS(p,r)		(FREE_BLOCKS_FROM (free_block_lists, (p), (r)))
+#define FREE_BLOCKS_LOCAL(p,r)		(FREE_BLOCKS_FROM (((MSBlockInfo***)(mono_native_tls_get_value (workers_free_block_lists_key))), (p), (r)))
 
 #define MS_BLOCK_OBJ_SIZE_INDEX(s)				\
 	(((s)+7)>>3 < MS_NUM_FAST_BLOCK_OBJ_SIZE_INDEXES ?	\
@@ -244,6 +333,15 @@ update_heap_boundaries_for_block (MSBlockInfo *block)
 	sgen_update_heap_boundaries ((mword)MS_BLOCK_FOR_BLOCK_INFO (block), (mword)MS_BLOCK_FOR_BLOCK_INFO (block) + MS_BLOCK_SIZE);
 }
 
+/* Must be called on an empty block before it's used or freed. */
+static void
+ms_recommit_empty_block (void *block)
+{
+	if (MS_EMPTY_BLOCK_IDLE (block) == MS_EMPTY_BLOCK_DECOMMITTED)
+		sgen_recommit_os_memory ((char*)block + ms_pagesize, MS_BLOCK_SIZE - ms_pagesize);
+	MS_EMPTY_BLOCK_IDLE (block) = 0;
+}
+
 static void*
 ms_get_empty_block (void)
 {
@@ -301,6 +399,7 @@ ms_get_empty_block (void)
 	SGEN_ATOMIC_ADD_P (num_empty_blocks, -1);
 
 	*(void**)block = NULL;
+	ms_recommit_empty_block (block);
 
 	g_assert (!((mword)block & (MS_BLOCK_SIZE - 1)));
 
@@ -337,7 +436,7 @@ check_block_free_list (MSBlockInfo *block, int size, gboolean pinned)
 
 		/* blocks in the free lists must have at least
 		   one free slot */
-		if (block->swept)
+		if (block_is_swept (block))
 			g_assert (block->free_list);
 
 		/* the block must be in the allocated_blocks array */
@@ -385,7 +484,7 @@ consistency_check (void)
 		g_assert (num_free == 0);
 
 		/* check all mark words are zero */
-		if (block->swept) {
+		if (block_is_swept (block)) {
 			for (i = 0; i < MS_NUM_MARK_WORDS; ++i)
 				g_assert (block->mark_words [i] == 0);
 		}
@@ -407,7 +506,7 @@ ms_alloc_block (int size_index, gboolean pinned, gboolean has_references)
 {
 	int size = block_obj_sizes [size_index];
 	int count = MS_BLOCK_FREE / size;
-	MSBlockInfo *info;
+	MSBlockInfo *info, *next_free;
 	MSBlockInfo **free_blocks = FREE_BLOCKS (pinned, has_references);
 	char *obj_start;
 	int i;
@@ -431,7 +530,8 @@ ms_alloc_block (int size_index, gboolean pinned, gboolean has_references)
 	 * want further evacuation.
 	 */
 	info->is_to_space = (sgen_get_current_collection_generation () == GENERATION_OLD);
-	info->swept = 1;
+	info->evacuate = FALSE;
+	info->state = BLOCK_STATE_SWEPT;
 	info->cardtable_mod_union = NULL;
 
 	update_heap_boundaries_for_block (info);
@@ -448,15 +548,35 @@ ms_alloc_block (int size_index, gboolean pinned, gboolean has_references)
 	/* the last one */
 	*(void**)obj_start = NULL;
 
-	info->next_free = free_blocks [size_index];
-	free_blocks [size_index] = info;
+	/* Worker threads might be taking blocks off the free list concurrently. */
+	do {
+		next_free = free_blocks [size_index];
+		info->next_free = next_free;
+	} while (SGEN_CAS_PTR ((gpointer*)&free_blocks [size_index], info, next_free) != next_free);
 
-	sgen_pointer_queue_add (&allocated_blocks, BLOCK_TAG (info));
+	if (sgen_collection_is_parallel ())
+		sgen_pointer_queue_add (&par_allocated_blocks, BLOCK_TAG (info));
+	else
+		sgen_pointer_queue_add (&allocated_blocks, BLOCK_TAG (info));
 
 	++num_major_sections;
 	return TRUE;
 }
 
+/*
+ * Appends the blocks allocated during a parallel nursery collection to
+ * `allocated_blocks`.  Must only be called when no worker is running.
+ */
+static void
+ms_add_par_allocated_blocks (void)
+{
+	size_t i;
+
+	for (i = 0; i < par_allocated_blocks.next_slot; ++i)
+		sgen_pointer_queue_add (&allocated_blocks, par_allocated_blocks.data [i]);
+	sgen_pointer_queue_clear (&par_allocated_blocks);
+}
+
 static gboolean
 obj_is_from_pinned_alloc (char *ptr)
 {
@@ -478,9 +598,9 @@ unlink_slot_from_free_list_uncontested (MSBlockInfo **free_blocks, int size_inde
 	block = free_blocks [size_index];
 	SGEN_ASSERT (9, block, "no free block to unlink from free_blocks %p size_index %d", free_blocks, size_index);
 
-	if (G_UNLIKELY (!block->swept)) {
-		stat_major_blocks_lazy_swept ++;
-		sweep_block (block, FALSE);
+	if (G_UNLIKELY (!block_is_swept (block))) {
+		if (sweep_block (block, FALSE))
+			stat_major_blocks_lazy_swept ++;
 	}
 
 	obj = block->free_list;
@@ -520,6 +640,64 @@ major_alloc_object (MonoVTable *vtable, size_t size, gboolean has_references)
 	return alloc_obj (vtable, size, FALSE, has_references);
 }
 
+/*
+ * Each worker allocates from its own thread-local free block lists.
+ * Whole blocks are taken off the global free lists with a CAS, which
+ * is safe from ABA because during a parallel collection blocks are only
+ * ever pushed onto the global lists when they are newly allocated.
+ *
+ * Unlike alloc_obj() this doesn't set the vtable.  Card table scanning
+ * jobs might look at the slot at any time, so the caller must only
+ * store the vtable once the object has been copied completely.
+ */
+static void*
+alloc_obj_par (size_t size, gboolean pinned, gboolean has_references)
+{
+	int size_index = MS_BLOCK_OBJ_SIZE_INDEX (size);
+	MSBlockInfo **free_blocks_local = FREE_BLOCKS_LOCAL (pinned, has_references);
+	MSBlockInfo *block;
+	void *obj;
+
+	SGEN_ASSERT (9, sgen_collection_is_parallel (), "Parallel allocator called outside of a parallel collection");
+
+	if (!free_blocks_local [size_index]) {
+		MSBlockInfo **free_blocks = FREE_BLOCKS (pinned, has_references);
+
+		for (;;) {
+			gboolean success;
+
+			block = free_blocks [size_index];
+			if (block) {
+				if (SGEN_CAS_PTR ((gpointer*)&free_blocks [size_index], block->next_free, block) != block)
+					continue;
+
+				block->next_free = NULL;
+				free_blocks_local [size_index] = block;
+				break;
+			}
+
+			LOCK_MS_BLOCK_LIST;
+			success = ms_alloc_block (size_index, pinned, has_references);
+			UNLOCK_MS_BLOCK_LIST;
+
+			if (G_UNLIKELY (!success))
+				return NULL;
+		}
+	}
+
+	obj = unlink_slot_from_free_list_uncontested (free_blocks_local, size_index);
+
+	*(void**)obj = NULL;
+
+	return obj;
+}
+
+static void*
+major_par_alloc_object (MonoVTable *vtable, size_t size, gboolean has_references)
+{
+	return alloc_obj_par (size, FALSE, has_references);
+}
+
 /*
  * We're not freeing the block if it's empty.  We leave that work for
  * the next major collection.
@@ -533,7 +711,7 @@ free_object (char *obj, size_t size, gboolean pinned)
 	MSBlockInfo *block = MS_BLOCK_FOR_OBJ (obj);
 	int word, bit;
 
-	if (!block->swept)
+	if (!block_is_swept (block))
 		sweep_block (block, FALSE);
 	SGEN_ASSERT (9, (pinned && block->pinned) || (!pinned && !block->pinned), "free-object pinning mixup object %p pinned %d block %p pinned %d", obj, pinned, block, block->pinned);
 	SGEN_ASSERT (9, MS_OBJ_ALLOCED (obj, block), "object %p is already free", obj);
@@ -557,19 +735,155 @@ major_free_non_pinned_object (char *obj, size_t size)
 	free_object (obj, size, FALSE);
 }
 
+/*
+ * Small pinned objects are allocated from per-thread blocks.  A thread
+ * takes a whole block off the global pinned free list, under the GC
+ * lock, and then pops slots off that block's free list inside a
+ * critical region, without any locking.  A cached block is on no free
+ * list, so nobody else touches it while the world is running.  At every
+ * stop-the-world the blocks go back on the global free lists, so the
+ * collector never has to know about them.
+ *
+ * The cache is indexed by size index, with the blocks for objects with
+ * references following the ones without.
+ */
+#define PINNED_ALLOC_CACHE_INDEX(si,r)	((r) ? num_block_obj_sizes + (si) : (si))
+
+static void*
+major_try_alloc_small_pinned_obj (SgenThreadInfo *info, MonoVTable *vtable, size_t size, gboolean has_references)
+{
+	MSBlockInfo **blocks = info->pinned_alloc_blocks;
+	int index;
+	MSBlockInfo *block;
+	void *obj;
+
+	if (!blocks)
+		return NULL;
+
+	index = PINNED_ALLOC_CACHE_INDEX (MS_BLOCK_OBJ_SIZE_INDEX (size), has_references);
+	block = blocks [index];
+	if (!block)
+		return NULL;
+
+	obj = block->free_list;
+	SGEN_ASSERT (9, obj, "block %p in pinned alloc cache had no available object to alloc from", block);
+
+	block->free_list = *(void**)obj;
+	if (!block->free_list)
+		blocks [index] = NULL;
+
+	*(MonoVTable**)obj = vtable;
+
+	return obj;
+}
+
+/* LOCKING: requires the GC lock, or the world to be stopped. */
+static void
+major_release_thread_pinned_blocks (SgenThreadInfo *info)
+{
+	MSBlockInfo **blocks = info->pinned_alloc_blocks;
+	int i;
+
+	if (!blocks)
+		return;
+
+	for (i = 0; i < num_block_obj_sizes * 2; ++i) {
+		MSBlockInfo *block = blocks [i];
+		MSBlockInfo **free_blocks;
+
+		if (!block)
+			continue;
+		blocks [i] = NULL;
+
+		SGEN_ASSERT (9, block->free_list && !block->next_free, "pinned alloc cache block %p must have free slots and be on no free list", block);
+		free_blocks = FREE_BLOCKS (TRUE, block->has_references);
+		block->next_free = free_blocks [block->obj_size_index];
+		free_blocks [block->obj_size_index] = block;
+	}
+}
+
+static void
+major_free_thread_pinned_blocks (SgenThreadInfo *info)
+{
+	if (!info->pinned_alloc_blocks)
+		return;
+	sgen_free_internal_dynamic (info->pinned_alloc_blocks, sizeof (MSBlockInfo*) * num_block_obj_sizes * 2, INTERNAL_MEM_MS_TABLES);
+	info->pinned_alloc_blocks = NULL;
+}
+
+/*
+ * Takes a block with free slots off the global pinned free list and
+ * gives it to the thread.
+ *
+ * LOCKING: requires the GC lock.
+ */
+static gboolean
+refill_thread_pinned_blocks (SgenThreadInfo *info, int size_index, gboolean has_references)
+{
+	MSBlockInfo **free_blocks = FREE_BLOCKS (TRUE, has_references);
+	MSBlockInfo **blocks;
+	MSBlockInfo *block;
+
+	if (!info->pinned_alloc_blocks)
+		info->pinned_alloc_blocks = sgen_alloc_internal_dynamic (sizeof (MSBlockInfo*) * num_block_obj_sizes * 2, INTERNAL_MEM_MS_TABLES, TRUE);
+	blocks = info->pinned_alloc_blocks;
+
+	SGEN_ASSERT (9, !blocks [PINNED_ALLOC_CACHE_INDEX (size_index, has_references)], "refilling the pinned alloc cache of thread %p although it has a block", info);
+
+	if (!free_blocks [size_index]) {
+		if (G_UNLIKELY (!ms_alloc_block (size_index, TRUE, has_references)))
+			return FALSE;
+	}
+
+	block = free_blocks [size_index];
+	if (G_UNLIKELY (!block_is_swept (block))) {
+		if (sweep_block (block, FALSE))
+			stat_major_blocks_lazy_swept ++;
+	}
+	SGEN_ASSERT (9, block->free_list, "block %p in free list had no available object to alloc from", block);
+
+	free_blocks [size_index] = block->next_free;
+	block->next_free = NULL;
+	blocks [PINNED_ALLOC_CACHE_INDEX (size_index, has_references)] = block;
+
+	++stat_pinned_alloc_blocks_cached;
+
+	return TRUE;
+}
+
+static void*
+alloc_pinned_obj (MonoVTable *vtable, size_t size, gboolean has_references)
+{
+	SgenThreadInfo *info = mono_thread_info_current ();
+	void *obj;
+
+	/* Threads the GC doesn't know about use the global free lists. */
+	if (!info)
+		return alloc_obj (vtable, size, TRUE, has_references);
+
+	obj = major_try_alloc_small_pinned_obj (info, vtable, size, has_references);
+	if (obj)
+		return obj;
+
+	if (!refill_thread_pinned_blocks (info, MS_BLOCK_OBJ_SIZE_INDEX (size), has_references))
+		return NULL;
+
+	return major_try_alloc_small_pinned_obj (info, vtable, size, has_references);
+}
+
 /* size is a multiple of SGEN_ALLOC_ALIGN */
 static void*
 major_alloc_small_pinned_obj (MonoVTable *vtable, size_t size, gboolean has_references)
 {
 	void *res;
 
-	res = alloc_obj (vtable, size, TRUE, has_references);
+	res = alloc_pinned_obj (vtable, size, has_references);
 	 /*If we failed to alloc memory, we better try releasing memory
 	  *as pinned alloc is requested by the runtime.
 	  */
 	 if (!res) {
 		sgen_perform_collection (0, GENERATION_OLD, "pinned alloc failure", TRUE);
-		res = alloc_obj (vtable, size, TRUE, has_references);
+		res = alloc_pinned_obj (vtable, size, has_references);
 	 }
 	 return res;
 }
@@ -668,14 +982,15 @@ major_iterate_objects (IterateObjectsFlags flags, IterateObjectCallbackFunc call
 			continue;
 		if (!block->pinned && !non_pinned)
 			continue;
-		if (sweep && lazy_sweep) {
+		/* The sweep thread might be changing the mark bits and the free list. */
+		if ((sweep && lazy_sweep) || sweep_in_progress) {
 			sweep_block (block, FALSE);
-			SGEN_ASSERT (0, block->swept, "Block must be swept after sweeping");
+			SGEN_ASSERT (0, block_is_swept (block), "Block must be swept after sweeping");
 		}
 
 		for (i = 0; i < count; ++i) {
 			void **obj = (void**) MS_BLOCK_OBJ (block, i);
-			if (!block->swept) {
+			if (!block_is_swept (block)) {
 				int word, bit;
 				MS_CALC_MARK_BIT (word, bit, obj);
 				if (!MS_MARK_BIT (block, word, bit))
@@ -774,6 +1089,8 @@ major_dump_heap (FILE *heap_dump_file)
 	for (i = 0; i < num_block_obj_sizes; ++i)
 		slots_available [i] = slots_used [i] = 0;
 
+	sweep_finish ();
+
 	FOREACH_BLOCK (block) {
 		int index = ms_find_block_obj_size_index (block->obj_size);
 		int count = MS_BLOCK_FREE / block->obj_size;
@@ -841,6 +1158,47 @@ major_dump_heap (FILE *heap_dump_file)
 		}							\
 	} while (0)
 
+/*
+ * With parallel marking several workers might try to mark the same
+ * object, so the mark bits are set with a CAS and only the worker that
+ * actually set the bit enqueues the object.
+ */
+static inline gboolean
+ms_par_set_mark_bit (MSBlockInfo *block, int word, int bit)
+{
+	mword old;
+
+	do {
+		old = block->mark_words [word];
+		if (old & (ONE_P << bit))
+			return FALSE;
+	} while (SGEN_CAS_PTR ((gpointer*)&block->mark_words [word], (gpointer)(old | (ONE_P << bit)), (gpointer)old) != (gpointer)old);
+
+	return TRUE;
+}
+
+static inline void
+ms_par_clear_mark_bit (MSBlockInfo *block, int word, int bit)
+{
+	mword old;
+
+	do {
+		old = block->mark_words [word];
+	} while (SGEN_CAS_PTR ((gpointer*)&block->mark_words [word], (gpointer)(old & ~(ONE_P << bit)), (gpointer)old) != (gpointer)old);
+}
+
+#define MS_PAR_MARK_OBJECT_AND_ENQUEUE(obj,desc,block,queue) do {	\
+		int __word, __bit;					\
+		MS_CALC_MARK_BIT (__word, __bit, (obj));		\
+		SGEN_ASSERT (9, MS_OBJ_ALLOCED ((obj), (block)), "object %p not allocated", obj); \
+		if (!MS_MARK_BIT ((block), __word, __bit) && ms_par_set_mark_bit ((block), __word, __bit)) { \
+			if (sgen_gc_descr_has_references (desc))			\
+				GRAY_OBJECT_ENQUEUE ((queue), (obj), (desc)); \
+			binary_protocol_mark ((obj), (gpointer)LOAD_VTABLE ((obj)), sgen_safe_object_get_size ((MonoObject*)(obj))); \
+			INC_NUM_MAJOR_OBJECTS_MARKED ();		\
+		}							\
+	} while (0)
+
 static void
 pin_major_object (char *obj, SgenGrayQueue *queue)
 {
@@ -856,6 +1214,95 @@ pin_major_object (char *obj, SgenGrayQueue *queue)
 
 #include "sgen-major-copy-object.h"
 
+/*
+ * Promotes a nursery object during a parallel major collection.
+ *
+ * Unlike copy_object_no_checks_par () the copy is complete, vtable
+ * included, and marked before the forwarding pointer is installed, so
+ * a worker that follows the forwarding pointer never sees a partial or
+ * unmarked object.  There is no card table scanning going on during a
+ * major collection, so this is safe.
+ *
+ * This can return OBJ itself if it's pinned, either by another thread
+ * or because we're out of memory.
+ */
+static MONO_NEVER_INLINE void*
+major_par_copy_nursery_object (void *obj, SgenGrayQueue *queue)
+{
+	mword vtable_word = *(mword*)obj;
+	MonoVTable *vt;
+	gboolean has_references;
+	mword objsize;
+	char *destination;
+	MSBlockInfo *block;
+	int word, bit;
+
+	if (SGEN_POINTER_IS_TAGGED_FORWARDED (vtable_word))
+		return SGEN_POINTER_UNTAG_VTABLE (vtable_word);
+	if (SGEN_POINTER_IS_TAGGED_PINNED (vtable_word))
+		return obj;
+
+	vt = (MonoVTable*)vtable_word;
+	has_references = SGEN_VTABLE_HAS_REFERENCES (vt);
+	objsize = SGEN_ALIGN_UP (sgen_par_object_get_size (vt, (MonoObject*)obj));
+	destination = alloc_obj_par (objsize, FALSE, has_references);
+
+	if (G_UNLIKELY (!destination)) {
+		void *result = obj;
+		sgen_parallel_pin_or_update (&result, obj, vt, queue);
+		if (result == obj)
+			sgen_set_pinned_from_failed_allocation (objsize);
+		return result;
+	}
+
+	*(MonoVTable**)destination = vt;
+	memcpy (destination + sizeof (mword), (char*)obj + sizeof (mword), objsize - sizeof (mword));
+
+	/* adjust array->bounds */
+	if (G_UNLIKELY (vt->rank && ((MonoArray*)obj)->bounds)) {
+		MonoArray *array = (MonoArray*)destination;
+		array->bounds = (MonoArrayBounds*)((char*)destination + ((char*)((MonoArray*)obj)->bounds - (char*)obj));
+	}
+
+	block = MS_BLOCK_FOR_OBJ (destination);
+	MS_CALC_MARK_BIT (word, bit, destination);
+	ms_par_set_mark_bit (block, word, bit);
+
+	/* The copy and its mark bit must be visible before the forwarding pointer is. */
+	mono_memory_write_barrier ();
+
+	vtable_word = (mword)SGEN_CAS_PTR (obj, SGEN_POINTER_TAG_FORWARDED (destination), vt);
+	if (vtable_word != (mword)vt) {
+		/* Another thread forwarded or pinned the object before us. */
+		ms_par_clear_mark_bit (block, word, bit);
+		memset (destination, 0, objsize);
+		InterlockedIncrement64 ((volatile gint64*)&stat_slots_allocated_in_vain);
+
+		if (SGEN_POINTER_IS_TAGGED_FORWARDED (vtable_word))
+			return SGEN_POINTER_UNTAG_VTABLE (vtable_word);
+		return obj;
+	}
+
+	SGEN_LOG (9, " (to %p, %s size: %lu)", destination, vt->klass->name, (unsigned long)objsize);
+	binary_protocol_copy (obj, destination, vt, objsize);
+	binary_protocol_mark (destination, vt, objsize);
+
+#ifdef ENABLE_DTRACE
+	if (G_UNLIKELY (MONO_GC_OBJ_MOVED_ENABLED ()))
+		MONO_GC_OBJ_MOVED ((mword)destination, (mword)obj, GENERATION_OLD, GENERATION_NURSERY, objsize, vt->klass->name_space, vt->klass->name);
+#endif
+
+	if (G_UNLIKELY (mono_profiler_events & MONO_PROFILE_GC_MOVES))
+		sgen_register_moved_object (obj, destination);
+
+	if (has_references) {
+		SGEN_LOG (9, "Enqueuing gray object %p (%s)", destination, vt->klass->name);
+		GRAY_OBJECT_ENQUEUE (queue, destination, sgen_vtable_get_descriptor (vt));
+	}
+
+	return destination;
+}
+
 static void
 major_copy_or_mark_object_with_evacuation_concurrent (void **ptr, void *obj, SgenGrayQueue *queue)
 {
@@ -935,12 +1382,17 @@ static void major_scan_object_with_evacuation (char *start, mword desc, SgenGray
 #define DRAIN_GRAY_STACK_FUNCTION_NAME	drain_gray_stack_with_evacuation
 #include "sgen-marksweep-drain-gray-stack.h"
 
+#define COPY_OR_MARK_PARALLEL
+#define COPY_OR_MARK_FUNCTION_NAME	major_copy_or_mark_object_par
+#define SCAN_OBJECT_FUNCTION_NAME	major_scan_object_par
+#include "sgen-marksweep-drain-gray-stack.h"
+
 static gboolean
 drain_gray_stack (ScanCopyContext ctx)
 {
-	gboolean evacuation = FALSE;
+	gboolean evacuation = num_blocks_to_compact > 0;
 	int i;
-	for (i = 0; i < num_block_obj_sizes; ++i) {
+	for (i = 0; !evacuation && i < num_block_obj_sizes; ++i) {
 		if (evacuate_block_obj_sizes [i]) {
 			evacuation = TRUE;
 			break;
@@ -967,6 +1419,12 @@ major_copy_or_mark_object_concurrent_canonical (void **ptr, SgenGrayQueue *queue
 	major_copy_or_mark_object_with_evacuation_concurrent (ptr, *ptr, queue);
 }
 
+static void
+major_copy_or_mark_object_par_canonical (void **ptr, SgenGrayQueue *queue)
+{
+	major_copy_or_mark_object_par (ptr, *ptr, queue);
+}
+
 static void
 mark_pinned_objects_in_block (MSBlockInfo *block, SgenGrayQueue *queue)
 {
@@ -1027,9 +1485,11 @@ sweep_block_for_size (MSBlockInfo *block, int count, int obj_size)
 /*
  * sweep_block:
  *
- *   Traverse BLOCK, freeing and zeroing unused objects.
+ *   Traverse BLOCK, freeing and zeroing unused objects.  If another
+ * thread is sweeping BLOCK we wait until it's done.  Returns whether
+ * we swept the block ourselves.
  */
-static void
+static gboolean
 sweep_block (MSBlockInfo *block, gboolean during_major_collection)
 {
 	int count;
@@ -1038,8 +1498,24 @@ sweep_block (MSBlockInfo *block, gboolean during_major_collection)
 	if (!during_major_collection)
 		g_assert (!sgen_concurrent_collection_in_progress ());
 
-	if (block->swept)
-		return;
+ retry:
+	switch (block->state) {
+	case BLOCK_STATE_SWEPT:
+		mono_memory_read_barrier ();
+		return FALSE;
+	case BLOCK_STATE_SWEEPING:
+		/* Sweeping a single block is quick, so we just spin. */
+		InterlockedIncrement64 ((volatile gint64*)&stat_major_blocks_sweep_waited);
+		while (block->state == BLOCK_STATE_SWEEPING)
+			mono_memory_barrier ();
+		goto retry;
+	case BLOCK_STATE_NEED_SWEEPING:
+		if (InterlockedCompareExchange (&block->state, BLOCK_STATE_SWEEPING, BLOCK_STATE_NEED_SWEEPING) != BLOCK_STATE_NEED_SWEEPING)
+			goto retry;
+		break;
+	default:
+		g_assert_not_reached ();
+	}
 
 	count = MS_BLOCK_FREE / block->obj_size;
 
@@ -1069,7 +1545,84 @@ sweep_block (MSBlockInfo *block, gboolean during_major_collection)
 	}
 	block->free_list = reversed;
 
-	block->swept = 1;
+	mono_memory_write_barrier ();
+	block->state = BLOCK_STATE_SWEPT;
+	return TRUE;
+}
+
+static mono_native_thread_return_t
+sweep_thread_func (void *dummy)
+{
+	mono_thread_info_register_small_id ();
+
+	for (;;) {
+		size_t i;
+		SGEN_TV_DECLARE (atv);
+		SGEN_TV_DECLARE (btv);
+
+		MONO_SEM_WAIT (&sweep_start_sem);
+
+		SGEN_TV_GETTIME (atv);
+		/*
+		 * The GC thread waits for us to finish before it
+		 * starts marking, so sweeping here is as safe as
+		 * sweeping during the major collection.
+		 */
+		for (i = 0; i < sweep_blocks.next_slot; ++i) {
+			if (sweep_block (sweep_blocks.data [i], TRUE))
+				++stat_major_blocks_swept_concurrently;
+		}
+		SGEN_TV_GETTIME (btv);
+		time_major_concurrent_sweep += SGEN_TV_ELAPSED (atv, btv);
+
+		MONO_SEM_POST (&sweep_done_sem);
+	}
+
+	return NULL;
+}
+
+/*
+ * Hands the blocks in `sweep_blocks` to the sweep thread.  Only
+ * called from the GC thread.
+ */
+static void
+sweep_start (void)
+{
+	SGEN_ASSERT (0, !sweep_in_progress, "Can't start sweeping while we're still sweeping");
+
+	if (!sweep_blocks.next_slot)
+		return;
+
+	if (!sweep_thread_started) {
+		MONO_SEM_INIT (&sweep_start_sem, 0);
+		MONO_SEM_INIT (&sweep_done_sem, 0);
+		mono_native_thread_create (&sweep_thread, sweep_thread_func, NULL);
+		sweep_thread_started = TRUE;
+	}
+
+	sweep_in_progress = TRUE;
+	MONO_SEM_POST (&sweep_start_sem);
+}
+
+/*
+ * Waits until the sweep thread has swept all the blocks it was given.
+ * Only called from the GC thread.
+ */
+static void
+sweep_finish (void)
+{
+	if (!sweep_in_progress)
+		return;
+
+	MONO_SEM_WAIT (&sweep_done_sem);
+	sgen_pointer_queue_clear (&sweep_blocks);
+	sweep_in_progress = FALSE;
+}
+
+static gboolean
+major_is_worker_thread (MonoNativeThreadId thread)
+{
+	return sweep_thread_started && thread == sweep_thread;
 }
 
 static inline int
@@ -1091,6 +1644,57 @@ bitcount (mword d)
 	return count;
 }
 
+static void
+add_free_block (MSBlockInfo *block)
+{
+	MSBlockInfo **free_blocks = FREE_BLOCKS (block->pinned, block->has_references);
+	int index = MS_BLOCK_OBJ_SIZE_INDEX (block->obj_size);
+	block->next_free = free_blocks [index];
+	free_blocks [index] = block;
+}
+
+static int
+compare_compaction_candidates (const void *va, const void *vb)
+{
+	const CompactionCandidate *a = va, *b = vb;
+	return a->live_bytes - b->live_bytes;
+}
+
+/*
+ * Marks the sparsest of the candidate blocks for evacuation in the next
+ * major collection, as long as their live bytes fit into the compaction
+ * budget.  The remaining candidates go back on the free lists.  Returns
+ * how many bytes we expect to free.
+ */
+static mword
+select_blocks_for_compaction (CompactionCandidate *candidates, size_t num_candidates)
+{
+	mword budget_used = 0;
+	mword saved = 0;
+	size_t i;
+
+	sgen_qsort (candidates, num_candidates, sizeof (CompactionCandidate), compare_compaction_candidates);
+
+	for (i = 0; i < num_candidates; ++i) {
+		MSBlockInfo *block = candidates [i].block;
+		int live_bytes = candidates [i].live_bytes;
+
+		if (budget_used + live_bytes <= compaction_budget) {
+			budget_used += live_bytes;
+			saved += (MS_BLOCK_FREE / block->obj_size) * block->obj_size - live_bytes;
+			block->evacuate = TRUE;
+			++num_blocks_to_compact;
+		} else {
+			add_free_block (block);
+		}
+	}
+
+	stat_major_blocks_compacted += num_blocks_to_compact;
+	SGEN_LOG (2, "Compacting %d of %zd sparse blocks, %lu live bytes", num_blocks_to_compact, num_candidates, (unsigned long)budget_used);
+
+	return saved;
+}
+
 static void
 ms_sweep (void)
 {
@@ -1105,9 +1709,26 @@ ms_sweep (void)
 	mword total_evacuate_heap = 0;
 	mword total_evacuate_saved = 0;
 
+	/* blocks that are sparse enough to be compacted */
+	CompactionCandidate *candidates = NULL;
+	size_t num_candidates = 0;
+	size_t max_candidates = 0;
+
 	for (i = 0; i < num_block_obj_sizes; ++i)
 		slots_available [i] = slots_used [i] = num_blocks [i] = 0;
 
+	/* The parallel marker doesn't evacuate. */
+	if (compaction_budget && !parallel_mark) {
+		max_candidates = allocated_blocks.next_slot;
+		if (max_candidates) {
+			candidates = sgen_alloc_internal_dynamic (sizeof (CompactionCandidate) * max_candidates,
+					INTERNAL_MEM_MS_BLOCK_INFO_SORT, FALSE);
+		}
+	}
+	num_blocks_to_compact = 0;
+
+	SGEN_ASSERT (0, !sweep_in_progress, "The previous sweep must be finished before the next one");
+
 	/* clear all the free lists */
 	for (i = 0; i < MS_BLOCK_TYPE_MAX; ++i) {
 		MSBlockInfo **free_blocks = free_block_lists [i];
@@ -1131,7 +1752,8 @@ ms_sweep (void)
 		block->has_pinned = block->pinned;
 
 		block->is_to_space = FALSE;
-		block->swept = 0;
+		block->evacuate = FALSE;
+		block->state = BLOCK_STATE_NEED_SWEEPING;
 
 		count = MS_BLOCK_FREE / block->obj_size;
 
@@ -1154,6 +1776,9 @@ ms_sweep (void)
 			sweep_block (block, TRUE);
 
 		if (have_live) {
+			if (concurrent_sweep)
+				sgen_pointer_queue_add (&sweep_blocks, block);
+
 			if (!has_pinned) {
 				++num_blocks [obj_size_index];
 				slots_used [obj_size_index] += nused;
@@ -1161,14 +1786,16 @@ ms_sweep (void)
 			}
 
 			/*
-			 * If there are free slots in the block, add
-			 * the block to the corresponding free list.
+			 * Sparse blocks go on the free lists only if
+			 * they're not picked for compaction below.
 			 */
-			if (have_free) {
-				MSBlockInfo **free_blocks = FREE_BLOCKS (block->pinned, block->has_references);
-				int index = MS_BLOCK_OBJ_SIZE_INDEX (block->obj_size);
-				block->next_free = free_blocks [index];
-				free_blocks [index] = block;
+			if (candidates && !has_pinned && (float)nused / (float)count < evacuation_threshold) {
+				SGEN_ASSERT (0, num_candidates < max_candidates, "More blocks than we thought");
+				candidates [num_candidates].block = block;
+				candidates [num_candidates].live_bytes = nused * block->obj_size;
+				++num_candidates;
+			} else if (have_free) {
+				add_free_block (block);
 			}
 
 			update_heap_boundaries_for_block (block);
@@ -1187,9 +1814,15 @@ ms_sweep (void)
 	} END_FOREACH_BLOCK;
 	sgen_pointer_queue_remove_nulls (&allocated_blocks);
 
+	if (candidates) {
+		total_evacuate_saved += select_blocks_for_compaction (candidates, num_candidates);
+		sgen_free_internal_dynamic (candidates, sizeof (CompactionCandidate) * max_candidates, INTERNAL_MEM_MS_BLOCK_INFO_SORT);
+	}
+
 	for (i = 0; i < num_block_obj_sizes; ++i) {
 		float usage = (float)slots_used [i] / (float)slots_available [i];
-		if (num_blocks [i] > 5 && usage < evacuation_threshold) {
+		/* The parallel marker doesn't evacuate, and with a compaction budget we evacuate blocks, not size classes. */
+		if (num_blocks [i] > 5 && usage < evacuation_threshold && !parallel_mark && !compaction_budget) {
 			evacuate_block_obj_sizes [i] = TRUE;
 			/*
 			g_print ("slot size %d - %d of %d used\n",
@@ -1209,6 +1842,9 @@ ms_sweep (void)
 	want_evacuation = (float)total_evacuate_saved / (float)total_evacuate_heap > (1 - concurrent_evacuation_threshold);
 
 	have_swept = TRUE;
+
+	if (concurrent_sweep)
+		sweep_start ();
 }
 
 static void
@@ -1316,6 +1952,9 @@ major_start_major_collection (void)
 {
 	int i;
 
+	/* Sweeping clears the mark bits, so it must be done before we mark. */
+	sweep_finish ();
+
 	/* clear the free lists */
 	for (i = 0; i < num_block_obj_sizes; ++i) {
 		if (!evacuate_block_obj_sizes [i])
@@ -1367,7 +2006,7 @@ compare_pointers (const void *va, const void *vb) {
 #endif
 
 static void
-major_have_computer_minor_collection_allowance (void)
+free_excess_empty_blocks (void)
 {
 	size_t section_reserve = sgen_get_minor_collection_allowance () / MS_BLOCK_SIZE;
 
@@ -1454,6 +2093,8 @@ major_have_computer_minor_collection_allowance (void)
 					 * we're iterating.
 					 */
 					int j;
+					for (j = first; j <= d; ++j)
+						ms_recommit_empty_block (empty_block_arr [j]);
 					sgen_free_os_memory (empty_block_arr [first], MS_BLOCK_SIZE * num_blocks, SGEN_ALLOC_HEAP);
 					for (j = first; j <= d; ++j)
 						empty_block_arr [j] = NULL;
@@ -1505,6 +2146,7 @@ major_have_computer_minor_collection_allowance (void)
 
 	while (num_empty_blocks > section_reserve) {
 		void *next = *(void**)empty_blocks;
+		ms_recommit_empty_block (empty_blocks);
 		sgen_free_os_memory (empty_blocks, MS_BLOCK_SIZE, SGEN_ALLOC_HEAP);
 		empty_blocks = next;
 		/*
@@ -1520,6 +2162,44 @@ major_have_computer_minor_collection_allowance (void)
 	}
 }
 
+/*
+ * The empty blocks we keep around as a reserve for the next cycle are
+ * still backed by memory.  If they stay unused for long enough, give
+ * that memory back to the OS.
+ */
+static void
+decommit_idle_empty_blocks (void)
+{
+	mword delay = sgen_memgov_get_decommit_delay ();
+	void *block;
+
+	if (!delay || ms_pagesize >= MS_BLOCK_SIZE)
+		return;
+
+	for (block = empty_blocks; block; block = *(void**)block) {
+		mword idle = MS_EMPTY_BLOCK_IDLE (block);
+
+		if (idle == MS_EMPTY_BLOCK_DECOMMITTED)
+			continue;
+
+		if (++idle < delay) {
+			MS_EMPTY_BLOCK_IDLE (block) = idle;
+			continue;
+		}
+
+		sgen_decommit_os_memory ((char*)block + ms_pagesize, MS_BLOCK_SIZE - ms_pagesize);
+		MS_EMPTY_BLOCK_IDLE (block) = MS_EMPTY_BLOCK_DECOMMITTED;
+		++stat_major_blocks_decommitted;
+	}
+}
+
+static void
+major_have_computer_minor_collection_allowance (void)
+{
+	free_excess_empty_blocks ();
+	decommit_idle_empty_blocks ();
+}
+
 static void
 major_find_pin_queue_start_ends (SgenGrayQueue *queue)
 {
@@ -1561,6 +2241,9 @@ major_get_used_size (void)
 	FOREACH_BLOCK (block) {
 		int count = MS_BLOCK_FREE / block->obj_size;
 		void **iter;
+		/* The free list is only valid once the block is swept. */
+		if (!block_is_swept (block))
+			sweep_block (block, FALSE);
 		size += count * block->obj_size;
 		for (iter = block->free_list; iter; iter = (void**)*iter)
 			size -= block->obj_size;
@@ -1587,12 +2270,27 @@ major_handle_gc_param (const char *opt)
 		}
 		evacuation_threshold = (float)percentage / 100.0f;
 		return TRUE;
+	} else if (g_str_has_prefix (opt, "compaction-budget=")) {
+		const char *arg = strchr (opt, '=') + 1;
+		size_t budget;
+		if (!*arg || !mono_gc_parse_environment_string_extract_number (arg, &budget)) {
+			fprintf (stderr, "compaction-budget must be an integer.\n");
+			exit (1);
+		}
+		compaction_budget = budget;
+		return TRUE;
 	} else if (!strcmp (opt, "lazy-sweep")) {
 		lazy_sweep = TRUE;
 		return TRUE;
 	} else if (!strcmp (opt, "no-lazy-sweep")) {
 		lazy_sweep = FALSE;
 		return TRUE;
+	} else if (!strcmp (opt, "concurrent-sweep")) {
+		concurrent_sweep = TRUE;
+		return TRUE;
+	} else if (!strcmp (opt, "no-concurrent-sweep")) {
+		concurrent_sweep = FALSE;
+		return TRUE;
 	}
 
 	return FALSE;
@@ -1604,7 +2302,9 @@ major_print_gc_param_usage (void)
 	fprintf (stderr,
 			""
 			"  evacuation-threshold=P (where P is a percentage, an integer in 0-100)\n"
+			"  compaction-budget=N (where N is an integer, possibly with a k or m suffix)\n"
 			"  (no-)lazy-sweep\n"
+			"  (no-)concurrent-sweep\n"
 			);
 }
 
@@ -1627,66 +2327,28 @@ extern guint64 scanned_objects;
 extern guint64 remarked_cards;
 #endif
 
-#define CARD_WORDS_PER_BLOCK (CARDS_PER_BLOCK / SIZEOF_VOID_P)
-/*
- * MS blocks are 16K aligned.
- * Cardtables are 4K aligned, at least.
- * This means that the cardtable of a given block is 32 bytes aligned.
- */
-static guint8*
-initial_skip_card (guint8 *card_data)
-{
-	mword *cards = (mword*)card_data;
-	mword card;
-	int i;
-	for (i = 0; i < CARD_WORDS_PER_BLOCK; ++i) {
-		card = cards [i];
-		if (card)
-			break;
-	}
-
-	if (i == CARD_WORDS_PER_BLOCK)
-		return card_data + CARDS_PER_BLOCK;
-
-#if defined(__i386__) && defined(__GNUC__)
-	return card_data + i * 4 +  (__builtin_ffs (card) - 1) / 8;
-#elif defined(__x86_64__) && defined(__GNUC__)
-	return card_data + i * 8 +  (__builtin_ffsll (card) - 1) / 8;
-#elif defined(__s390x__) && defined(__GNUC__)
-	return card_data + i * 8 +  (__builtin_ffsll (GUINT64_TO_LE(card)) - 1) / 8;
-#else
-	for (i = i * SIZEOF_VOID_P; i < CARDS_PER_BLOCK; ++i) {
-		if (card_data [i])
-			return &card_data [i];
-	}
-	return card_data;
-#endif
-}
-
-
-static G_GNUC_UNUSED guint8*
-skip_card (guint8 *card_data, guint8 *card_data_end)
-{
-	while (card_data < card_data_end && !*card_data)
-		++card_data;
-	return card_data;
-}
-
 #define MS_BLOCK_OBJ_INDEX_FAST(o,b,os)	(((char*)(o) - ((b) + MS_BLOCK_SKIP)) / (os))
 #define MS_BLOCK_OBJ_FAST(b,os,i)			((b) + MS_BLOCK_SKIP + (os) * (i))
 #define MS_OBJ_ALLOCED_FAST(o,b)		(*(void**)(o) && (*(char**)(o) < (b) || *(char**)(o) >= (b) + MS_BLOCK_SIZE))
 
+/*
+ * Scans the cards of the JOB_INDEX-th of JOB_SPLIT_COUNT contiguous
+ * ranges of blocks.
+ */
 static void
-major_scan_card_table (gboolean mod_union, SgenGrayQueue *queue)
+major_scan_card_table (gboolean mod_union, int job_index, int job_split_count, SgenGrayQueue *queue)
 {
 	MSBlockInfo *block;
 	gboolean has_references;
 	ScanObjectFunc scan_func = sgen_get_current_object_ops ()->scan_object;
+	size_t num_blocks = allocated_blocks.next_slot;
+	size_t first_block = num_blocks * job_index / job_split_count;
+	size_t last_block = num_blocks * (job_index + 1) / job_split_count;
 
 	if (!concurrent_mark)
 		g_assert (!mod_union);
 
-	FOREACH_BLOCK_HAS_REFERENCES (block, has_references) {
+	FOREACH_BLOCK_RANGE_HAS_REFERENCES (block, first_block, last_block, has_references) {
 		int block_obj_size;
 		char *block_start;
 
@@ -1733,7 +2395,7 @@ major_scan_card_table (gboolean mod_union, SgenGrayQueue *queue)
 			while (obj < end) {
 				size_t card_offset;
 
-				if (!block->swept)
+				if (!block_is_swept (block))
 					sweep_block (block, FALSE);
 
 				if (!MS_OBJ_ALLOCED_FAST (obj, block_start))
@@ -1781,7 +2443,9 @@ major_scan_card_table (gboolean mod_union, SgenGrayQueue *queue)
 
 			card_data += MS_BLOCK_SKIP >> CARD_BITS;
 
-			for (card_data = initial_skip_card (card_data); card_data < card_data_end; ++card_data) { //card_data = skip_card (card_data + 1, card_data_end)) {
+			for (card_data = sgen_card_table_find_next_card (card_data, card_data_end);
+					card_data < card_data_end;
+					card_data = sgen_card_table_find_next_card (card_data + 1, card_data_end)) {
 				size_t index;
 				size_t idx = card_data - card_base;
 				char *start = (char*)(block_start + idx * CARD_SIZE_IN_BYTES);
@@ -1790,10 +2454,7 @@ major_scan_card_table (gboolean mod_union, SgenGrayQueue *queue)
 
 				HEAVY_STAT (++scanned_cards);
 
-				if (!*card_data)
-					continue;
-
-				if (!block->swept)
+				if (!block_is_swept (block))
 					sweep_block (block, FALSE);
 
 				HEAVY_STAT (++marked_cards);
@@ -1886,21 +2547,97 @@ alloc_free_block_lists (MSBlockInfo ***lists)
 		lists [i] = sgen_alloc_internal_dynamic (sizeof (MSBlockInfo*) * num_block_obj_sizes, INTERNAL_MEM_MS_TABLES, TRUE);
 }
 
+static void*
+major_alloc_worker_data (void)
+{
+	MSBlockInfo ***lists = sgen_alloc_internal_dynamic (sizeof (MSBlockInfo**) * MS_BLOCK_TYPE_MAX, INTERNAL_MEM_MS_TABLES, TRUE);
+	alloc_free_block_lists (lists);
+	return lists;
+}
+
+static void
+major_init_worker_thread (void *data)
+{
+	MSBlockInfo ***lists = data;
+	int i;
+
+	g_assert (lists && lists != free_block_lists);
+	for (i = 0; i < MS_BLOCK_TYPE_MAX; ++i) {
+		int j;
+		for (j = 0; j < num_block_obj_sizes; ++j)
+			g_assert (!lists [i][j]);
+	}
+
+	mono_native_tls_set_value (workers_free_block_lists_key, data);
+}
+
+/*
+ * Gives the blocks a worker still has free slots in back to the global
+ * free lists.  This is called from the GC thread once the workers have
+ * finished, so no atomics are needed.
+ */
+static void
+major_reset_worker_data (void *data)
+{
+	MSBlockInfo ***lists = data;
+	int i;
+
+	for (i = 0; i < MS_BLOCK_TYPE_MAX; ++i) {
+		int j;
+		for (j = 0; j < num_block_obj_sizes; ++j) {
+			MSBlockInfo *block = lists [i][j];
+			while (block) {
+				MSBlockInfo *next = block->next_free;
+				block->next_free = free_block_lists [i][j];
+				free_block_lists [i][j] = block;
+				block = next;
+			}
+			lists [i][j] = NULL;
+		}
+	}
+
+	ms_add_par_allocated_blocks ();
+}
+
+/* Called when the workers shut down, after their data has been reset */
+static void
+major_free_worker_data (void *data)
+{
+	MSBlockInfo ***lists = data;
+	int i;
+
+	for (i = 0; i < MS_BLOCK_TYPE_MAX; ++i) {
+		int j;
+		for (j = 0; j < num_block_obj_sizes; ++j)
+			g_assert (!lists [i][j]);
+		sgen_free_internal_dynamic (lists [i], sizeof (MSBlockInfo*) * num_block_obj_sizes, INTERNAL_MEM_MS_TABLES);
+	}
+	sgen_free_internal_dynamic (lists, sizeof (MSBlockInfo**) * MS_BLOCK_TYPE_MAX, INTERNAL_MEM_MS_TABLES);
+}
+
 #undef pthread_create
 
 static void
 post_param_init (SgenMajorCollector *collector)
 {
+	/* Blocks the sweep thread hasn't got to yet are swept lazily. */
+	if (concurrent_sweep && !lazy_sweep) {
+		sgen_env_var_error (MONO_GC_PARAMS_NAME, "Disabling concurrent sweep.", "`concurrent-sweep` requires `lazy-sweep`.");
+		concurrent_sweep = FALSE;
+	}
+
 	collector->sweeps_lazily = lazy_sweep;
 }
 
 static void
-sgen_marksweep_init_internal (SgenMajorCollector *collector, gboolean is_concurrent)
+sgen_marksweep_init_internal (SgenMajorCollector *collector, gboolean is_concurrent, gboolean is_parallel)
 {
 	int i;
 
 	sgen_register_fixed_internal_mem_type (INTERNAL_MEM_MS_BLOCK_INFO, sizeof (MSBlockInfo));
 
+	ms_pagesize = mono_pagesize ();
+
 	num_block_obj_sizes = ms_calculate_block_obj_sizes (MS_BLOCK_OBJ_SIZE_FACTOR, NULL);
 	block_obj_sizes = sgen_alloc_internal_dynamic (sizeof (int) * num_block_obj_sizes, INTERNAL_MEM_MS_TABLES, TRUE);
 	ms_calculate_block_obj_sizes (MS_BLOCK_OBJ_SIZE_FACTOR, block_obj_sizes);
@@ -1920,6 +2657,9 @@ sgen_marksweep_init_internal (SgenMajorCollector *collector, gboolean is_concurr
 
 	alloc_free_block_lists (free_block_lists);
 
+	LOCK_INIT (ms_block_list_mutex);
+	mono_native_tls_alloc (&workers_free_block_lists_key, NULL);
+
 	for (i = 0; i < MS_NUM_FAST_BLOCK_OBJ_SIZE_INDEXES; ++i)
 		fast_block_obj_size_indexes [i] = ms_find_block_obj_size_index (i * 8);
 	for (i = 0; i < MS_NUM_FAST_BLOCK_OBJ_SIZE_INDEXES * 8; ++i)
@@ -1928,7 +2668,13 @@ sgen_marksweep_init_internal (SgenMajorCollector *collector, gboolean is_concurr
 	mono_counters_register ("# major blocks allocated", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_blocks_alloced);
 	mono_counters_register ("# major blocks freed", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_blocks_freed);
 	mono_counters_register ("# major blocks lazy swept", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_blocks_lazy_swept);
+	mono_counters_register ("# pinned alloc blocks cached", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_pinned_alloc_blocks_cached);
+	mono_counters_register ("# major blocks swept concurrently", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_blocks_swept_concurrently);
+	mono_counters_register ("# major block sweep waits", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_blocks_sweep_waited);
+	mono_counters_register ("Major concurrent sweep", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_major_concurrent_sweep);
 	mono_counters_register ("# major objects evacuated", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_objects_evacuated);
+	mono_counters_register ("# major blocks compacted", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_blocks_compacted);
+	mono_counters_register ("# major blocks decommitted", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_blocks_decommitted);
 #if SIZEOF_VOID_P != 8
 	mono_counters_register ("# major blocks freed ideally", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_blocks_freed_ideal);
 	mono_counters_register ("# major blocks freed less ideally", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_major_blocks_freed_less_ideal);
@@ -1939,6 +2685,8 @@ sgen_marksweep_init_internal (SgenMajorCollector *collector, gboolean is_concurr
 	collector->section_size = MAJOR_SECTION_SIZE;
 
 	concurrent_mark = is_concurrent;
+	parallel_mark = is_parallel;
+	collector->is_parallel = is_parallel;
 	if (is_concurrent) {
 		collector->is_concurrent = TRUE;
 		collector->want_synchronous_collection = &want_evacuation;
@@ -1954,9 +2702,13 @@ sgen_marksweep_init_internal (SgenMajorCollector *collector, gboolean is_concurr
 	collector->alloc_heap = major_alloc_heap;
 	collector->is_object_live = major_is_object_live;
 	collector->alloc_small_pinned_obj = major_alloc_small_pinned_obj;
+	collector->try_alloc_small_pinned_obj = major_try_alloc_small_pinned_obj;
+	collector->release_thread_pinned_blocks = major_release_thread_pinned_blocks;
+	collector->free_thread_pinned_blocks = major_free_thread_pinned_blocks;
 	collector->alloc_degraded = major_alloc_degraded;
 
 	collector->alloc_object = major_alloc_object;
+	collector->par_alloc_object = major_par_alloc_object;
 	collector->free_pinned_object = free_pinned_object;
 	collector->iterate_objects = major_iterate_objects;
 	collector->free_non_pinned_object = major_free_non_pinned_object;
@@ -1989,9 +2741,21 @@ sgen_marksweep_init_internal (SgenMajorCollector *collector, gboolean is_concurr
 	collector->is_valid_object = major_is_valid_object;
 	collector->describe_pointer = major_describe_pointer;
 	collector->count_cards = major_count_cards;
+	collector->is_worker_thread = major_is_worker_thread;
+	if (!is_concurrent) {
+		collector->alloc_worker_data = major_alloc_worker_data;
+		collector->init_worker_thread = major_init_worker_thread;
+		collector->reset_worker_data = major_reset_worker_data;
+		collector->free_worker_data = major_free_worker_data;
+	}
 
-	collector->major_ops.copy_or_mark_object = major_copy_or_mark_object_canonical;
-	collector->major_ops.scan_object = major_scan_object_with_evacuation;
+	if (is_parallel) {
+		collector->major_ops.copy_or_mark_object = major_copy_or_mark_object_par_canonical;
+		collector->major_ops.scan_object = major_scan_object_par;
+	} else {
+		collector->major_ops.copy_or_mark_object = major_copy_or_mark_object_canonical;
+		collector->major_ops.scan_object = major_scan_object_with_evacuation;
+	}
 	if (is_concurrent) {
 		collector->major_concurrent_ops.copy_or_mark_object = major_copy_or_mark_object_concurrent_canonical;
 		collector->major_concurrent_ops.scan_object = major_scan_object_no_mark_concurrent;
@@ -2000,7 +2764,7 @@ sgen_marksweep_init_internal (SgenMajorCollector *collector, gboolean is_concurr
 
 #if !defined (FIXED_HEAP) && !defined (SGEN_PARALLEL_MARK)
 	/* FIXME: this will not work with evacuation or the split nursery. */
-	if (!is_concurrent)
+	if (!is_concurrent && !is_parallel)
 		collector->drain_gray_stack = drain_gray_stack;
 
 #ifdef HEAVY_STATISTICS
@@ -2034,13 +2798,19 @@ sgen_marksweep_init_internal (SgenMajorCollector *collector, gboolean is_concurr
 void
 sgen_marksweep_init (SgenMajorCollector *collector)
 {
-	sgen_marksweep_init_internal (collector, FALSE);
+	sgen_marksweep_init_internal (collector, FALSE, FALSE);
+}
+
+void
+sgen_marksweep_par_init (SgenMajorCollector *collector)
+{
+	sgen_marksweep_init_internal (collector, FALSE, TRUE);
 }
 
 void
 sgen_marksweep_conc_init (SgenMajorCollector *collector)
 {
-	sgen_marksweep_init_internal (collector, TRUE);
+	sgen_marksweep_init_internal (collector, TRUE, FALSE);
 }
 
 #endif
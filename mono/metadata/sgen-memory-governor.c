@@ -49,6 +49,10 @@ static double save_target_ratio = SGEN_DEFAULT_SAVE_TARGET_RATIO;
 static mword allocated_heap;
 static mword total_alloc = 0;
 static mword total_alloc_max = 0;
+/* `total_alloc` is what we have reserved, this is what's backed by memory */
+static mword total_committed = 0;
+
+static int decommit_delay = SGEN_DEFAULT_DECOMMIT_DELAY;
 
 /* GC triggers. */
 
@@ -121,6 +125,7 @@ sgen_memgov_try_calculate_minor_collection_allowance (gboolean overwrite)
 		SGEN_LOG (1, "After collection: %ld bytes (%ld major, %ld LOS)",
 				  (long)new_heap_size, (long)new_major, (long)last_collection_los_memory_usage);
 		SGEN_LOG (1, "Allowance: %ld bytes", (long)minor_collection_allowance);
+		SGEN_LOG (1, "OS memory: %ld bytes reserved, %ld committed", (long)total_alloc, (long)total_committed);
 	}
 
 	if (major_collector.have_computed_minor_collection_allowance)
@@ -286,6 +291,7 @@ sgen_alloc_os_memory (size_t size, SgenAllocFlags flags, const char *assert_desc
 	sgen_assert_memory_alloc (ptr, size, assert_description);
 	if (ptr) {
 		SGEN_ATOMIC_ADD_P (total_alloc, size);
+		SGEN_ATOMIC_ADD_P (total_committed, size);
 		if (flags & SGEN_ALLOC_HEAP)
 			MONO_GC_HEAP_ALLOC ((mword)ptr, size);
 		total_alloc_max = MAX (total_alloc_max, total_alloc);
@@ -305,6 +311,7 @@ sgen_alloc_os_memory_aligned (size_t size, mword alignment, SgenAllocFlags flags
 	sgen_assert_memory_alloc (ptr, size, assert_description);
 	if (ptr) {
 		SGEN_ATOMIC_ADD_P (total_alloc, size);
+		SGEN_ATOMIC_ADD_P (total_committed, size);
 		if (flags & SGEN_ALLOC_HEAP)
 			MONO_GC_HEAP_ALLOC ((mword)ptr, size);
 		total_alloc_max = MAX (total_alloc_max, total_alloc);
@@ -314,6 +321,7 @@ sgen_alloc_os_memory_aligned (size_t size, mword alignment, SgenAllocFlags flags
 
 /*
  * Free the memory returned by sgen_alloc_os_memory (), returning it to the OS.
+ * Parts of it that were decommitted must have been recommitted first.
  */
 void
 sgen_free_os_memory (void *addr, size_t size, SgenAllocFlags flags)
@@ -322,11 +330,45 @@ sgen_free_os_memory (void *addr, size_t size, SgenAllocFlags flags)
 
 	mono_vfree (addr, size);
 	SGEN_ATOMIC_ADD_P (total_alloc, -(gssize)size);
+	SGEN_ATOMIC_ADD_P (total_committed, -(gssize)size);
 	if (flags & SGEN_ALLOC_HEAP)
 		MONO_GC_HEAP_FREE ((mword)addr, size);
 	total_alloc_max = MAX (total_alloc_max, total_alloc);
 }
 
+/*
+ * Give the pages of a range of memory returned by sgen_alloc_os_memory ()
+ * back to the OS, but keep the range mapped.  The range reads as zeroes
+ * afterwards.  `addr` and `size` must be page aligned.
+ */
+void
+sgen_decommit_os_memory (void *addr, size_t size)
+{
+	mono_mprotect (addr, size, MONO_MMAP_READ | MONO_MMAP_WRITE | MONO_MMAP_DISCARD);
+	SGEN_ATOMIC_ADD_P (total_committed, -(gssize)size);
+}
+
+/*
+ * Must be called before a decommitted range is used or freed again.  The
+ * pages are faulted back in when they're touched, so this is bookkeeping
+ * only.
+ */
+void
+sgen_recommit_os_memory (void *addr, size_t size)
+{
+	SGEN_ATOMIC_ADD_P (total_committed, size);
+}
+
+/*
+ * Returns after how many major collections unused heap memory should be
+ * decommitted, or 0 if it shouldn't be.
+ */
+int
+sgen_memgov_get_decommit_delay (void)
+{
+	return decommit_delay;
+}
+
 int64_t
 mono_gc_get_heap_size (void)
 {
@@ -356,7 +398,7 @@ gboolean
 sgen_memgov_try_alloc_space (mword size, int space)
 {
 	if (sgen_memgov_available_free_space () < size) {
-		SGEN_ASSERT (4, !sgen_is_worker_thread (mono_native_thread_id_get ()), "Memory shouldn't run out in worker thread");
+		SGEN_ASSERT (4, sgen_collection_is_parallel () || !sgen_is_worker_thread (mono_native_thread_id_get ()), "Memory shouldn't run out in worker thread outside of parallel nursery collections");
 		return FALSE;
 	}
 
@@ -366,16 +408,20 @@ sgen_memgov_try_alloc_space (mword size, int space)
 }
 
 void
-sgen_memgov_init (size_t max_heap, size_t soft_limit, gboolean debug_allowance, double allowance_ratio, double save_target)
+sgen_memgov_init (size_t max_heap, size_t soft_limit, gboolean debug_allowance, double allowance_ratio, double save_target, int decommit_after)
 {
 	if (soft_limit)
 		soft_heap_limit = soft_limit;
 
+	if (decommit_after >= 0)
+		decommit_delay = decommit_after;
+
 	debug_print_allowance = debug_allowance;
 	minor_collection_allowance = MIN_MINOR_COLLECTION_ALLOWANCE;
 
 	mono_counters_register ("Memgov alloc", MONO_COUNTER_GC | MONO_COUNTER_WORD | MONO_COUNTER_BYTES | MONO_COUNTER_VARIABLE, &total_alloc);
 	mono_counters_register ("Memgov max alloc", MONO_COUNTER_GC | MONO_COUNTER_WORD | MONO_COUNTER_BYTES | MONO_COUNTER_MONOTONIC, &total_alloc_max);
+	mono_counters_register ("Memgov committed", MONO_COUNTER_GC | MONO_COUNTER_WORD | MONO_COUNTER_BYTES | MONO_COUNTER_VARIABLE, &total_committed);
 
 	if (max_heap == 0)
 		return;
@@ -21,6 +21,9 @@
 
 #define collector_pin_object(obj, queue) sgen_pin_object (obj, queue);
 #define COLLECTOR_SERIAL_ALLOC_FOR_PROMOTION alloc_for_promotion
+#ifdef PARALLEL_COPY_OBJECT
+#define COLLECTOR_PARALLEL_ALLOC_FOR_PROMOTION par_alloc_for_promotion
+#endif
 
 extern guint64 stat_nursery_copy_object_failed_to_space; /* from sgen-gc.c */
 
@@ -212,6 +215,99 @@ SERIAL_COPY_OBJECT_FROM_OBJ (void **obj_slot, SgenGrayQueue *queue)
 #endif
 }
 
+#ifdef PARALLEL_COPY_OBJECT
+/*
+ * The parallel versions are only used with the simple nursery, so
+ * objects are always promoted to the major heap.  They can be called
+ * from several worker threads at the same time, so they must not
+ * touch non-atomic global state.  Their addresses are taken for the
+ * parallel ops, so they are not always inlined.
+ */
+static inline void
+PARALLEL_COPY_OBJECT (void **obj_slot, SgenGrayQueue *queue)
+{
+	char *forwarded;
+	char *obj = *obj_slot;
+
+	SGEN_ASSERT (9, current_collection_generation == GENERATION_NURSERY, "calling minor-parallel-copy from a %d generation collection", current_collection_generation);
+
+	HEAVY_STAT (++stat_copy_object_called_nursery);
+
+	if (!sgen_ptr_in_nursery (obj)) {
+		HEAVY_STAT (++stat_nursery_copy_object_failed_from_space);
+		return;
+	}
+
+	SGEN_LOG (9, "Precise parallel copy of %p from %p", obj, obj_slot);
+
+	if ((forwarded = SGEN_OBJECT_IS_FORWARDED (obj))) {
+		HEAVY_STAT (++stat_nursery_copy_object_failed_forwarded);
+		SGEN_UPDATE_REFERENCE (obj_slot, forwarded);
+		return;
+	}
+	if (G_UNLIKELY (SGEN_OBJECT_IS_PINNED (obj))) {
+		HEAVY_STAT (++stat_nursery_copy_object_failed_pinned);
+		return;
+	}
+
+	HEAVY_STAT (++stat_objects_copied_nursery);
+
+	SGEN_UPDATE_REFERENCE (obj_slot, copy_object_no_checks_par (obj, queue));
+}
+
+/*
+ * PARALLEL_COPY_OBJECT_FROM_OBJ:
+ *
+ *   Similar to PARALLEL_COPY_OBJECT, but assumes that OBJ_SLOT is part of an object, so it handles global remsets as well.
+ */
+static inline void
+PARALLEL_COPY_OBJECT_FROM_OBJ (void **obj_slot, SgenGrayQueue *queue)
+{
+	char *forwarded;
+	char *obj = *obj_slot;
+	void *copy;
+
+	SGEN_ASSERT (9, current_collection_generation == GENERATION_NURSERY, "calling minor-parallel-copy-from-obj from a %d generation collection", current_collection_generation);
+
+	HEAVY_STAT (++stat_copy_object_called_nursery);
+
+	if (!sgen_ptr_in_nursery (obj)) {
+		HEAVY_STAT (++stat_nursery_copy_object_failed_from_space);
+		return;
+	}
+
+	SGEN_LOG (9, "Precise parallel copy of %p from %p", obj, obj_slot);
+
+	if ((forwarded = SGEN_OBJECT_IS_FORWARDED (obj))) {
+		HEAVY_STAT (++stat_nursery_copy_object_failed_forwarded);
+		SGEN_UPDATE_REFERENCE (obj_slot, forwarded);
+		return;
+	}
+	if (G_UNLIKELY (SGEN_OBJECT_IS_PINNED (obj))) {
+		HEAVY_STAT (++stat_nursery_copy_object_failed_pinned);
+		if (!sgen_ptr_in_nursery (obj_slot) && !SGEN_OBJECT_IS_CEMENTED (obj))
+			sgen_add_to_global_remset (obj_slot, obj);
+		return;
+	}
+
+	HEAVY_STAT (++stat_objects_copied_nursery);
+
+	copy = copy_object_no_checks_par (obj, queue);
+	SGEN_UPDATE_REFERENCE (obj_slot, copy);
+	/* copy_object_no_checks_par () returns obj if it was pinned meanwhile */
+	if (G_UNLIKELY (obj == copy)) {
+		if (!sgen_ptr_in_nursery (obj_slot) && !SGEN_OBJECT_IS_CEMENTED (copy))
+			sgen_add_to_global_remset (obj_slot, copy);
+	}
+}
+
 #define FILL_MINOR_COLLECTOR_COPY_OBJECT(collector)	do {			\
 		(collector)->serial_ops.copy_or_mark_object = SERIAL_COPY_OBJECT;			\
+		if ((collector)->is_parallel)					\
+			(collector)->parallel_ops.copy_or_mark_object = PARALLEL_COPY_OBJECT; \
 	} while (0)
+#else
+#define FILL_MINOR_COLLECTOR_COPY_OBJECT(collector)	do {			\
+		(collector)->serial_ops.copy_or_mark_object = SERIAL_COPY_OBJECT;			\
+	} while (0)
+#endif
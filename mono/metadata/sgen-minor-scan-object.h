@@ -78,7 +78,53 @@ SERIAL_SCAN_VTYPE (char *start, mword desc, SgenGrayQueue *queue BINARY_PROTOCOL
 #include "sgen-scan-object.h"
 }
 
+#ifdef PARALLEL_SCAN_OBJECT
+#undef HANDLE_PTR
+/* Global remsets are handled in PARALLEL_COPY_OBJECT_FROM_OBJ */
+#define HANDLE_PTR(ptr,obj)	do {	\
+		void *__old = *(ptr);	\
+		binary_protocol_scan_process_reference ((obj), (ptr), __old); \
+		if (__old) {	\
+			PARALLEL_COPY_OBJECT_FROM_OBJ ((ptr), queue);	\
+			SGEN_COND_LOG (9, __old != *(ptr), "Overwrote field at %p with %p (was: %p)", (ptr), *(ptr), __old); \
+		}	\
+	} while (0)
+
+static void
+PARALLEL_SCAN_OBJECT (char *start, mword desc, SgenGrayQueue *queue)
+{
+	SGEN_ASSERT (9, sgen_get_current_collection_generation () == GENERATION_NURSERY, "Must not use minor scan during major collection.");
+
+#define SCAN_OBJECT_PROTOCOL
+#include "sgen-scan-object.h"
+
+	HEAVY_STAT (++stat_scan_object_called_nursery);
+}
+
+static void
+PARALLEL_SCAN_VTYPE (char *start, mword desc, SgenGrayQueue *queue BINARY_PROTOCOL_ARG (size_t size))
+{
+	SGEN_ASSERT (9, sgen_get_current_collection_generation () == GENERATION_NURSERY, "Must not use minor scan during major collection.");
+
+	/* The descriptors include info about the MonoObject header as well */
+	start -= sizeof (MonoObject);
+
+#define SCAN_OBJECT_NOVTABLE
+#define SCAN_OBJECT_PROTOCOL
+#include "sgen-scan-object.h"
+}
+
 #define FILL_MINOR_COLLECTOR_SCAN_OBJECT(collector)	do {			\
 		(collector)->serial_ops.scan_object = SERIAL_SCAN_OBJECT;	\
 		(collector)->serial_ops.scan_vtype = SERIAL_SCAN_VTYPE; \
+		if ((collector)->is_parallel) {				\
+			(collector)->parallel_ops.scan_object = PARALLEL_SCAN_OBJECT; \
+			(collector)->parallel_ops.scan_vtype = PARALLEL_SCAN_VTYPE; \
+		}							\
 	} while (0)
+#else
+#define FILL_MINOR_COLLECTOR_SCAN_OBJECT(collector)	do {			\
+		(collector)->serial_ops.scan_object = SERIAL_SCAN_OBJECT;	\
+		(collector)->serial_ops.scan_vtype = SERIAL_SCAN_VTYPE; \
+	} while (0)
+#endif
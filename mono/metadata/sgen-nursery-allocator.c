@@ -110,6 +110,20 @@ int sgen_nursery_bits = 22;
 char *sgen_space_bitmap MONO_INTERNAL;
 size_t sgen_space_bitmap_size MONO_INTERNAL;
 
+/*
+ * Dynamic nursery sizing.  The whole nursery is reserved up front, but
+ * only its first `nursery_active_size` bytes are handed out to the
+ * mutator.  If there is a pause time goal the active size is adapted
+ * after each nursery collection, see sgen_nursery_adapt_size ().
+ */
+static size_t nursery_active_size;
+static size_t nursery_min_active_size;
+/* The pause time goal in 100ns ticks, or 0 if the nursery size is fixed */
+gint64 sgen_nursery_max_pause = 0;
+
+static guint64 stat_nursery_grown = 0;
+static guint64 stat_nursery_shrunk = 0;
+
 #ifdef HEAVY_STATISTICS
 
 static gint32 stat_wasted_bytes_trailer = 0;
@@ -731,6 +745,26 @@ add_nursery_frag (SgenFragmentAllocator *allocator, size_t frag_size, char* frag
 	}
 }
 
+/*
+ * Like add_nursery_frag (), but only the part of the fragment below the
+ * end of the active nursery is given to the allocator.  The rest is
+ * cleared so the nursery can still be walked.
+ */
+static void
+add_nursery_frag_in_active_range (SgenFragmentAllocator *allocator, char *frag_start, char *frag_end)
+{
+	char *active_end = sgen_nursery_start + nursery_active_size;
+
+	if (frag_end > active_end) {
+		char *clear_start = MAX (frag_start, active_end);
+		sgen_clear_range (clear_start, frag_end);
+		frag_end = clear_start;
+	}
+
+	if (frag_end > frag_start)
+		add_nursery_frag (allocator, frag_end - frag_start, frag_start, frag_end);
+}
+
 static void
 fragment_list_reverse (SgenFragmentAllocator *allocator)
 {
@@ -808,7 +842,7 @@ sgen_build_nursery_fragments (GCMemSection *nursery_section, SgenGrayQueue *unpi
 		g_assert (frag_size >= 0);
 		g_assert (size > 0);
 		if (frag_size && size)
-			add_nursery_frag (&mutator_allocator, frag_size, frag_start, frag_end);	
+			add_nursery_frag_in_active_range (&mutator_allocator, frag_start, frag_end);
 
 		frag_size = size;
 #ifdef NALLOC_DEBUG
@@ -821,7 +855,7 @@ sgen_build_nursery_fragments (GCMemSection *nursery_section, SgenGrayQueue *unpi
 	frag_end = sgen_nursery_end;
 	frag_size = frag_end - frag_start;
 	if (frag_size)
-		add_nursery_frag (&mutator_allocator, frag_size, frag_start, frag_end);
+		add_nursery_frag_in_active_range (&mutator_allocator, frag_start, frag_end);
 
 	/* Now it's safe to release the fragments exclude list. */
 	sgen_minor_collector.build_fragments_release_exclude_head ();
@@ -896,6 +930,63 @@ sgen_nursery_alloc_range (size_t desired_size, size_t minimum_size, size_t *out_
 	return sgen_fragment_allocator_par_range_alloc (&mutator_allocator, desired_size, minimum_size, out_alloc_size);
 }
 
+/*** Dynamic sizing ***/
+
+size_t
+sgen_nursery_get_active_size (void)
+{
+	return nursery_active_size;
+}
+
+/*
+ * Called in a nursery collection after the live objects have been
+ * copied, but before the nursery fragments are built, with how long the
+ * collection has taken so far and how many bytes were copied.  Picks
+ * the active nursery size for the next cycle.
+ */
+void
+sgen_nursery_adapt_size (gint64 pause, mword bytes_survived)
+{
+	size_t new_size = nursery_active_size;
+	double survival_rate;
+
+	if (!sgen_nursery_max_pause)
+		return;
+
+	survival_rate = (double)bytes_survived / nursery_active_size;
+
+	if (pause > sgen_nursery_max_pause) {
+		/* The time we take is mostly spent on the survivors, so shrink proportionally. */
+		new_size = (size_t)(nursery_active_size * MAX ((double)sgen_nursery_max_pause / pause, 0.5));
+	} else if (pause * 2 < sgen_nursery_max_pause) {
+		/*
+		 * There's room to spare.  If a lot survives we're probably
+		 * promoting objects that would die soon, so grow quickly.
+		 * Otherwise grow a little so we collect less often.
+		 */
+		if (survival_rate >= SGEN_NURSERY_HIGH_SURVIVAL_RATE)
+			new_size = nursery_active_size * 2;
+		else
+			new_size = nursery_active_size + nursery_active_size / 4;
+	}
+
+	new_size = new_size & ~(size_t)(SGEN_NURSERY_RESIZE_GRANULE - 1);
+	new_size = MAX (MIN (new_size, sgen_nursery_size), nursery_min_active_size);
+
+	if (new_size == nursery_active_size)
+		return;
+
+	SGEN_LOG (2, "Resizing nursery from %zd to %zd bytes (pause %lld us, survival rate %.2f)",
+			nursery_active_size, new_size, (long long)pause / 10, survival_rate);
+
+	if (new_size > nursery_active_size)
+		++stat_nursery_grown;
+	else
+		++stat_nursery_shrunk;
+
+	nursery_active_size = new_size;
+}
+
 /*** Initialization ***/
 
 #ifdef HEAVY_STATISTICS
@@ -922,6 +1013,10 @@ void
 sgen_init_nursery_allocator (void)
 {
 	sgen_register_fixed_internal_mem_type (INTERNAL_MEM_FRAGMENT, sizeof (SgenFragment));
+
+	mono_counters_register ("# nursery grown", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_nursery_grown);
+	mono_counters_register ("# nursery shrunk", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_nursery_shrunk);
+	mono_counters_register ("Nursery active size", MONO_COUNTER_GC | MONO_COUNTER_WORD | MONO_COUNTER_BYTES | MONO_COUNTER_VARIABLE, &nursery_active_size);
 #ifdef NALLOC_DEBUG
 	alloc_records = sgen_alloc_os_memory (sizeof (AllocRecord) * ALLOC_RECORD_COUNT, SGEN_ALLOC_INTERNAL | SGEN_ALLOC_ACTIVATE, "debugging memory");
 #endif
@@ -953,6 +1048,10 @@ sgen_nursery_allocator_set_nursery_bounds (char *start, char *end)
 	sgen_space_bitmap_size = (end - start + SGEN_TO_SPACE_GRANULE_IN_BYTES * 8 - 1) / (SGEN_TO_SPACE_GRANULE_IN_BYTES * 8);
 	sgen_space_bitmap = g_malloc0 (sgen_space_bitmap_size);
 
+	/* We start out with the whole nursery and only shrink it if we pause too long. */
+	nursery_active_size = end - start;
+	nursery_min_active_size = MIN (nursery_active_size, MAX (nursery_active_size / SGEN_NURSERY_MIN_ACTIVE_FRACTION, SGEN_NURSERY_RESIZE_GRANULE));
+
 	/* Setup the single first large fragment */
 	sgen_minor_collector.init_nursery (&mutator_allocator, start, end);
 }
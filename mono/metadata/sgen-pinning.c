@@ -26,6 +26,9 @@
 #include "metadata/sgen-pinning.h"
 #include "metadata/sgen-protocol.h"
 #include "metadata/sgen-pointer-queue.h"
+#include "metadata/sgen-workers.h"
+#include "utils/mono-counters.h"
+#include "utils/mono-time.h"
 
 static SgenPointerQueue pin_queue;
 static size_t last_num_pinned = 0;
@@ -33,11 +36,46 @@ static size_t last_num_pinned = 0;
 #define PIN_HASH_SIZE 1024
 static void *pin_hash_filter [PIN_HASH_SIZE];
 
+/*
+ * Pointers are staged in runs, usually one per thread stack.  Each run
+ * is sorted and uniqued when it ends, while it's still in the cache, so
+ * sgen_optimize_pin_queue () only has to merge the runs.  PIN_RUN_ENDS
+ * holds the index one past the end of each finished run.  Once the queue
+ * has been optimized its entries are rearranged by the collector, so
+ * later optimizations, after late pinning, sort the whole queue again.
+ */
+static SgenPointerQueue pin_run_ends;
+static size_t pin_run_start = 0;
+static gboolean pin_runs_valid = FALSE;
+
+/* Merge rounds with at least this many entries are split into worker jobs */
+#define PIN_QUEUE_PARALLEL_MERGE_MIN_ENTRIES	(64 * 1024)
+
+static guint64 stat_pin_queue_staged = 0;
+static guint64 stat_pin_queue_runs = 0;
+static guint64 stat_pin_queue_merge_jobs = 0;
+static guint64 time_pin_queue_parallel_merge = 0;
+static guint64 time_pin_queue_optimize = 0;
+
+void
+sgen_init_pin_queue_counters (void)
+{
+	mono_counters_register ("Pin queue staged entries", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_pin_queue_staged);
+	mono_counters_register ("Pin queue sorted runs", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_pin_queue_runs);
+	mono_counters_register ("Pin queue merge jobs", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_pin_queue_merge_jobs);
+	mono_counters_register ("Pin queue parallel merge", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_pin_queue_parallel_merge);
+	mono_counters_register ("Pin queue optimize", MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &time_pin_queue_optimize);
+}
+
 void
 sgen_init_pinning (void)
 {
 	memset (pin_hash_filter, 0, sizeof (pin_hash_filter));
 	pin_queue.mem_type = INTERNAL_MEM_PIN_QUEUE;
+	pin_run_ends.mem_type = INTERNAL_MEM_PIN_QUEUE;
+	sgen_pointer_queue_clear (&pin_run_ends);
+	pin_run_start = pin_queue.next_slot;
+	pin_runs_valid = TRUE;
 }
 
 void
@@ -60,11 +98,165 @@ sgen_pin_stage_ptr (void *ptr)
 	sgen_pointer_queue_add (&pin_queue, ptr);
 }
 
+/*
+ * Ends the run of pointers staged since the last call: the run is sorted
+ * and uniqued in place.
+ */
+void
+sgen_pin_stage_end_run (void)
+{
+	void **start, **cur, **end;
+
+	if (!pin_runs_valid || pin_queue.next_slot == pin_run_start)
+		return;
+
+	start = cur = pin_queue.data + pin_run_start;
+	end = pin_queue.data + pin_queue.next_slot;
+	stat_pin_queue_staged += end - start;
+
+	if (end - start > 1)
+		sgen_sort_addresses (start, end - start);
+	while (cur < end) {
+		*start = *cur++;
+		while (cur < end && *start == *cur)
+			cur++;
+		start++;
+	}
+
+	pin_queue.next_slot = start - pin_queue.data;
+	pin_run_start = pin_queue.next_slot;
+	sgen_pointer_queue_add (&pin_run_ends, (void*)pin_run_start);
+	++stat_pin_queue_runs;
+}
+
+typedef struct {
+	void **src;
+	void **dst;
+	size_t start, middle, end;
+} PinMergeJobData;
+
+static void
+merge_runs (void **src, void **dst, size_t start, size_t middle, size_t end)
+{
+	size_t i = start, j = middle, k = start;
+
+	while (i < middle && j < end) {
+		if (src [j] < src [i])
+			dst [k++] = src [j++];
+		else
+			dst [k++] = src [i++];
+	}
+	if (i < middle)
+		memcpy (dst + k, src + i, sizeof (void*) * (middle - i));
+	else if (j < end)
+		memcpy (dst + k, src + j, sizeof (void*) * (end - j));
+}
+
+static void
+job_merge_runs (WorkerData *worker_data, void *job_data_untyped)
+{
+	PinMergeJobData *job = job_data_untyped;
+	merge_runs (job->src, job->dst, job->start, job->middle, job->end);
+}
+
+/*
+ * Merges the sorted runs of the pin queue pairwise until only one is
+ * left.  The merges of a round are independent, so big rounds are run
+ * as worker jobs if there are several workers to run them.  Each such
+ * round costs a wakeup and a join of the workers, so the last round, with
+ * a single pair, is always done inline.  Duplicates between runs are left
+ * for the caller to remove.
+ */
+static void
+merge_pin_queue_runs (void)
+{
+	size_t num_runs = pin_run_ends.next_slot;
+	size_t *run_ends = (size_t*)pin_run_ends.data;
+	size_t tmp_size = pin_queue.next_slot;
+	void **src = pin_queue.data;
+	void **dst = sgen_alloc_internal_dynamic (sizeof (void*) * tmp_size, INTERNAL_MEM_PIN_QUEUE, TRUE);
+	void **tmp = dst;
+	gboolean use_workers = sgen_workers_get_job_split_count () > 1 && pin_queue.next_slot >= PIN_QUEUE_PARALLEL_MERGE_MIN_ENTRIES;
+	SGEN_TV_DECLARE (atv);
+	SGEN_TV_DECLARE (btv);
+
+	while (num_runs > 1) {
+		size_t num_pairs = num_runs / 2;
+		size_t i, start;
+		gboolean parallel = use_workers && num_pairs > 1;
+		PinMergeJobData jobs [parallel ? num_pairs : 1];
+		void *job_ptrs [parallel ? num_pairs : 1];
+
+		for (i = 0; i < num_pairs; ++i) {
+			start = i ? run_ends [2 * i - 1] : 0;
+			if (parallel) {
+				jobs [i].src = src;
+				jobs [i].dst = dst;
+				jobs [i].start = start;
+				jobs [i].middle = run_ends [2 * i];
+				jobs [i].end = run_ends [2 * i + 1];
+				job_ptrs [i] = &jobs [i];
+			} else {
+				merge_runs (src, dst, start, run_ends [2 * i], run_ends [2 * i + 1]);
+			}
+		}
+		if (parallel) {
+			stat_pin_queue_merge_jobs += num_pairs;
+			SGEN_TV_GETTIME (atv);
+			sgen_workers_run_jobs (job_merge_runs, job_ptrs, num_pairs);
+			SGEN_TV_GETTIME (btv);
+			time_pin_queue_parallel_merge += SGEN_TV_ELAPSED (atv, btv);
+		}
+
+		/* An odd run out is just copied */
+		if (num_runs & 1) {
+			start = run_ends [num_runs - 2];
+			memcpy (dst + start, src + start, sizeof (void*) * (run_ends [num_runs - 1] - start));
+		}
+
+		for (i = 0; i < num_pairs; ++i)
+			run_ends [i] = run_ends [2 * i + 1];
+		if (num_runs & 1)
+			run_ends [num_pairs] = run_ends [num_runs - 1];
+		num_runs = num_pairs + (num_runs & 1);
+
+		tmp = src;
+		src = dst;
+		dst = tmp;
+	}
+
+	if (src != pin_queue.data) {
+		memcpy (pin_queue.data, src, sizeof (void*) * pin_queue.next_slot);
+		tmp = src;
+	} else {
+		tmp = dst;
+	}
+	sgen_free_internal_dynamic (tmp, sizeof (void*) * tmp_size, INTERNAL_MEM_PIN_QUEUE);
+}
+
+/*
+ * Finds the range of pin queue entries within [START, END).  Most heap
+ * blocks don't have any, so the second search is only done if the first
+ * one found an entry in range, and then only over the rest of the queue.
+ */
 gboolean
 sgen_find_optimized_pin_queue_area (void *start, void *end, size_t *first_out, size_t *last_out)
 {
 	size_t first = sgen_pointer_queue_search (&pin_queue, start);
-	size_t last = sgen_pointer_queue_search (&pin_queue, end);
+	size_t last = first;
+
+	if (first < pin_queue.next_slot && pin_queue.data [first] < end) {
+		size_t hi = pin_queue.next_slot;
+		++last;
+		while (last < hi) {
+			size_t middle = last + ((hi - last) >> 1);
+			if (end <= pin_queue.data [middle])
+				hi = middle;
+			else
+				last = middle + 1;
+		}
+	}
+
 	SGEN_ASSERT (0, last == pin_queue.next_slot || pin_queue.data [last] >= end, "Pin queue search gone awry");
 	*first_out = first;
 	*last_out = last;
@@ -155,7 +347,30 @@ sgen_pin_queue_clear_discarded_entries (GCMemSection *section, size_t max_pin_sl
 void
 sgen_optimize_pin_queue (void)
 {
-	sgen_pointer_queue_sort_uniq (&pin_queue);
+	size_t num_staged = pin_queue.next_slot;
+	size_t num_runs;
+	SGEN_TV_DECLARE (atv);
+	SGEN_TV_DECLARE (btv);
+
+	SGEN_TV_GETTIME (atv);
+
+	if (pin_runs_valid) {
+		sgen_pin_stage_end_run ();
+		num_runs = pin_run_ends.next_slot;
+		if (num_runs > 1) {
+			merge_pin_queue_runs ();
+			sgen_pointer_queue_uniq (&pin_queue);
+		}
+		sgen_pointer_queue_clear (&pin_run_ends);
+		pin_runs_valid = FALSE;
+	} else {
+		num_runs = 0;
+		sgen_pointer_queue_sort_uniq (&pin_queue);
+	}
+
+	SGEN_TV_GETTIME (btv);
+	time_pin_queue_optimize += SGEN_TV_ELAPSED (atv, btv);
+	SGEN_LOG (2, "Optimized pin queue from %zd to %zd entries (%zd runs) in %d usecs", num_staged, pin_queue.next_slot, num_runs, SGEN_TV_ELAPSED (atv, btv) / 10);
 }
 
 size_t
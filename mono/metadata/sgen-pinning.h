@@ -28,8 +28,10 @@ enum {
 };
 
 void sgen_pin_stage_ptr (void *ptr) MONO_INTERNAL;
+void sgen_pin_stage_end_run (void) MONO_INTERNAL;
 void sgen_optimize_pin_queue (void) MONO_INTERNAL;
 void sgen_init_pinning (void) MONO_INTERNAL;
+void sgen_init_pin_queue_counters (void) MONO_INTERNAL;
 void sgen_finish_pinning (void) MONO_INTERNAL;
 void sgen_pin_queue_clear_discarded_entries (GCMemSection *section, size_t max_pin_slot) MONO_INTERNAL;
 size_t sgen_get_pinned_count (void) MONO_INTERNAL;
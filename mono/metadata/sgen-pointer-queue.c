@@ -102,17 +102,12 @@ sgen_pointer_queue_remove_nulls (SgenPointerQueue *queue)
 }
 
 /*
- * Sorts the pointers in the queue, then removes duplicates.
+ * Removes duplicates from the sorted queue.
  */
 void
-sgen_pointer_queue_sort_uniq (SgenPointerQueue *queue)
+sgen_pointer_queue_uniq (SgenPointerQueue *queue)
 {
 	void **start, **cur, **end;
-	/* sort and uniq pin_queue: we just sort and we let the rest discard multiple values */
-	/* it may be better to keep ranges of pinned memory instead of individually pinning objects */
-	SGEN_LOG (5, "Sorting pointer queue, size: %lu", queue->next_slot);
-	if (queue->next_slot > 1)
-		sgen_sort_addresses (queue->data, queue->next_slot);
 	start = cur = queue->data;
 	end = queue->data + queue->next_slot;
 	while (cur < end) {
@@ -125,6 +120,20 @@ sgen_pointer_queue_sort_uniq (SgenPointerQueue *queue)
 	SGEN_LOG (5, "Pointer queue reduced to size: %lu", queue->next_slot);
 }
 
+/*
+ * Sorts the pointers in the queue, then removes duplicates.
+ */
+void
+sgen_pointer_queue_sort_uniq (SgenPointerQueue *queue)
+{
+	/* sort and uniq pin_queue: we just sort and we let the rest discard multiple values */
+	/* it may be better to keep ranges of pinned memory instead of individually pinning objects */
+	SGEN_LOG (5, "Sorting pointer queue, size: %lu", queue->next_slot);
+	if (queue->next_slot > 1)
+		sgen_sort_addresses (queue->data, queue->next_slot);
+	sgen_pointer_queue_uniq (queue);
+}
+
 /*
  * Does a linear search through the pointer queue to find `ptr`.  Returns the index if
  * found, otherwise (size_t)-1.
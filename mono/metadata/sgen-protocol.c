@@ -28,6 +28,7 @@
 #include "sgen-memory-governor.h"
 #include "utils/mono-mmap.h"
 #include "utils/mono-threads.h"
+#include "utils/mono-time.h"
 
 #include <errno.h>
 #ifdef HAVE_UNISTD_H
@@ -39,19 +40,62 @@
 /* If valid, dump binary protocol to this file */
 static int binary_protocol_file = -1;
 
-/* We set this to -1 to indicate an exclusive lock */
-static volatile int binary_protocol_use_count = 0;
+#define BINARY_PROTOCOL_BUFFER_SIZE	(65536 - 16 * 8)
 
-#define BINARY_PROTOCOL_BUFFER_SIZE	(65536 - 2 * 8)
+/*
+ * Type, timestamp and at most six fields, varint-encoded.
+ */
+#define BINARY_PROTOCOL_MAX_ENTRY_SIZE	(1 + 7 * 10)
 
+/*
+ * Each thread writes its entries into its own buffer, so writing an
+ * entry doesn't need any synchronization.  All buffers are on the
+ * binary_protocol_buffers list.  Flushing writes the entries a buffer
+ * got since the last flush as a chunk, so the owning thread can keep
+ * filling it.  When a buffer is full, or its thread exits, it is retired,
+ * and the next flush frees it.
+ *
+ * Entries are encoded relative to the previous entry in the same
+ * buffer: see protocol_entry ().
+ */
 typedef struct _BinaryProtocolBuffer BinaryProtocolBuffer;
 struct _BinaryProtocolBuffer {
 	BinaryProtocolBuffer * volatile next;
+	gpointer thread;
+	int buffer_index;
+	gboolean worker;
+	long long base_timestamp;
+
+	/* Only accessed by the owning thread */
+	long long last_timestamp;
+	mword last_pointer;
+
+	/* Written by the owning thread after each complete entry */
 	volatile int index;
+	volatile gboolean retired;
+
+	/* Only accessed with the flush mutex held */
+	int flushed_index;
+
 	unsigned char buffer [BINARY_PROTOCOL_BUFFER_SIZE];
 };
 
 static BinaryProtocolBuffer * volatile binary_protocol_buffers = NULL;
+static volatile int binary_protocol_num_buffers = 0;
+static mono_mutex_t binary_protocol_flush_mutex;
+
+/* The key is also used with __thread, so the buffer is retired when its thread exits */
+static MonoNativeTlsKey binary_protocol_buffer_key;
+#ifdef HAVE_KW_THREAD
+static __thread BinaryProtocolBuffer *binary_protocol_thread_buffer;
+#define GET_THREAD_BUFFER()	binary_protocol_thread_buffer
+#define SET_THREAD_BUFFER(b)	do { binary_protocol_thread_buffer = (b); mono_native_tls_set_value (binary_protocol_buffer_key, (b)); } while (0)
+#else
+#define GET_THREAD_BUFFER()	((BinaryProtocolBuffer*)mono_native_tls_get_value (binary_protocol_buffer_key))
+#define SET_THREAD_BUFFER(b)	mono_native_tls_set_value (binary_protocol_buffer_key, (b))
+#endif
+
+static void binary_protocol_thread_exited (gpointer buffer);
 
 static char* filename_or_prefix = NULL;
 static int current_file_index = 0;
@@ -109,6 +153,9 @@ binary_protocol_init (const char *filename, long long limit)
 
 	file_size_limit = limit;
 
+	mono_mutex_init (&binary_protocol_flush_mutex);
+	mono_native_tls_alloc (&binary_protocol_buffer_key, binary_protocol_thread_exited);
+
 	binary_protocol_open_file ();
 #endif
 }
@@ -133,63 +180,14 @@ close_binary_protocol_file (void)
 	binary_protocol_file = -1;
 }
 
-static gboolean
-try_lock_exclusive (void)
-{
-	do {
-		if (binary_protocol_use_count)
-			return FALSE;
-	} while (InterlockedCompareExchange (&binary_protocol_use_count, -1, 0) != 0);
-	mono_memory_barrier ();
-	return TRUE;
-}
-
-static void
-unlock_exclusive (void)
-{
-	mono_memory_barrier ();
-	SGEN_ASSERT (0, binary_protocol_use_count == -1, "Exclusively locked count must be -1");
-	if (InterlockedCompareExchange (&binary_protocol_use_count, 0, -1) != -1)
-		SGEN_ASSERT (0, FALSE, "Somebody messed with the exclusive lock");
-}
-
-static void
-lock_recursive (void)
-{
-	int old_count;
-	do {
-	retry:
-		old_count = binary_protocol_use_count;
-		if (old_count < 0) {
-			/* Exclusively locked - retry */
-			/* FIXME: short back-off */
-			goto retry;
-		}
-	} while (InterlockedCompareExchange (&binary_protocol_use_count, old_count + 1, old_count) != old_count);
-	mono_memory_barrier ();
-}
-
-static void
-unlock_recursive (void)
-{
-	int old_count;
-	mono_memory_barrier ();
-	do {
-		old_count = binary_protocol_use_count;
-		SGEN_ASSERT (0, old_count > 0, "Locked use count must be at least 1");
-	} while (InterlockedCompareExchange (&binary_protocol_use_count, old_count - 1, old_count) != old_count);
-}
-
 static void
-binary_protocol_flush_buffer (BinaryProtocolBuffer *buffer)
+binary_protocol_write (gpointer data, size_t size)
 {
 	ssize_t ret;
-	size_t to_write = buffer->index;
 	size_t written = 0;
-	g_assert (buffer->index > 0);
 
-	while (written < to_write) {
-		ret = write (binary_protocol_file, buffer->buffer + written, to_write - written);
+	while (written < size && binary_protocol_file != -1) {
+		ret = write (binary_protocol_file, (char*)data + written, size - written);
 		if (ret >= 0)
 			written += ret;
 		else if (errno == EINTR)
@@ -198,9 +196,29 @@ binary_protocol_flush_buffer (BinaryProtocolBuffer *buffer)
 			close_binary_protocol_file ();
 	}
 
-	current_file_size += buffer->index;
+	current_file_size += size;
+}
+
+/* LOCKING: requires the flush mutex */
+static void
+binary_protocol_flush_buffer (BinaryProtocolBuffer *buffer, int index)
+{
+	SGenProtocolChunkHeader header;
+
+	if (index == buffer->flushed_index)
+		return;
+
+	header.thread = (long long)(mword)buffer->thread;
+	header.base_timestamp = buffer->base_timestamp;
+	header.buffer_index = buffer->buffer_index;
+	header.worker = buffer->worker;
+	header.offset = buffer->flushed_index;
+	header.size = index - buffer->flushed_index;
+
+	binary_protocol_write (&header, sizeof (header));
+	binary_protocol_write (buffer->buffer + buffer->flushed_index, header.size);
 
-	sgen_free_os_memory (buffer, sizeof (BinaryProtocolBuffer), SGEN_ALLOC_INTERNAL);
+	buffer->flushed_index = index;
 }
 
 static void
@@ -229,94 +247,191 @@ binary_protocol_flush_buffers (gboolean force)
 {
 #ifdef HAVE_UNISTD_H
 	int num_buffers = 0, i;
-	BinaryProtocolBuffer *buf;
+	BinaryProtocolBuffer *buf, *head;
+	BinaryProtocolBuffer * volatile *prev;
 	BinaryProtocolBuffer **bufs;
 
 	if (binary_protocol_file == -1)
 		return;
 
-	if (!force && !try_lock_exclusive ())
+	if (force)
+		mono_mutex_lock (&binary_protocol_flush_mutex);
+	else if (mono_mutex_trylock (&binary_protocol_flush_mutex))
 		return;
 
-	for (buf = binary_protocol_buffers; buf != NULL; buf = buf->next)
+	/*
+	 * New buffers are only ever pushed at the head of the list, so
+	 * from the head we snapshot on the list is stable.
+	 */
+	head = binary_protocol_buffers;
+	for (buf = head; buf != NULL; buf = buf->next)
 		++num_buffers;
 	bufs = sgen_alloc_internal_dynamic (num_buffers * sizeof (BinaryProtocolBuffer*), INTERNAL_MEM_BINARY_PROTOCOL, TRUE);
-	for (buf = binary_protocol_buffers, i = 0; buf != NULL; buf = buf->next, i++)
+	for (buf = head, i = 0; buf != NULL; buf = buf->next, i++)
 		bufs [i] = buf;
 	SGEN_ASSERT (0, i == num_buffers, "Binary protocol buffer count error");
 
-	binary_protocol_buffers = NULL;
-
+	/* Oldest first, so the chunks of each thread are written in order. */
 	for (i = num_buffers - 1; i >= 0; --i) {
-		binary_protocol_flush_buffer (bufs [i]);
+		int index;
+		gboolean retired;
+
+		buf = bufs [i];
+		retired = buf->retired;
+		mono_memory_read_barrier ();
+		index = buf->index;
+
+		binary_protocol_flush_buffer (buf, index);
 		binary_protocol_check_file_overflow ();
+
+		if (!retired)
+			bufs [i] = NULL;
+	}
+
+	/*
+	 * Free the retired buffers, which are completely written now.
+	 * Other threads only ever change the head of the list, so once a
+	 * buffer is not the head we can unlink it without atomics.
+	 */
+	for (i = 0; i < num_buffers; ++i) {
+		buf = bufs [i];
+		if (!buf)
+			continue;
+		if (InterlockedCompareExchangePointer ((void**)&binary_protocol_buffers, buf->next, buf) != buf) {
+			for (prev = &binary_protocol_buffers; *prev != buf; prev = &(*prev)->next)
+				;
+			*prev = buf->next;
+		}
+		sgen_free_os_memory (buf, sizeof (BinaryProtocolBuffer), SGEN_ALLOC_INTERNAL);
 	}
 
-	sgen_free_internal_dynamic (buf, num_buffers * sizeof (BinaryProtocolBuffer*), INTERNAL_MEM_BINARY_PROTOCOL);
+	sgen_free_internal_dynamic (bufs, num_buffers * sizeof (BinaryProtocolBuffer*), INTERNAL_MEM_BINARY_PROTOCOL);
 
-	if (!force)
-		unlock_exclusive ();
+	mono_mutex_unlock (&binary_protocol_flush_mutex);
 #endif
 }
 
 #ifdef HAVE_UNISTD_H
 static BinaryProtocolBuffer*
-binary_protocol_get_buffer (int length)
+binary_protocol_new_buffer (void)
 {
-	BinaryProtocolBuffer *buffer, *new_buffer;
- retry:
-	buffer = binary_protocol_buffers;
-	if (buffer && buffer->index + length <= BINARY_PROTOCOL_BUFFER_SIZE)
-		return buffer;
+	BinaryProtocolBuffer *buffer, *old;
 
-	new_buffer = sgen_alloc_os_memory (sizeof (BinaryProtocolBuffer), SGEN_ALLOC_INTERNAL | SGEN_ALLOC_ACTIVATE, "debugging memory");
-	new_buffer->next = buffer;
-	new_buffer->index = 0;
+	buffer = sgen_alloc_os_memory (sizeof (BinaryProtocolBuffer), SGEN_ALLOC_INTERNAL | SGEN_ALLOC_ACTIVATE, "debugging memory");
+	buffer->thread = (gpointer)mono_native_thread_id_get ();
+	buffer->buffer_index = InterlockedIncrement (&binary_protocol_num_buffers);
+	buffer->worker = sgen_is_worker_thread (mono_native_thread_id_get ());
+	SGEN_TV_GETTIME (buffer->base_timestamp);
+	buffer->last_timestamp = buffer->base_timestamp;
 
-	if (InterlockedCompareExchangePointer ((void**)&binary_protocol_buffers, new_buffer, buffer) != buffer) {
-		sgen_free_os_memory (new_buffer, sizeof (BinaryProtocolBuffer), SGEN_ALLOC_INTERNAL);
-		goto retry;
-	}
+	do {
+		old = binary_protocol_buffers;
+		buffer->next = old;
+	} while (InterlockedCompareExchangePointer ((void**)&binary_protocol_buffers, buffer, old) != old);
 
-	return new_buffer;
+	SET_THREAD_BUFFER (buffer);
+	return buffer;
+}
+
+static void
+binary_protocol_retire_buffer (BinaryProtocolBuffer *buffer)
+{
+	mono_memory_write_barrier ();
+	buffer->retired = TRUE;
+	SET_THREAD_BUFFER (NULL);
+}
+
+/*
+ * TLS destructor, for threads which exit without calling
+ * binary_protocol_thread_unregister ().
+ */
+static void
+binary_protocol_thread_exited (gpointer buffer)
+{
+	mono_memory_write_barrier ();
+	((BinaryProtocolBuffer*)buffer)->retired = TRUE;
+}
+
+#define ZIGZAG(v)	(((guint64)(v) << 1) ^ (guint64)((gint64)(v) >> 63))
+
+static unsigned char*
+encode_varint (guint64 value, unsigned char *p)
+{
+	do {
+		unsigned char b = value & 0x7f;
+		value >>= 7;
+		if (value)
+			b |= 0x80;
+		*p++ = b;
+	} while (value);
+	return p;
 }
 #endif
 
+/*
+ * An entry is the type byte, the time since the previous entry in the
+ * buffer (or since the buffer was created) and the fields of the
+ * entry struct, as described by binary_protocol_entry_format ().
+ * Pointers are encoded as the difference from the previous pointer in
+ * the buffer, all signed values are zigzag-encoded.
+ */
 static void
 protocol_entry (unsigned char type, gpointer data, int size)
 {
 #ifdef HAVE_UNISTD_H
-	int index;
 	BinaryProtocolBuffer *buffer;
+	const char *format;
+	unsigned char *p;
+	long long timestamp;
+	int offset = 0;
 
 	if (binary_protocol_file == -1)
 		return;
 
-	if (sgen_is_worker_thread (mono_native_thread_id_get ()))
-		type |= 0x80;
-
-	lock_recursive ();
-
- retry:
-	buffer = binary_protocol_get_buffer (size + 1);
- retry_same_buffer:
-	index = buffer->index;
-	if (index + 1 + size > BINARY_PROTOCOL_BUFFER_SIZE)
-		goto retry;
-
-	if (InterlockedCompareExchange (&buffer->index, index + 1 + size, index) != index)
-		goto retry_same_buffer;
-
-	/* FIXME: if we're interrupted at this point, we have a buffer
-	   entry that contains random data. */
+	buffer = GET_THREAD_BUFFER ();
+	if (!buffer || buffer->index + BINARY_PROTOCOL_MAX_ENTRY_SIZE > BINARY_PROTOCOL_BUFFER_SIZE) {
+		if (buffer)
+			binary_protocol_retire_buffer (buffer);
+		buffer = binary_protocol_new_buffer ();
+	}
 
-	buffer->buffer [index++] = type;
-	memcpy (buffer->buffer + index, data, size);
-	index += size;
+	if (buffer->worker)
+		type |= 0x80;
 
-	g_assert (index <= BINARY_PROTOCOL_BUFFER_SIZE);
+	SGEN_TV_GETTIME (timestamp);
+
+	p = buffer->buffer + buffer->index;
+	*p++ = type;
+	p = encode_varint (timestamp - buffer->last_timestamp, p);
+	buffer->last_timestamp = timestamp;
+
+	for (format = binary_protocol_entry_format (type & 0x7f); *format; ++format) {
+		char *field;
+		offset = binary_protocol_field_offset (*format, offset);
+		field = (char*)data + offset;
+		switch (*format) {
+		case 'p': {
+			mword ptr = (mword)*(gpointer*)field;
+			p = encode_varint (ZIGZAG ((gint64)ptr - (gint64)buffer->last_pointer), p);
+			buffer->last_pointer = ptr;
+			break;
+		}
+		case 'i':
+			p = encode_varint (ZIGZAG (*(int*)field), p);
+			break;
+		case 'l':
+			p = encode_varint (ZIGZAG (*(long long*)field), p);
+			break;
+		default:
+			g_assert_not_reached ();
+		}
+		offset += binary_protocol_field_size (*format);
+	}
+	SGEN_ASSERT (0, offset <= size, "Binary protocol entry format doesn't match the entry");
 
-	unlock_recursive ();
+	/* The flushing thread must see the whole entry. */
+	mono_memory_write_barrier ();
+	buffer->index = p - buffer->buffer;
 #endif
 }
 
@@ -420,6 +535,11 @@ binary_protocol_thread_unregister (gpointer thread)
 	SGenProtocolThreadUnregister entry = { thread };
 	protocol_entry (SGEN_PROTOCOL_THREAD_UNREGISTER, &entry, sizeof (SGenProtocolThreadUnregister));
 
+#ifdef HAVE_UNISTD_H
+	/* The thread is going away, so the next flush can free its buffer. */
+	if (thread == (gpointer)mono_native_thread_id_get () && GET_THREAD_BUFFER ())
+		binary_protocol_retire_buffer (GET_THREAD_BUFFER ());
+#endif
 }
 
 void
@@ -254,6 +254,93 @@ typedef struct {
 
 /* missing: finalizers, roots, non-store wbarriers */
 
+/*
+ * The protocol file is a sequence of chunks, each one a header followed
+ * by `size` bytes of entries from one thread's buffer, starting at
+ * `offset` in that buffer.  Entries are encoded relative to the previous
+ * ones in the same buffer, so a chunk can only be decoded after the
+ * preceding chunks of its buffer.
+ */
+typedef struct {
+	long long thread;
+	long long base_timestamp;
+	int buffer_index;
+	int worker;
+	int offset;
+	int size;
+} SGenProtocolChunkHeader;
+
+typedef struct {
+	char c;
+	long long l;
+} SGenProtocolLongLongAlign;
+
+/*
+ * The fields of each entry struct, in order: 'p' is a gpointer, 'i' an
+ * int and 'l' a long long.
+ */
+static inline const char*
+binary_protocol_entry_format (int type)
+{
+	switch (type) {
+	case SGEN_PROTOCOL_COLLECTION_FORCE: return "i";
+	case SGEN_PROTOCOL_COLLECTION_BEGIN: return "ii";
+	case SGEN_PROTOCOL_COLLECTION_END: return "iill";
+	case SGEN_PROTOCOL_CONCURRENT_START: return "";
+	case SGEN_PROTOCOL_CONCURRENT_UPDATE: return "";
+	case SGEN_PROTOCOL_CONCURRENT_FINISH: return "";
+	case SGEN_PROTOCOL_WORLD_STOPPING: return "l";
+	case SGEN_PROTOCOL_WORLD_STOPPED: return "lllll";
+	case SGEN_PROTOCOL_WORLD_RESTARTING: return "illlll";
+	case SGEN_PROTOCOL_WORLD_RESTARTED: return "il";
+	case SGEN_PROTOCOL_ALLOC: return "ppi";
+	case SGEN_PROTOCOL_ALLOC_PINNED: return "ppi";
+	case SGEN_PROTOCOL_ALLOC_DEGRADED: return "ppi";
+	case SGEN_PROTOCOL_COPY: return "pppi";
+	case SGEN_PROTOCOL_PIN_STAGE: return "pp";
+	case SGEN_PROTOCOL_PIN: return "ppi";
+	case SGEN_PROTOCOL_MARK: return "ppi";
+	case SGEN_PROTOCOL_SCAN_BEGIN: return "ppi";
+	case SGEN_PROTOCOL_SCAN_VTYPE_BEGIN: return "pi";
+	case SGEN_PROTOCOL_SCAN_PROCESS_REFERENCE: return "ppp";
+	case SGEN_PROTOCOL_WBARRIER: return "ppp";
+	case SGEN_PROTOCOL_GLOBAL_REMSET: return "ppp";
+	case SGEN_PROTOCOL_PTR_UPDATE: return "ppppi";
+	case SGEN_PROTOCOL_CLEANUP: return "ppi";
+	case SGEN_PROTOCOL_EMPTY: return "pi";
+	case SGEN_PROTOCOL_THREAD_SUSPEND: return "pp";
+	case SGEN_PROTOCOL_THREAD_RESTART: return "p";
+	case SGEN_PROTOCOL_THREAD_REGISTER: return "p";
+	case SGEN_PROTOCOL_THREAD_UNREGISTER: return "p";
+	case SGEN_PROTOCOL_MISSING_REMSET: return "ppippi";
+	case SGEN_PROTOCOL_CARD_SCAN: return "pi";
+	case SGEN_PROTOCOL_CEMENT: return "ppi";
+	case SGEN_PROTOCOL_CEMENT_RESET: return "";
+	case SGEN_PROTOCOL_DISLINK_UPDATE: return "ppii";
+	case SGEN_PROTOCOL_DISLINK_UPDATE_STAGED: return "ppii";
+	case SGEN_PROTOCOL_DISLINK_PROCESS_STAGED: return "ppi";
+	case SGEN_PROTOCOL_DOMAIN_UNLOAD_BEGIN: return "p";
+	case SGEN_PROTOCOL_DOMAIN_UNLOAD_END: return "p";
+	case SGEN_PROTOCOL_GRAY_ENQUEUE: return "ppp";
+	case SGEN_PROTOCOL_GRAY_DEQUEUE: return "ppp";
+	default: return NULL;
+	}
+}
+
+static inline int
+binary_protocol_field_size (char field)
+{
+	return field == 'p' ? sizeof (gpointer) : field == 'i' ? sizeof (int) : sizeof (long long);
+}
+
+/* The offset of a field in an entry struct, given the end of the previous field. */
+static inline int
+binary_protocol_field_offset (char field, int offset)
+{
+	int align = field == 'l' ? G_STRUCT_OFFSET (SGenProtocolLongLongAlign, l) : binary_protocol_field_size (field);
+	return (offset + align - 1) & ~(align - 1);
+}
+
 void binary_protocol_init (const char *filename, long long limit) MONO_INTERNAL;
 gboolean binary_protocol_is_enabled (void) MONO_INTERNAL;
 
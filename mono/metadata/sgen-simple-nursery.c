@@ -35,6 +35,12 @@ alloc_for_promotion (MonoVTable *vtable, char *obj, size_t objsize, gboolean has
 	return major_collector.alloc_object (vtable, objsize, has_references);
 }
 
+static inline char*
+par_alloc_for_promotion (MonoVTable *vtable, char *obj, size_t objsize, gboolean has_references)
+{
+	return major_collector.par_alloc_object (vtable, objsize, has_references);
+}
+
 static SgenFragment*
 build_fragments_get_exclude_head (void)
 {
@@ -74,14 +80,19 @@ init_nursery (SgenFragmentAllocator *allocator, char *start, char *end)
 
 #define SERIAL_COPY_OBJECT simple_nursery_serial_copy_object
 #define SERIAL_COPY_OBJECT_FROM_OBJ simple_nursery_serial_copy_object_from_obj
+#define PARALLEL_COPY_OBJECT simple_nursery_parallel_copy_object
+#define PARALLEL_COPY_OBJECT_FROM_OBJ simple_nursery_parallel_copy_object_from_obj
+#define PARALLEL_SCAN_OBJECT simple_nursery_parallel_scan_object
+#define PARALLEL_SCAN_VTYPE simple_nursery_parallel_scan_vtype
 
 #include "sgen-minor-copy-object.h"
 #include "sgen-minor-scan-object.h"
 
 void
-sgen_simple_nursery_init (SgenMinorCollector *collector)
+sgen_simple_nursery_init (SgenMinorCollector *collector, gboolean parallel)
 {
 	collector->is_split = FALSE;
+	collector->is_parallel = parallel;
 
 	collector->alloc_for_promotion = alloc_for_promotion;
 
@@ -321,9 +321,23 @@ build_fragments_release_exclude_head (void)
 	sgen_fragment_allocator_release (&collector_allocator);
 }
 
+/*
+ * The promotion barrier splits the active part of the nursery, which
+ * changes size with `max-pause`.  Objects that already live above the
+ * new barrier keep their age, so moving it is harmless.
+ */
+static void
+update_promotion_barrier (void)
+{
+	size_t alloc_quote = (size_t)(sgen_nursery_get_active_size () * alloc_ratio);
+	promotion_barrier = align_down (sgen_get_nursery_start () + alloc_quote, 3);
+}
+
 static void
 build_fragments_finish (SgenFragmentAllocator *allocator)
 {
+	update_promotion_barrier ();
+
 	/* We split the fragment list based on the promotion barrier. */
 	collector_allocator = *allocator;
 	fragment_list_split (&collector_allocator);
@@ -381,8 +395,7 @@ clear_fragments (void)
 static void
 init_nursery (SgenFragmentAllocator *allocator, char *start, char *end)
 {
-	int alloc_quote = (int)((end - start) * alloc_ratio);
-	promotion_barrier = align_down (start + alloc_quote, 3);
+	update_promotion_barrier ();
 	sgen_fragment_allocator_add (allocator, start, promotion_barrier);
 	sgen_fragment_allocator_add (&collector_allocator, promotion_barrier, end);
 
@@ -441,6 +454,7 @@ void
 sgen_split_nursery_init (SgenMinorCollector *collector)
 {
 	collector->is_split = TRUE;
+	collector->is_parallel = FALSE;
 
 	collector->alloc_for_promotion = minor_alloc_for_promotion;
 
@@ -198,6 +198,20 @@ count_cards (long long *major_total, long long *major_marked, long long *los_tot
 	sgen_los_count_cards (los_total, los_marked);
 }
 
+/*
+ * Threads allocate small pinned objects from their own major heap
+ * blocks.  While the world is stopped the collector owns all blocks.
+ */
+static void
+release_pinned_alloc_blocks (void)
+{
+	SgenThreadInfo *info;
+
+	FOREACH_THREAD (info) {
+		sgen_get_major_collector ()->release_thread_pinned_blocks (info);
+	} END_FOREACH_THREAD
+}
+
 static TV_DECLARE (stop_world_time);
 static unsigned long max_pause_usec = 0;
 
@@ -230,6 +244,8 @@ sgen_stop_world (int generation)
 		g_error ("More threads have died (%d) that been initialy suspended %d", dead, count);
 	count -= dead;
 
+	release_pinned_alloc_blocks ();
+
 	SGEN_LOG (3, "world stopped %d thread(s)", count);
 	mono_profiler_gc_event (MONO_GC_EVENT_POST_STOP_WORLD, generation);
 	MONO_GC_WORLD_STOP_END ();
@@ -45,6 +45,7 @@
 
 #include "sgen-gc.h"
 #include "sgen-bridge.h"
+#include "sgen-workers.h"
 #include "sgen-hash-table.h"
 #include "sgen-qsort.h"
 #include "tabledefs.h"
@@ -230,6 +231,8 @@ typedef struct {
 	DynPtrArray bridges;
 	int api_index    : 31;
 	unsigned visited : 1;
+	/* Allocation order, indexes the visited bitmaps of the xref jobs */
+	int index;
 } ColorData;
 
 
@@ -258,10 +261,16 @@ static int num_colors_with_bridges;
 static int xref_count;
 
 static size_t setup_time, tarjan_time, scc_setup_time, gather_xref_time, xref_setup_time, cleanup_time;
+static int gather_xref_jobs;
+static int gather_xref_threads;
+static gboolean xrefs_gathered;
 static SgenBridgeProcessor *bridge_processor;
 
 #define BUCKET_SIZE 8184
 
+/* Don't split flattening the color graph into jobs smaller than this */
+#define MIN_BRIDGE_COLORS_PER_XREF_JOB 1024
+
 //ScanData buckets
 #define NUM_SCAN_ENTRIES ((BUCKET_SIZE - SIZEOF_VOID_P * 2) / sizeof (ScanData))
 
@@ -369,7 +378,7 @@ retry:
 		goto retry;
 	}
 	cur_color_bucket->next_data = res + 1;
-	color_data_count++;
+	res->index = color_data_count++;
 	return res;
 }
 
@@ -895,6 +904,7 @@ cleanup (void)
 	reset_cache ();
 	object_index = 0;
 	num_colors_with_bridges = 0;
+	xrefs_gathered = FALSE;
 }
 
 #ifdef DUMP_GRAPH
@@ -930,6 +940,125 @@ dump_color_table (const char *why, gboolean do_index)
 }
 #endif
 
+#define COLOR_VISITED(v,cd)	((v) [(cd)->index >> 3] & (1 << ((cd)->index & 7)))
+#define SET_COLOR_VISITED(v,cd)	((v) [(cd)->index >> 3] |= (1 << ((cd)->index & 7)))
+#define CLEAR_COLOR_VISITED(v,cd)	((v) [(cd)->index >> 3] &= ~(1 << ((cd)->index & 7)))
+
+/*
+ * The xref jobs only read the other_colors of colors without bridges and
+ * only replace the other_colors of the colors they own, so they can run in
+ * parallel.  Each job has its own visited bitmap.
+ */
+static void
+gather_xrefs (ColorData *color, DynPtrArray *xrefs, guint8 *visited)
+{
+	int i;
+	for (i = 0; i < dyn_array_ptr_size (&color->other_colors); ++i) {
+		ColorData *src = dyn_array_ptr_get (&color->other_colors, i);
+		if (COLOR_VISITED (visited, src))
+			continue;
+		SET_COLOR_VISITED (visited, src);
+		if (dyn_array_ptr_size (&src->bridges))
+			dyn_array_ptr_add (xrefs, src);
+		else
+			gather_xrefs (src, xrefs, visited);
+	}
+}
+
+static void
+reset_xrefs (ColorData *color, guint8 *visited)
+{
+	int i;
+	for (i = 0; i < dyn_array_ptr_size (&color->other_colors); ++i) {
+		ColorData *src = dyn_array_ptr_get (&color->other_colors, i);
+		if (!COLOR_VISITED (visited, src))
+			continue;
+		CLEAR_COLOR_VISITED (visited, src);
+		if (!dyn_array_ptr_size (&src->bridges))
+			reset_xrefs (src, visited);
+	}
+}
+
+typedef struct {
+	int job_index;
+	int job_split_count;
+	int xref_count;
+} GatherXRefsJobData;
+
+/* Flatten the color graph for the colors with bridges in every job_split_count-th bucket. */
+static void
+gather_xrefs_job (WorkerData *worker_data, void *job_data)
+{
+	GatherXRefsJobData *job = job_data;
+	size_t visited_size = (color_data_count + 7) / 8;
+	guint8 *visited = sgen_alloc_internal_dynamic (visited_size, INTERNAL_MEM_BRIDGE_DATA, TRUE);
+	DynPtrArray xrefs;
+	ColorBucket *cur;
+	int i;
+
+	memset (&xrefs, 0, sizeof (xrefs));
+	job->xref_count = 0;
+
+	for (cur = root_color_bucket, i = 0; cur; cur = cur->next, ++i) {
+		ColorData *cd;
+		if (i % job->job_split_count != job->job_index)
+			continue;
+		for (cd = &cur->data [0]; cd < cur->next_data; ++cd) {
+			if (!dyn_array_ptr_size (&cd->bridges))
+				continue;
+
+			dyn_array_ptr_set_size (&xrefs, 0);
+			gather_xrefs (cd, &xrefs, visited);
+			reset_xrefs (cd, visited);
+			dyn_array_ptr_set_all (&cd->other_colors, &xrefs);
+			job->xref_count += dyn_array_ptr_size (&cd->other_colors);
+		}
+	}
+
+	dyn_array_ptr_uninit (&xrefs);
+	sgen_free_internal_dynamic (visited, visited_size, INTERNAL_MEM_BRIDGE_DATA);
+}
+
+static int
+gather_xrefs_job_split_count (void)
+{
+	int count;
+
+	if (!sgen_collection_is_parallel () && !sgen_collection_is_concurrent ())
+		return 1;
+
+	count = num_colors_with_bridges / MIN_BRIDGE_COLORS_PER_XREF_JOB;
+	return MAX (1, MIN (count, sgen_workers_get_job_split_count ()));
+}
+
+static void
+gather_all_xrefs (int num_jobs)
+{
+	GatherXRefsJobData jobs [num_jobs];
+	void *job_ptrs [num_jobs];
+	int i;
+
+	for (i = 0; i < num_jobs; ++i) {
+		jobs [i].job_index = i;
+		jobs [i].job_split_count = num_jobs;
+		job_ptrs [i] = &jobs [i];
+	}
+
+	if (num_jobs > 1) {
+		gather_xref_threads = sgen_workers_run_jobs (gather_xrefs_job, job_ptrs, num_jobs);
+	} else {
+		gather_xrefs_job (NULL, &jobs [0]);
+		gather_xref_threads = 1;
+	}
+
+	xref_count = 0;
+	for (i = 0; i < num_jobs; ++i)
+		xref_count += jobs [i].xref_count;
+
+	gather_xref_jobs = num_jobs;
+	xrefs_gathered = TRUE;
+}
+
 static gint64
 step_timer (gint64 *timer)
 {
@@ -943,7 +1072,7 @@ step_timer (gint64 *timer)
 static void
 processing_stw_step (void)
 {
-	int i;
+	int i, num_jobs;
 	int bridge_count;
 	gint64 curtime;
 
@@ -982,6 +1111,18 @@ processing_stw_step (void)
 
 	tarjan_time = step_timer (&curtime);
 
+	/*
+	 * Flattening the color graph doesn't need the object graph, so
+	 * it could be left for after the world is restarted, but with
+	 * lots of bridges it dominates the bridge processing time.  We
+	 * do it here, where we can split it among the workers, if
+	 * they're available.
+	 */
+	num_jobs = gather_xrefs_job_split_count ();
+	if (num_jobs > 1)
+		gather_all_xrefs (num_jobs);
+	gather_xref_time = step_timer (&curtime);
+
 #if defined (DUMP_GRAPH)
 	printf ("----summary----\n");
 	printf ("bridges:\n");
@@ -996,37 +1137,6 @@ processing_stw_step (void)
 	clear_after_processing ();
 }
 
-
-static void
-gather_xrefs (ColorData *color)
-{
-	int i;
-	for (i = 0; i < dyn_array_ptr_size (&color->other_colors); ++i) {
-		ColorData *src = dyn_array_ptr_get (&color->other_colors, i);
-		if (src->visited)
-			continue;
-		src->visited = TRUE;
-		if (dyn_array_ptr_size (&src->bridges))
-			dyn_array_ptr_add (&color_merge_array, src);
-		else
-			gather_xrefs (src);
-	}
-}
-
-static void
-reset_xrefs (ColorData *color)
-{
-	int i;
-	for (i = 0; i < dyn_array_ptr_size (&color->other_colors); ++i) {
-		ColorData *src = dyn_array_ptr_get (&color->other_colors, i);
-		if (!src->visited)
-			continue;
-		src->visited = FALSE;
-		if (!dyn_array_ptr_size (&src->bridges))
-			reset_xrefs (src);
-	}
-}
-
 static void
 processing_build_callback_data (int generation)
 {
@@ -1053,7 +1163,7 @@ processing_build_callback_data (int generation)
 
 	/* This is a straightforward translation from colors to the bridge callback format. */
 	api_sccs = sgen_alloc_internal_dynamic (sizeof (MonoGCBridgeSCC*) * num_colors_with_bridges, INTERNAL_MEM_BRIDGE_DATA, TRUE);
-	api_index = xref_count = 0;
+	api_index = 0;
 
 	for (cur = root_color_bucket; cur; cur = cur->next) {
 		ColorData *cd;
@@ -1076,23 +1186,12 @@ processing_build_callback_data (int generation)
 
 	scc_setup_time = step_timer (&curtime);
 
-	for (cur = root_color_bucket; cur; cur = cur->next) {
-		ColorData *cd;
-		for (cd = &cur->data [0]; cd < cur->next_data; ++cd) {
-			int bridges = dyn_array_ptr_size (&cd->bridges);
-			if (!bridges)
-				continue;
-
-			dyn_array_ptr_set_size (&color_merge_array, 0);
-			gather_xrefs (cd);
-			reset_xrefs (cd);
-			dyn_array_ptr_set_all (&cd->other_colors, &color_merge_array);
-			xref_count += dyn_array_ptr_size (&cd->other_colors);
-		}
+	/* If the STW step couldn't use the workers we flatten the color graph here. */
+	if (!xrefs_gathered) {
+		gather_all_xrefs (1);
+		gather_xref_time += step_timer (&curtime);
 	}
 
-	gather_xref_time = step_timer (&curtime);
-
 #if defined (DUMP_GRAPH)
 	printf ("TOTAL XREFS %d\n", xref_count);
 	dump_color_table (" after xref pass", TRUE);
@@ -1150,14 +1249,14 @@ processing_after_callback (int generation)
 
 	cleanup_time = step_timer (&curtime);
 
-	mono_trace (G_LOG_LEVEL_INFO, MONO_TRACE_GC, "GC_TAR_BRIDGE bridges %d objects %d colors %d ignored %d sccs %d xref %d cache %d/%d setup %.2fms tarjan %.2fms scc-setup %.2fms gather-xref %.2fms xref-setup %.2fms cleanup %.2fms",
+	mono_trace (G_LOG_LEVEL_INFO, MONO_TRACE_GC, "GC_TAR_BRIDGE bridges %d objects %d colors %d ignored %d sccs %d xref %d cache %d/%d setup %.2fms tarjan %.2fms scc-setup %.2fms gather-xref %.2fms (%d jobs on %d threads) xref-setup %.2fms cleanup %.2fms",
 		bridge_count, object_count, color_count,
 		ignored_objects, scc_count, xref_count,
 		cache_hits, cache_misses,
 		setup_time / 10000.0f,
 		tarjan_time / 10000.0f,
 		scc_setup_time / 10000.0f,
-		gather_xref_time / 10000.0f,
+		gather_xref_time / 10000.0f, gather_xref_jobs, gather_xref_threads,
 		xref_setup_time / 10000.0f,
 		cleanup_time / 10000.0f);
 
@@ -25,6 +25,7 @@
 #include "metadata/sgen-gc.h"
 #include "metadata/sgen-workers.h"
 #include "utils/mono-counters.h"
+#include "utils/mono-time.h"
 
 static int workers_num;
 static WorkerData *workers_data;
@@ -34,6 +35,7 @@ static SgenSectionGrayQueue workers_distribute_gray_queue;
 static gboolean workers_distribute_gray_queue_inited;
 
 static gboolean workers_started = FALSE;
+static volatile gboolean workers_shutting_down = FALSE;
 
 enum {
 	STATE_NOT_WORKING,
@@ -66,6 +68,7 @@ static volatile State workers_state;
 
 static MonoSemType workers_waiting_sem;
 static MonoSemType workers_done_sem;
+static MonoSemType workers_exited_sem;
 
 static volatile int workers_job_queue_num_entries = 0;
 static volatile JobQueueEntry *workers_job_queue = NULL;
@@ -77,6 +80,8 @@ static guint64 stat_workers_stolen_from_self_lock;
 static guint64 stat_workers_stolen_from_self_no_lock;
 static guint64 stat_workers_stolen_from_others;
 static guint64 stat_workers_num_waited;
+static guint64 stat_workers_run_jobs;
+static guint64 stat_workers_run_jobs_parallel;
 
 static gboolean
 set_state (State old_state, State new_state)
@@ -203,6 +208,10 @@ workers_wait (void)
 
 	MONO_SEM_WAIT (&workers_waiting_sem);
 
+	/* Woken up by sgen_workers_shutdown (), the state doesn't count us anymore */
+	if (workers_shutting_down)
+		return;
+
 	do {
 		new_state = old_state = workers_state;
 
@@ -219,7 +228,7 @@ workers_wait (void)
 static gboolean
 collection_needs_workers (void)
 {
-	return sgen_collection_is_concurrent ();
+	return sgen_collection_is_concurrent () || sgen_collection_is_parallel ();
 }
 
 void
@@ -330,6 +339,8 @@ workers_dequeue_and_do_job (WorkerData *data)
 	entry->func (data, entry->data);
 	sgen_free_internal (entry, INTERNAL_MEM_JOB_QUEUE_ENTRY);
 
+	++data->stat_jobs_done;
+
 	SGEN_ATOMIC_ADD (workers_num_jobs_finished, 1);
 
 	return TRUE;
@@ -385,6 +396,7 @@ workers_steal (WorkerData *data, WorkerData *victim_data, gboolean lock)
 			stat_workers_stolen_from_self_no_lock += num;
 	} else {
 		stat_workers_stolen_from_others += num;
+		data->stat_entries_stolen += num;
 	}
 
 	return num != 0;
@@ -415,7 +427,7 @@ workers_get_work (WorkerData *data)
 	 * distribute gray queue.
 	 */
 	major = sgen_get_major_collector ();
-	if (major->is_concurrent) {
+	if (major->is_concurrent || sgen_collection_is_parallel ()) {
 		GrayQueueSection *section = sgen_section_gray_queue_dequeue (&workers_distribute_gray_queue);
 		if (section) {
 			sgen_gray_object_enqueue_section (&data->private_gray_queue, section);
@@ -503,7 +515,7 @@ workers_thread_func (void *data_untyped)
 	for (;;) {
 		gboolean did_work = FALSE;
 
-		SGEN_ASSERT (0, sgen_get_current_collection_generation () != GENERATION_NURSERY, "Why are we doing work while there's a nursery collection happening?");
+		SGEN_ASSERT (0, sgen_get_current_collection_generation () != GENERATION_NURSERY || sgen_collection_is_parallel (), "Why are we doing work while there's a serial nursery collection happening?");
 
 		while (workers_state.data.state == STATE_WORKING && workers_dequeue_and_do_job (data)) {
 			did_work = TRUE;
@@ -511,19 +523,32 @@ workers_thread_func (void *data_untyped)
 		}
 
 		if (!sgen_gray_object_queue_is_empty (&data->private_gray_queue) || workers_get_work (data)) {
-			SgenObjectOperations *ops = sgen_concurrent_collection_in_progress ()
-				? &major->major_concurrent_ops
-				: &major->major_ops;
-			ScanCopyContext ctx = { ops->scan_object, NULL, &data->private_gray_queue };
+			SgenObjectOperations *ops;
+			ScanCopyContext ctx;
+			SGEN_TV_DECLARE (atv);
+			SGEN_TV_DECLARE (btv);
+
+			if (sgen_collection_is_parallel () && sgen_get_current_collection_generation () == GENERATION_NURSERY)
+				ops = &sgen_minor_collector.parallel_ops;
+			else if (sgen_concurrent_collection_in_progress ())
+				ops = &major->major_concurrent_ops;
+			else
+				ops = &major->major_ops;
+			ctx.scan_func = ops->scan_object;
+			ctx.copy_func = NULL;
+			ctx.queue = &data->private_gray_queue;
 
 			g_assert (!sgen_gray_object_queue_is_empty (&data->private_gray_queue));
 
+			SGEN_TV_GETTIME (atv);
 			while (!sgen_drain_gray_stack (32, ctx)) {
 				if (workers_state.data.state == STATE_NURSERY_COLLECTION)
 					workers_wait ();
 
 				workers_gray_queue_share_redirect (&data->private_gray_queue);
 			}
+			SGEN_TV_GETTIME (btv);
+			data->stat_drain_time += SGEN_TV_ELAPSED (atv, btv);
 			g_assert (sgen_gray_object_queue_is_empty (&data->private_gray_queue));
 
 			init_private_gray_queue (data);
@@ -531,11 +556,14 @@ workers_thread_func (void *data_untyped)
 			did_work = TRUE;
 		}
 
-		if (!did_work)
+		if (!did_work) {
 			workers_wait ();
+			if (workers_shutting_down)
+				break;
+		}
 	}
 
-	/* dummy return to make compilers happy */
+	MONO_SEM_POST (&workers_exited_sem);
 	return NULL;
 }
 
@@ -559,15 +587,16 @@ sgen_workers_init_distribute_gray_queue (void)
 	if (!collection_needs_workers ())
 		return;
 
-	init_distribute_gray_queue (sgen_get_major_collector ()->is_concurrent);
+	init_distribute_gray_queue (sgen_get_major_collector ()->is_concurrent || sgen_get_major_collector ()->is_parallel || sgen_minor_collector.is_parallel);
 }
 
 void
 sgen_workers_init (int num_workers)
 {
+	char name [64];
 	int i;
 
-	if (!sgen_get_major_collector ()->is_concurrent)
+	if (!sgen_get_major_collector ()->is_concurrent && !sgen_get_major_collector ()->is_parallel && !sgen_minor_collector.is_parallel)
 		return;
 
 	//g_print ("initing %d workers\n", num_workers);
@@ -579,8 +608,9 @@ sgen_workers_init (int num_workers)
 
 	MONO_SEM_INIT (&workers_waiting_sem, 0);
 	MONO_SEM_INIT (&workers_done_sem, 0);
+	MONO_SEM_INIT (&workers_exited_sem, 0);
 
-	init_distribute_gray_queue (sgen_get_major_collector ()->is_concurrent);
+	init_distribute_gray_queue (sgen_get_major_collector ()->is_concurrent || sgen_get_major_collector ()->is_parallel || sgen_minor_collector.is_parallel);
 
 	if (sgen_get_major_collector ()->alloc_worker_data)
 		workers_gc_thread_major_collector_data = sgen_get_major_collector ()->alloc_worker_data ();
@@ -594,6 +624,13 @@ sgen_workers_init (int num_workers)
 
 		if (sgen_get_major_collector ()->alloc_worker_data)
 			workers_data [i].major_collector_data = sgen_get_major_collector ()->alloc_worker_data ();
+
+		g_snprintf (name, sizeof (name), "Worker %d jobs", i);
+		mono_counters_register (name, MONO_COUNTER_GC | MONO_COUNTER_ULONG, &workers_data [i].stat_jobs_done);
+		g_snprintf (name, sizeof (name), "Worker %d stolen from others", i);
+		mono_counters_register (name, MONO_COUNTER_GC | MONO_COUNTER_ULONG, &workers_data [i].stat_entries_stolen);
+		g_snprintf (name, sizeof (name), "Worker %d drain time", i);
+		mono_counters_register (name, MONO_COUNTER_GC | MONO_COUNTER_ULONG | MONO_COUNTER_TIME, &workers_data [i].stat_drain_time);
 	}
 
 	LOCK_INIT (workers_job_queue_mutex);
@@ -604,6 +641,8 @@ sgen_workers_init (int num_workers)
 	mono_counters_register ("Stolen from self no lock", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_workers_stolen_from_self_no_lock);
 	mono_counters_register ("Stolen from others", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_workers_stolen_from_others);
 	mono_counters_register ("# workers waited", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_workers_num_waited);
+	mono_counters_register ("# worker job batches", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_workers_run_jobs);
+	mono_counters_register ("# worker job batches run by several workers", MONO_COUNTER_GC | MONO_COUNTER_ULONG, &stat_workers_run_jobs_parallel);
 }
 
 /* only the GC thread is allowed to start and join workers */
@@ -627,6 +666,8 @@ sgen_workers_start_all_workers (void)
 	if (!collection_needs_workers ())
 		return;
 
+	SGEN_ASSERT (0, !workers_shutting_down, "Can't start the workers after they were shut down");
+
 	if (sgen_get_major_collector ()->init_worker_thread)
 		sgen_get_major_collector ()->init_worker_thread (workers_gc_thread_major_collector_data);
 
@@ -714,6 +755,45 @@ sgen_workers_join (void)
 	}
 }
 
+/*
+ * Stops the worker threads and frees the major collector's data for them.
+ * Must be called when no collection is running, and no collection can
+ * happen afterwards.
+ */
+void
+sgen_workers_shutdown (void)
+{
+	SgenMajorCollector *major = sgen_get_major_collector ();
+	int i;
+
+	if (!workers_data)
+		return;
+
+	if (workers_started) {
+		assert_not_working (workers_state);
+
+		workers_shutting_down = TRUE;
+		mono_memory_write_barrier ();
+		for (i = 0; i < workers_num; ++i)
+			MONO_SEM_POST (&workers_waiting_sem);
+		for (i = 0; i < workers_num; ++i)
+			MONO_SEM_WAIT (&workers_exited_sem);
+	} else {
+		workers_shutting_down = TRUE;
+	}
+
+	if (major->free_worker_data) {
+		for (i = 0; i < workers_num; ++i) {
+			major->free_worker_data (workers_data [i].major_collector_data);
+			workers_data [i].major_collector_data = NULL;
+		}
+		if (workers_gc_thread_major_collector_data) {
+			major->free_worker_data (workers_gc_thread_major_collector_data);
+			workers_gc_thread_major_collector_data = NULL;
+		}
+	}
+}
+
 gboolean
 sgen_workers_all_done (void)
 {
@@ -751,7 +831,83 @@ sgen_workers_get_distribute_section_gray_queue (void)
 void
 sgen_workers_reset_data (void)
 {
-	if (sgen_get_major_collector ()->reset_worker_data)
+	if (sgen_get_major_collector ()->reset_worker_data && workers_gc_thread_major_collector_data)
 		sgen_get_major_collector ()->reset_worker_data (workers_gc_thread_major_collector_data);
 }
+
+/*
+ * Runs FUNC once for each of the NUM_JOBS elements of JOB_DATA on the
+ * workers and waits until all of them are done.  This is for work that
+ * is done while the workers are idle, like merging the pin queue or
+ * processing partitions of the finalization and weak link tables, so the
+ * jobs must not use the gray queues.  If the workers are not available, or there is gray
+ * work they would start on, the jobs are run by the calling thread.  Returns the
+ * number of threads which ran jobs.
+ */
+int
+sgen_workers_run_jobs (JobFunc func, void **job_data, int num_jobs)
+{
+	JobQueueEntry *entry;
+	guint64 *jobs_done;
+	int i, num_workers_used;
+
+	if (!collection_needs_workers () || !workers_started || workers_state.data.state != STATE_NOT_WORKING ||
+			!sgen_section_gray_queue_is_empty (&workers_distribute_gray_queue)) {
+		for (i = 0; i < num_jobs; ++i)
+			func (NULL, job_data [i]);
+		return num_jobs ? 1 : 0;
+	}
+
+	if (!num_jobs)
+		return 0;
+
+	g_assert (workers_job_queue_num_entries == 0);
+	workers_num_jobs_enqueued = 0;
+	workers_num_jobs_finished = 0;
+
+	jobs_done = g_newa (guint64, workers_num);
+	for (i = 0; i < workers_num; ++i)
+		jobs_done [i] = workers_data [i].stat_jobs_done;
+
+	/*
+	 * Enqueueing the jobs one by one would only wake up one worker, since the
+	 * others are only signaled while the workers are not working.
+	 */
+	mono_mutex_lock (&workers_job_queue_mutex);
+	for (i = num_jobs - 1; i >= 0; --i) {
+		entry = sgen_alloc_internal (INTERNAL_MEM_JOB_QUEUE_ENTRY);
+		entry->func = func;
+		entry->data = job_data [i];
+		entry->next = (JobQueueEntry*)workers_job_queue;
+		workers_job_queue = entry;
+	}
+	workers_job_queue_num_entries += num_jobs;
+	workers_num_jobs_enqueued += num_jobs;
+	mono_mutex_unlock (&workers_job_queue_mutex);
+
+	workers_signal_enqueue_work (MIN (num_jobs, workers_num), FALSE);
+
+	sgen_workers_join ();
+
+	num_workers_used = 0;
+	for (i = 0; i < workers_num; ++i) {
+		if (workers_data [i].stat_jobs_done != jobs_done [i])
+			++num_workers_used;
+	}
+	++stat_workers_run_jobs;
+	if (num_workers_used > 1)
+		++stat_workers_run_jobs_parallel;
+	SGEN_LOG (6, "Ran %d jobs on %d workers", num_jobs, num_workers_used);
+	return num_workers_used;
+}
+
+/*
+ * The number of jobs that divisible work, like the card table scan,
+ * should be split into.
+ */
+int
+sgen_workers_get_job_split_count (void)
+{
+	return workers_num;
+}
 #endif
@@ -23,6 +23,9 @@
 
 #define STEALABLE_STACK_SIZE	512
 
+/* The worker state only has eight bits to count threads. */
+#define SGEN_MAX_WORKERS	64
+
 
 typedef struct _WorkerData WorkerData;
 struct _WorkerData {
@@ -35,6 +38,11 @@ struct _WorkerData {
 	mono_mutex_t stealable_stack_mutex;
 	volatile int stealable_stack_fill;
 	GrayQueueEntry stealable_stack [STEALABLE_STACK_SIZE];
+
+	/* Load balance statistics, only written by the worker thread */
+	guint64 stat_jobs_done;
+	guint64 stat_entries_stolen;
+	guint64 stat_drain_time;
 };
 
 typedef void (*JobFunc) (WorkerData *worker_data, void *job_data);
@@ -54,9 +62,12 @@ void sgen_workers_ensure_awake (void) MONO_INTERNAL;
 void sgen_workers_init_distribute_gray_queue (void) MONO_INTERNAL;
 void sgen_workers_enqueue_job (JobFunc func, void *data) MONO_INTERNAL;
 void sgen_workers_wait_for_jobs_finished (void) MONO_INTERNAL;
+int sgen_workers_run_jobs (JobFunc func, void **job_data, int num_jobs) MONO_INTERNAL;
 void sgen_workers_distribute_gray_queue_sections (void) MONO_INTERNAL;
 void sgen_workers_reset_data (void) MONO_INTERNAL;
+int sgen_workers_get_job_split_count (void) MONO_INTERNAL;
 void sgen_workers_join (void) MONO_INTERNAL;
+void sgen_workers_shutdown (void) MONO_INTERNAL;
 gboolean sgen_workers_all_done (void) MONO_INTERNAL;
 gboolean sgen_workers_are_working (void) MONO_INTERNAL;
 SgenSectionGrayQueue* sgen_workers_get_distribute_section_gray_queue (void) MONO_INTERNAL;
@@ -447,8 +447,10 @@ static void thread_cleanup (MonoInternalThread *thread)
 		mono_memory_barrier ();
 	}
 
-	if (thread == mono_thread_internal_current ())
+	if (thread == mono_thread_internal_current ()) {
 		mono_thread_pop_appdomain_ref ();
+		mono_gchandle_free_thread_cache ();
+	}
 
 	thread->cached_culture_info = NULL;
 
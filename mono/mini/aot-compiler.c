@@ -122,6 +122,7 @@ typedef struct MonoAotOptions {
 	int ngsharedvt_arg_trampolines;
 	int nrgctx_fetch_trampolines;
 	gboolean print_skipped_methods;
+	gboolean profile_only;
 	gboolean stats;
 	char *tool_prefix;
 	gboolean autoreg;
@@ -132,7 +133,7 @@ typedef struct MonoAotOptions {
 } MonoAotOptions;
 
 typedef struct MonoAotStats {
-	int ccount, mcount, lmfcount, abscount, gcount, ocount, genericcount;
+	int ccount, mcount, lmfcount, abscount, gcount, ocount, genericcount, coldcount;
 	int code_size, info_size, ex_info_size, unwind_info_size, got_size, class_info_size, got_info_size, plt_size;
 	int methods_without_got_slots, direct_calls, all_calls, llvm_count;
 	int got_slots, offsets_size;
@@ -168,6 +169,11 @@ typedef struct MonoAotCompile {
 	GPtrArray *image_table;
 	GPtrArray *globals;
 	GPtrArray *method_order;
+	/* Full names of the methods found in the profile data */
+	GHashTable *profile_methods;
+	/* Shared methods which were added for a generic instance found in the profile data */
+	GHashTable *profiled_shared_methods;
+	gboolean has_profile;
 	GHashTable *export_names;
 	/* Maps MonoClass* -> blob offset */
 	GHashTable *klass_blob_hash;
@@ -3216,12 +3222,32 @@ add_method (MonoAotCompile *acfg, MonoMethod *method)
 	return add_method_full (acfg, method, FALSE, 0);
 }
 
+static gboolean is_profiled_method (MonoAotCompile *acfg, MonoMethod *method);
+
 static void
 add_extra_method_with_depth (MonoAotCompile *acfg, MonoMethod *method, int depth)
 {
+	gboolean profiled = FALSE;
+
+	/* Only add the generic instances which were used */
+	if (acfg->aot_opts.profile_only && method->is_inflated && method->wrapper_type == MONO_WRAPPER_NONE) {
+		if (!is_profiled_method (acfg, method))
+			return;
+		profiled = TRUE;
+	}
+
 	if (mono_method_is_generic_sharable_full (method, FALSE, TRUE, FALSE))
 		method = mini_get_shared_method (method);
 
+	if (profiled) {
+		/* The shared method has a different name, remember that it is needed */
+		mono_acfg_lock (acfg);
+		if (!acfg->profiled_shared_methods)
+			acfg->profiled_shared_methods = g_hash_table_new (NULL, NULL);
+		g_hash_table_insert (acfg->profiled_shared_methods, method, method);
+		mono_acfg_unlock (acfg);
+	}
+
 	if (acfg->aot_opts.log_generics)
 		aot_printf (acfg, "%*sAdding method %s.\n", depth, "", mono_method_full_name (method, TRUE));
 
@@ -6451,6 +6477,8 @@ mono_aot_parse_options (const char *aot_options, MonoAotOptions *opts)
 			opts->no_direct_calls = TRUE;
 		} else if (str_begins_with (arg, "print-skipped")) {
 			opts->print_skipped_methods = TRUE;
+		} else if (str_begins_with (arg, "profile-only")) {
+			opts->profile_only = TRUE;
 		} else if (str_begins_with (arg, "stats")) {
 			opts->stats = TRUE;
 		} else if (str_begins_with (arg, "no-instances")) {
@@ -6503,6 +6531,7 @@ mono_aot_parse_options (const char *aot_options, MonoAotOptions *opts)
 			printf ("    soft-debug\n");
 			printf ("    gc-maps\n");
 			printf ("    print-skipped\n");
+			printf ("    profile-only\n");
 			printf ("    no-instances\n");
 			printf ("    stats\n");
 			printf ("    info\n");
@@ -6687,6 +6716,14 @@ compile_method (MonoAotCompile *acfg, MonoMethod *method)
 	if (method->wrapper_type == MONO_WRAPPER_COMINTEROP)
 		return;
 
+	if (acfg->aot_opts.profile_only && !is_profiled_method (acfg, method)) {
+		/* Cold methods are JITted, or fail in full-aot mode */
+		if (acfg->aot_opts.print_skipped_methods)
+			printf ("Skip (not in profile): %s\n", mono_method_full_name (method, TRUE));
+		InterlockedIncrement (&acfg->stats.coldcount);
+		return;
+	}
+
 	InterlockedIncrement (&acfg->stats.mcount);
 
 #if 0
@@ -6984,20 +7021,47 @@ compile_thread_main (gpointer *user_data)
 		compile_method (acfg, g_ptr_array_index (methods, i));
 }
 
+typedef struct {
+	guint32 index;
+	guint32 calls;
+	int seq;
+} ProfileMethod;
+
+static int
+compare_profile_methods (const void *a, const void *b)
+{
+	const ProfileMethod *m1 = *(const ProfileMethod**)a;
+	const ProfileMethod *m2 = *(const ProfileMethod**)b;
+
+	/* Hottest first, in the order they were seen otherwise */
+	if (m1->calls != m2->calls)
+		return m1->calls > m2->calls ? -1 : 1;
+	return m1->seq - m2->seq;
+}
+
+/*
+ * load_profile_files_for_image:
+ *
+ *   Load the profile data files created by the AOT profiler for IMAGE. The names of
+ * the methods found in them are added to acfg->profile_methods. If ORDER is not NULL,
+ * the methods of the image being compiled are added to it, mapping their index + 1
+ * to a ProfileMethod.
+ */
 static void
-load_profile_files (MonoAotCompile *acfg)
+load_profile_files_for_image (MonoAotCompile *acfg, MonoImage *image, GHashTable *order)
 {
 	FILE *infile;
 	char *tmp;
-	int file_index, res, method_index, i;
+	int file_index, res, method_index;
 	char ver [256];
-	guint32 token;
-	GList *unordered, *l;
-	gboolean found;
+	char name [4096];
+	guint32 token, calls;
+	unsigned long count;
+	gboolean has_calls;
 
 	file_index = 0;
 	while (TRUE) {
-		tmp = g_strdup_printf ("%s/.mono/aot-profile-data/%s-%d", g_get_home_dir (), acfg->image->assembly_name, file_index);
+		tmp = g_strdup_printf ("%s/.mono/aot-profile-data/%s-%d", g_get_home_dir (), image->assembly_name, file_index);
 
 		if (!g_file_test (tmp, G_FILE_TEST_IS_REGULAR)) {
 			g_free (tmp);
@@ -7013,66 +7077,164 @@ load_profile_files (MonoAotCompile *acfg)
 		file_index ++;
 
 		res = fscanf (infile, "%32s\n", ver);
-		if ((res != 1) || strcmp (ver, "#VER:2") != 0) {
+		if ((res != 1) || (strcmp (ver, "#VER:2") != 0 && strcmp (ver, "#VER:3") != 0)) {
 			printf ("Profile file has wrong version or invalid.\n");
 			fclose (infile);
 			continue;
 		}
 
+		/* Version 3 adds the guid of the image and the number of calls */
+		has_calls = strcmp (ver, "#VER:3") == 0;
+		if (has_calls) {
+			if (fgets (name, sizeof (name), infile) == NULL || strncmp (name, "#GUID:", 6) != 0 || strncmp (name + 6, mono_image_get_guid (image), strlen (mono_image_get_guid (image))) != 0) {
+				printf ("Profile file is for a different version of the assembly, ignoring it.\n");
+				fclose (infile);
+				continue;
+			}
+		}
+
 		while (TRUE) {
-			char name [1024];
 			MonoMethodDesc *desc;
 			MonoMethod *method;
+			char *method_name;
 
-			if (fgets (name, 1023, infile) == NULL)
+			if (fgets (name, sizeof (name), infile) == NULL)
 				break;
 
 			/* Kill the newline */
 			if (strlen (name) > 0)
 				name [strlen (name) - 1] = '\0';
 
-			desc = mono_method_desc_new (name, TRUE);
+			calls = 0;
+			method_name = name;
+			if (has_calls) {
+				count = strtoul (name, &method_name, 10);
+				calls = count > G_MAXUINT32 ? G_MAXUINT32 : count;
+				if (*method_name != '\t')
+					continue;
+				method_name ++;
+			}
 
-			method = mono_method_desc_search_in_image (desc, acfg->image);
+			acfg->has_profile = TRUE;
+			if (!acfg->profile_methods)
+				acfg->profile_methods = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+			if (!g_hash_table_lookup (acfg->profile_methods, method_name))
+				g_hash_table_insert (acfg->profile_methods, g_strdup (method_name), GUINT_TO_POINTER (TRUE));
+
+			if (!order)
+				continue;
+
+			/* Generic instances can't be looked up by name, they are matched by name when they are added */
+			if (strchr (method_name, '<'))
+				continue;
+
+			desc = mono_method_desc_new (method_name, TRUE);
+			if (!desc)
+				continue;
+			method = mono_method_desc_search_in_image (desc, image);
+			mono_method_desc_free (desc);
 
 			if (method && mono_method_get_token (method)) {
+				ProfileMethod *pm;
+
 				token = mono_method_get_token (method);
 				method_index = mono_metadata_token_index (token) - 1;
 
-				found = FALSE;
-				for (i = 0; i < acfg->method_order->len; ++i) {
-					if (g_ptr_array_index (acfg->method_order, i) == GUINT_TO_POINTER (method_index)) {
-						found = TRUE;
-						break;
-					}
+				pm = g_hash_table_lookup (order, GUINT_TO_POINTER (method_index + 1));
+				if (!pm) {
+					pm = g_new0 (ProfileMethod, 1);
+					pm->index = method_index;
+					pm->seq = g_hash_table_size (order);
+					g_hash_table_insert (order, GUINT_TO_POINTER (method_index + 1), pm);
 				}
-				if (!found)
-					g_ptr_array_add (acfg->method_order, GUINT_TO_POINTER (method_index));
+				/* Counts from multiple runs are summed, saturating */
+				if (calls > G_MAXUINT32 - pm->calls)
+					pm->calls = G_MAXUINT32;
+				else
+					pm->calls += calls;
 			} else {
 				//printf ("No method found matching '%s'.\n", name);
 			}
 		}
 		fclose (infile);
 	}
+}
+
+static void
+load_profile_files (MonoAotCompile *acfg)
+{
+	GHashTable *order;
+	GPtrArray *ordered;
+	GHashTableIter iter;
+	ProfileMethod *pm;
+	int method_index, i;
+
+	order = g_hash_table_new_full (NULL, NULL, NULL, g_free);
+	load_profile_files_for_image (acfg, acfg->image, order);
+
+	/* Generic instances used by this image might be recorded in the profiles of the assemblies it references */
+	for (i = 0; i < acfg->image->nreferences; ++i) {
+		MonoAssembly *ass;
+
+		mono_assembly_load_reference (acfg->image, i);
+		ass = acfg->image->references [i];
+		if (ass && ass != REFERENCE_MISSING && ass->image != acfg->image)
+			load_profile_files_for_image (acfg, ass->image, NULL);
+	}
+
+	if (acfg->aot_opts.profile_only && !acfg->has_profile) {
+		aot_printerrf (acfg, "The 'profile-only' option was given, but no profile data was found, compiling all methods.\n");
+		acfg->aot_opts.profile_only = FALSE;
+	}
+
+	/* The methods in the profile come first, hottest first, for better code locality */
+	ordered = g_ptr_array_new ();
+	g_hash_table_iter_init (&iter, order);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer*)&pm))
+		g_ptr_array_add (ordered, pm);
+	qsort (ordered->pdata, ordered->len, sizeof (gpointer), compare_profile_methods);
+	for (i = 0; i < ordered->len; ++i) {
+		pm = g_ptr_array_index (ordered, i);
+		g_ptr_array_add (acfg->method_order, GUINT_TO_POINTER (pm->index));
+	}
+	g_ptr_array_free (ordered, TRUE);
 
 	/* Add missing methods */
-	unordered = NULL;
 	for (method_index = 0; method_index < acfg->image->tables [MONO_TABLE_METHOD].rows; ++method_index) {
-		found = FALSE;
-		for (i = 0; i < acfg->method_order->len; ++i) {
-			if (g_ptr_array_index (acfg->method_order, i) == GUINT_TO_POINTER (method_index)) {
-				found = TRUE;
-				break;
-			}
-		}
-		if (!found)
-			unordered = g_list_prepend (unordered, GUINT_TO_POINTER (method_index));
+		if (!g_hash_table_lookup (order, GUINT_TO_POINTER (method_index + 1)))
+			g_ptr_array_add (acfg->method_order, GUINT_TO_POINTER (method_index));
 	}
-	unordered = g_list_reverse (unordered);
-	for (l = unordered; l; l = l->next)
-		g_ptr_array_add (acfg->method_order, l->data);
+
+	g_hash_table_destroy (order);
 }
- 
+
+/*
+ * is_profiled_method:
+ *
+ *   Return whenever METHOD was used according to the profile data. Wrappers are
+ * not recorded by the profiler, so they are assumed to be used.
+ */
+static gboolean
+is_profiled_method (MonoAotCompile *acfg, MonoMethod *method)
+{
+	char *name;
+	gboolean res;
+
+	if (!acfg->profile_methods || method->wrapper_type != MONO_WRAPPER_NONE)
+		return TRUE;
+
+	mono_acfg_lock (acfg);
+	res = acfg->profiled_shared_methods && g_hash_table_lookup (acfg->profiled_shared_methods, method);
+	mono_acfg_unlock (acfg);
+	if (res)
+		return TRUE;
+
+	name = mono_method_full_name (method, TRUE);
+	res = g_hash_table_lookup (acfg->profile_methods, name) != NULL;
+	g_free (name);
+	return res;
+}
+
 /* Used by the LLVM backend */
 guint32
 mono_aot_get_got_offset (MonoJumpInfo *ji)
@@ -8901,6 +9063,10 @@ acfg_free (MonoAotCompile *acfg)
 	g_hash_table_destroy (acfg->plt_entry_debug_sym_cache);
 	g_hash_table_destroy (acfg->klass_blob_hash);
 	g_hash_table_destroy (acfg->method_blob_hash);
+	if (acfg->profile_methods)
+		g_hash_table_destroy (acfg->profile_methods);
+	if (acfg->profiled_shared_methods)
+		g_hash_table_destroy (acfg->profiled_shared_methods);
 	got_info_free (&acfg->got_info);
 	got_info_free (&acfg->llvm_got_info);
 	mono_mempool_destroy (acfg->mempool);
@@ -9332,6 +9498,8 @@ mono_compile_assembly (MonoAssembly *ass, guint32 opts, const char *aot_options)
 		aot_printf (acfg, "%d methods contain lmf pointers (%d%%)\n", acfg->stats.lmfcount, acfg->stats.mcount ? (acfg->stats.lmfcount * 100) / acfg->stats.mcount : 100);
 	if (acfg->stats.ocount)
 		aot_printf (acfg, "%d methods have other problems (%d%%)\n", acfg->stats.ocount, acfg->stats.mcount ? (acfg->stats.ocount * 100) / acfg->stats.mcount : 100);
+	if (acfg->stats.coldcount)
+		aot_printf (acfg, "%d methods were skipped since they are not in the profile\n", acfg->stats.coldcount);
 
 	TV_GETTIME (atv);
 	res = img_writer_emit_writeout (acfg->w);
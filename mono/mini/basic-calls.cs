@@ -1,5 +1,7 @@
 using System;
 using System.Reflection;
+using System.Runtime.CompilerServices;
+using System.Threading;
 
 /*
  * Regression tests for the mono JIT.
@@ -317,5 +319,30 @@ class Tests
 			return 2;
 		return 0;
 	}
+
+	[MethodImplAttribute (MethodImplOptions.NoInlining)]
+	static int hot_callee (int i, int acc) {
+		if ((i & 1) == 0)
+			return acc + 2;
+		else
+			return acc - 1;
+	}
+
+	/*
+	 * With -O=tiered, hot_callee is queued for recompilation by the first
+	 * loop, and replaced by its tier 1 code while we sleep, so the call site
+	 * is patched to it in the second loop. The tiered rcheck pass checks that
+	 * methods were recompiled using the JIT counters.
+	 */
+	public static int test_0_hot_callee_recompiled () {
+		int acc = 0;
+
+		for (int i = 0; i < 1000; ++i)
+			acc = hot_callee (i, acc);
+		Thread.Sleep (200);
+		for (int i = 1000; i < 200000; ++i)
+			acc = hot_callee (i, acc);
+		return acc == 100000 ? 0 : 1;
+	}
 }
 
@@ -1,5 +1,7 @@
 using System;
+using System.Collections.Generic;
 using System.Reflection;
+using System.Runtime.CompilerServices;
 
 /*
  * Regression tests for the mono JIT.
@@ -85,6 +87,50 @@ sealed public class SealedFinal : Middle {
 	}
 }
 
+public interface IValue {
+	int Value ();
+}
+
+public class Value0 : IValue { public int Value () { return 0; } }
+public class Value1 : IValue { public int Value () { return 1; } }
+public class Value2 : IValue { public int Value () { return 2; } }
+public class Value3 : IValue { public int Value () { return 3; } }
+public class Value4 : IValue { public int Value () { return 4; } }
+public class Value5 : IValue { public int Value () { return 5; } }
+public class Value6 : IValue { public int Value () { return 6; } }
+public class Value7 : IValue { public int Value () { return 7; } }
+public class Value8 : IValue { public int Value () { return 8; } }
+public class Value9 : IValue { public int Value () { return 9; } }
+
+/* The subclasses are only loaded after the calls were compiled, see -O=cha */
+public class ChaBase {
+	public virtual int Value () {
+		return 1;
+	}
+}
+
+public class ChaDerived : ChaBase {
+	public override int Value () {
+		return 2;
+	}
+}
+
+public abstract class ChaShape {
+	public abstract int Sides ();
+}
+
+public class ChaTriangle : ChaShape {
+	public override int Sides () {
+		return 3;
+	}
+}
+
+public class ChaSquare : ChaShape {
+	public override int Sides () {
+		return 4;
+	}
+}
+
 
 class Tests {
 
@@ -193,4 +239,113 @@ class Tests {
 		
 		return 0;
 	}
-}
\ No newline at end of file
+
+	/*
+	 * Interface calls through a single call site, see -O=icache. These are inlined
+	 * into the tests, so they are compiled with the optimizations being tested.
+	 */
+	static int call_value (IValue v) {
+		return v.Value ();
+	}
+
+	static int call_count (IList<int> l) {
+		return l.Count;
+	}
+
+	static public int test_0_icache_monomorphic () {
+		IValue v = new Value3 ();
+
+		for (int i = 0; i < 100; ++i)
+			if (call_value (v) != 3)
+				return 1;
+		return 0;
+	}
+
+	static public int test_0_icache_polymorphic () {
+		IValue[] values = new IValue [] { new Value0 (), new Value1 (), new Value2 () };
+
+		for (int i = 0; i < 100; ++i)
+			if (call_value (values [i % 3]) != i % 3)
+				return 1;
+		return 0;
+	}
+
+	static public int test_0_icache_megamorphic () {
+		IValue[] values = new IValue [] { new Value0 (), new Value1 (), new Value2 (), new Value3 (), new Value4 (),
+										  new Value5 (), new Value6 (), new Value7 (), new Value8 (), new Value9 () };
+
+		for (int i = 0; i < 1000; ++i)
+			if (call_value (values [i % 10]) != i % 10)
+				return 1;
+		return 0;
+	}
+
+	static public int test_0_icache_arrays () {
+		IList<int> array = new int [5];
+		IList<int> list = new List<int> (new int [] { 1, 2, 3 });
+
+		for (int i = 0; i < 100; ++i) {
+			if (call_count (array) != 5)
+				return 1;
+			if (i % 2 == 0 && call_count (list) != 3)
+				return 2;
+		}
+		return 0;
+	}
+
+	static public int test_0_icache_null_receiver () {
+		try {
+			call_value (null);
+			return 1;
+		} catch (NullReferenceException) {
+			return 0;
+		}
+	}
+
+	[MethodImplAttribute (MethodImplOptions.NoInlining)]
+	static int cha_call_value (ChaBase b) {
+		return b.Value ();
+	}
+
+	[MethodImplAttribute (MethodImplOptions.NoInlining)]
+	static ChaBase cha_new_derived () {
+		return new ChaDerived ();
+	}
+
+	[MethodImplAttribute (MethodImplOptions.NoInlining)]
+	static int cha_call_sides (ChaShape s) {
+		return s.Sides ();
+	}
+
+	[MethodImplAttribute (MethodImplOptions.NoInlining)]
+	static ChaShape cha_new_square () {
+		return new ChaSquare ();
+	}
+
+	static public int test_0_cha_override_loaded_later () {
+		if (cha_call_value (new ChaBase ()) != 1)
+			return 1;
+		/* Loads an override of ChaBase.Value () */
+		if (cha_call_value (cha_new_derived ()) != 2)
+			return 2;
+		if (cha_call_value (new ChaBase ()) != 1)
+			return 3;
+		try {
+			cha_call_value (null);
+			return 4;
+		} catch (NullReferenceException) {
+		}
+		return 0;
+	}
+
+	static public int test_0_cha_single_implementation () {
+		if (cha_call_sides (new ChaTriangle ()) != 3)
+			return 1;
+		/* Loads a second implementation of ChaShape.Sides () */
+		if (cha_call_sides (cha_new_square ()) != 4)
+			return 2;
+		if (cha_call_sides (new ChaTriangle ()) != 3)
+			return 3;
+		return 0;
+	}
+}
@@ -1243,3 +1243,71 @@ mono_gsharedvt_value_copy (gpointer dest, gpointer src, MonoClass *klass)
 	else
         mono_gc_wbarrier_generic_store (dest, *(MonoObject**)src);
 }
+
+/*
+ * inline_cache_count_miss:
+ *
+ *   Count a receiver which could not be added to CACHE. After too many of them,
+ * calls from the call site go through the IMT without calling
+ * mono_inline_cache_miss ().
+ */
+static void
+inline_cache_count_miss (MonoInlineCache *cache)
+{
+	if (InterlockedIncrement (&cache->misses) >= MONO_INLINE_CACHE_MAX_MISSES) {
+		if (InterlockedCompareExchange (&cache->megamorphic, TRUE, FALSE) == FALSE)
+			InterlockedIncrement (&mono_jit_stats.inline_cache_megamorphic);
+	}
+}
+
+/*
+ * mono_inline_cache_miss:
+ *
+ *   Called by interface calls made through CACHE when the vtable of OBJ is not in
+ * the cache. Return the address to call, adding it to the cache if possible.
+ */
+gpointer
+mono_inline_cache_miss (MonoInlineCache *cache, MonoObject *obj)
+{
+	MonoVTable *vtable = obj->vtable;
+	MonoClass *klass = vtable->klass;
+	MonoMethod *m;
+	gpointer addr, compiled_method, imt_addr;
+	int index;
+
+	InterlockedIncrement (&mono_jit_stats.inline_cache_misses);
+
+	imt_addr = ((gpointer*)vtable) [(gint32)mono_method_get_imt_slot (cache->method) - MONO_IMT_SIZE];
+	if (cache->megamorphic)
+		return imt_addr;
+
+	/*
+	 * Proxies, arrays and variant interfaces are not cached, they are dispatched
+	 * through the IMT slot, the caller passes the IMT argument. They count as misses,
+	 * so call sites which mostly see them end up using the IMT directly.
+	 */
+	if (mono_object_is_transparent_proxy (obj) || klass->rank || mono_class_interface_offset (klass, cache->method->klass) < 0) {
+		inline_cache_count_miss (cache);
+		return imt_addr;
+	}
+
+	m = mono_object_get_virtual_method (obj, cache->method);
+	compiled_method = mono_compile_method (m);
+	addr = mini_add_method_trampoline (NULL, m, compiled_method, mono_method_needs_static_rgctx_invoke (m, FALSE), klass->valuetype);
+
+	/* Calls to tier 0 code have to keep going through the trampolines to be counted */
+	if (mono_tiered_count_call (compiled_method))
+		return addr;
+
+	index = InterlockedIncrement (&cache->nentries) - 1;
+	if (index < MONO_INLINE_CACHE_SIZE) {
+		cache->entries [index].addr = addr;
+		/* The calling code checks the vtable first */
+		mono_memory_write_barrier ();
+		cache->entries [index].vtable = vtable;
+	} else {
+		inline_cache_count_miss (cache);
+	}
+
+	return addr;
+}
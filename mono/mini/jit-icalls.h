@@ -180,5 +180,7 @@ mono_gsharedvt_constrained_call (gpointer mp, MonoMethod *cmethod, MonoClass *kl
 
 void mono_gsharedvt_value_copy (gpointer dest, gpointer src, MonoClass *klass) MONO_INTERNAL;
 
+gpointer mono_inline_cache_miss (MonoInlineCache *cache, MonoObject *obj) MONO_INTERNAL;
+
 #endif /* __MONO_JIT_ICALLS_H__ */
 
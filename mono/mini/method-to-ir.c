@@ -144,6 +144,7 @@ MONO_API MonoInst* mono_emit_native_call (MonoCompile *cfg, gconstpointer func,
 
 static int inline_method (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig, MonoInst **sp,
 						  guchar *ip, guint real_offset, gboolean inline_always, MonoBasicBlock **out_cbb);
+static MonoInst* emit_memory_barrier (MonoCompile *cfg, int kind);
 
 /* helper methods signatures */
 static MonoMethodSignature *helper_sig_class_init_trampoline;
@@ -2898,6 +2899,162 @@ mono_emit_method_call (MonoCompile *cfg, MonoMethod *method, MonoInst **args, Mo
 	return mono_emit_method_call_full (cfg, method, mono_method_signature (method), FALSE, args, this, NULL, NULL);
 }
 
+/* Not atomic, only used for statistics */
+static void
+emit_inc_counter (MonoCompile *cfg, gint32 *counter)
+{
+	MonoInst *ins;
+	int reg = alloc_ireg (cfg);
+
+	EMIT_NEW_PCONST (cfg, ins, counter);
+	MONO_EMIT_NEW_LOAD_MEMBASE_OP (cfg, OP_LOADI4_MEMBASE, reg, ins->dreg, 0);
+	MONO_EMIT_NEW_BIALU_IMM (cfg, OP_IADD_IMM, reg, reg, 1);
+	MONO_EMIT_NEW_STORE_MEMBASE (cfg, OP_STOREI4_MEMBASE_REG, ins->dreg, 0, reg);
+}
+
+/*
+ * get_devirt_target:
+ *
+ *   Return the method a virtual call to CMETHOD can be devirtualized to, based on
+ * the overrides loaded so far, or NULL. Classes loaded later can override the
+ * returned method, so the call has to check *OVERRIDE_INFO at runtime.
+ */
+static MonoMethod*
+get_devirt_target (MonoCompile *cfg, MonoMethod *cmethod, MonoMethodSignature *fsig, MonoMethodOverrideInfo **override_info)
+{
+	MonoMethodOverrideInfo *info;
+	MonoMethod *target;
+
+	if (!(cfg->opt & MONO_OPT_CHA) || !mono_class_track_overrides || cfg->compile_aot || COMPILE_LLVM (cfg))
+		return NULL;
+	if (cmethod->wrapper_type != MONO_WRAPPER_NONE || cmethod->is_inflated || cmethod->klass->generic_class || cmethod->klass->generic_container)
+		return NULL;
+	/* Receivers of these could be transparent proxies */
+	if (MONO_CLASS_IS_INTERFACE (cmethod->klass) || cmethod->klass == mono_defaults.object_class || mono_class_is_marshalbyref (cmethod->klass))
+		return NULL;
+	if (fsig->generic_param_count || MONO_TYPE_ISSTRUCT (fsig->ret))
+		return NULL;
+
+	info = mono_method_get_override_info (cmethod);
+	if (!info->overridden) {
+		if (cmethod->flags & METHOD_ATTRIBUTE_ABSTRACT)
+			return NULL;
+		target = cmethod;
+	} else {
+		/* Abstract methods with a single implementation */
+		target = info->override;
+		if (!(cmethod->flags & METHOD_ATTRIBUTE_ABSTRACT) || !target || (target->flags & METHOD_ATTRIBUTE_ABSTRACT))
+			return NULL;
+		if (target->is_inflated || target->klass->generic_class || target->klass->generic_container)
+			return NULL;
+		info = mono_method_get_override_info (target);
+		if (info->overridden)
+			return NULL;
+	}
+
+	*override_info = info;
+	return target;
+}
+
+#ifdef MONO_ARCH_IMT_REG
+static gboolean
+can_use_inline_cache (MonoCompile *cfg, MonoMethod *method, MonoMethodSignature *sig)
+{
+	if (!(cfg->opt & MONO_OPT_INLINE_CACHE) || !mono_use_imt || cfg->compile_aot || COMPILE_LLVM (cfg))
+		return FALSE;
+	if (!(method->klass->flags & TYPE_ATTRIBUTE_INTERFACE) || sig->generic_param_count || sig->pinvoke)
+		return FALSE;
+	/* The cache is keyed by vtable, and the method is embedded as a constant */
+	if (cfg->generic_sharing_context && mini_method_check_context_used (cfg, method))
+		return FALSE;
+	return TRUE;
+}
+
+/*
+ * emit_inline_cache_call:
+ *
+ *   Emit an interface call to METHOD through a polymorphic inline cache. The cache
+ * remembers the vtables of the receivers seen at this call site along with the
+ * address of the implementing method, so hits make a direct call. Misses call
+ * mono_inline_cache_miss () which fills the cache. Once the call site has seen
+ * too many receiver types, calls go through the IMT as usual. The IMT argument
+ * is always passed, so the IMT slot can be called in every case.
+ */
+static MonoInst*
+emit_inline_cache_call (MonoCompile *cfg, MonoMethod *method, MonoMethodSignature *sig, MonoInst **args)
+{
+	MonoInlineCache *cache;
+	MonoBasicBlock *hit_bb, *miss_bb, *megamorphic_bb, *end_bb, *next_bb;
+	MonoInst *cache_ins, *imt_arg, *addr, *ins, *iargs [2];
+	int vtable_reg, addr_reg, entry_reg, i;
+
+	cache = mono_domain_alloc0 (cfg->domain, sizeof (MonoInlineCache));
+	cache->method = method;
+	InterlockedIncrement (&mono_jit_stats.inline_caches);
+
+	NEW_BBLOCK (cfg, hit_bb);
+	NEW_BBLOCK (cfg, miss_bb);
+	NEW_BBLOCK (cfg, megamorphic_bb);
+	NEW_BBLOCK (cfg, end_bb);
+
+	addr_reg = alloc_preg (cfg);
+	vtable_reg = alloc_preg (cfg);
+	MONO_EMIT_NEW_LOAD_MEMBASE_FAULT (cfg, vtable_reg, args [0]->dreg, MONO_STRUCT_OFFSET (MonoObject, vtable));
+	EMIT_NEW_PCONST (cfg, cache_ins, cache);
+
+	for (i = 0; i < MONO_INLINE_CACHE_SIZE; ++i) {
+		int offset = MONO_STRUCT_OFFSET (MonoInlineCache, entries) + i * sizeof (MonoInlineCacheEntry);
+
+		next_bb = (i == MONO_INLINE_CACHE_SIZE - 1) ? miss_bb : NULL;
+		if (!next_bb)
+			NEW_BBLOCK (cfg, next_bb);
+
+		entry_reg = alloc_preg (cfg);
+		MONO_EMIT_NEW_LOAD_MEMBASE (cfg, entry_reg, cache_ins->dreg, offset + MONO_STRUCT_OFFSET (MonoInlineCacheEntry, vtable));
+		MONO_EMIT_NEW_BIALU (cfg, OP_COMPARE, -1, entry_reg, vtable_reg);
+		MONO_EMIT_NEW_BRANCH_BLOCK (cfg, OP_PBNE_UN, next_bb);
+		/* mono_inline_cache_miss () stores addr before vtable */
+		emit_memory_barrier (cfg, LoadLoadBarrier);
+		MONO_EMIT_NEW_LOAD_MEMBASE (cfg, addr_reg, cache_ins->dreg, offset + MONO_STRUCT_OFFSET (MonoInlineCacheEntry, addr));
+		MONO_EMIT_NEW_BRANCH_BLOCK (cfg, OP_BR, hit_bb);
+
+		if (next_bb != miss_bb)
+			MONO_START_BB (cfg, next_bb);
+	}
+
+	/* Miss */
+	MONO_START_BB (cfg, miss_bb);
+	entry_reg = alloc_ireg (cfg);
+	MONO_EMIT_NEW_LOAD_MEMBASE_OP (cfg, OP_LOADI4_MEMBASE, entry_reg, cache_ins->dreg, MONO_STRUCT_OFFSET (MonoInlineCache, megamorphic));
+	MONO_EMIT_NEW_BIALU_IMM (cfg, OP_COMPARE_IMM, -1, entry_reg, 0);
+	MONO_EMIT_NEW_BRANCH_BLOCK (cfg, OP_IBNE_UN, megamorphic_bb);
+	iargs [0] = cache_ins;
+	iargs [1] = args [0];
+	ins = mono_emit_jit_icall (cfg, mono_inline_cache_miss, iargs);
+	MONO_EMIT_NEW_UNALU (cfg, OP_MOVE, addr_reg, ins->dreg);
+	MONO_EMIT_NEW_BRANCH_BLOCK (cfg, OP_BR, end_bb);
+
+	/* Megamorphic, call the IMT slot */
+	MONO_START_BB (cfg, megamorphic_bb);
+	MONO_EMIT_NEW_LOAD_MEMBASE (cfg, addr_reg, vtable_reg, ((gint32)mono_method_get_imt_slot (method) - MONO_IMT_SIZE) * SIZEOF_VOID_P);
+	if (mono_jit_stats.enabled)
+		emit_inc_counter (cfg, &mono_jit_stats.inline_cache_megamorphic_calls);
+	MONO_EMIT_NEW_BRANCH_BLOCK (cfg, OP_BR, end_bb);
+
+	/* Hit */
+	MONO_START_BB (cfg, hit_bb);
+	if (mono_jit_stats.enabled)
+		emit_inc_counter (cfg, &mono_jit_stats.inline_cache_hits);
+
+	MONO_START_BB (cfg, end_bb);
+
+	EMIT_NEW_UNALU (cfg, addr, OP_MOVE, alloc_preg (cfg), addr_reg);
+	EMIT_NEW_METHODCONST (cfg, imt_arg, method);
+
+	return mono_emit_calli (cfg, sig, args, addr, imt_arg, NULL);
+}
+#endif
+
 MonoInst*
 mono_emit_native_call (MonoCompile *cfg, gconstpointer func, MonoMethodSignature *sig,
 					   MonoInst **args)
@@ -8074,6 +8231,8 @@ mono_method_to_ir (MonoCompile *cfg, MonoMethod *method, MonoBasicBlock *start_b
 			gboolean push_res = TRUE;
 			gboolean skip_ret = FALSE;
 			gboolean delegate_invoke = FALSE;
+			MonoMethod *devirt_method = NULL;
+			MonoMethodOverrideInfo *override_info = NULL;
 
 			CHECK_OPSIZE (5);
 			token = read32 (ip + 1);
@@ -8590,6 +8749,84 @@ mono_method_to_ir (MonoCompile *cfg, MonoMethod *method, MonoBasicBlock *start_b
 				}
 			}
 
+			/*
+			 * Guarded devirtualization: if no loaded class overrides the called method,
+			 * inline it behind a check which fails once an override is loaded.
+			 */
+			if (cmethod && virtual && (cfg->opt & MONO_OPT_INLINE) && (cmethod->flags & METHOD_ATTRIBUTE_VIRTUAL) && !MONO_METHOD_IS_FINAL (cmethod) &&
+				!tail_call && !imt_arg && !vtable_arg && !constrained_call && !pass_imt_from_rgctx && !context_used &&
+				(devirt_method = get_devirt_target (cfg, cmethod, fsig, &override_info)) && mono_method_check_inlining (cfg, devirt_method)) {
+				MonoBasicBlock *slow_bb, *end_bb;
+				MonoInst *ret_var = NULL, *store, **args;
+				int flag_reg, costs;
+
+				/* Prevent inlining of methods that contain indirect calls */
+				INLINE_FAILURE ("guarded call");
+
+				/* inline_method () overwrites sp [0] with the return value */
+				args = mono_mempool_alloc (cfg->mempool, sizeof (MonoInst*) * n);
+				memcpy (args, sp, sizeof (MonoInst*) * n);
+				if (!MONO_TYPE_IS_VOID (fsig->ret))
+					ret_var = mono_compile_create_var (cfg, fsig->ret, OP_LOCAL);
+
+				NEW_BBLOCK (cfg, slow_bb);
+				NEW_BBLOCK (cfg, end_bb);
+
+				EMIT_NEW_PCONST (cfg, ins, &override_info->overridden);
+				flag_reg = alloc_ireg (cfg);
+				MONO_EMIT_NEW_LOAD_MEMBASE_OP (cfg, OP_LOADI4_MEMBASE, flag_reg, ins->dreg, 0);
+				MONO_EMIT_NEW_BIALU_IMM (cfg, OP_COMPARE_IMM, -1, flag_reg, 0);
+				MONO_EMIT_NEW_BRANCH_BLOCK (cfg, OP_IBNE_UN, slow_bb);
+				if (devirt_method == cmethod) {
+					MONO_EMIT_NEW_CHECK_THIS (cfg, args [0]->dreg);
+				} else {
+					/* Receivers which are not instances of the overriding class use another override */
+					MonoBasicBlock *fast_bb;
+					int vtable_reg = alloc_preg (cfg);
+					int klass_reg = alloc_preg (cfg);
+
+					NEW_BBLOCK (cfg, fast_bb);
+					MONO_EMIT_NEW_LOAD_MEMBASE_FAULT (cfg, vtable_reg, args [0]->dreg, MONO_STRUCT_OFFSET (MonoObject, vtable));
+					MONO_EMIT_NEW_LOAD_MEMBASE (cfg, klass_reg, vtable_reg, MONO_STRUCT_OFFSET (MonoVTable, klass));
+					mini_emit_isninst_cast (cfg, klass_reg, devirt_method->klass, slow_bb, fast_bb);
+					MONO_EMIT_NEW_BRANCH_BLOCK (cfg, OP_BR, slow_bb);
+					MONO_START_BB (cfg, fast_bb);
+				}
+
+				bblock = cfg->cbb;
+				costs = inline_method (cfg, devirt_method, fsig, sp, ip, cfg->real_offset, FALSE, &bblock);
+				if (costs) {
+					cfg->real_offset += 5;
+					inline_costs += costs;
+					if (ret_var)
+						EMIT_NEW_TEMPSTORE (cfg, store, ret_var->inst_c0, sp [0]);
+				} else {
+					/* Too large to inline, call it directly */
+					ins = mono_emit_method_call_full (cfg, devirt_method, fsig, FALSE, args, NULL, NULL, NULL);
+					if (ret_var)
+						EMIT_NEW_TEMPSTORE (cfg, store, ret_var->inst_c0, mono_emit_widen_call_res (cfg, ins, fsig));
+				}
+				MONO_EMIT_NEW_BRANCH_BLOCK (cfg, OP_BR, end_bb);
+
+				MONO_START_BB (cfg, slow_bb);
+				if (mono_jit_stats.enabled)
+					emit_inc_counter (cfg, &mono_jit_stats.devirt_guard_failures);
+				ins = mono_emit_method_call_full (cfg, cmethod, fsig, FALSE, args, args [0], NULL, NULL);
+				if (ret_var)
+					EMIT_NEW_TEMPSTORE (cfg, store, ret_var->inst_c0, mono_emit_widen_call_res (cfg, ins, fsig));
+
+				MONO_START_BB (cfg, end_bb);
+				bblock = cfg->cbb;
+
+				if (ret_var) {
+					EMIT_NEW_TEMPLOAD (cfg, ins, ret_var->inst_c0);
+					*sp++ = ins;
+				}
+				push_res = FALSE;
+				InterlockedIncrement (&mono_jit_stats.devirt_guarded_calls);
+				goto call_end;
+			}
+
 			/* Tail recursion elimination */
 			if ((cfg->opt & MONO_OPT_TAILC) && call_opcode == CEE_CALL && cmethod == method && ip [5] == CEE_RET && !vtable_arg) {
 				gboolean has_vtargs = FALSE;
@@ -8877,6 +9114,13 @@ mono_method_to_ir (MonoCompile *cfg, MonoMethod *method, MonoBasicBlock *start_b
 
 			/* Common call */
 			INLINE_FAILURE ("call");
+#ifdef MONO_ARCH_IMT_REG
+			if (virtual && !tail_call && !imt_arg && !vtable_arg && !constrained_call && can_use_inline_cache (cfg, cmethod, fsig)) {
+				ins = emit_inline_cache_call (cfg, cmethod, fsig, sp);
+				bblock = cfg->cbb;
+				goto call_end;
+			}
+#endif
 			ins = mono_emit_method_call_full (cfg, cmethod, fsig, tail_call, sp, virtual ? sp [0] : NULL,
 											  imt_arg, vtable_arg);
 
@@ -12,8 +12,12 @@
 #include "mini-gc.h"
 #include <mono/metadata/gc-internal.h>
 
-#if 0
-//#if defined(MONO_ARCH_GC_MAPS_SUPPORTED)
+/*
+ * The GC map code is only kept working on amd64.  The other backends
+ * define MONO_ARCH_GC_MAPS_SUPPORTED too, but haven't been tested with
+ * precise stack marking for a long time.
+ */
+#if defined(MONO_ARCH_GC_MAPS_SUPPORTED) && defined(TARGET_AMD64)
 
 #include <mono/metadata/sgen-conf.h>
 #include <mono/metadata/gc-internal.h>
@@ -215,18 +219,19 @@ typedef struct {
 	 * Their address needs to be computed.
 	 */
 
-	/* The fixed fields of the GCMap encoded using LEB128 */
+	/*
+	 * The fixed fields of the GCMap encoded using LEB128, followed by
+	 * an array of ncallsites entries, each entry is callsite_entry_size bytes long,
+	 * followed by the GC bitmaps.
+	 */
 	guint8 encoded [MONO_ZERO_LEN_ARRAY];
-
-	/* An array of ncallsites entries, each entry is callsite_entry_size bytes long */
-	guint8 callsites [MONO_ZERO_LEN_ARRAY];
-
-	/* The GC bitmaps */
-	guint8 bitmaps [MONO_ZERO_LEN_ARRAY];
 } GCEncodedMap;
 
-static int precise_frame_count [2], precise_frame_limit = -1;
+static int precise_frame_count [2];
+#ifdef DEBUG_ENABLED
+static int precise_frame_limit = -1;
 static gboolean precise_frame_limit_inited;
+#endif
 
 /* Stats */
 typedef struct {
@@ -602,15 +607,11 @@ thread_suspend_func (gpointer user_data, void *sigctx, MonoContext *ctx)
 
 	if (tls->tid != GetCurrentThreadId ()) {
 		/* Happens on osx because threads are not suspended using signals */
-#ifndef TARGET_WIN32
-		gboolean res;
-#endif
-
 		g_assert (tls->info);
 #ifdef TARGET_WIN32
 		return;
 #else
-		res = mono_thread_state_init_from_handle (&tls->unwind_state, tls->info);
+		mono_thread_state_init_from_handle (&tls->unwind_state, tls->info);
 #endif
 	} else {
 		tls->unwind_state.unwind_data [MONO_UNWIND_DATA_LMF] = mono_get_lmf ();
@@ -896,6 +897,7 @@ conservative_pass (TlsData *tls, guint8 *stack_start, guint8 *stack_end)
 		/* The embedded callsite table requires this */
 		g_assert (((mgreg_t)emap % 4) == 0);
 
+#ifdef DEBUG_ENABLED
 		/*
 		 * Debugging aid to control the number of frames scanned precisely
 		 */
@@ -907,16 +909,17 @@ conservative_pass (TlsData *tls, guint8 *stack_start, guint8 *stack_end)
 				
 		if (precise_frame_limit != -1) {
 			if (precise_frame_count [FALSE] == precise_frame_limit)
-				printf ("LAST PRECISE FRAME: %s\n", mono_method_full_name (method, TRUE));
+				DEBUG (char *fname = mono_method_full_name (method, TRUE); fprintf (logfile, "LAST PRECISE FRAME: %s\n", fname); g_free (fname));
 			if (precise_frame_count [FALSE] > precise_frame_limit)
 				continue;
 		}
+#endif
 		precise_frame_count [FALSE] ++;
 
 		/* Decode the encoded GC map */
 		map = &map_tmp;
 		memset (map, 0, sizeof (GCMap));
-		decode_gc_map (&emap->encoded [0], map, &p);
+		decode_gc_map (emap->encoded, map, &p);
 		p = (guint8*)ALIGN_TO (p, map->callsite_entry_size);
 		map->callsites.offsets8 = p;
 		p += map->callsite_entry_size * map->ncallsites;
@@ -1250,7 +1253,7 @@ mini_gc_init_gc_map (MonoCompile *cfg)
 	} else if (!mono_gc_precise_stack_mark_enabled ())
 		return;
 
-#if 1
+#ifdef DEBUG_ENABLED
 	/* Debugging support */
 	{
 		static int precise_count;
@@ -1258,7 +1261,7 @@ mini_gc_init_gc_map (MonoCompile *cfg)
 		precise_count ++;
 		if (g_getenv ("MONO_GCMAP_COUNT")) {
 			if (precise_count == atoi (g_getenv ("MONO_GCMAP_COUNT")))
-				printf ("LAST: %s\n", mono_method_full_name (cfg->method, TRUE));
+				DEBUG (char *fname = mono_method_full_name (cfg->method, TRUE); fprintf (logfile, "LAST: %s\n", fname); g_free (fname));
 			if (precise_count > atoi (g_getenv ("MONO_GCMAP_COUNT")))
 				return;
 		}
@@ -2381,7 +2384,7 @@ create_map (MonoCompile *cfg)
 		//emap->ref_slots = map->ref_slots;
 
 		/* Encoded fixed fields */
-		p = &emap->encoded [0];
+		p = emap->encoded;
 		//emap->encoded_size = encoded_size;
 		memcpy (p, buf, encoded_size);
 		p += encoded_size;
@@ -2486,13 +2489,19 @@ mini_gc_init (void)
 {
 	MonoGCCallbacks cb;
 
-	memset (&cb, 0, sizeof (cb));
-	cb.thread_attach_func = thread_attach_func;
-	cb.thread_detach_func = thread_detach_func;
-	cb.thread_suspend_func = thread_suspend_func;
-	/* Comment this out to disable precise stack marking */
-	cb.thread_mark_func = thread_mark_func;
-	mono_gc_set_gc_callbacks (&cb);
+	/*
+	 * Without precise stack marking the GC scans the stacks itself, so
+	 * there is no need to keep track of the threads.
+	 */
+	if (mono_gc_is_moving () && mono_gc_precise_stack_mark_enabled ()) {
+		memset (&cb, 0, sizeof (cb));
+		cb.thread_attach_func = thread_attach_func;
+		cb.thread_detach_func = thread_detach_func;
+		cb.thread_suspend_func = thread_suspend_func;
+		/* Comment this out to disable precise stack marking */
+		cb.thread_mark_func = thread_mark_func;
+		mono_gc_set_gc_callbacks (&cb);
+	}
 
 	logfile = mono_gc_get_logfile ();
 
@@ -395,6 +395,7 @@ common_call_trampoline (mgreg_t *regs, guint8 *code, MonoMethod *m, guint8* tram
 	gboolean virtual, variance_used = FALSE;
 	gpointer *orig_vtable_slot, *vtable_slot_to_patch = NULL;
 	MonoJitInfo *ji = NULL;
+	gboolean tier0;
 
 	virtual = (gpointer)vtable_slot > (gpointer)vt;
 
@@ -584,6 +585,12 @@ common_call_trampoline (mgreg_t *regs, guint8 *code, MonoMethod *m, guint8* tram
 	addr = compiled_method = mono_compile_method (m);
 	g_assert (addr);
 
+	/*
+	 * Calls to tier 0 code are not patched, so they keep coming through the
+	 * trampoline and are counted until the method is recompiled.
+	 */
+	tier0 = mono_tiered_count_call (compiled_method);
+
 	if (generic_virtual || variant_iface) {
 		if (vt->klass->valuetype) /*FIXME is this required variant iface?*/
 			need_unbox_tramp = TRUE;
@@ -600,6 +607,9 @@ common_call_trampoline (mgreg_t *regs, guint8 *code, MonoMethod *m, guint8* tram
 		vtable_slot = orig_vtable_slot;
 		g_assert (vtable_slot);
 
+		if (tier0)
+			return addr;
+
 		mono_method_add_generic_virtual_invocation (mono_domain_get (), 
 													vt, vtable_slot,
 													target, addr);
@@ -607,6 +617,9 @@ common_call_trampoline (mgreg_t *regs, guint8 *code, MonoMethod *m, guint8* tram
 		return addr;
 	}
 
+	if (tier0)
+		return addr;
+
 	/* the method was jumped to */
 	if (!code) {
 		MonoDomain *domain = mono_domain_get ();
@@ -1018,6 +1031,7 @@ mono_delegate_trampoline (mgreg_t *regs, guint8 *code, gpointer *arg, guint8* tr
 	MonoMethodSignature *sig;
 	gpointer addr, compiled_method;
 	gboolean is_remote = FALSE;
+	gboolean tier0 = FALSE;
 
 	trampoline_calls ++;
 
@@ -1122,9 +1136,11 @@ mono_delegate_trampoline (mgreg_t *regs, guint8 *code, gpointer *arg, guint8* tr
 			delegate->method_ptr = *delegate->method_code;
 		} else {
 			compiled_method = addr = mono_compile_method (method);
+			/* Keep calling through the trampoline until the method is recompiled */
+			tier0 = mono_tiered_count_call (compiled_method);
 			addr = mini_add_method_trampoline (NULL, method, compiled_method, need_rgctx_tramp, need_unbox_tramp);
 			delegate->method_ptr = addr;
-			if (enable_caching && delegate->method_code)
+			if (enable_caching && delegate->method_code && !tier0)
 				*delegate->method_code = delegate->method_ptr;
 		}
 	} else {
@@ -1151,6 +1167,9 @@ mono_delegate_trampoline (mgreg_t *regs, guint8 *code, gpointer *arg, guint8* tr
 		code = mini_add_method_trampoline (NULL, m, code, mono_method_needs_static_rgctx_invoke (m, FALSE), FALSE);
 	}
 
+	if (tier0)
+		return code;
+
 	delegate->invoke_impl = mono_get_addr_from_ftnptr (code);
 	if (enable_caching && !callvirt && tramp_info->method) {
 		tramp_info->method_ptr = delegate->method_ptr;
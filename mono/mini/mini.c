@@ -62,6 +62,8 @@
 #include <mono/utils/dtrace.h>
 #include <mono/utils/mono-signal-handler.h>
 #include <mono/utils/mono-threads.h>
+#include <mono/utils/mono-semaphore.h>
+#include <mono/utils/mono-time.h>
 
 #include "mini.h"
 #include "seq-points.h"
@@ -1715,19 +1717,11 @@ mono_icall_get_wrapper_full (MonoJitICallInfo* callinfo, gboolean do_compile)
 	if (callinfo->trampoline)
 		return callinfo->trampoline;
 
-	/* 
-	 * We use the lock on the root domain instead of the JIT lock to protect 
-	 * callinfo->trampoline, since we do a lot of stuff inside the critical section.
+	/*
+	 * The wrapper is created and compiled outside of any lock, so other threads are not
+	 * blocked while it is compiled. If two threads race, both create a wrapper, but only
+	 * the first one is published. The lock on the root domain protects callinfo->trampoline.
 	 */
-	mono_loader_lock (); /*FIXME mono_compile_method requires the loader lock, by large.*/
-	mono_domain_lock (domain);
-
-	if (callinfo->trampoline) {
-		mono_domain_unlock (domain);
-		mono_loader_unlock ();
-		return callinfo->trampoline;
-	}
-
 	name = g_strdup_printf ("__icall_wrapper_%s", callinfo->name);
 	wrapper = mono_marshal_get_icall_wrapper (callinfo->sig, name, callinfo->func, check_for_pending_exc);
 	g_free (name);
@@ -1736,13 +1730,14 @@ mono_icall_get_wrapper_full (MonoJitICallInfo* callinfo, gboolean do_compile)
 		trampoline = mono_compile_method (wrapper);
 	else
 		trampoline = mono_create_ftnptr (domain, mono_create_jit_trampoline_in_domain (domain, wrapper));
-	mono_register_jit_icall_wrapper (callinfo, trampoline);
-
-	callinfo->trampoline = trampoline;
 
+	mono_domain_lock (domain);
+	if (!callinfo->trampoline) {
+		mono_register_jit_icall_wrapper (callinfo, trampoline);
+		callinfo->trampoline = trampoline;
+	}
 	mono_domain_unlock (domain);
-	mono_loader_unlock ();
-	
+
 	return callinfo->trampoline;
 }
 
@@ -5751,6 +5746,8 @@ mono_jit_compile_method_inner (MonoMethod *method, MonoDomain *target_domain, in
 	guint32 prof_options;
 	GTimer *jit_timer;
 	MonoMethod *prof_method, *shared;
+	gboolean tier0;
+	guint32 tier0_opt;
 
 #ifdef MONO_USE_AOT_COMPILER
 	if (opt & MONO_OPT_AOT) {
@@ -5881,9 +5878,11 @@ mono_jit_compile_method_inner (MonoMethod *method, MonoDomain *target_domain, in
 		return NULL;
 	}
 
+	tier0 = mono_tiered_get_tier0_optimizations (method, target_domain, opt, &tier0_opt);
+
 	jit_timer = g_timer_new ();
 
-	cfg = mini_method_compile (method, opt, target_domain, JIT_FLAG_RUN_CCTORS, 0);
+	cfg = mini_method_compile (method, tier0 ? tier0_opt : opt, target_domain, JIT_FLAG_RUN_CCTORS, 0);
 	prof_method = cfg->method;
 
 	g_timer_stop (jit_timer);
@@ -5997,6 +5996,10 @@ mono_jit_compile_method_inner (MonoMethod *method, MonoDomain *target_domain, in
 		}
 	}
 	if (code == NULL) {
+		/* Has to be done before other threads can find the code */
+		if (tier0)
+			mono_tiered_register_method (target_domain, method, cfg->jit_info, opt);
+
 		/* The lookup + insert is atomic since this is done inside the domain lock */
 		mono_domain_jit_code_hash_lock (target_domain);
 		mono_internal_hash_table_insert (&target_domain->jit_code_hash, cfg->jit_info->d.method, cfg->jit_info);
@@ -6090,6 +6093,181 @@ mono_jit_compile_method_inner (MonoMethod *method, MonoDomain *target_domain, in
 	return code;
 }
 
+/*
+ * Methods which are being compiled. Threads which need a method which is already
+ * being compiled by another thread wait for it instead of compiling it again,
+ * while methods which are not related are compiled in parallel.
+ */
+typedef struct {
+	MonoMethod *method;
+	MonoDomain *domain;
+	guint32 owner;
+	/* Number of nested compilations of the method by the owner */
+	int recursion;
+	/* Number of threads referencing this entry */
+	int ref;
+	int waiters;
+	gboolean done;
+	MonoSemType sem;
+} JitCompilationEntry;
+
+/*
+ * Compiling a method can run managed code, i.e. cctors, so two threads might
+ * end up waiting for each other. Such waits are detected and avoided, as a last
+ * resort waiters give up after this many ms and compile the method themselves.
+ */
+#define MAX_JIT_WAIT_MS 1000
+
+static GPtrArray *jit_compilation_entries;
+/* Maps the threads waiting for a compilation to its JitCompilationEntry */
+static GHashTable *jit_waiting_threads;
+static mono_mutex_t jit_compilation_mutex;
+
+static JitCompilationEntry*
+find_compilation_entry (MonoMethod *method, MonoDomain *domain)
+{
+	int i;
+
+	for (i = 0; i < jit_compilation_entries->len; ++i) {
+		JitCompilationEntry *entry = g_ptr_array_index (jit_compilation_entries, i);
+
+		if (entry->method == method && entry->domain == domain)
+			return entry;
+	}
+	return NULL;
+}
+
+/*
+ * jit_wait_can_deadlock:
+ *
+ *   Return whenever the current thread, TID, should not wait for ENTRY to be
+ * compiled, because the owner might be waiting for this thread.
+ */
+static gboolean
+jit_wait_can_deadlock (JitCompilationEntry *entry, guint32 tid)
+{
+	JitCompilationEntry *e;
+
+	/*
+	 * The owner could be waiting for a cctor run by this thread, or be blocked on
+	 * a cctor itself, which class init doesn't know depends on us.
+	 */
+	if (mono_type_initialization_involves_thread (tid) || mono_type_initialization_involves_thread (entry->owner))
+		return TRUE;
+
+	/* Check whenever the owner waits for a method compiled by this thread */
+	for (e = entry; e; e = g_hash_table_lookup (jit_waiting_threads, GUINT_TO_POINTER (e->owner))) {
+		if (e->owner == tid)
+			return TRUE;
+	}
+	return FALSE;
+}
+
+static void
+unref_compilation_entry (JitCompilationEntry *entry)
+{
+	if (--entry->ref)
+		return;
+	MONO_SEM_DESTROY (&entry->sem);
+	g_free (entry);
+}
+
+/*
+ * wait_or_register_method_to_compile:
+ *
+ *   Return TRUE if the caller should compile METHOD, in which case it has to call
+ * unregister_method_to_compile () afterwards. Return FALSE if another thread compiled
+ * the method while we waited for it.
+ */
+static gboolean
+wait_or_register_method_to_compile (MonoMethod *method, MonoDomain *domain)
+{
+	JitCompilationEntry *entry;
+	guint32 start, tid = GetCurrentThreadId ();
+	gboolean compiled;
+
+	mono_mutex_lock (&jit_compilation_mutex);
+
+	entry = find_compilation_entry (method, domain);
+	if (!entry) {
+		entry = g_new0 (JitCompilationEntry, 1);
+		entry->method = method;
+		entry->domain = domain;
+		entry->owner = tid;
+		entry->ref = 1;
+		MONO_SEM_INIT (&entry->sem, 0);
+		g_ptr_array_add (jit_compilation_entries, entry);
+		mono_mutex_unlock (&jit_compilation_mutex);
+		return TRUE;
+	}
+
+	/* Recursive compilation of the same method, i.e. from a cctor */
+	if (entry->owner == tid) {
+		entry->recursion ++;
+		mono_mutex_unlock (&jit_compilation_mutex);
+		return TRUE;
+	}
+
+	/* Compile the method in parallel, the first one to finish is used */
+	if (jit_wait_can_deadlock (entry, tid)) {
+		mono_jit_stats.methods_jit_wait_skipped ++;
+		mono_mutex_unlock (&jit_compilation_mutex);
+		return TRUE;
+	}
+
+	entry->ref ++;
+	g_hash_table_insert (jit_waiting_threads, GUINT_TO_POINTER (tid), entry);
+	start = mono_msec_ticks ();
+	while (!entry->done) {
+		guint32 elapsed = mono_msec_ticks () - start;
+
+		if (elapsed >= MAX_JIT_WAIT_MS) {
+			mono_jit_stats.methods_jit_wait_timeouts ++;
+			break;
+		}
+
+		entry->waiters ++;
+		mono_mutex_unlock (&jit_compilation_mutex);
+		MONO_SEM_TIMEDWAIT (&entry->sem, MAX_JIT_WAIT_MS - elapsed);
+		mono_mutex_lock (&jit_compilation_mutex);
+	}
+	compiled = entry->done;
+	if (compiled)
+		mono_jit_stats.methods_jit_waits ++;
+	g_hash_table_remove (jit_waiting_threads, GUINT_TO_POINTER (tid));
+	unref_compilation_entry (entry);
+
+	mono_mutex_unlock (&jit_compilation_mutex);
+
+	/* If the other thread failed to compile the method, compile it again to get the exception */
+	return !compiled || !lookup_method (domain, method);
+}
+
+static void
+unregister_method_to_compile (MonoMethod *method, MonoDomain *domain)
+{
+	JitCompilationEntry *entry;
+
+	mono_mutex_lock (&jit_compilation_mutex);
+
+	entry = find_compilation_entry (method, domain);
+	if (entry && entry->owner == GetCurrentThreadId ()) {
+		if (entry->recursion) {
+			entry->recursion --;
+			mono_mutex_unlock (&jit_compilation_mutex);
+			return;
+		}
+		g_ptr_array_remove_fast (jit_compilation_entries, entry);
+		entry->done = TRUE;
+		/* Waiters which timed out might leave tokens behind, they are freed with the entry */
+		for (; entry->waiters > 0; entry->waiters --)
+			MONO_SEM_POST (&entry->sem);
+		unref_compilation_entry (entry);
+	}
+
+	mono_mutex_unlock (&jit_compilation_mutex);
+}
+
 static gpointer
 mono_jit_compile_method_with_opt (MonoMethod *method, guint32 opt, MonoException **ex)
 {
@@ -6159,7 +6337,12 @@ mono_jit_compile_method_with_opt (MonoMethod *method, guint32 opt, MonoException
 		}
 	}
 
+	if (!wait_or_register_method_to_compile (method, target_domain))
+		/* Compiled by another thread, the lookup above will find it now */
+		return mono_jit_compile_method_with_opt (method, opt, ex);
+
 	code = mono_jit_compile_method_inner (method, target_domain, opt, ex);
+	unregister_method_to_compile (method, target_domain);
 	if (!code)
 		return NULL;
 
@@ -6996,6 +7179,19 @@ register_jit_stats (void)
 	mono_counters_register ("Methods JITted using mono JIT", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.methods_without_llvm);
 	mono_counters_register ("Methods JITted using LLVM", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.methods_with_llvm);	
 	mono_counters_register ("Total time spent JITting (sec)", MONO_COUNTER_JIT | MONO_COUNTER_DOUBLE, &mono_jit_stats.jit_time);
+	mono_counters_register ("Methods JITted at tier 0", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.methods_tier0);
+	mono_counters_register ("Methods recompiled at tier 1", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.methods_tier1);
+	mono_counters_register ("Time spent recompiling at tier 1 (sec)", MONO_COUNTER_JIT | MONO_COUNTER_DOUBLE, &mono_jit_stats.tier1_time);
+	mono_counters_register ("Methods compiled by another thread", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.methods_jit_waits);
+	mono_counters_register ("JIT compilation wait timeouts", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.methods_jit_wait_timeouts);
+	mono_counters_register ("JIT compilation waits skipped", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.methods_jit_wait_skipped);
+	mono_counters_register ("Interface call inline caches", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.inline_caches);
+	mono_counters_register ("Inline cache hits", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.inline_cache_hits);
+	mono_counters_register ("Inline cache misses", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.inline_cache_misses);
+	mono_counters_register ("Megamorphic inline caches", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.inline_cache_megamorphic);
+	mono_counters_register ("Megamorphic inline cache calls", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.inline_cache_megamorphic_calls);
+	mono_counters_register ("Guarded devirtualized calls", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.devirt_guarded_calls);
+	mono_counters_register ("Devirtualization guard failures", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.devirt_guard_failures);
 	mono_counters_register ("Basic blocks", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.basic_blocks);
 	mono_counters_register ("Max basic blocks", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.max_basic_blocks);
 	mono_counters_register ("Allocated vars", MONO_COUNTER_JIT | MONO_COUNTER_INT, &mono_jit_stats.allocate_var);
@@ -7179,6 +7375,9 @@ mini_init (const char *filename, const char *runtime_version)
 #endif
 
 	mono_mutex_init_recursive (&jit_mutex);
+	mono_mutex_init (&jit_compilation_mutex);
+	jit_compilation_entries = g_ptr_array_new ();
+	jit_waiting_threads = g_hash_table_new (NULL, NULL);
 
 	mono_cross_helpers_run ();
 
@@ -7272,6 +7471,13 @@ mini_init (const char *filename, const char *runtime_version)
 	if (default_opt & MONO_OPT_AOT)
 		mono_aot_init ();
 
+	if (default_opt & MONO_OPT_TIERED)
+		mono_tiered_init ();
+
+	/* Has to be set before any class is loaded */
+	if (default_opt & MONO_OPT_CHA)
+		mono_class_track_overrides = TRUE;
+
 	mono_debugger_agent_init ();
 
 #ifdef MONO_ARCH_GSHARED_SUPPORTED
@@ -7608,6 +7814,7 @@ register_icalls (void)
 	register_icall (mono_gc_wbarrier_value_copy_bitmap, "mono_gc_wbarrier_value_copy_bitmap", "void ptr ptr int int", FALSE);
 
 	register_icall (mono_object_castclass_with_cache, "mono_object_castclass_with_cache", "object object ptr ptr", FALSE);
+	register_icall (mono_inline_cache_miss, "mono_inline_cache_miss", "ptr ptr object", FALSE);
 	register_icall (mono_object_isinst_with_cache, "mono_object_isinst_with_cache", "object object ptr ptr", FALSE);
 
 	register_icall (mono_debugger_agent_user_break, "mono_debugger_agent_user_break", "void", FALSE);
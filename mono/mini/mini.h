@@ -1646,6 +1646,26 @@ typedef enum {
 	MONO_CFG_HAS_ARRAY_ACCESS = 1 << 8
 } MonoCompileFlags;
 
+/* Number of receiver vtables remembered by an interface call inline cache */
+#define MONO_INLINE_CACHE_SIZE 4
+/* Misses after the cache is full before the call site is considered megamorphic */
+#define MONO_INLINE_CACHE_MAX_MISSES 8
+
+typedef struct {
+	MonoVTable *vtable;
+	gpointer addr;
+} MonoInlineCacheEntry;
+
+/* Per call site cache used by interface calls if MONO_OPT_INLINE_CACHE is enabled */
+typedef struct {
+	MonoInlineCacheEntry entries [MONO_INLINE_CACHE_SIZE];
+	MonoMethod *method;
+	volatile gint32 nentries;
+	volatile gint32 misses;
+	/* Calls go through the IMT once this is set */
+	volatile gint32 megamorphic;
+} MonoInlineCache;
+
 typedef struct {
 	gint32 methods_compiled;
 	gint32 methods_aot;
@@ -1675,11 +1695,24 @@ typedef struct {
 	gint32 alias_removed;
 	gint32 loads_eliminated;
 	gint32 stores_eliminated;
+	gint32 methods_tier0;
+	gint32 methods_tier1;
+	gint32 methods_jit_waits;
+	gint32 methods_jit_wait_timeouts;
+	gint32 methods_jit_wait_skipped;
+	gint32 inline_caches;
+	gint32 inline_cache_hits;
+	gint32 inline_cache_misses;
+	gint32 inline_cache_megamorphic;
+	gint32 inline_cache_megamorphic_calls;
+	gint32 devirt_guarded_calls;
+	gint32 devirt_guard_failures;
 	int methods_with_llvm;
 	int methods_without_llvm;
 	char *max_ratio_method;
 	char *biggest_method;
 	double jit_time;
+	double tier1_time;
 	gboolean enabled;
 } MonoJitStats;
 
@@ -2187,6 +2220,12 @@ jinfo_get_method (MonoJitInfo *ji)
 	return mono_jit_info_get_method (ji);
 }
 
+/* Tiered compilation */
+void      mono_tiered_init                  (void) MONO_INTERNAL;
+gboolean  mono_tiered_get_tier0_optimizations (MonoMethod *method, MonoDomain *domain, guint32 opt, guint32 *tier0_opt) MONO_INTERNAL;
+void      mono_tiered_register_method       (MonoDomain *domain, MonoMethod *method, MonoJitInfo *ji, guint32 opt) MONO_INTERNAL;
+gboolean  mono_tiered_count_call            (gpointer code) MONO_INTERNAL;
+
 /* AOT */
 void      mono_aot_init                     (void) MONO_INTERNAL;
 void      mono_aot_cleanup                  (void) MONO_INTERNAL;
@@ -0,0 +1,364 @@
+/*
+ * tiered.c: Tiered compilation of hot methods
+ *
+ * Copyright 2015 Xamarin, Inc (http://www.xamarin.com)
+ */
+
+/*
+ * When MONO_OPT_TIERED is enabled, methods are first compiled with a small
+ * set of cheap optimizations (tier 0).  Calls to tier 0 code go through the
+ * JIT trampolines, which are not patched for such methods, so every call
+ * through a trampoline is counted by mono_tiered_count_call ().  Once a
+ * method reaches the call threshold, it is queued for recompilation with the
+ * full set of optimizations (tier 1) by a small pool of background threads.
+ * The tier 1 code then replaces the tier 0 code in the jit code hash, so the
+ * next call through a trampoline patches the caller to the optimized code.
+ *
+ * Limitations:
+ * - There is no on-stack replacement, so methods containing backward
+ *   branches are compiled with full optimizations right away, since a long
+ *   running loop would otherwise never leave the tier 0 code.
+ * - Callers which cached the tier 0 address outside of the trampolines, like
+ *   runtime invoke wrappers, recursive calls and CEE_JMP targets, keep
+ *   calling the tier 0 code.
+ * - The tier 0 code is never freed, since other threads might still be
+ *   executing it.
+ * - Only methods of the root domain are tiered, the debugger and other code
+ *   which depends on sequence points disables tiering.
+ */
+
+#include <config.h>
+
+#include <mono/metadata/appdomain.h>
+#include <mono/metadata/mono-basic-block.h>
+#include <mono/metadata/mono-endian.h>
+#include <mono/metadata/threads-types.h>
+#include <mono/utils/mono-conc-hashtable.h>
+#include <mono/utils/mono-proclib.h>
+#include <mono/utils/mono-semaphore.h>
+
+#include "mini.h"
+
+/* Optimizations which change the semantics or the ABI, they are kept at every tier */
+#define TIER_INDEPENDENT_OPTIMIZATIONS (MONO_OPT_SHARED | MONO_OPT_AOT | MONO_OPT_PRECOMP | MONO_OPT_GSHARED | MONO_OPT_GSHAREDVT | \
+	MONO_OPT_SSE2 | MONO_OPT_SIMD | MONO_OPT_UNSAFE | MONO_OPT_TAILC | MONO_OPT_TIERED)
+
+/* Optimizations which are cheap enough to be done at tier 0 */
+#define TIER0_OPTIMIZATIONS (MONO_OPT_PEEPHOLE | MONO_OPT_BRANCH | MONO_OPT_CFOLD | MONO_OPT_INTRINS | MONO_OPT_CMOV | MONO_OPT_FCMOV)
+
+#define DEFAULT_THRESHOLD 30
+
+typedef struct {
+	MonoMethod *method;
+	MonoDomain *domain;
+	MonoJitInfo *ji;
+	/* The optimizations to use for the tier 1 code */
+	guint32 opt;
+	volatile gint32 calls;
+	volatile gint32 queued;
+} TieredMethod;
+
+static gboolean tiered_inited;
+static gboolean tiered_active;
+static int tiered_threshold = DEFAULT_THRESHOLD;
+
+/* Maps the MonoJitInfo of tier 0 code to TieredMethod */
+static MonoConcurrentHashTable *tiered_methods;
+static mono_mutex_t tiered_methods_mutex;
+
+static GQueue *tiered_queue;
+static mono_mutex_t tiered_queue_mutex;
+static MonoSemType tiered_queue_sem;
+/* The queue is drained by up to tiered_max_threads threads, which are started on demand */
+static int tiered_max_threads;
+static int tiered_threads_started;
+static int tiered_threads_busy;
+
+void
+mono_tiered_init (void)
+{
+	const char *env;
+
+	if (tiered_inited)
+		return;
+
+	env = g_getenv ("MONO_TIERED_THRESHOLD");
+	if (env) {
+		int threshold = atoi (env);
+
+		if (threshold > 0)
+			tiered_threshold = threshold;
+		else
+			g_warning ("Invalid MONO_TIERED_THRESHOLD '%s', using %d.", env, tiered_threshold);
+	}
+
+	env = g_getenv ("MONO_TIERED_THREADS");
+	if (env && atoi (env) > 0)
+		tiered_max_threads = atoi (env);
+	else
+		tiered_max_threads = MAX (1, mono_cpu_count () / 2);
+
+	mono_mutex_init (&tiered_methods_mutex);
+	mono_mutex_init (&tiered_queue_mutex);
+	MONO_SEM_INIT (&tiered_queue_sem, 0);
+	tiered_queue = g_queue_new ();
+	tiered_methods = mono_conc_hashtable_new (&tiered_methods_mutex, NULL, NULL);
+
+	mono_memory_barrier ();
+	tiered_inited = TRUE;
+}
+
+static gboolean
+has_backward_branch (MonoMethodHeader *header)
+{
+	const unsigned char *start = header->code;
+	const unsigned char *end = start + header->code_size;
+	const unsigned char *ip = start, *p;
+	int value, size;
+	guint32 i, n;
+
+	while (ip < end) {
+		p = ip;
+		size = mono_opcode_value_and_size (&ip, end, &value);
+		if (size < 0)
+			return TRUE;
+
+		/* ip points to the last byte of the opcode */
+		switch (mono_opcodes [value].argument) {
+		case MonoShortInlineBrTarget:
+			if ((signed char)ip [1] < 0)
+				return TRUE;
+			break;
+		case MonoInlineBrTarget:
+			if ((gint32)read32 (ip + 1) < 0)
+				return TRUE;
+			break;
+		case MonoInlineSwitch:
+			n = read32 (ip + 1);
+			if (ip + 5 + 4 * (gsize)n > end)
+				return TRUE;
+			for (i = 0; i < n; ++i) {
+				if ((gint32)read32 (ip + 5 + 4 * i) < 0)
+					return TRUE;
+			}
+			size = (ip + 5 + 4 * n) - p;
+			break;
+		default:
+			break;
+		}
+		ip = p + size;
+	}
+
+	return FALSE;
+}
+
+/*
+ * mono_tiered_get_tier0_optimizations:
+ *
+ *   Return whenever METHOD should be compiled at tier 0 first. If so, set
+ * TIER0_OPT to the optimizations to use, based on OPT.
+ */
+gboolean
+mono_tiered_get_tier0_optimizations (MonoMethod *method, MonoDomain *domain, guint32 opt, guint32 *tier0_opt)
+{
+	MonoDebugOptions *debug_options;
+	MonoMethodHeader *header;
+	gboolean loops;
+
+	if (!tiered_inited || !(opt & MONO_OPT_TIERED))
+		return FALSE;
+	if (method->wrapper_type != MONO_WRAPPER_NONE || method->dynamic)
+		return FALSE;
+	if (domain != mono_get_root_domain ())
+		return FALSE;
+	if ((method->iflags & METHOD_IMPL_ATTRIBUTE_INTERNAL_CALL) || (method->flags & METHOD_ATTRIBUTE_PINVOKE_IMPL) ||
+		(method->flags & METHOD_ATTRIBUTE_ABSTRACT) || (method->iflags & METHOD_IMPL_ATTRIBUTE_RUNTIME))
+		return FALSE;
+
+	debug_options = mini_get_debug_options ();
+	if (debug_options->gen_seq_points_debug_data || debug_options->mdb_optimizations)
+		return FALSE;
+
+	header = mono_method_get_header (method);
+	if (!header) {
+		mono_loader_clear_error ();
+		return FALSE;
+	}
+	loops = has_backward_branch (header);
+	mono_metadata_free_mh (header);
+	if (loops)
+		return FALSE;
+
+	*tier0_opt = opt & (TIER0_OPTIMIZATIONS | TIER_INDEPENDENT_OPTIMIZATIONS);
+	return TRUE;
+}
+
+/*
+ * mono_tiered_register_method:
+ *
+ *   Register JI as the tier 0 code of METHOD, which should be recompiled
+ * using OPT once it becomes hot. Called with the domain lock held, before
+ * the code is added to the jit code hash.
+ */
+void
+mono_tiered_register_method (MonoDomain *domain, MonoMethod *method, MonoJitInfo *ji, guint32 opt)
+{
+	TieredMethod *tm;
+
+	tm = g_new0 (TieredMethod, 1);
+	tm->method = method;
+	tm->domain = domain;
+	tm->ji = ji;
+	tm->opt = opt;
+
+	ji->tier0 = TRUE;
+	mono_conc_hashtable_insert (tiered_methods, ji, tm);
+
+	InterlockedIncrement (&mono_jit_stats.methods_tier0);
+	tiered_active = TRUE;
+}
+
+/*
+ * tiered_keep_tier0:
+ *
+ *   Called when the tier 0 code of TM is not going to be replaced. Stop counting
+ * its calls, so the trampolines patch its callers.
+ */
+static void
+tiered_keep_tier0 (TieredMethod *tm)
+{
+	tm->ji->tier0 = FALSE;
+	mono_conc_hashtable_remove (tiered_methods, tm->ji);
+	/* TM is leaked, mono_tiered_count_call () might still be using it */
+}
+
+static void
+tiered_recompile (TieredMethod *tm)
+{
+	MonoCompile *cfg;
+	MonoJitInfo *ji;
+	MonoDomain *domain = tm->domain;
+	GTimer *timer;
+
+	timer = g_timer_new ();
+	cfg = mini_method_compile (tm->method, tm->opt, domain, JIT_FLAG_RUN_CCTORS, 0);
+	g_timer_stop (timer);
+	/* Recompilations run on several pool threads */
+	mono_mutex_lock (&tiered_queue_mutex);
+	mono_jit_stats.tier1_time += g_timer_elapsed (timer, NULL);
+	mono_mutex_unlock (&tiered_queue_mutex);
+	g_timer_destroy (timer);
+
+	if (cfg->exception_type != MONO_EXCEPTION_NONE) {
+		/* Keep using the tier 0 code */
+		if (cfg->prof_options & MONO_PROFILE_JIT_COMPILATION)
+			mono_profiler_method_end_jit (tm->method, NULL, MONO_PROFILE_FAILED);
+		mono_loader_clear_error ();
+		mono_destroy_compile (cfg);
+		tiered_keep_tier0 (tm);
+		return;
+	}
+
+	ji = cfg->jit_info;
+
+	mono_domain_lock (domain);
+	mono_domain_jit_code_hash_lock (domain);
+	if (ji->d.method == tm->ji->d.method && mono_internal_hash_table_lookup (&domain->jit_code_hash, ji->d.method) == tm->ji) {
+		mono_internal_hash_table_remove (&domain->jit_code_hash, tm->ji->d.method);
+		mono_internal_hash_table_insert (&domain->jit_code_hash, ji->d.method, ji);
+		mono_domain_jit_code_hash_unlock (domain);
+		mono_domain_unlock (domain);
+
+		mono_emit_jit_map (ji);
+		InterlockedIncrement (&mono_jit_stats.methods_tier1);
+	} else {
+		mono_domain_jit_code_hash_unlock (domain);
+		mono_domain_unlock (domain);
+
+		tiered_keep_tier0 (tm);
+	}
+
+	if (cfg->prof_options & MONO_PROFILE_JIT_COMPILATION)
+		mono_profiler_method_end_jit (tm->method, ji, MONO_PROFILE_OK);
+
+	mono_destroy_compile (cfg);
+}
+
+static void
+tiered_thread (gpointer unused)
+{
+	TieredMethod *tm;
+
+	ves_icall_System_Threading_Thread_SetName_internal (mono_thread_internal_current (), mono_string_new (mono_get_root_domain (), "Tiered JIT"));
+
+	while (!mono_runtime_is_shutting_down ()) {
+		MONO_SEM_WAIT_ALERTABLE (&tiered_queue_sem, TRUE);
+
+		mono_mutex_lock (&tiered_queue_mutex);
+		tm = g_queue_pop_head (tiered_queue);
+		if (tm)
+			tiered_threads_busy ++;
+		mono_mutex_unlock (&tiered_queue_mutex);
+
+		if (!tm)
+			continue;
+		if (!mono_runtime_is_shutting_down ())
+			tiered_recompile (tm);
+
+		mono_mutex_lock (&tiered_queue_mutex);
+		tiered_threads_busy --;
+		mono_mutex_unlock (&tiered_queue_mutex);
+	}
+}
+
+static void
+tiered_enqueue (TieredMethod *tm)
+{
+	gboolean start_thread = FALSE;
+
+	mono_mutex_lock (&tiered_queue_mutex);
+	g_queue_push_tail (tiered_queue, tm);
+	/* Start another thread if all of them are busy compiling */
+	if (tiered_threads_busy == tiered_threads_started && tiered_threads_started < tiered_max_threads) {
+		tiered_threads_started ++;
+		start_thread = TRUE;
+	}
+	mono_mutex_unlock (&tiered_queue_mutex);
+
+	if (start_thread)
+		mono_thread_create_internal (mono_get_root_domain (), tiered_thread, NULL, TRUE, 0);
+
+	MONO_SEM_POST (&tiered_queue_sem);
+}
+
+/*
+ * mono_tiered_count_call:
+ *
+ *   Called by the trampolines after resolving a call to CODE. Return whenever
+ * CODE is tier 0 code, in which case the caller should not be patched, so
+ * further calls keep being counted.
+ */
+gboolean
+mono_tiered_count_call (gpointer code)
+{
+	MonoJitInfo *ji;
+	TieredMethod *tm;
+
+	if (!tiered_active)
+		return FALSE;
+
+	ji = mini_jit_info_table_find (mono_domain_get (), mono_get_addr_from_ftnptr (code), NULL);
+	if (!ji || !ji->tier0)
+		return FALSE;
+
+	tm = mono_conc_hashtable_lookup (tiered_methods, ji);
+	if (!tm)
+		return TRUE;
+
+	if (InterlockedIncrement (&tm->calls) >= tiered_threshold && !tm->queued) {
+		if (InterlockedCompareExchange (&tm->queued, TRUE, FALSE) == FALSE)
+			tiered_enqueue (tm);
+	}
+
+	return TRUE;
+}
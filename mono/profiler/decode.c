@@ -1896,6 +1896,136 @@ found_object (uintptr_t obj)
 	tracked_objects [num_tracked_objects - 1] = obj;
 }
 
+/*
+ * The data of the TYPE_HEAP_CHUNK events of the last heap shot, by digest:
+ * TYPE_HEAP_CHUNK_UNCHANGED events refer to them.
+ */
+typedef struct _HeapChunk HeapChunk;
+struct _HeapChunk {
+	HeapChunk *next;
+	uint64_t digest;
+	uintptr_t len;
+	unsigned char data [0];
+};
+
+typedef struct {
+	HeapChunk **hash;
+	uintptr_t size;
+	uintptr_t count;
+} HeapChunkTable;
+
+static HeapChunkTable prev_heap_chunks;
+static HeapChunkTable cur_heap_chunks;
+
+static void
+heap_chunk_table_add (HeapChunkTable *table, HeapChunk *chunk)
+{
+	uintptr_t i;
+	if (table->count >= table->size) {
+		uintptr_t nsize = table->size? table->size * 2: 256;
+		HeapChunk **n = calloc (sizeof (HeapChunk*), nsize);
+		for (i = 0; i < table->size; ++i) {
+			HeapChunk *c, *next;
+			for (c = table->hash [i]; c; c = next) {
+				next = c->next;
+				c->next = n [c->digest % nsize];
+				n [c->digest % nsize] = c;
+			}
+		}
+		free (table->hash);
+		table->hash = n;
+		table->size = nsize;
+	}
+	i = chunk->digest % table->size;
+	chunk->next = table->hash [i];
+	table->hash [i] = chunk;
+	table->count++;
+}
+
+static HeapChunk*
+heap_chunk_table_remove (HeapChunkTable *table, uint64_t digest)
+{
+	HeapChunk **prev;
+	if (!table->size)
+		return NULL;
+	for (prev = &table->hash [digest % table->size]; *prev; prev = &(*prev)->next) {
+		HeapChunk *c = *prev;
+		if (c->digest == digest) {
+			*prev = c->next;
+			table->count--;
+			return c;
+		}
+	}
+	return NULL;
+}
+
+static void
+heap_chunks_end_heap_shot (void)
+{
+	uintptr_t i;
+	for (i = 0; i < prev_heap_chunks.size; ++i) {
+		HeapChunk *c, *next;
+		for (c = prev_heap_chunks.hash [i]; c; c = next) {
+			next = c->next;
+			free (c);
+		}
+	}
+	free (prev_heap_chunks.hash);
+	prev_heap_chunks = cur_heap_chunks;
+	memset (&cur_heap_chunks, 0, sizeof (cur_heap_chunks));
+}
+
+static HeapObjectDesc*
+heap_shot_add_object (HeapShot *hs, uintptr_t objaddr, ClassDesc *cd, uint64_t size, uintptr_t num, uintptr_t *ref_offset)
+{
+	HeapObjectDesc *ho = NULL;
+	*ref_offset = 0;
+	if (size) {
+		HeapClassDesc *hcd = add_heap_shot_class (hs, cd, size);
+		if (collect_traces) {
+			ho = alloc_heap_obj (objaddr, hcd, num);
+			add_heap_shot_obj (hs, ho);
+		}
+	} else {
+		if (collect_traces)
+			ho = heap_shot_obj_add_refs (hs, objaddr, num, ref_offset);
+	}
+	return ho;
+}
+
+static void
+decode_heap_chunk (HeapShot *hs, unsigned char *p)
+{
+	uintptr_t num_classes = decode_uleb128 (p, &p);
+	uintptr_t c, j;
+	int i;
+	for (c = 0; c < num_classes; ++c) {
+		ClassDesc *cd = lookup_class (decode_uleb128 (p, &p));
+		uintptr_t num_objects = decode_uleb128 (p, &p);
+		uintptr_t objaddr = 0;
+		for (j = 0; j < num_objects; ++j) {
+			HeapObjectDesc *ho;
+			uint64_t size;
+			uintptr_t num, ref_offset;
+			objaddr += decode_uleb128 (p, &p);
+			size = decode_uleb128 (p, &p);
+			num = decode_uleb128 (p, &p);
+			ho = heap_shot_add_object (hs, objaddr << 3, cd, size, num, &ref_offset);
+			for (i = 0; i < num; ++i) {
+				uintptr_t ref;
+				decode_uleb128 (p, &p);
+				ref = (objaddr + decode_sleb128 (p, &p)) << 3;
+				if (collect_traces)
+					ho->refs [ref_offset + i] = ref;
+				if (num_tracked_objects)
+					track_obj_reference (ref, objaddr << 3, cd);
+			}
+			if (debug && size)
+				fprintf (outfile, "traced object %p, size %llu (%s), refs: %zd\n", (void*)(objaddr << 3), (unsigned long long) size, cd->name, num);
+		}
+	}
+}
+
 static int num_jit_helpers = 0;
 static int jit_helpers_code_size = 0;
 
@@ -2186,26 +2316,16 @@ decode_buffer (ProfContext *ctx)
 		case TYPE_HEAP: {
 			int subtype = *p & 0xf0;
 			if (subtype == TYPE_HEAP_OBJECT) {
-				HeapObjectDesc *ho = NULL;
+				HeapObjectDesc *ho;
 				int i;
 				intptr_t objdiff = decode_sleb128 (p + 1, &p);
 				intptr_t ptrdiff = decode_sleb128 (p, &p);
 				uint64_t size = decode_uleb128 (p, &p);
 				uintptr_t num = decode_uleb128 (p, &p);
-				uintptr_t ref_offset = 0;
+				uintptr_t ref_offset;
 				uintptr_t last_obj_offset = 0;
 				ClassDesc *cd = lookup_class (ptr_base + ptrdiff);
-				if (size) {
-					HeapClassDesc *hcd = add_heap_shot_class (thread->current_heap_shot, cd, size);
-					if (collect_traces) {
-						ho = alloc_heap_obj (OBJ_ADDR (objdiff), hcd, num);
-						add_heap_shot_obj (thread->current_heap_shot, ho);
-						ref_offset = 0;
-					}
-				} else {
-					if (collect_traces)
-						ho = heap_shot_obj_add_refs (thread->current_heap_shot, OBJ_ADDR (objdiff), num, &ref_offset);
-				}
+				ho = heap_shot_add_object (thread->current_heap_shot, OBJ_ADDR (objdiff), cd, size, num, &ref_offset);
 				for (i = 0; i < num; ++i) {
 					/* FIXME: use object distance to measure how good
 					 * the GC is at keeping related objects close
@@ -2220,6 +2340,29 @@ decode_buffer (ProfContext *ctx)
 				}
 				if (debug && size)
 					fprintf (outfile, "traced object %p, size %llu (%s), refs: %zd\n", (void*)OBJ_ADDR (objdiff), (unsigned long long) size, cd->name, num);
+			} else if (subtype == TYPE_HEAP_CHUNK) {
+				uint64_t digest = decode_uleb128 (p + 1, &p);
+				uintptr_t len = decode_uleb128 (p, &p);
+				HeapChunk *chunk = malloc (sizeof (HeapChunk) + len);
+				chunk->digest = digest;
+				chunk->len = len;
+				memcpy (chunk->data, p, len);
+				p += len;
+				if (debug)
+					fprintf (outfile, "heap chunk %llx, %zd bytes\n", (unsigned long long) digest, len);
+				decode_heap_chunk (thread->current_heap_shot, chunk->data);
+				heap_chunk_table_add (&cur_heap_chunks, chunk);
+			} else if (subtype == TYPE_HEAP_CHUNK_UNCHANGED) {
+				uint64_t digest = decode_uleb128 (p + 1, &p);
+				HeapChunk *chunk = heap_chunk_table_remove (&prev_heap_chunks, digest);
+				if (debug)
+					fprintf (outfile, "unchanged heap chunk %llx\n", (unsigned long long) digest);
+				if (!chunk) {
+					fprintf (outfile, "Unknown heap chunk %llx\n", (unsigned long long) digest);
+					return 0;
+				}
+				decode_heap_chunk (thread->current_heap_shot, chunk->data);
+				heap_chunk_table_add (&cur_heap_chunks, chunk);
 			} else if (subtype == TYPE_HEAP_ROOT) {
 				uintptr_t num = decode_uleb128 (p + 1, &p);
 				uintptr_t gc_num G_GNUC_UNUSED = decode_uleb128 (p, &p);
@@ -2263,6 +2406,7 @@ decode_buffer (ProfContext *ctx)
 					heap_shot_free_objects (hs);
 				}
 				thread->current_heap_shot = NULL;
+				heap_chunks_end_heap_shot ();
 			} else if (subtype == TYPE_HEAP_START) {
 				uint64_t tdiff = decode_uleb128 (p + 1, &p);
 				LOG_TIME (time_base, tdiff);
@@ -7,8 +7,13 @@
  * This profiler collects profiling information usable by the Mono AOT compiler
  * to generate better code. It saves the information into files under ~/.mono. 
  * The AOT compiler can load these files during compilation.
- * Currently, only the order in which methods were compiled is saved, 
- * allowing more efficient function ordering in the AOT files.
+ * For every method which was executed, the number of calls is saved, along with
+ * the order in which methods were compiled. The AOT compiler uses this to order
+ * the methods in the AOT files by hotness, and to only compile the methods and
+ * generic instances which were used with the 'profile-only' option.
+ *
+ * Counting calls requires the JIT to instrument every method, use the
+ * 'nocalls' option (--profile=aot:nocalls) to only record the methods.
  */
 
 #include <config.h>
@@ -17,6 +22,9 @@
 #include <mono/metadata/tabledefs.h>
 #include <mono/metadata/debug-helpers.h>
 #include <mono/metadata/assembly.h>
+#include <mono/utils/mono-mutex.h>
+#include <mono/utils/mono-membar.h>
+#include <mono/utils/atomic.h>
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
@@ -27,12 +35,35 @@
 #include <direct.h>
 #endif
 
+typedef struct {
+	MonoMethod *method;
+	/* Saturates at G_MAXINT32 */
+	gint32 calls;
+} MethodData;
+
+/*
+ * Open addressed, insert only hash table mapping MonoMethod* -> MethodData.
+ * It is modified with the profiler lock held, but it can be read without it,
+ * so method enter events don't need to take the lock.
+ */
+typedef struct {
+	int size;
+	MethodData **entries;
+} MethodTable;
+
 struct _MonoProfiler {
+	/* Maps MonoImage* -> PerImageData */
 	GHashTable *images;
+	MethodTable *methods;
+	int num_methods;
+	/* Tables replaced by a larger one, lock free readers might still access them */
+	GSList *old_tables;
+	mono_mutex_t mutex;
 };
 
 typedef struct {
-	GList *methods;
+	/* MethodData, in the order the methods were first seen */
+	GPtrArray *methods;
 } PerImageData;
 
 typedef struct ForeachData {
@@ -46,14 +77,16 @@ static void
 foreach_method (gpointer data, gpointer user_data)
 {
 	ForeachData *udata = (ForeachData*)user_data;
-	MonoMethod *method = (MonoMethod*)data;
+	MethodData *mdata = (MethodData*)data;
+	MonoMethod *method = mdata->method;
 	char *name;
 
+	/* Inflated methods have the token of their generic definition */
 	if (!mono_method_get_token (method) || mono_class_get_image (mono_method_get_class (method)) != udata->image)
 		return;
 
 	name = mono_method_full_name (method, TRUE);
-	fprintf (udata->outfile, "%s\n", name);
+	fprintf (udata->outfile, "%d\t%s\n", mdata->calls, name);
 	g_free (name);
 }
 
@@ -97,13 +130,19 @@ output_image (gpointer key, gpointer value, gpointer user_data)
 	outfile = fopen (outfile_name, "w+");
 	g_assert (outfile);
 
-	fprintf (outfile, "#VER:%d\n", 2);
+	fprintf (outfile, "#VER:%d\n", 3);
+	/* Allows the AOT compiler to ignore profiles of other versions of the assembly */
+	fprintf (outfile, "#GUID:%s\n", mono_image_get_guid (image));
 
 	data.prof = prof;
 	data.outfile = outfile;
 	data.image = image;
 
-	g_list_foreach (image_data->methods, foreach_method, &data);
+	g_ptr_array_foreach (image_data->methods, foreach_method, &data);
+
+	fclose (outfile);
+	g_free (outfile_name);
+	g_free (tmp);
 }
 
 /* called at the end of the program */
@@ -113,24 +152,130 @@ prof_shutdown (MonoProfiler *prof)
 	g_hash_table_foreach (prof->images, output_image, prof);
 }
 
+#define METHOD_HASH(method) ((guint32)((gsize)(method) >> 3))
+
+static MethodTable*
+method_table_new (int size)
+{
+	MethodTable *table = g_new0 (MethodTable, 1);
+
+	table->size = size;
+	table->entries = g_new0 (MethodData*, size);
+	return table;
+}
+
+/* Can be called without the profiler lock held */
+static MethodData*
+lookup_method_data (MonoProfiler *prof, MonoMethod *method)
+{
+	MethodTable *table = prof->methods;
+	MethodData *mdata;
+	int mask, i;
+
+	mono_memory_read_barrier ();
+	mask = table->size - 1;
+	for (i = METHOD_HASH (method) & mask; (mdata = table->entries [i]); i = (i + 1) & mask) {
+		/* Pairs with the write barrier in add_method_data () */
+		mono_memory_read_barrier ();
+		if (mdata->method == method)
+			return mdata;
+	}
+	return NULL;
+}
+
 static void
-prof_jit_enter (MonoProfiler *prof, MonoMethod *method)
+method_table_add (MethodTable *table, MethodData *mdata)
 {
+	int mask = table->size - 1;
+	int i;
+
+	for (i = METHOD_HASH (mdata->method) & mask; table->entries [i]; i = (i + 1) & mask)
+		;
+	table->entries [i] = mdata;
 }
 
+/* Called with the profiler lock held */
 static void
-prof_jit_leave (MonoProfiler *prof, MonoMethod *method, int result)
+add_method_data (MonoProfiler *prof, MethodData *mdata)
+{
+	MethodTable *table = prof->methods;
+
+	if ((prof->num_methods + 1) * 2 > table->size) {
+		MethodTable *new_table = method_table_new (table->size * 2);
+		int i;
+
+		for (i = 0; i < table->size; ++i) {
+			if (table->entries [i])
+				method_table_add (new_table, table->entries [i]);
+		}
+		method_table_add (new_table, mdata);
+		mono_memory_write_barrier ();
+		prof->methods = new_table;
+		prof->old_tables = g_slist_prepend (prof->old_tables, table);
+	} else {
+		mono_memory_write_barrier ();
+		method_table_add (table, mdata);
+	}
+	prof->num_methods ++;
+}
+
+/* Called with the profiler lock held */
+static MethodData*
+get_method_data (MonoProfiler *prof, MonoMethod *method)
 {
-	MonoImage *image = mono_class_get_image (mono_method_get_class (method));
+	MonoImage *image;
 	PerImageData *data;
+	MethodData *mdata;
+
+	mdata = lookup_method_data (prof, method);
+	if (mdata)
+		return mdata;
 
+	image = mono_class_get_image (mono_method_get_class (method));
 	data = g_hash_table_lookup (prof->images, image);
 	if (!data) {
 		data = g_new0 (PerImageData, 1);
+		data->methods = g_ptr_array_new ();
 		g_hash_table_insert (prof->images, image, data);
 	}
 
-	data->methods = g_list_append (data->methods, method);
+	mdata = g_new0 (MethodData, 1);
+	mdata->method = method;
+	add_method_data (prof, mdata);
+	g_ptr_array_add (data->methods, mdata);
+
+	return mdata;
+}
+
+static void
+prof_jit_enter (MonoProfiler *prof, MonoMethod *method)
+{
+}
+
+static void
+prof_jit_leave (MonoProfiler *prof, MonoMethod *method, int result)
+{
+	mono_mutex_lock (&prof->mutex);
+	get_method_data (prof, method);
+	mono_mutex_unlock (&prof->mutex);
+}
+
+static void
+prof_method_enter (MonoProfiler *prof, MonoMethod *method)
+{
+	MethodData *mdata;
+
+	/* The method data is normally added by prof_jit_leave () */
+	mdata = lookup_method_data (prof, method);
+	if (!mdata) {
+		mono_mutex_lock (&prof->mutex);
+		mdata = get_method_data (prof, method);
+		mono_mutex_unlock (&prof->mutex);
+	}
+
+	/* Racy, but the count can only overshoot by the number of threads */
+	if (mdata->calls < G_MAXINT32)
+		InterlockedIncrement (&mdata->calls);
 }
 
 void
@@ -141,15 +286,32 @@ void
 mono_profiler_startup (const char *desc)
 {
 	MonoProfiler *prof;
+	gboolean count_calls = TRUE;
+
+	if (desc && strncmp (desc, "aot:", 4) == 0) {
+		if (strcmp (desc + 4, "nocalls") == 0) {
+			count_calls = FALSE;
+		} else {
+			fprintf (stderr, "mono-profiler-aot: Unknown option '%s', the only option is 'nocalls'.\n", desc + 4);
+			exit (1);
+		}
+	}
 
 	prof = g_new0 (MonoProfiler, 1);
 	prof->images = g_hash_table_new (NULL, NULL);
+	prof->methods = method_table_new (256);
+	mono_mutex_init (&prof->mutex);
 
 	mono_profiler_install (prof, prof_shutdown);
 	
 	mono_profiler_install_jit_compile (prof_jit_enter, prof_jit_leave);
 
-	mono_profiler_set_events (MONO_PROFILE_JIT_COMPILATION);
+	if (count_calls) {
+		mono_profiler_install_enter_leave (prof_method_enter, NULL);
+		mono_profiler_set_events (MONO_PROFILE_JIT_COMPILATION | MONO_PROFILE_ENTER_LEAVE);
+	} else {
+		mono_profiler_set_events (MONO_PROFILE_JIT_COMPILATION);
+	}
 }
 
 
@@ -262,7 +262,8 @@ typedef struct _LogBuffer LogBuffer;
  *
  * type heap format
  * type: TYPE_HEAP
- * exinfo: one of TYPE_HEAP_START, TYPE_HEAP_END, TYPE_HEAP_OBJECT, TYPE_HEAP_ROOT
+ * exinfo: one of TYPE_HEAP_START, TYPE_HEAP_END, TYPE_HEAP_OBJECT, TYPE_HEAP_ROOT,
+ * TYPE_HEAP_CHUNK, TYPE_HEAP_CHUNK_UNCHANGED
  * if exinfo == TYPE_HEAP_START
  * 	[time diff: uleb128] nanoseconds since last timing
  * if exinfo == TYPE_HEAP_END
@@ -286,6 +287,31 @@ typedef struct _LogBuffer LogBuffer;
  * 	[root_type: uleb128] the root_type: MonoProfileGCRootType (profiler.h)
  * 	[extra_info: uleb128] the extra_info value
  * 	object, root_type and extra_info are repeated num_roots times
+ * if exinfo == TYPE_HEAP_CHUNK
+ * 	[digest: uleb128] 64 bit FNV-1a hash of the chunk data
+ * 	[len: uleb128] size in bytes of the chunk data
+ * 	[data: len bytes] the chunk data, which is self-contained:
+ * 	[num_classes: uleb128] number of class groups
+ * 	for each class group:
+ * 		[class: uleb128] the MonoClass* of the objects in the group
+ * 		[num_objects: uleb128] number of objects in the group
+ * 		for each object, sorted by address:
+ * 			[object: uleb128] the object address shifted right by 3 as
+ * 			a difference from the previous object in the group (from 0
+ * 			for the first one)
+ * 			[size: uleb128] size of the object on the heap: if it is 0,
+ * 			the object appeared in a previous chunk and only more
+ * 			references follow
+ * 			[num_refs: uleb128] number of object references
+ * 			[offset: uleb128] [objref: sleb128] repeated num_refs times:
+ * 			the offsets are encoded as in TYPE_HEAP_OBJECT, each objref
+ * 			is the referenced address shifted right by 3 as a difference
+ * 			from the (shifted) object address
+ * if exinfo == TYPE_HEAP_CHUNK_UNCHANGED
+ * 	[digest: uleb128] the chunk data is the same as the one of the chunk
+ * 	with this digest in the previous heap shot
+ * 	TYPE_HEAP_CHUNK and TYPE_HEAP_CHUNK_UNCHANGED are used instead of
+ * 	TYPE_HEAP_OBJECT when the heapshot-compact option is given.
  *
  * type sample format
  * type: TYPE_SAMPLE
@@ -733,6 +759,247 @@ gc_reference (MonoObject *obj, MonoClass *klass, uintptr_t size, uintptr_t num,
 	return 0;
 }
 
+/*
+ * Compact heap shots (heapshot-compact option).
+ * The objects reported by the heap walk are grouped in chunks: a chunk ends
+ * at an object whose address hashes to a boundary value, so the chunk
+ * boundaries depend only on the heap contents and a region of the heap that
+ * didn't change between two heap shots produces the same chunks.
+ * Inside a chunk the objects are sorted by class and address and encoded
+ * with deltas (see the TYPE_HEAP_CHUNK format description). We keep the
+ * digests of the chunks written for the previous heap shot: when a chunk is
+ * identical to one of them, only its digest is written.
+ */
+#define HS_CHUNK_MASK 511
+#define HS_CHUNK_MAX_BYTES (BUFFER_SIZE / 2)
+/* worst case encoding sizes used to bound the chunk size */
+#define HS_CHUNK_HEADER_BYTES 10 /* num_classes */
+#define HS_CHUNK_OBJ_BYTES 50
+#define HS_CHUNK_REF_BYTES 20
+
+typedef struct {
+	uintptr_t obj;
+	MonoClass *klass;
+	uintptr_t size;
+	uintptr_t refs_start;
+	uintptr_t num_refs;
+} HsChunkObject;
+
+typedef struct {
+	uintptr_t offset;
+	uintptr_t ref;
+} HsChunkRef;
+
+typedef struct {
+	uint64_t *digests;
+	uintptr_t count;
+	uintptr_t size;
+} HsDigestSet;
+
+static int hs_compact = 0;
+static HsChunkObject *hs_chunk_objs;
+static int hs_chunk_num_objs;
+static HsChunkRef *hs_chunk_refs;
+static int hs_chunk_num_refs;
+static int hs_chunk_bytes;
+static int hs_chunk_boundary;
+static unsigned char *hs_chunk_data;
+static HsDigestSet hs_prev_digests;
+static HsDigestSet hs_cur_digests;
+
+static int
+hs_digest_set_contains (HsDigestSet *set, uint64_t digest)
+{
+	uintptr_t i;
+	if (!set->size)
+		return 0;
+	for (i = digest % set->size; set->digests [i]; i = (i + 1) % set->size) {
+		if (set->digests [i] == digest)
+			return 1;
+	}
+	return 0;
+}
+
+static void
+hs_digest_set_add (HsDigestSet *set, uint64_t digest)
+{
+	uintptr_t i;
+	if (set->count * 2 >= set->size) {
+		HsDigestSet n;
+		n.size = set->size? set->size * 2: 256;
+		n.count = 0;
+		n.digests = calloc (n.size, sizeof (uint64_t));
+		for (i = 0; i < set->size; ++i) {
+			if (set->digests [i])
+				hs_digest_set_add (&n, set->digests [i]);
+		}
+		free (set->digests);
+		*set = n;
+	}
+	for (i = digest % set->size; set->digests [i]; i = (i + 1) % set->size) {
+		if (set->digests [i] == digest)
+			return;
+	}
+	set->digests [i] = digest;
+	set->count++;
+}
+
+static int
+compare_chunk_objects (const void *a, const void *b)
+{
+	const HsChunkObject *oa = a;
+	const HsChunkObject *ob = b;
+	if (oa->klass != ob->klass)
+		return (uintptr_t)oa->klass < (uintptr_t)ob->klass? -1: 1;
+	if (oa->obj != ob->obj)
+		return oa->obj < ob->obj? -1: 1;
+	return 0;
+}
+
+static void
+hs_chunk_flush (void)
+{
+	LogBuffer *logbuffer;
+	unsigned char *p = hs_chunk_data;
+	uint64_t digest = 14695981039346656037ULL;
+	int i, j, len, num_classes = 0;
+
+	if (!hs_chunk_num_objs)
+		return;
+	qsort (hs_chunk_objs, hs_chunk_num_objs, sizeof (HsChunkObject), compare_chunk_objects);
+	for (i = 0; i < hs_chunk_num_objs; ++i) {
+		if (!i || hs_chunk_objs [i].klass != hs_chunk_objs [i - 1].klass)
+			num_classes++;
+	}
+	encode_uleb128 (num_classes, p, &p);
+	for (i = 0; i < hs_chunk_num_objs;) {
+		MonoClass *klass = hs_chunk_objs [i].klass;
+		uintptr_t last_obj = 0;
+		int count = 1;
+		while (i + count < hs_chunk_num_objs && hs_chunk_objs [i + count].klass == klass)
+			count++;
+		encode_uleb128 ((uintptr_t)klass, p, &p);
+		encode_uleb128 (count, p, &p);
+		for (; count; --count, ++i) {
+			HsChunkObject *o = &hs_chunk_objs [i];
+			uintptr_t last_offset = 0;
+			encode_uleb128 (o->obj - last_obj, p, &p);
+			last_obj = o->obj;
+			encode_uleb128 (o->size, p, &p);
+			encode_uleb128 (o->num_refs, p, &p);
+			for (j = 0; j < o->num_refs; ++j) {
+				HsChunkRef *r = &hs_chunk_refs [o->refs_start + j];
+				encode_uleb128 (r->offset - last_offset, p, &p);
+				last_offset = r->offset;
+				encode_sleb128 ((intptr_t)(r->ref - o->obj), p, &p);
+			}
+		}
+	}
+	len = p - hs_chunk_data;
+	assert (len <= HS_CHUNK_MAX_BYTES);
+	/* FNV-1a */
+	for (i = 0; i < len; ++i) {
+		digest ^= hs_chunk_data [i];
+		digest *= 1099511628211ULL;
+	}
+	/* zero marks the empty slots in the digest sets */
+	if (!digest)
+		digest = 1;
+
+	if (hs_digest_set_contains (&hs_prev_digests, digest)) {
+		logbuffer = ensure_logbuf (20);
+		emit_byte (logbuffer, TYPE_HEAP_CHUNK_UNCHANGED | TYPE_HEAP);
+		emit_uvalue (logbuffer, digest);
+	} else {
+		logbuffer = ensure_logbuf (len + 30);
+		emit_byte (logbuffer, TYPE_HEAP_CHUNK | TYPE_HEAP);
+		emit_uvalue (logbuffer, digest);
+		emit_value (logbuffer, len);
+		memcpy (logbuffer->data, hs_chunk_data, len);
+		logbuffer->data += len;
+		assert (logbuffer->data <= logbuffer->data_end);
+	}
+	hs_digest_set_add (&hs_cur_digests, digest);
+
+	hs_chunk_num_objs = 0;
+	hs_chunk_num_refs = 0;
+	hs_chunk_bytes = 0;
+	hs_chunk_boundary = 0;
+}
+
+static HsChunkObject*
+hs_chunk_add_object (uintptr_t obj, MonoClass *klass, uintptr_t size)
+{
+	HsChunkObject *o;
+	if (HS_CHUNK_HEADER_BYTES + hs_chunk_bytes + HS_CHUNK_OBJ_BYTES > HS_CHUNK_MAX_BYTES)
+		hs_chunk_flush ();
+	o = &hs_chunk_objs [hs_chunk_num_objs++];
+	o->obj = obj;
+	o->klass = klass;
+	o->size = size;
+	o->refs_start = hs_chunk_num_refs;
+	o->num_refs = 0;
+	hs_chunk_bytes += HS_CHUNK_OBJ_BYTES;
+	return o;
+}
+
+static int
+gc_reference_compact (MonoObject *obj, MonoClass *klass, uintptr_t size, uintptr_t num, MonoObject **refs, uintptr_t *offsets, void *data)
+{
+	HsChunkObject *o;
+	uintptr_t objaddr = (uintptr_t)obj >> 3;
+	int i;
+
+	if (size) {
+		if (hs_chunk_boundary)
+			hs_chunk_flush ();
+		/* account for object alignment in the heap */
+		size += 7;
+		size &= ~7;
+		o = hs_chunk_add_object (objaddr, klass, size);
+		if (((objaddr * 0x9E3779B1) >> 7 & HS_CHUNK_MASK) == 0)
+			hs_chunk_boundary = 1;
+	} else if (hs_chunk_num_objs && hs_chunk_objs [hs_chunk_num_objs - 1].obj == objaddr) {
+		o = &hs_chunk_objs [hs_chunk_num_objs - 1];
+	} else {
+		/* more references for an object written in a previous chunk */
+		o = hs_chunk_add_object (objaddr, klass, 0);
+	}
+	for (i = 0; i < num; ++i) {
+		HsChunkRef *r;
+		if (HS_CHUNK_HEADER_BYTES + hs_chunk_bytes + HS_CHUNK_REF_BYTES > HS_CHUNK_MAX_BYTES) {
+			hs_chunk_flush ();
+			o = hs_chunk_add_object (objaddr, klass, 0);
+		}
+		r = &hs_chunk_refs [hs_chunk_num_refs++];
+		r->offset = offsets [i];
+		r->ref = (uintptr_t)refs [i] >> 3;
+		o->num_refs++;
+		hs_chunk_bytes += HS_CHUNK_REF_BYTES;
+	}
+	return 0;
+}
+
+static void
+hs_compact_walk (void)
+{
+	HsDigestSet tmp;
+	if (!hs_chunk_data) {
+		hs_chunk_objs = malloc (sizeof (HsChunkObject) * (HS_CHUNK_MAX_BYTES / HS_CHUNK_OBJ_BYTES));
+		hs_chunk_refs = malloc (sizeof (HsChunkRef) * (HS_CHUNK_MAX_BYTES / HS_CHUNK_REF_BYTES));
+		hs_chunk_data = malloc (HS_CHUNK_MAX_BYTES);
+	}
+	mono_gc_walk_heap (0, gc_reference_compact, NULL);
+	hs_chunk_flush ();
+	/* the chunks of this heap shot are the base for the next one */
+	tmp = hs_prev_digests;
+	hs_prev_digests = hs_cur_digests;
+	hs_cur_digests = tmp;
+	hs_cur_digests.count = 0;
+	if (hs_cur_digests.digests)
+		memset (hs_cur_digests.digests, 0, hs_cur_digests.size * sizeof (uint64_t));
+}
+
 static unsigned int hs_mode_ms = 0;
 static unsigned int hs_mode_gc = 0;
 static unsigned int hs_mode_ondemand = 0;
@@ -763,7 +1030,10 @@ heap_walk (MonoProfiler *profiler)
 	heapshot_requested = 0;
 	emit_byte (logbuffer, TYPE_HEAP_START | TYPE_HEAP);
 	emit_time (logbuffer, now);
-	mono_gc_walk_heap (0, gc_reference, NULL);
+	if (hs_compact)
+		hs_compact_walk ();
+	else
+		mono_gc_walk_heap (0, gc_reference, NULL);
 	logbuffer = ensure_logbuf (10);
 	now = current_time ();
 	emit_byte (logbuffer, TYPE_HEAP_END | TYPE_HEAP);
@@ -2775,6 +3045,7 @@ usage (int do_exit)
 	printf ("\t[no]calls        enable/disable recording enter/leave method events\n");
 	printf ("\theapshot[=MODE]  record heap shot info (by default at each major collection)\n");
 	printf ("\t                 MODE: every XXms milliseconds, every YYgc collections, ondemand\n");
+	printf ("\theapshot-compact write heap shots in chunks, skipping the unchanged ones\n");
 	printf ("\tcounters         sample counters every 1s\n");
 	printf ("\tsample[=TYPE]    use statistical sampling mode (by default cycles/1000)\n");
 	printf ("\t                 TYPE: cycles,instr,cacherefs,cachemiss,branches,branchmiss\n");
@@ -3007,6 +3278,10 @@ mono_profiler_startup (const char *desc)
 			sampling_mode = MONO_PROFILER_STAT_MODE_PROCESS;
 			continue;
 		}
+		if ((opt = match_option (p, "heapshot-compact", NULL)) != p) {
+			hs_compact = 1;
+			continue;
+		}
 		if ((opt = match_option (p, "heapshot", &val)) != p) {
 			events &= ~MONO_PROFILE_ALLOCATIONS;
 			events &= ~MONO_PROFILE_ENTER_LEAVE;
@@ -5,7 +5,7 @@
 #define LOG_HEADER_ID 0x4D505A01
 #define LOG_VERSION_MAJOR 0
 #define LOG_VERSION_MINOR 4
-#define LOG_DATA_VERSION 8
+#define LOG_DATA_VERSION 9
 /*
  * Changes in data versions:
  * version 2: added offsets in heap walk
@@ -14,6 +14,7 @@
  * version 5: added counters sampling
  * version 6: added optional backtrace in sampling info
  * version 8: added TYPE_RUNTIME and JIT helpers/trampolines
+ * version 9: added TYPE_HEAP_CHUNK and TYPE_HEAP_CHUNK_UNCHANGED
  */
 
 enum {
@@ -31,6 +32,8 @@ enum {
 	TYPE_HEAP_END    = 1 << 4,
 	TYPE_HEAP_OBJECT = 2 << 4,
 	TYPE_HEAP_ROOT   = 3 << 4,
+	TYPE_HEAP_CHUNK  = 4 << 4,
+	TYPE_HEAP_CHUNK_UNCHANGED = 5 << 4,
 	/* extended type for TYPE_METADATA */
 	TYPE_START_LOAD   = 1 << 4,
 	TYPE_END_LOAD     = 2 << 4,
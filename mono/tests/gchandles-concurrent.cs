@@ -0,0 +1,127 @@
+using System;
+using System.Threading;
+using System.Runtime.InteropServices;
+
+/*
+ * Allocates and frees GC handles from several threads while another thread
+ * unloads appdomains holding handles, so growing the handle tables, claiming
+ * and freeing slots, and mono_gchandle_free_domain () race with each other.
+ * A slot handed out twice shows up as a handle with the wrong target.
+ */
+class Tests {
+	const int threads = 4;
+	const int rounds = 40;
+	/* Large enough for the tables to grow while the threads run */
+	const int batch = 4000;
+	const int domains = 20;
+
+	static volatile bool failed;
+	static volatile bool done;
+
+	class Payload {
+		public int thread;
+		public int index;
+
+		public Payload (int thread, int index) {
+			this.thread = thread;
+			this.index = index;
+		}
+	}
+
+	static GCHandleType HandleType (int i) {
+		switch (i & 3) {
+		case 0:
+			return GCHandleType.Normal;
+		case 1:
+			return GCHandleType.Weak;
+		case 2:
+			return GCHandleType.WeakTrackResurrection;
+		default:
+			return GCHandleType.Pinned;
+		}
+	}
+
+	static void Check (GCHandle[] handles, Payload[] payloads, int thread) {
+		for (int i = 0; i < handles.Length; ++i) {
+			if (!handles [i].IsAllocated)
+				continue;
+			Payload p = handles [i].Target as Payload;
+			if (p != payloads [i] || p.thread != thread || p.index != i) {
+				Console.WriteLine ("thread {0}: handle {1} has the wrong target", thread, i);
+				failed = true;
+				return;
+			}
+		}
+	}
+
+	static void Worker (object o) {
+		int thread = (int)o;
+		Payload[] payloads = new Payload [batch];
+		GCHandle[] handles = new GCHandle [batch];
+
+		for (int i = 0; i < batch; ++i)
+			payloads [i] = new Payload (thread, i);
+
+		for (int r = 0; r < rounds && !failed; ++r) {
+			for (int i = 0; i < batch; ++i) {
+				GCHandleType t = HandleType (i);
+				handles [i] = GCHandle.Alloc (payloads [i], t == GCHandleType.Pinned ? GCHandleType.Normal : t);
+			}
+			Check (handles, payloads, thread);
+
+			/* Free every other handle, and reuse the freed slots right away */
+			for (int i = r & 1; i < batch; i += 2)
+				handles [i].Free ();
+			for (int i = r & 1; i < batch; i += 2)
+				handles [i] = GCHandle.Alloc (payloads [i], HandleType (i) == GCHandleType.Weak ? GCHandleType.Weak : GCHandleType.Normal);
+			Check (handles, payloads, thread);
+
+			for (int i = 0; i < batch; ++i)
+				handles [i].Free ();
+
+			/* Pinned handles only accept blittable objects */
+			GCHandle[] pinned = new GCHandle [batch / 4];
+			for (int i = 0; i < pinned.Length; ++i)
+				pinned [i] = GCHandle.Alloc (new int [] { thread, i }, GCHandleType.Pinned);
+			for (int i = 0; i < pinned.Length; ++i) {
+				int[] a = (int[])pinned [i].Target;
+				if (a [0] != thread || a [1] != i) {
+					Console.WriteLine ("thread {0}: pinned handle {1} has the wrong target", thread, i);
+					failed = true;
+				}
+				pinned [i].Free ();
+			}
+		}
+	}
+
+	public static void AllocInDomain () {
+		for (int i = 0; i < batch; ++i)
+			GCHandle.Alloc (new object (), HandleType (i));
+	}
+
+	static void Unloader () {
+		for (int i = 0; i < domains && !done && !failed; ++i) {
+			AppDomain domain = AppDomain.CreateDomain ("gchandles-" + i);
+			domain.DoCallBack (new CrossAppDomainDelegate (AllocInDomain));
+			AppDomain.Unload (domain);
+		}
+	}
+
+	static int Main () {
+		Thread[] workers = new Thread [threads];
+		Thread unloader = new Thread (Unloader);
+
+		for (int i = 0; i < threads; ++i) {
+			workers [i] = new Thread (Worker);
+			workers [i].Start (i);
+		}
+		unloader.Start ();
+
+		for (int i = 0; i < threads; ++i)
+			workers [i].Join ();
+		done = true;
+		unloader.Join ();
+
+		return failed ? 1 : 0;
+	}
+}
@@ -0,0 +1,59 @@
+using System;
+
+/*
+ * Stores nursery objects into many large (LOS) arrays and checks
+ * they survive nursery collections.  With minor=simple-par the card
+ * table scan of the arrays is split across the workers.
+ */
+class LosCardStress
+{
+	class Node
+	{
+		public int value;
+		public Node next;
+
+		public Node (int v, Node n)
+		{
+			value = v;
+			next = n;
+		}
+	}
+
+	const int NumArrays = 64;
+	const int ArrayLength = 4096;
+
+	static int Main ()
+	{
+		Node[][] arrays = new Node [NumArrays][];
+		Random random = new Random (17);
+
+		for (int i = 0; i < NumArrays; ++i)
+			arrays [i] = new Node [ArrayLength];
+
+		for (int iter = 0; iter < 200; ++iter) {
+			for (int j = 0; j < 2000; ++j) {
+				int a = random.Next (NumArrays);
+				int k = random.Next (ArrayLength);
+				arrays [a][k] = new Node (a * ArrayLength + k, new Node (-1, null));
+			}
+
+			/* Garbage to trigger nursery collections */
+			for (int j = 0; j < 2000; ++j) {
+				new Node (0, null);
+			}
+
+			for (int a = 0; a < NumArrays; ++a) {
+				Node[] array = arrays [a];
+				for (int k = 0; k < ArrayLength; ++k) {
+					Node n = array [k];
+					if (n != null && (n.value != a * ArrayLength + k || n.next == null || n.next.value != -1)) {
+						Console.WriteLine ("Wrong object in array {0} at {1}", a, k);
+						return 1;
+					}
+				}
+			}
+		}
+
+		return 0;
+	}
+}
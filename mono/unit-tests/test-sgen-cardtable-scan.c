@@ -0,0 +1,134 @@
+/*
+ * test-sgen-cardtable-scan.c: Unit test and micro-benchmark for the
+ * dirty card search.
+ *
+ * Copyright (C) 2014 Xamarin Inc
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License 2.0 as published by the Free Software Foundation;
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License 2.0 along with this library; if not, write to the Free
+ * Software Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#include "config.h"
+
+#include <metadata/sgen-gc.h>
+#include <metadata/sgen-cardtable.h>
+#include <utils/mono-time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#define POOL_SIZE	(1024 * 1024)
+#define POOL_ALIGN	64
+
+#define CHECK_OFFSETS	64
+#define CHECK_LENGTHS	200
+
+/* One dirty card in this many, roughly what a minor collection sees. */
+#define BENCH_SPARSENESS	4096
+#define BENCH_PASSES		200
+
+static const char *impls [] = { "word", "sse2", "avx2" };
+
+static guint8*
+reference_find_next_card (guint8 *card_data, guint8 *end)
+{
+	while (card_data < end && !*card_data)
+		++card_data;
+	return card_data;
+}
+
+static void
+check_impl (guint8 *cards)
+{
+	int offset, length, i;
+
+	for (offset = 0; offset < CHECK_OFFSETS; ++offset) {
+		for (length = 0; length < CHECK_LENGTHS; ++length) {
+			guint8 *start = cards + offset;
+			guint8 *end = start + length;
+
+			memset (cards, 0, CHECK_OFFSETS + CHECK_LENGTHS);
+			assert (sgen_card_table_find_next_card (start, end) == end);
+
+			/* A single dirty card at every position, plus one just past the end. */
+			for (i = 0; i <= length; ++i) {
+				memset (cards, 0, CHECK_OFFSETS + CHECK_LENGTHS + 1);
+				start [i] = 1;
+				assert (sgen_card_table_find_next_card (start, end) == start + i);
+			}
+
+			/* Random contents, walked like the scanners do. */
+			for (i = 0; i < CHECK_OFFSETS + CHECK_LENGTHS; ++i)
+				cards [i] = (random () % 8) ? 0 : 1;
+			for (i = 0; start + i <= end; ++i)
+				assert (sgen_card_table_find_next_card (start + i, end) == reference_find_next_card (start + i, end));
+		}
+	}
+}
+
+static long long
+bench_impl (guint8 *cards)
+{
+	guint8 *end = cards + POOL_SIZE;
+	gint64 start_time = mono_100ns_ticks ();
+	long long found = 0;
+	int pass;
+
+	for (pass = 0; pass < BENCH_PASSES; ++pass) {
+		guint8 *card;
+		for (card = sgen_card_table_find_next_card (cards, end); card < end; card = sgen_card_table_find_next_card (card + 1, end))
+			++found;
+	}
+
+	assert (found == (long long)BENCH_PASSES * (POOL_SIZE / BENCH_SPARSENESS));
+
+	return mono_100ns_ticks () - start_time;
+}
+
+int
+main (void)
+{
+	guint8 *pool = malloc (POOL_SIZE + POOL_ALIGN);
+	guint8 *cards = (guint8*)(((mword)pool + POOL_ALIGN - 1) & ~(mword)(POOL_ALIGN - 1));
+	long long word_time = 0;
+	int i, j;
+
+	srandom (time (NULL));
+
+	for (i = 0; i < G_N_ELEMENTS (impls); ++i) {
+		long long elapsed;
+
+		if (!sgen_card_table_set_find_next_card_impl (impls [i])) {
+			printf ("%s: not supported\n", impls [i]);
+			continue;
+		}
+
+		check_impl (cards);
+
+		memset (cards, 0, POOL_SIZE);
+		for (j = 0; j < POOL_SIZE; j += BENCH_SPARSENESS)
+			cards [j + random () % BENCH_SPARSENESS] = 1;
+
+		elapsed = bench_impl (cards);
+		if (!word_time)
+			word_time = elapsed;
+		printf ("%s: %.2f ms for %d passes over %d cards (%.2fx)\n", impls [i],
+				elapsed / 10000.0, BENCH_PASSES, POOL_SIZE, elapsed ? (double)word_time / elapsed : 0.0);
+	}
+
+	free (pool);
+	return 0;
+}
@@ -38,6 +38,7 @@ gboolean mono_hwcap_x86_has_ssse3 = FALSE;
 gboolean mono_hwcap_x86_has_sse41 = FALSE;
 gboolean mono_hwcap_x86_has_sse42 = FALSE;
 gboolean mono_hwcap_x86_has_sse4a = FALSE;
+gboolean mono_hwcap_x86_has_avx2 = FALSE;
 
 static gboolean
 cpuid (int id, int *p_eax, int *p_ebx, int *p_ecx, int *p_edx)
@@ -88,9 +89,10 @@ cpuid (int id, int *p_eax, int *p_ebx, int *p_ecx, int *p_edx)
 #endif
 
 	/* Now issue the actual cpuid instruction. We can use
-	   MSVC's __cpuid on both 32-bit and 64-bit. */
+	   MSVC's __cpuidex on both 32-bit and 64-bit. The sub-leaf
+	   in ecx is always 0; leaves that don't take one ignore it. */
 #if defined(_MSC_VER)
-	__cpuid (info, id);
+	__cpuidex (info, id, 0);
 	*p_eax = info [0];
 	*p_ebx = info [1];
 	*p_ecx = info [2];
@@ -103,23 +105,44 @@ cpuid (int id, int *p_eax, int *p_ebx, int *p_ecx, int *p_edx)
 		"cpuid\n\t"
 		"xchgl\t%%ebx, %k1\n\t"
 		: "=a" (*p_eax), "=&r" (*p_ebx), "=c" (*p_ecx), "=d" (*p_edx)
-		: "0" (id)
+		: "0" (id), "2" (0)
 	);
 #else
 	__asm__ __volatile__ (
 		"cpuid\n\t"
 		: "=a" (*p_eax), "=b" (*p_ebx), "=c" (*p_ecx), "=d" (*p_edx)
-		: "a" (id)
+		: "a" (id), "c" (0)
 	);
 #endif
 
 	return TRUE;
 }
 
+/* Returns the low word of XCR0, i.e. which register states the OS saves. */
+static int
+xgetbv (void)
+{
+#if defined(_MSC_VER)
+	return (int) _xgetbv (0);
+#else
+	int eax, edx;
+
+	/* Encoded by hand since old assemblers don't know xgetbv. */
+	__asm__ __volatile__ (
+		".byte\t0x0f, 0x01, 0xd0\n\t"
+		: "=a" (eax), "=d" (edx)
+		: "c" (0)
+	);
+
+	return eax;
+#endif
+}
+
 void
 mono_hwcap_arch_init (void)
 {
 	int eax, ebx, ecx, edx;
+	gboolean os_saves_ymm = FALSE;
 
 	if (cpuid (1, &eax, &ebx, &ecx, &edx)) {
 		if (edx & (1 << 15)) {
@@ -146,6 +169,17 @@ mono_hwcap_arch_init (void)
 
 		if (ecx & (1 << 20))
 			mono_hwcap_x86_has_sse42 = TRUE;
+
+		/* AVX and OSXSAVE; the OS must also save the YMM registers. */
+		if ((ecx & (1 << 27)) && (ecx & (1 << 28)))
+			os_saves_ymm = (xgetbv () & 0x6) == 0x6;
+	}
+
+	if (os_saves_ymm && cpuid (0, &eax, &ebx, &ecx, &edx) && eax >= 7) {
+		if (cpuid (7, &eax, &ebx, &ecx, &edx)) {
+			if (ebx & (1 << 5))
+				mono_hwcap_x86_has_avx2 = TRUE;
+		}
 	}
 
 	if (cpuid (0x80000000, &eax, &ebx, &ecx, &edx)) {
@@ -175,4 +209,5 @@ mono_hwcap_print (FILE *f)
 	g_fprintf (f, "mono_hwcap_x86_has_sse41 = %i\n", mono_hwcap_x86_has_sse41);
 	g_fprintf (f, "mono_hwcap_x86_has_sse42 = %i\n", mono_hwcap_x86_has_sse42);
 	g_fprintf (f, "mono_hwcap_x86_has_sse4a = %i\n", mono_hwcap_x86_has_sse4a);
+	g_fprintf (f, "mono_hwcap_x86_has_avx2 = %i\n", mono_hwcap_x86_has_avx2);
 }
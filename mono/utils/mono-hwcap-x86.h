@@ -13,5 +13,6 @@ extern gboolean mono_hwcap_x86_has_ssse3;
 extern gboolean mono_hwcap_x86_has_sse41;
 extern gboolean mono_hwcap_x86_has_sse42;
 extern gboolean mono_hwcap_x86_has_sse4a;
+extern gboolean mono_hwcap_x86_has_avx2;
 
 #endif /* __MONO_UTILS_HWCAP_X86_H__ */
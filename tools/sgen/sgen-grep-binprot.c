@@ -8,72 +8,160 @@
 
 #include <mono/metadata/sgen-protocol.h>
 
-#define SGEN_PROTOCOL_EOF	255
-
 #define TYPE(t)		((t) & 0x7f)
 #define WORKER(t)	((t) & 0x80)
 
+/*
+ * The protocol file is a sequence of chunks from the per-thread
+ * buffers.  We decode all of them and then sort the entries by
+ * timestamp to get a single stream.
+ */
+typedef struct {
+	long long thread;
+	int next_offset;
+	long long last_timestamp;
+	guint64 last_pointer;
+} BufferState;
+
+typedef struct {
+	long long timestamp;
+	long long thread;
+	int seq;
+	int type;
+	void *data;
+} Entry;
+
+static guint64
+decode_varint (unsigned char **p, unsigned char *end)
+{
+	guint64 value = 0;
+	int shift = 0;
+	unsigned char b;
+
+	do {
+		assert (*p < end);
+		b = *(*p)++;
+		value |= (guint64)(b & 0x7f) << shift;
+		shift += 7;
+	} while (b & 0x80);
+
+	return value;
+}
+
+#define UNZIGZAG(v)	((gint64)((v) >> 1) ^ -(gint64)((v) & 1))
+
 static int
-read_entry (FILE *in, void **data)
+entry_size (int type)
 {
-	unsigned char type;
-	int size;
+	const char *format = binary_protocol_entry_format (type);
+	int offset = 0, align = 1;
 
-	if (fread (&type, 1, 1, in) != 1)
-		return SGEN_PROTOCOL_EOF;
-	switch (TYPE (type)) {
-	case SGEN_PROTOCOL_COLLECTION_FORCE: size = sizeof (SGenProtocolCollectionForce); break;
-	case SGEN_PROTOCOL_COLLECTION_BEGIN: size = sizeof (SGenProtocolCollectionBegin); break;
-	case SGEN_PROTOCOL_COLLECTION_END: size = sizeof (SGenProtocolCollectionEnd); break;
-	case SGEN_PROTOCOL_CONCURRENT_START: size = 0; break;
-	case SGEN_PROTOCOL_CONCURRENT_UPDATE: size = 0; break;
-	case SGEN_PROTOCOL_CONCURRENT_FINISH: size = 0; break;
-	case SGEN_PROTOCOL_WORLD_STOPPING: size = sizeof (SGenProtocolWorldStopping); break;
-	case SGEN_PROTOCOL_WORLD_STOPPED: size = sizeof (SGenProtocolWorldStopped); break;
-	case SGEN_PROTOCOL_WORLD_RESTARTING: size = sizeof (SGenProtocolWorldRestarting); break;
-	case SGEN_PROTOCOL_WORLD_RESTARTED: size = sizeof (SGenProtocolWorldRestarted); break;
-	case SGEN_PROTOCOL_ALLOC: size = sizeof (SGenProtocolAlloc); break;
-	case SGEN_PROTOCOL_ALLOC_PINNED: size = sizeof (SGenProtocolAlloc); break;
-	case SGEN_PROTOCOL_ALLOC_DEGRADED: size = sizeof (SGenProtocolAlloc); break;
-	case SGEN_PROTOCOL_COPY: size = sizeof (SGenProtocolCopy); break;
-	case SGEN_PROTOCOL_PIN_STAGE: size = sizeof (SGenProtocolPinStage); break;
-	case SGEN_PROTOCOL_PIN: size = sizeof (SGenProtocolPin); break;
-	case SGEN_PROTOCOL_MARK: size = sizeof (SGenProtocolMark); break;
-	case SGEN_PROTOCOL_SCAN_BEGIN: size = sizeof (SGenProtocolScanBegin); break;
-	case SGEN_PROTOCOL_SCAN_VTYPE_BEGIN: size = sizeof (SGenProtocolScanVTypeBegin); break;
-	case SGEN_PROTOCOL_SCAN_PROCESS_REFERENCE: size = sizeof (SGenProtocolScanProcessReference); break;
-	case SGEN_PROTOCOL_WBARRIER: size = sizeof (SGenProtocolWBarrier); break;
-	case SGEN_PROTOCOL_GLOBAL_REMSET: size = sizeof (SGenProtocolGlobalRemset); break;
-	case SGEN_PROTOCOL_PTR_UPDATE: size = sizeof (SGenProtocolPtrUpdate); break;
-	case SGEN_PROTOCOL_CLEANUP: size = sizeof (SGenProtocolCleanup); break;
-	case SGEN_PROTOCOL_EMPTY: size = sizeof (SGenProtocolEmpty); break;
-	case SGEN_PROTOCOL_THREAD_SUSPEND: size = sizeof (SGenProtocolThreadSuspend); break;
-	case SGEN_PROTOCOL_THREAD_RESTART: size = sizeof (SGenProtocolThreadRestart); break;
-	case SGEN_PROTOCOL_THREAD_REGISTER: size = sizeof (SGenProtocolThreadRegister); break;
-	case SGEN_PROTOCOL_THREAD_UNREGISTER: size = sizeof (SGenProtocolThreadUnregister); break;
-	case SGEN_PROTOCOL_MISSING_REMSET: size = sizeof (SGenProtocolMissingRemset); break;
-	case SGEN_PROTOCOL_CARD_SCAN: size = sizeof (SGenProtocolCardScan); break;
-	case SGEN_PROTOCOL_CEMENT: size = sizeof (SGenProtocolCement); break;
-	case SGEN_PROTOCOL_CEMENT_RESET: size = 0; break;
-	case SGEN_PROTOCOL_DISLINK_UPDATE: size = sizeof (SGenProtocolDislinkUpdate); break;
-	case SGEN_PROTOCOL_DISLINK_UPDATE_STAGED: size = sizeof (SGenProtocolDislinkUpdateStaged); break;
-	case SGEN_PROTOCOL_DISLINK_PROCESS_STAGED: size = sizeof (SGenProtocolDislinkProcessStaged); break;
-	case SGEN_PROTOCOL_DOMAIN_UNLOAD_BEGIN: size = sizeof (SGenProtocolDomainUnload); break;
-	case SGEN_PROTOCOL_DOMAIN_UNLOAD_END: size = sizeof (SGenProtocolDomainUnload); break;
-	case SGEN_PROTOCOL_GRAY_ENQUEUE: size = sizeof (SGenProtocolGrayQueue); break;
-	case SGEN_PROTOCOL_GRAY_DEQUEUE: size = sizeof (SGenProtocolGrayQueue); break;
-	default: assert (0);
-	}
-
-	if (size) {
-		*data = malloc (size);
-		if (fread (*data, size, 1, in) != 1)
+	assert (format);
+	for (; *format; ++format) {
+		/* Rounding 1 up to the field's alignment gives the alignment. */
+		int field_align = binary_protocol_field_offset (*format, 1);
+		if (field_align > align)
+			align = field_align;
+		offset = binary_protocol_field_offset (*format, offset) + binary_protocol_field_size (*format);
+	}
+	return (offset + align - 1) & ~(align - 1);
+}
+
+static void
+decode_entry (BufferState *state, unsigned char **p, unsigned char *end, Entry *entry)
+{
+	const char *format;
+	int type = *(*p)++;
+	int size = entry_size (TYPE (type));
+	int offset = 0;
+	char *data = size ? malloc (size) : NULL;
+
+	state->last_timestamp += (long long)decode_varint (p, end);
+
+	for (format = binary_protocol_entry_format (TYPE (type)); *format; ++format) {
+		guint64 value = decode_varint (p, end);
+		offset = binary_protocol_field_offset (*format, offset);
+		switch (*format) {
+		case 'p':
+			state->last_pointer += (guint64)UNZIGZAG (value);
+			*(gpointer*)(data + offset) = (gpointer)(gsize)state->last_pointer;
+			break;
+		case 'i':
+			*(int*)(data + offset) = (int)UNZIGZAG (value);
+			break;
+		case 'l':
+			*(long long*)(data + offset) = UNZIGZAG (value);
+			break;
+		default:
 			assert (0);
-	} else {
-		*data = NULL;
+		}
+		offset += binary_protocol_field_size (*format);
+	}
+
+	entry->timestamp = state->last_timestamp;
+	entry->thread = state->thread;
+	entry->type = type;
+	entry->data = data;
+}
+
+static void
+read_chunks (FILE *in, GArray *entries)
+{
+	GHashTable *states = g_hash_table_new_full (NULL, NULL, NULL, free);
+	SGenProtocolChunkHeader header;
+	unsigned char *chunk = NULL;
+	int chunk_size = 0;
+
+	while (fread (&header, sizeof (header), 1, in) == 1) {
+		BufferState *state;
+		unsigned char *p, *end;
+
+		if (header.size > chunk_size) {
+			chunk_size = header.size;
+			chunk = realloc (chunk, chunk_size);
+		}
+		if (fread (chunk, header.size, 1, in) != 1)
+			break;
+
+		state = g_hash_table_lookup (states, GINT_TO_POINTER (header.buffer_index));
+		if (!state) {
+			state = calloc (1, sizeof (BufferState));
+			state->thread = header.thread;
+			state->last_timestamp = header.base_timestamp;
+			g_hash_table_insert (states, GINT_TO_POINTER (header.buffer_index), state);
+		}
+
+		/*
+		 * If the file was rotated we might have lost the beginning
+		 * of the buffer, which we need to decode the rest of it.
+		 */
+		if (header.offset != state->next_offset)
+			continue;
+		state->next_offset += header.size;
+
+		p = chunk;
+		end = chunk + header.size;
+		while (p < end) {
+			Entry entry;
+			decode_entry (state, &p, end, &entry);
+			entry.seq = entries->len;
+			g_array_append_val (entries, entry);
+		}
 	}
 
-	return (int)type;
+	free (chunk);
+	g_hash_table_destroy (states);
+}
+
+static int
+compare_entries (const void *a, const void *b)
+{
+	const Entry *ea = a;
+	const Entry *eb = b;
+
+	if (ea->timestamp != eb->timestamp)
+		return ea->timestamp < eb->timestamp ? -1 : 1;
+	return ea->seq - eb->seq;
 }
 
 static gboolean
@@ -490,6 +578,8 @@ main (int argc, char *argv[])
 {
 	int type;
 	void *data;
+	GArray *entries;
+	guint e;
 	int num_args = argc - 1;
 	int num_nums = 0;
 	int num_vtables = 0;
@@ -497,6 +587,7 @@ main (int argc, char *argv[])
 	long nums [num_args];
 	long vtables [num_args];
 	gboolean dump_all = FALSE;
+	gboolean print_threads = FALSE;
 	gboolean pause_times = FALSE;
 	gboolean pause_times_stopped = FALSE;
 	gboolean pause_times_concurrent = FALSE;
@@ -508,6 +599,8 @@ main (int argc, char *argv[])
 		char *next_arg = argv [i + 2];
 		if (!strcmp (arg, "--all")) {
 			dump_all = TRUE;
+		} else if (!strcmp (arg, "--threads")) {
+			print_threads = TRUE;
 		} else if (!strcmp (arg, "--pause-times")) {
 			pause_times = TRUE;
 		} else if (!strcmp (arg, "-v") || !strcmp (arg, "--vtable")) {
@@ -523,7 +616,14 @@ main (int argc, char *argv[])
 	if (pause_times)
 		assert (!dump_all);
 
-	while ((type = read_entry (stdin, &data)) != SGEN_PROTOCOL_EOF) {
+	entries = g_array_new (FALSE, FALSE, sizeof (Entry));
+	read_chunks (stdin, entries);
+	qsort (entries->data, entries->len, sizeof (Entry), compare_entries);
+
+	for (e = 0; e < entries->len; ++e) {
+		Entry *entry = &g_array_index (entries, Entry, e);
+		type = entry->type;
+		data = entry->data;
 		if (pause_times) {
 			switch (type) {
 			case SGEN_PROTOCOL_WORLD_STOPPING: {
@@ -572,11 +672,15 @@ main (int argc, char *argv[])
 			}
 			if (dump_all)
 				printf (match ? "* " : "  ");
+			if (print_threads && (match || dump_all))
+				printf ("%llx %lld ", entry->thread, entry->timestamp);
 			if (match || dump_all)
 				print_entry (type, data);
 		}
 		free (data);
 	}
 
+	g_array_free (entries, TRUE);
+
 	return 0;
 }